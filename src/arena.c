@@ -0,0 +1,241 @@
+/*
+ * arena.c - Bump allocator for index-lifetime objects
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the arena declared in arena.h. Chunks are mapped
+ * directly; with ARENA_HUGEPAGES they are first asked for as explicit huge
+ * pages (MAP_HUGETLB), which only succeeds if the administrator reserved
+ * some, and otherwise mapped aligned to ARENA_CHUNK and advised for
+ * transparent huge pages (MADV_HUGEPAGE). Huge pages are only asked for
+ * on Linux; other POSIX systems map regular pages, and Windows takes the
+ * chunks from the aligned heap.
+ */
+
+#include "config.h"
+#include <string.h>
+#ifndef OS_WINDOWS
+#include <sys/mman.h>
+#endif
+#include "arena.h"
+#include "numa.h"
+#include "mem.h"
+
+/* Chunk header, sized so that the first object is ARENA_MAX_ALIGN aligned */
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t      size;
+    char        pad[ARENA_MAX_ALIGN - sizeof(ArenaChunk *) - sizeof(size_t)];
+};
+
+#define ROUND_UP(x, a) (((x) + (a) - 1) & ~((size_t) (a) - 1))
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+#ifndef OS_WINDOWS
+/*
+ * Maps `size` bytes aligned to ARENA_CHUNK: twice the size is mapped and
+ * the misaligned head and tail are unmapped.
+ */
+static void *map_aligned(size_t size) {
+    char *base = mmap(NULL, size + ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uintptr_t start;
+    size_t head;
+
+    if (base == MAP_FAILED)
+        return NULL;
+    start = ROUND_UP((uintptr_t) base, ARENA_CHUNK);
+    head = start - (uintptr_t) base;
+    if (head)
+        munmap(base, head);
+    munmap((char *) start + size, ARENA_CHUNK - head);
+    return (void *) start;
+}
+
+/*
+ * Maps `size` zeroed bytes (a multiple of the page size); `hugepages`
+ * asks for huge pages and sets `*huge` if they were obtained.
+ */
+static void *chunk_alloc(size_t size, int hugepages, int *huge) {
+    void *p;
+
+    if (hugepages) {
+#ifdef __linux__
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *huge = 1;
+            return p;
+        }
+        if ((p = map_aligned(size)) != NULL)
+            *huge = madvise(p, size, MADV_HUGEPAGE) == 0;
+        return p;
+#else
+        (void) huge;
+        return map_aligned(size);
+#endif
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void chunk_free(void *p, size_t size) {
+    munmap(p, size);
+}
+#else
+/* Without mmap the chunks come from the aligned heap, in regular pages */
+static void *chunk_alloc(size_t size, int hugepages, int *huge) {
+    (void) huge;
+    return aligned_calloc_mem(hugepages ? ARENA_CHUNK : ARENA_MAX_ALIGN, size);
+}
+
+static void chunk_free(void *p, size_t size) {
+    (void) size;
+    free_aligned_mem(p);
+}
+#endif
+
+static ArenaChunk *chunk_map(Arena *a, size_t size) {
+    ArenaChunk *c;
+    int huge = 0;
+
+    if (a->flags & ARENA_HUGEPAGES)
+        size = ROUND_UP(size, ARENA_CHUNK);
+    else
+        size = ROUND_UP(size, 4096);
+    if ((c = chunk_alloc(size, a->flags & ARENA_HUGEPAGES, &huge)) == NULL)
+        return NULL;
+    /* Nothing touched the pages yet; a refused policy leaves them where they fault */
+    if (a->node >= 0)
+        node_bind(c, size, a->node);
+
+    c->size = size;
+    c->next = a->chunks;
+    a->chunks = c;
+    a->mapped += size;
+    if (huge)
+        a->huge += size;
+    return c;
+}
+
+/*
+ * Free list of objects of `size` bytes. With `create`, an unused slot is
+ * claimed if the size has none yet; NULL if every slot is taken.
+ */
+static ArenaFree *free_list(Arena *a, size_t size, int create) {
+    int i = (int) ((size / ARENA_ALIGN) % ARENA_CLASSES);
+
+    for (int n = 0; n < ARENA_CLASSES; n++, i = (i + 1) % ARENA_CLASSES) {
+        if (a->free[i].size == size)
+            return &a->free[i];
+        if (a->free[i].size == 0) {
+            if (!create)
+                return NULL;
+            a->free[i].size = size;
+            return &a->free[i];
+        }
+    }
+    return NULL;
+}
+
+static void *bump(Arena *a, size_t size, size_t alignment) {
+    char *p = (char *) ROUND_UP((uintptr_t) a->bump, alignment);
+    ArenaChunk *c;
+
+    if (a->bump == NULL || p + size > a->end) {
+        /* Too large for a regular chunk: give it its own, keep bumping the current one */
+        if (size > a->chunk - sizeof(ArenaChunk)) {
+            c = chunk_map(a, sizeof(ArenaChunk) + size);
+            return c ? (char *) (c + 1) : NULL;
+        }
+        if ((c = chunk_map(a, a->chunk)) == NULL)
+            return NULL;
+        p = (char *) (c + 1);
+        a->end = (char *) c + c->size;
+    }
+    a->bump = p + size;
+    return p;
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+void arena_init(Arena *a, size_t chunk, int flags) {
+    memset(a, 0, sizeof(Arena));
+    if (chunk < 2 * sizeof(ArenaChunk))
+        chunk = ARENA_CHUNK;
+    a->chunk = flags & ARENA_HUGEPAGES ? ROUND_UP(chunk, ARENA_CHUNK) : ROUND_UP(chunk, 4096);
+    a->flags = flags;
+    a->node = ((flags >> 8) & 0xff) - 1;
+    pthread_mutex_init(&a->lock, NULL);
+}
+
+void *arena_alloc(Arena *a, size_t size, size_t alignment) {
+    ArenaFree *f;
+    void *ptr;
+
+    if (alignment < ARENA_ALIGN)
+        alignment = ARENA_ALIGN;
+    if (size == 0 || alignment > ARENA_MAX_ALIGN || (alignment & (alignment - 1)))
+        return NULL;
+    size = ROUND_UP(size, ARENA_ALIGN);
+
+    pthread_mutex_lock(&a->lock);
+    f = free_list(a, size, 0);
+    if (f && f->head && ((uintptr_t) f->head & (alignment - 1)) == 0) {
+        ptr = f->head;
+        f->head = *(void **) ptr;
+        memset(ptr, 0, size);
+    } else {
+        ptr = bump(a, size, alignment);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+}
+
+void arena_free(Arena *a, void *ptr, size_t size) {
+    ArenaFree *f;
+
+    if (ptr == NULL)
+        return;
+    size = ROUND_UP(size, ARENA_ALIGN);
+
+    pthread_mutex_lock(&a->lock);
+    /* With every slot taken the object stays unused until arena_destroy() */
+    if ((f = free_list(a, size, 1)) != NULL) {
+        *(void **) ptr = f->head;
+        f->head = ptr;
+    }
+    pthread_mutex_unlock(&a->lock);
+}
+
+void arena_destroy(Arena *a) {
+    ArenaChunk *c, *next;
+
+    for (c = a->chunks; c; c = next) {
+        next = c->next;
+        chunk_free(c, c->size);
+    }
+    pthread_mutex_destroy(&a->lock);
+    memset(a, 0, sizeof(Arena));
+}
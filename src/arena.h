@@ -0,0 +1,102 @@
+/*
+ * arena.h - Bump allocator for index-lifetime objects
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Objects that live as long as an index (graph nodes, vectors) are carved
+ * one after the other out of large chunks instead of being allocated one
+ * by one, so that nodes inserted together sit together and a chunk can be
+ * backed by huge pages. A random hop through the graph then misses the
+ * TLB far less often than with objects spread over the heap.
+ *
+ * Freed objects are kept on a free list of their size and handed out
+ * again to the next allocation of that size; the chunks themselves are
+ * only returned by arena_destroy(). Objects carry no header: the caller
+ * gives the size back on free.
+ *
+ * With ARENA_NODE(n), chunks are bound to NUMA node `n` before they are
+ * first touched, wherever the allocating thread runs.
+ *
+ * An Arena is thread-safe.
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "victor.h"   // ARENA_* flags
+
+#define ARENA_CHUNK     (2 * 1024 * 1024)  // Default chunk size, one huge page
+#define ARENA_ALIGN     16                 // Alignment of every object
+#define ARENA_MAX_ALIGN 64                 // Largest alignment that may be requested
+#define ARENA_CLASSES   32                 // Object sizes with a free list
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    size_t size;                      // Object size, 0 if the slot is unused
+    void  *head;                      // Freed objects of that size
+} ArenaFree;
+
+typedef struct {
+    ArenaChunk *chunks;               // Every chunk, newest first
+    char       *bump;                 // Next free byte of the newest chunk
+    char       *end;                  // End of the newest chunk
+    size_t      chunk;                // Size of a regular chunk
+    int         flags;                // ARENA_* flags
+    int         node;                 // NUMA node chunks are bound to, -1 for none
+    uint64_t    mapped;               // Bytes mapped in chunks
+    uint64_t    huge;                 // Part of `mapped` given huge pages
+    ArenaFree   free[ARENA_CLASSES];  // Free lists by object size
+    pthread_mutex_t lock;
+} Arena;
+
+/**
+ * Initializes an arena.
+ *
+ * @param chunk Chunk size, 0 for ARENA_CHUNK. Rounded up to a multiple of
+ *              ARENA_CHUNK when ARENA_HUGEPAGES is given.
+ * @param flags ARENA_* flags (victor.h).
+ */
+extern void arena_init(Arena *a, size_t chunk, int flags);
+
+/**
+ * Allocates a zeroed object of `size` bytes aligned to `alignment` (at
+ * least ARENA_ALIGN, at most ARENA_MAX_ALIGN). Objects larger than a chunk
+ * get a chunk of their own.
+ *
+ * @return Pointer to the object, or NULL on failure.
+ */
+extern void *arena_alloc(Arena *a, size_t size, size_t alignment);
+
+/**
+ * Returns an object allocated with `size` bytes to the arena.
+ */
+extern void arena_free(Arena *a, void *ptr, size_t size);
+
+/**
+ * Unmaps every chunk, and with them every object of the arena.
+ */
+extern void arena_destroy(Arena *a);
+
+#endif
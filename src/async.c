@@ -0,0 +1,353 @@
+/*
+ * async.c - Asynchronous search on top of the library thread pool
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Two flavours of non-blocking search are provided:
+ *
+ *  - search_async(): the search runs on a pool worker and the user callback
+ *    is invoked from that worker once it finishes.
+ *
+ *  - SearchQueue: a submission/completion queue. Finished searches are
+ *    appended to a completion list and a file descriptor (eventfd on Linux,
+ *    a pipe elsewhere) becomes readable, so an event loop can wait on it with
+ *    epoll/poll/kqueue and collect results with squeue_poll() on its own thread.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef OS_LINUX
+#include <sys/eventfd.h>
+#elif !defined(OS_WINDOWS)
+#include <fcntl.h>
+#endif
+
+#include "index.h"
+#include "pool.h"
+#include "mem.h"
+#include "numa.h"
+
+/*
+ * AsyncJob - A single pending search. The query vector is copied into the
+ * job so the caller may reuse its buffer as soon as the submit returns.
+ */
+typedef struct AsyncJob {
+    Index *index;
+    uint64_t tag;
+    MatchResult *results;
+    int n;
+    int status;
+
+    SearchCallback cb;           // Callback mode
+    struct SearchQueue *queue;   // Completion queue mode
+    void *userdata;
+
+    struct AsyncJob *next;       // Completion list link
+    uint16_t dims;
+    float32_t vector[];
+} AsyncJob;
+
+struct SearchQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t  idle;        // Signaled when inflight drops to zero
+    AsyncJob *head;              // Completed jobs, oldest first
+    AsyncJob *tail;
+    int inflight;                // Submitted and not yet completed
+    int efd;                     // Readable end of the notification channel
+    int wfd;                     // Writable end (== efd with eventfd)
+};
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+#ifndef OS_WINDOWS
+static void notify_set(SearchQueue *sq) {
+#ifdef OS_LINUX
+    uint64_t one = 1;
+    while (write(sq->wfd, &one, sizeof(one)) < 0 && errno == EINTR);
+#else
+    char c = 1;
+    while (write(sq->wfd, &c, 1) < 0 && errno == EINTR);
+#endif
+}
+
+static void notify_clear(SearchQueue *sq) {
+#ifdef OS_LINUX
+    uint64_t v;
+    while (read(sq->efd, &v, sizeof(v)) < 0 && errno == EINTR);
+#else
+    char buff[64];
+    while (read(sq->efd, buff, sizeof(buff)) > 0 || errno == EINTR);
+#endif
+}
+#endif
+
+static AsyncJob *alloc_job(Index *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n, void *userdata) {
+    AsyncJob *job = calloc_mem(1, sizeof(AsyncJob) + dims * sizeof(float32_t));
+    if (!job)
+        return NULL;
+    job->index = index;
+    job->tag = tag;
+    job->results = results;
+    job->n = n;
+    job->userdata = userdata;
+    job->dims = dims;
+    memcpy(job->vector, vector, dims * sizeof(float32_t));
+    return job;
+}
+
+static int check_args(Index *index, float32_t *vector, uint16_t dims, MatchResult *results, int n) {
+    if (index == NULL)  return INVALID_INDEX;
+    if (vector == NULL) return INVALID_VECTOR;
+    if (results == NULL || n <= 0) return INVALID_RESULT;
+    if (dims == 0) return INVALID_DIMENSIONS;
+    if (index->data == NULL || index->search == NULL)
+        return INVALID_INIT;
+    return SUCCESS;
+}
+
+/*
+ * Pool task: runs the search and hands the result to the callback or to
+ * the completion queue. The index is released (async_pending decremented)
+ * before the job is handed back, so destroy_index() never waits on user code.
+ */
+static void async_search_task(void *arg) {
+    AsyncJob *job = (AsyncJob *) arg;
+    SearchQueue *sq = job->queue;
+
+    job->status = search(job->index, job->tag, job->vector, job->dims, job->results, job->n);
+    index_unref(job->index, &job->index->async_pending);
+    job->index = NULL;
+
+    if (sq == NULL) {
+        job->cb(job->status, job->results, job->n, job->userdata);
+        free_mem(job);
+        return;
+    }
+
+    pthread_mutex_lock(&sq->lock);
+    if (sq->tail)
+        sq->tail->next = job;
+    else {
+        sq->head = job;
+#ifndef OS_WINDOWS
+        notify_set(sq);
+#endif
+    }
+    sq->tail = job;
+    if (--sq->inflight == 0)
+        pthread_cond_broadcast(&sq->idle);
+    pthread_mutex_unlock(&sq->lock);
+}
+
+/*
+ * Queues a job on any worker, or on one of NUMA node `node` if >= 0.
+ */
+static int submit_job(AsyncJob *job, int node) {
+    int ret;
+
+    __atomic_add_fetch(&job->index->async_pending, 1, __ATOMIC_ACQ_REL);
+    if ((ret = pool_submit_node(async_search_task, job, node)) != SUCCESS)
+        index_unref(job->index, &job->index->async_pending);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int set_worker_threads(int nthreads) {
+    return pool_resize(nthreads);
+}
+
+int set_worker_pinning(int enable) {
+    return pool_pin(enable);
+}
+
+int search_async(Index *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n,
+                 SearchCallback cb, void *userdata) {
+    AsyncJob *job;
+    int ret;
+
+    if ((ret = check_args(index, vector, dims, results, n)) != SUCCESS)
+        return ret;
+    if (cb == NULL)
+        return INVALID_ARGUMENT;
+
+    if ((job = alloc_job(index, tag, vector, dims, results, n, userdata)) == NULL)
+        return SYSTEM_ERROR;
+    job->cb = cb;
+
+    if ((ret = submit_job(job, -1)) != SUCCESS)
+        free_mem(job);
+    return ret;
+}
+
+int replicas_search_async(IndexReplicas *r, uint64_t tag, float32_t *vector, uint16_t dims,
+                          MatchResult *results, int n, SearchCallback cb, void *userdata) {
+    AsyncJob *job;
+    Index *index;
+    int node, ret;
+
+    if (r == NULL)
+        return INVALID_INDEX;
+    node = (int) (__atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED) % (unsigned int) r->count);
+    index = r->replicas[node];
+    if ((ret = check_args(index, vector, dims, results, n)) != SUCCESS)
+        return ret;
+    if (cb == NULL)
+        return INVALID_ARGUMENT;
+
+    if ((job = alloc_job(index, tag, vector, dims, results, n, userdata)) == NULL)
+        return SYSTEM_ERROR;
+    job->cb = cb;
+
+    if ((ret = submit_job(job, node)) != SUCCESS)
+        free_mem(job);
+    return ret;
+}
+
+SearchQueue *alloc_search_queue(void) {
+    SearchQueue *sq = calloc_mem(1, sizeof(SearchQueue));
+    if (!sq)
+        return NULL;
+
+    sq->efd = sq->wfd = -1;
+#ifdef OS_LINUX
+    if ((sq->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        goto error_return;
+    sq->wfd = sq->efd;
+#elif !defined(OS_WINDOWS)
+    int fds[2];
+    if (pipe(fds) != 0)
+        goto error_return;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    sq->efd = fds[0];
+    sq->wfd = fds[1];
+#endif
+
+    pthread_mutex_init(&sq->lock, NULL);
+    pthread_cond_init(&sq->idle, NULL);
+    return sq;
+
+#ifndef OS_WINDOWS
+error_return:
+    free_mem(sq);
+    return NULL;
+#endif
+}
+
+int squeue_submit(SearchQueue *sq, Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
+                  MatchResult *results, int n, void *userdata) {
+    AsyncJob *job;
+    int ret;
+
+    if (sq == NULL)
+        return INVALID_ARGUMENT;
+    if ((ret = check_args(index, vector, dims, results, n)) != SUCCESS)
+        return ret;
+
+    if ((job = alloc_job(index, tag, vector, dims, results, n, userdata)) == NULL)
+        return SYSTEM_ERROR;
+    job->queue = sq;
+
+    pthread_mutex_lock(&sq->lock);
+    sq->inflight++;
+    pthread_mutex_unlock(&sq->lock);
+
+    if ((ret = submit_job(job, -1)) != SUCCESS) {
+        pthread_mutex_lock(&sq->lock);
+        if (--sq->inflight == 0)
+            pthread_cond_broadcast(&sq->idle);
+        pthread_mutex_unlock(&sq->lock);
+        free_mem(job);
+    }
+    return ret;
+}
+
+int squeue_poll(SearchQueue *sq, SearchCompletion *out, int max) {
+    AsyncJob *job;
+    int i = 0;
+
+    if (sq == NULL || out == NULL || max <= 0)
+        return -1;
+
+    pthread_mutex_lock(&sq->lock);
+    while (i < max && (job = sq->head) != NULL) {
+        sq->head = job->next;
+        out[i].userdata = job->userdata;
+        out[i].results  = job->results;
+        out[i].n        = job->n;
+        out[i].status   = job->status;
+        free_mem(job);
+        i++;
+    }
+    if (sq->head == NULL) {
+        sq->tail = NULL;
+#ifndef OS_WINDOWS
+        if (i > 0)
+            notify_clear(sq);
+#endif
+    }
+    pthread_mutex_unlock(&sq->lock);
+    return i;
+}
+
+int squeue_fd(SearchQueue *sq) {
+    if (sq == NULL)
+        return -1;
+    return sq->efd;
+}
+
+int destroy_search_queue(SearchQueue **sq) {
+    AsyncJob *job;
+
+    if (sq == NULL || *sq == NULL)
+        return INVALID_ARGUMENT;
+
+    pthread_mutex_lock(&(*sq)->lock);
+    while ((*sq)->inflight > 0)
+        pthread_cond_wait(&(*sq)->idle, &(*sq)->lock);
+    while ((job = (*sq)->head) != NULL) {
+        (*sq)->head = job->next;
+        free_mem(job);
+    }
+    pthread_mutex_unlock(&(*sq)->lock);
+
+#ifndef OS_WINDOWS
+    if ((*sq)->wfd >= 0 && (*sq)->wfd != (*sq)->efd)
+        close((*sq)->wfd);
+    if ((*sq)->efd >= 0)
+        close((*sq)->efd);
+#endif
+    pthread_cond_destroy(&(*sq)->idle);
+    pthread_mutex_destroy(&(*sq)->lock);
+    free_mem(*sq);
+    *sq = NULL;
+    return SUCCESS;
+}
@@ -31,6 +31,8 @@ const char *index_strerror(IndexErrorCode code) {
         case FILEIO_ERROR:        return "File I/O error.";
         case NOT_IMPLEMENTED:     return "Functionality not yet implemented.";
         case INVALID_FILE:        return "File format or contents are invalid.";
+        case READ_ONLY_INDEX:     return "Index is read-only.";
+        case INDEX_NOT_EMPTY:     return "Operation requires an index that has never held vectors.";
         default:                  return "Unknown error code.";
     }
 }
@@ -46,6 +48,10 @@ const char *table_strerror(TableErrorCode code) {
 		case KV_ERROR_FILEIO:		 return "System-level IO error.";
 		case KV_ERROR_FILE_INVALID:  return "Invalid or malformed file structure.";
 		case KV_ERROR_MISMATCH_ELEMENT_COUNT: return "mismatch in expected vs actual elements ";
+		case KV_ERROR_NOT_ORDERED:   return "Table is not ordered.";
+		case KV_ERROR_NOT_PERSISTENT: return "Table is not persistent.";
+		case KV_ERROR_PERSISTENT:     return "Not available on a persistent table.";
+		case KV_ERROR_NOT_IMPLEMENTED: return "Not implemented on this platform.";
         default:                     return "Unknown table error code.";
     }
 }
\ No newline at end of file
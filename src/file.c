@@ -19,16 +19,18 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include "file.h"
 #include "mem.h"
 
 #if defined(_WIN32)
+#include <io.h>
 
 /**
  * @brief Opens a file on Windows platforms.
  *
  * @param path Path to the file.
- * @param mode Mode string ("rb", "wb").
+ * @param mode Mode string ("rb", "wb", "ab", "a+b").
  * @return Pointer to IOFile on success, NULL on failure.
  */
 IOFile *file_open(const char *path, const char *mode) {
@@ -89,6 +91,80 @@ off_t file_tello(IOFile *f) {
     return ftello(f->fp);
 }
 
+/**
+ * @brief Writes a list of buffers on Windows (one fwrite per buffer).
+ *
+ * @param f File handle.
+ * @param iov Array of buffers.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written.
+ */
+size_t file_writev(IOFile *f, const IOVec *iov, int iovcnt) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t n = fwrite(iov[i].iov_base, 1, iov[i].iov_len, f->fp);
+        total += n;
+        if (n != iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+
+/**
+ * @brief Reads at an absolute offset on Windows (moves the file position).
+ *
+ * @param f File handle.
+ * @param ptr Destination buffer.
+ * @param len Number of bytes to read.
+ * @param offset Absolute file offset.
+ * @return Number of bytes read.
+ */
+size_t file_pread(IOFile *f, void *ptr, size_t len, off_t offset) {
+    if (_fseeki64(f->fp, offset, SEEK_SET) != 0)
+        return 0;
+    return fread(ptr, 1, len, f->fp);
+}
+
+/**
+ * @brief Writes at an absolute offset on Windows (moves the file position).
+ *
+ * @param f File handle.
+ * @param ptr Source buffer.
+ * @param len Number of bytes to write.
+ * @param offset Absolute file offset.
+ * @return Number of bytes written.
+ */
+size_t file_pwrite(IOFile *f, const void *ptr, size_t len, off_t offset) {
+    if (_fseeki64(f->fp, offset, SEEK_SET) != 0)
+        return 0;
+    return fwrite(ptr, 1, len, f->fp);
+}
+
+/**
+ * @brief Flushes buffered data and commits it to disk on Windows.
+ *
+ * @param f File handle.
+ * @return 0 on success, -1 on failure.
+ */
+int file_sync(IOFile *f) {
+    if (fflush(f->fp) != 0)
+        return -1;
+    return _commit(_fileno(f->fp)) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Changes the file length on Windows.
+ *
+ * @param f File handle.
+ * @param length New length in bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int file_resize(IOFile *f, off_t length) {
+    if (fflush(f->fp) != 0)
+        return -1;
+    return _chsize_s(_fileno(f->fp), length) == 0 ? 0 : -1;
+}
+
 /**
  * @brief Closes a file and frees resources on Windows.
  *
@@ -106,13 +182,15 @@ void file_close(IOFile *f) {
  * @brief Opens a file on Unix-like platforms.
  *
  * @param path Path to the file.
- * @param mode Mode string ("rb", "wb").
+ * @param mode Mode string ("rb", "wb", "ab", "a+b").
  * @return Pointer to IOFile on success, NULL on failure.
  */
 IOFile *file_open(const char *path, const char *mode) {
     int flags = 0;
     if (strcmp(mode, "rb") == 0) flags = O_RDONLY;
     else if (strcmp(mode, "wb") == 0) flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (strcmp(mode, "ab") == 0) flags = O_WRONLY | O_CREAT | O_APPEND;
+    else if (strcmp(mode, "a+b") == 0) flags = O_RDWR | O_CREAT | O_APPEND;
     else return NULL;
 
     int fd = open(path, flags, 0644);
@@ -172,6 +250,149 @@ off_t file_tello(IOFile *f) {
     return lseek(f->fd, 0, SEEK_CUR);
 }
 
+/**
+ * @brief Writes a list of buffers with writev() on Unix-like platforms.
+ *
+ * Buffers are issued in batches of up to 64; partial writes resume
+ * from the first buffer not fully written. Empty buffers are skipped,
+ * and a write that makes no progress fails with EIO.
+ *
+ * @param f File handle.
+ * @param iov Array of buffers.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written.
+ */
+size_t file_writev(IOFile *f, const IOVec *iov, int iovcnt) {
+    IOVec batch[64];
+    size_t total = 0;
+    size_t skip = 0;        // Bytes of iov[0] already written
+    int i = 0;
+
+    while (i < iovcnt) {
+        int n = 0;
+        ssize_t w;
+
+        if (iov[i].iov_len == skip) {
+            skip = 0;
+            i++;
+            continue;
+        }
+        for (int j = i; j < iovcnt && n < (int) (sizeof(batch) / sizeof(batch[0])); j++, n++) {
+            batch[n] = iov[j];
+            if (j == i) {
+                batch[n].iov_base = (char *) batch[n].iov_base + skip;
+                batch[n].iov_len -= skip;
+            }
+        }
+
+        w = writev(f->fd, batch, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (w == 0) {
+            errno = EIO;
+            break;
+        }
+        total += (size_t) w;
+
+        /* Advance past the buffers fully written */
+        while (w > 0 && i < iovcnt) {
+            size_t left = iov[i].iov_len - skip;
+            if ((size_t) w >= left) {
+                w -= left;
+                skip = 0;
+                i++;
+            } else {
+                skip += (size_t) w;
+                w = 0;
+            }
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Reads at an absolute offset with pread() on Unix-like platforms.
+ *
+ * @param f File handle.
+ * @param ptr Destination buffer.
+ * @param len Number of bytes to read.
+ * @param offset Absolute file offset.
+ * @return Number of bytes read.
+ */
+size_t file_pread(IOFile *f, void *ptr, size_t len, off_t offset) {
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t r = pread(f->fd, (char *) ptr + total, len - total, offset + (off_t) total);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (r == 0)
+            break;
+        total += (size_t) r;
+    }
+    return total;
+}
+
+/**
+ * @brief Writes at an absolute offset with pwrite() on Unix-like platforms.
+ *
+ * @param f File handle.
+ * @param ptr Source buffer.
+ * @param len Number of bytes to write.
+ * @param offset Absolute file offset.
+ * @return Number of bytes written.
+ */
+size_t file_pwrite(IOFile *f, const void *ptr, size_t len, off_t offset) {
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t w = pwrite(f->fd, (const char *) ptr + total, len - total, offset + (off_t) total);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (w == 0) {
+            /* No progress with bytes left: do not spin */
+            errno = EIO;
+            break;
+        }
+        total += (size_t) w;
+    }
+    return total;
+}
+
+/**
+ * @brief Flushes file data to stable storage on Unix-like platforms.
+ *
+ * @param f File handle.
+ * @return 0 on success, -1 on failure.
+ */
+int file_sync(IOFile *f) {
+#if defined(__linux__)
+    return fdatasync(f->fd) == 0 ? 0 : -1;
+#else
+    return fsync(f->fd) == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Changes the file length on Unix-like platforms.
+ *
+ * @param f File handle.
+ * @param length New length in bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int file_resize(IOFile *f, off_t length) {
+    return ftruncate(f->fd, length) == 0 ? 0 : -1;
+}
+
 /**
  * @brief Closes a file and frees resources on Unix-like platforms.
  *
@@ -184,4 +405,86 @@ void file_close(IOFile *f) {
 }
 
 #endif
- 
\ No newline at end of file
+
+/*
+ * Buffered writer, common to all platforms.
+ */
+
+/**
+ * @brief Initializes a buffered writer.
+ *
+ * @param w Writer to initialize.
+ * @param f Destination file.
+ * @param size Buffer size in bytes.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int writer_init(IOWriter *w, IOFile *f, size_t size) {
+    w->f = f;
+    w->len = 0;
+    w->size = size;
+    w->buff = aligned_calloc_mem(4096, size);
+    return w->buff ? 0 : -1;
+}
+
+/**
+ * @brief Appends bytes to the writer, writing out the buffer when full.
+ *
+ * A piece that does not fit in the remaining space is written in the same
+ * writev() call as the buffered bytes instead of being copied.
+ *
+ * @param w Writer.
+ * @param ptr Source bytes.
+ * @param len Number of bytes.
+ * @return 0 on success, -1 on I/O error.
+ */
+int writer_put(IOWriter *w, const void *ptr, size_t len) {
+    IOVec iov[2];
+
+    if (len <= w->size - w->len) {
+        memcpy(w->buff + w->len, ptr, len);
+        w->len += len;
+        if (w->len == w->size)
+            return writer_flush(w);
+        return 0;
+    }
+
+    iov[0].iov_base = w->buff;
+    iov[0].iov_len  = w->len;
+    iov[1].iov_base = (void *) ptr;
+    iov[1].iov_len  = len;
+    if (file_writev(w->f, iov, 2) != w->len + len)
+        return -1;
+    w->len = 0;
+    return 0;
+}
+
+/**
+ * @brief Writes out the buffered bytes.
+ *
+ * @param w Writer.
+ * @return 0 on success, -1 on I/O error.
+ */
+int writer_flush(IOWriter *w) {
+    IOVec iov;
+
+    if (w->len == 0)
+        return 0;
+    iov.iov_base = w->buff;
+    iov.iov_len  = w->len;
+    if (file_writev(w->f, &iov, 1) != w->len)
+        return -1;
+    w->len = 0;
+    return 0;
+}
+
+/**
+ * @brief Releases the writer buffer.
+ *
+ * @param w Writer.
+ */
+void writer_free(IOWriter *w) {
+    if (w->buff)
+        free_aligned_mem(w->buff);
+    w->buff = NULL;
+    w->len = w->size = 0;
+}
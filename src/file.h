@@ -24,13 +24,20 @@
 
 #if defined(_WIN32)
 #include <stdio.h>
+#include <stddef.h>
 #else
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #endif
 
+/**
+ * @brief Size of the buffer used by IOWriter for store dumps.
+ */
+#define IO_BUFFER_SIZE (4 * 1024 * 1024)
+
 /**
  * @brief Represents a portable file object for cross-platform file operations.
  */
@@ -42,11 +49,37 @@ typedef struct IOFile {
 #endif
 } IOFile;
 
+/**
+ * @brief Scatter/gather element for file_writev().
+ */
+#if defined(_WIN32)
+typedef struct {
+    void  *iov_base;
+    size_t iov_len;
+} IOVec;
+#else
+typedef struct iovec IOVec;
+#endif
+
+/**
+ * @brief Buffered sequential writer on top of an IOFile.
+ *
+ * Small pieces are copied into a large aligned buffer; pieces that do not
+ * fit are written together with the buffered data in a single writev().
+ */
+typedef struct {
+    IOFile *f;      /**< Destination file. */
+    char   *buff;   /**< Staging buffer. */
+    size_t  size;   /**< Buffer capacity. */
+    size_t  len;    /**< Bytes staged. */
+} IOWriter;
+
 /**
  * @brief Opens a file with the specified path and mode ("rb", "wb").
  *
  * @param path Path to the file.
- * @param mode Mode string ("rb" for read binary, "wb" for write binary).
+ * @param mode Mode string ("rb" for read binary, "wb" for write binary,
+ *             "ab" to append, "a+b" to read and append).
  * @return Pointer to IOFile on success, NULL on failure.
  */
 extern IOFile *file_open(const char *path, const char *mode);
@@ -91,6 +124,83 @@ extern int file_seek(IOFile *f, long offset, int whence);
  */
 extern off_t file_tello(IOFile *f);
 
+/**
+ * @brief Writes a list of buffers, retrying on partial writes.
+ * @param f File handle.
+ * @param iov Array of buffers.
+ * @param iovcnt Number of buffers.
+ * @return Number of bytes written; less than the total on error.
+ */
+extern size_t file_writev(IOFile *f, const IOVec *iov, int iovcnt);
+
+/**
+ * @brief Reads `len` bytes at `offset`, retrying on short reads.
+ *
+ * Does not move the file position on Unix-like platforms, so it may be used
+ * concurrently on the same handle.
+ *
+ * @param f File handle.
+ * @param ptr Destination buffer.
+ * @param len Number of bytes to read.
+ * @param offset Absolute file offset.
+ * @return Number of bytes read; less than `len` at end of file or on error.
+ */
+extern size_t file_pread(IOFile *f, void *ptr, size_t len, off_t offset);
+
+/**
+ * @brief Writes `len` bytes at `offset`, retrying on partial writes.
+ * Like file_pread(), it does not move the file position on Unix-like
+ * platforms. On Windows both are emulated with a seek and must not be
+ * used concurrently on the same handle.
+ * @param f File handle.
+ * @param ptr Source buffer.
+ * @param len Number of bytes to write.
+ * @param offset Absolute file offset.
+ * @return Number of bytes written; less than `len` on error.
+ */
+extern size_t file_pwrite(IOFile *f, const void *ptr, size_t len, off_t offset);
+
+/**
+ * @brief Initializes a buffered writer.
+ * @param w Writer to initialize.
+ * @param f Destination file, positioned where writing starts.
+ * @param size Buffer size in bytes.
+ * @return 0 on success, -1 on allocation failure.
+ */
+extern int writer_init(IOWriter *w, IOFile *f, size_t size);
+
+/**
+ * @brief Appends bytes to the writer.
+ * @return 0 on success, -1 on I/O error.
+ */
+extern int writer_put(IOWriter *w, const void *ptr, size_t len);
+
+/**
+ * @brief Writes out any buffered bytes.
+ * @return 0 on success, -1 on I/O error.
+ */
+extern int writer_flush(IOWriter *w);
+
+/**
+ * @brief Releases the writer buffer (buffered bytes are discarded).
+ */
+extern void writer_free(IOWriter *w);
+
+/**
+ * @brief Flushes file data to stable storage.
+ * @param f File handle.
+ * @return 0 on success, -1 on failure.
+ */
+extern int file_sync(IOFile *f);
+
+/**
+ * @brief Truncates or extends the file to the given length.
+ * @param f File handle (opened for writing).
+ * @param length New length in bytes.
+ * @return 0 on success, -1 on failure.
+ */
+extern int file_resize(IOFile *f, off_t length);
+
 /**
  * @brief Closes the file and releases the IOFile structure.
  *
@@ -4,6 +4,7 @@
 #include "victor.h"
 #include "mem.h"
 #include "map.h"
+#include "trace.h"
 
 
 
@@ -59,10 +60,10 @@ static inline int assign_level(int M0) {
  *       - Level 0 stores up to `M0` neighbors
  *       - Levels > 0 store up to `M0 / 2` neighbors each
  *
- * Memory layout (single `calloc`):
+ * Memory layout (single block from alloc_object()):
  *   | GraphNode | Degrees[L+1] | neighbors[L+1] | neighbor arrays |
  *
- * The vector is allocated via `make_vector()` and linked to the node.
+ * The vector is allocated via `make_vector_acct()` and linked to the node.
  *
  * @param id             Unique vector identifier
  * @param vector         Pointer to the raw vector values
@@ -73,30 +74,51 @@ static inline int assign_level(int M0) {
  * @return Pointer to the allocated GraphNode, or NULL on failure
  */
 
-GraphNode *alloc_graph_node(uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims_aligned, int M0) {
+/*
+ * Size of the block of a node reaching `level`.
+ */
+static inline size_t node_block_size(int level, int M0) {
+    return sizeof(GraphNode) + (level + 1) * (sizeof(Degrees) + sizeof(GraphNode **)) +
+           (M0 + level * (M0 / 2)) * sizeof(GraphNode *);
+}
+
+/*
+ * Moves the neighbor lists of `node` from MEM_NODES, where its block is
+ * accounted, to the category of their level (sign 1), or back (sign -1).
+ */
+static void node_track(IndexHNSW *idx, GraphNode *node, int sign) {
+    size_t list;
+
+    if (idx->mem == NULL)
+        return;
+    for (int l = 0; l <= node->level; l++) {
+        list = (l == 0 ? idx->M0 : idx->M0 / 2) * sizeof(GraphNode *);
+        mem_track(idx->mem, MEM_NODES, NULL, -sign * (int64_t) list);
+        mem_track(idx->mem, MEM_LEVEL(l), NULL, sign * (int64_t) list);
+    }
+}
+
+GraphNode *alloc_graph_node(IndexHNSW *idx, uint64_t id, uint64_t tag, float32_t *vector) {
     GraphNode *node = NULL;
+    int M0 = idx->M0;
     int M = M0 / 2;
     int level = assign_level(M0);
-    size_t sz = 0;
-
-    sz += sizeof(GraphNode);
-    sz += (level + 1) * sizeof(Degrees);
-    sz += (level + 1) * sizeof(GraphNode **);
-    sz += (M0 + ((level) * M)) * sizeof(GraphNode *);
+    size_t sz = node_block_size(level, M0);
 
-    node = (GraphNode *)calloc_mem(1, sz);
+    node = (GraphNode *) alloc_object(idx->mem, MEM_NODES, sz, 0);
     if (!node) 
         return NULL;
 
 	if (vector && id != NULL_ID) {
-		node->vector = make_vector(id, tag, vector, dims_aligned);
+		node->vector = make_vector_acct(idx->mem, id, tag, vector, idx->dims_aligned);
 		if (!node->vector) {
-			free_mem(node);
+			free_object(idx->mem, MEM_NODES, node, sz, 0);
 			return NULL;
 		}
 	} else {
 		node->vector = NULL;
 	}
+    node->payload = NULL;
     uint8_t *ptr = (uint8_t *)(node + 1);
 
     node->level = level;
@@ -115,10 +137,20 @@ GraphNode *alloc_graph_node(uint64_t id, uint64_t tag, float32_t *vector, uint16
         node->degrees[l].idegree = 0;
         node->degrees[l].odegree = 0;
     }
+    node_track(idx, node, 1);
 
     return node;
 }
 
+void graph_node_adopt(IndexHNSW *idx, GraphNode *node, Vector *vector) {
+    node->vector = vector;
+    mem_track(idx->mem, MEM_VECTORS, NULL, VECTORSZ(idx->dims_aligned));
+}
+
+size_t graph_node_size(const IndexHNSW *idx, const GraphNode *node) {
+    return node_block_size(node->level, idx->M0) + (node->vector ? VECTORSZ(idx->dims_aligned) : 0);
+}
+
 /**
  * free_gnode - Frees a GraphNode and its associated vector.
  *
@@ -127,14 +159,15 @@ GraphNode *alloc_graph_node(uint64_t id, uint64_t tag, float32_t *vector, uint16
  *
  * @param g Pointer to a GraphNode pointer. Will be NULL'd after free.
  */
-void free_graph_node(GraphNode **g) {
+void free_graph_node(IndexHNSW *idx, GraphNode **g) {
     if (!g || !*g)
         return;
-    if ((*g)->vector) {
-        free_vector(&(*g)->vector);
-        (*g)->vector = NULL;
-    }
-    free_mem(*g);
+    if (!(*g)->alive)
+        mem_track(idx->mem, MEM_TOMBSTONES, NULL, -(int64_t) graph_node_size(idx, *g));
+    node_track(idx, *g, -1);
+    free_payload_acct(idx->mem, &(*g)->payload);
+    free_vector_acct(idx->mem, &(*g)->vector, idx->dims_aligned);
+    free_object(idx->mem, MEM_NODES, *g, node_block_size((*g)->level, idx->M0), 0);
     *g = NULL;
 }
 
@@ -153,6 +186,8 @@ typedef struct {
 
 	// flags
 	int filter_alive;
+
+    SearchTrace *trace;     /* Work counters of the search, NULL when not requested. */
 } SearchContext;
 
 #define SELECT_NEIGHBORS_SIMPLE     0x00
@@ -539,6 +574,7 @@ static int search_layer(SearchContext *sc, GraphNode **ep, int len, int ef, int
     HeapNode c = HEAP_NODE_NULL();
     HeapNode w = HEAP_NODE_NULL(); 
     HeapNode n = HEAP_NODE_NULL();
+    SearchTrace *t = sc->trace;
     float32_t d;
     int ret = SYSTEM_ERROR, i;
 
@@ -562,19 +598,30 @@ static int search_layer(SearchContext *sc, GraphNode **ep, int len, int ef, int
                 goto cleanup_return;
             }
             PANIC_IF(heap_insert(&C, &n) != HEAP_SUCCESS, "invalid heap");
-            if (!sc->filter_alive || current->alive)
+            TRACE_VISIT(t, level);
+            TRACE_ADD(t, heap_ops, 1);
+            if (!sc->filter_alive || current->alive) {
             	PANIC_IF(heap_insert(W, &n)  != HEAP_SUCCESS, "invalid heap");
+                TRACE_ADD(t, heap_ops, 1);
+            } else {
+                TRACE_ADD(t, tombstones, 1);
+            }
         }
     }
+    TRACE_PEAK(t, heap_size(&C));
+    TRACE_SET(t, stop, TRACE_STOP_EXHAUSTED);
 
     while(heap_size(&C) > 0) {
 
         PANIC_IF(heap_pop(&C, &c)  != HEAP_SUCCESS, "lack of consistency");
+        TRACE_ADD(t, heap_ops, 1);
 
 		if (heap_size(W) > 0) {
 			PANIC_IF(heap_peek(W, &w) != HEAP_SUCCESS, "lack of consistency");
-			if (heap_full(W) && sc->cmp->is_better_match(w.distance, c.distance)) 
+			if (heap_full(W) && sc->cmp->is_better_match(w.distance, c.distance)) {
+                TRACE_SET(t, stop, TRACE_STOP_BOUND);
 				break;
+            }
 		}
         
         current = (GraphNode *) HEAP_NODE_PTR(c);
@@ -589,12 +636,15 @@ static int search_layer(SearchContext *sc, GraphNode **ep, int len, int ef, int
                 }
                 d = sc->cmp->compare_vectors(sc->query, neighbor->vector->vector, sc->dims_aligned);
                 n = HEAP_NODE_SET_PTR(neighbor, d);
+                TRACE_VISIT(t, level);
 				
 				if (heap_size(W) > 0) {
 					PANIC_IF(heap_peek(W, &w) != HEAP_SUCCESS, "lack of consistency");
 				}
 				if (!heap_full(W) || sc->cmp->is_better_match(d, w.distance)) {	
                     PANIC_IF(heap_insert(&C, &n) == HEAP_ERROR_FULL, "bad initialization");
+                    TRACE_ADD(t, heap_ops, 1);
+                    TRACE_PEAK(t, heap_size(&C));
                 }
                 
                 if (!sc->filter_alive || neighbor->alive) {
@@ -602,10 +652,14 @@ static int search_layer(SearchContext *sc, GraphNode **ep, int len, int ef, int
 						PANIC_IF(heap_peek(W, &w) != HEAP_SUCCESS, "lack of consistency");
                         if (sc->cmp->is_better_match(n.distance, w.distance)) {
                             PANIC_IF(heap_replace(W, &n) != HEAP_SUCCESS, "cannot replace worst node in W");
+                            TRACE_ADD(t, heap_ops, 1);
                         }
                     } else{
                         PANIC_IF(heap_insert(W, &n) == HEAP_ERROR_FULL, "lack of consistency");
+                        TRACE_ADD(t, heap_ops, 1);
                     }
+                } else {
+                    TRACE_ADD(t, tombstones, 1);
                 }
             }
         } /* for */
@@ -692,6 +746,7 @@ int graph_insert(IndexHNSW *idx, GraphNode *node) {
     sc.query = node->vector->vector;
     sc.dims_aligned   = idx->dims_aligned;
 	sc.filter_alive = 0;
+    sc.trace = NULL;
 	entry = calloc_mem(idx->M0, sizeof(GraphNode *));
     if (!entry)
         goto return_with_error;
@@ -780,29 +835,37 @@ return_with_error:
  * @param result       Output array of MatchResult to store the best matches.
  * @param n            Number of top matches to return.
  * @param cmp          Pointer to the CmpMethod structure for distance comparison.
+ * @param trace        Work counters to fill, or NULL.
+ * @param payloads     Receives the payload of each match, or NULL.
  * @return SUCCESS if the search was successful, SYSTEM_ERROR on memory error.
  */
-int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, MatchResult *result, int n) {
+int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, MatchResult *result, int n,
+                        SearchTrace *trace, Payload **payloads) {
     Heap heap = HEAP_INIT();
     HeapNode node;
 	GraphNode *current = idx->head;
+    double start = TRACE_CLOCK(trace);
+    int i, k;
 
+    for (i = 0; i < n; i++) {
+        result[i].distance = idx->cmp->worst_match_value;
+        result[i].id = NULL_ID;
+    }
 	if (!current) 
 		return SUCCESS;
 
     if (init_heap(&heap, HEAP_WORST_TOP, n, idx->cmp->is_better_match) == HEAP_ERROR_ALLOC)
         return SYSTEM_ERROR;
     
-    int i, k;
-    for (i = 0; i < n; i++) {
-        result[i].distance = idx->cmp->worst_match_value;
-        result[i].id = NULL_ID;
-    }
     while (current) {
-		if (!tag || (tag & current->vector->tag )) {
+		if (current->alive && (!tag || (tag & current->vector->tag))) {
 			node.distance = idx->cmp->compare_vectors(current->vector->vector, v, idx->dims_aligned);
 			HEAP_NODE_PTR(node) = current;
 			PANIC_IF(heap_insert_or_replace_if_better(&heap, &node) != HEAP_SUCCESS, "error in heap");
+			TRACE_ADD(trace, distances, 1);
+			TRACE_ADD(trace, heap_ops, 1);
+		} else if (!current->alive) {
+			TRACE_ADD(trace, tombstones, 1);
 		}
 		current = current->next;
     }
@@ -812,8 +875,11 @@ int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, Mat
 		heap_pop(&heap, &node);
 		result[--k].distance = node.distance;
 		result[k].id = ((GraphNode *)HEAP_NODE_PTR(node))->vector->id;
+		if (payloads)
+			payloads[k] = ((GraphNode *)HEAP_NODE_PTR(node))->payload;
 	}
     heap_destroy(&heap);
+    TRACE_SET(trace, base_ms, get_time_ms_monotonic() - start);
     return SUCCESS;
 }
 
@@ -836,6 +902,7 @@ int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, Mat
  *   @dims    Number of dimensions in the input vector.
  *   @R       Top Best Heap size `n` to store the closest matches.
  *   @n       Maximum number of matches to return (top-k).
+ *   @trace   Work counters to fill, or NULL.
  *
  * Returns:
  *   SUCCESS (0) on success.
@@ -854,12 +921,13 @@ int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, Mat
  *   - This function internally allocates and frees a temporary aligned query buffer.
  *   - Uses ef = 1 for higher layers (greedy search), and `ef_search` at layer 0.
  */
-int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k) {
+int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k, SearchTrace *trace) {
     SearchContext sc;
     GraphNode *ep;
     Heap W = HEAP_INIT();
     HeapNode w;
     int i, ret = SYSTEM_ERROR, ef;
+    double start = TRACE_CLOCK(trace), base;
 
     PANIC_IF(heap_cap(R) != k, "incorrect space allocation in R");
 
@@ -871,6 +939,8 @@ int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k) {
     sc.cmp = idx->cmp;
     sc.dims_aligned   = idx->dims_aligned;
 	sc.filter_alive = 0;
+    sc.trace = trace;
+    TRACE_SET(trace, levels, idx->top_level + 1);
     ep = idx->gentry;
     for (i = idx->top_level; i > 0; i--) {
         if (search_layer(&sc, &ep, 1, 1, i, &W) != SUCCESS)
@@ -883,6 +953,8 @@ int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k) {
     }
 	ef = k > idx->ef_search ? k * 2 : idx->ef_search;
 	// Agregar si filtro, agregar si tiene en cuenta borrados
+    base = TRACE_CLOCK(trace);
+    TRACE_SET(trace, descent_ms, base - start);
     
 	sc.filter_alive = 1;
 	if (search_layer(&sc, &ep,1, ef, 0, &W) != SUCCESS)
@@ -897,6 +969,7 @@ int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k) {
         PANIC_IF(heap_pop(&W, &w) != HEAP_SUCCESS, "invalid condition");
         PANIC_IF(heap_insert(R, &w) != HEAP_SUCCESS, "invalid condition");
     }
+    TRACE_SET(trace, base_ms, get_time_ms_monotonic() - base);
     ret = SUCCESS;
 
 return_with_error:
@@ -3,6 +3,7 @@
 
 #include "method.h"
 #include "heap.h"
+#include "mem.h"
 
 /**
  * Degrees - Per-level degree counters for a GraphNode.
@@ -45,6 +46,7 @@ typedef struct {
  */
 typedef struct graph_node {
     Vector *vector;
+    Payload *payload;  // Payload of the vector, or NULL; released on delete
    
     int level;
     int alive;
@@ -86,6 +88,8 @@ typedef struct {
     
     GraphNode *gentry;  /**< Global entry point to the top level of the graph. */
     GraphNode *head;  /**< Local entry list used for traversal or deletion. */
+
+    MemAccount *mem;    /**< Account charged with nodes and vectors, or NULL. */
 } IndexHNSW;
 
 
@@ -104,17 +108,16 @@ typedef struct {
  *   | GraphNode | Degrees[L+1] | neighbors[L+1] | neighbor arrays |
  *
  * The vector is allocated via `make_vector()` and linked to the node.
+ * Both are charged to `idx->mem`.
  *
+ * @param idx            Index the node is allocated for (dimensions, M0)
  * @param id             Unique vector identifier
  * @param vector         Pointer to the raw vector values
- * @param dims_aligned   Number of dimensions (padded for SIMD alignment)
- * @param M0             Max number of neighbors for level 0
- * @param level          Max level for this node (inclusive)
  *
  * @return Pointer to the allocated GraphNode, or NULL on failure
  */
 
-extern GraphNode *alloc_graph_node(uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims_aligned, int M0);
+extern GraphNode *alloc_graph_node(IndexHNSW *idx, uint64_t id, uint64_t tag, float32_t *vector);
 
 /**
  * free_gnode - Frees a GraphNode and its associated vector.
@@ -122,9 +125,21 @@ extern GraphNode *alloc_graph_node(uint64_t id, uint64_t tag, float32_t *vector,
  * This function releases both the vector and the node memory.
  * Safe to call with NULL or already-freed nodes.
  *
- * @param g Pointer to a GraphNode pointer. Will be NULL'd after free.
+ * @param idx Index the node was allocated for.
+ * @param g   Pointer to a GraphNode pointer. Will be NULL'd after free.
+ */
+extern void free_graph_node(IndexHNSW *idx, GraphNode **g);
+
+/**
+ * Charges a vector adopted by a node (instead of allocated with it) to
+ * the account of the index.
+ */
+extern void graph_node_adopt(IndexHNSW *idx, GraphNode *node, Vector *vector);
+
+/**
+ * Bytes held by a node and its vector.
  */
-extern void free_graph_node(GraphNode **g);
+extern size_t graph_node_size(const IndexHNSW *idx, const GraphNode *node);
 
 /**
  * @brief Performs approximate nearest neighbor search in HNSW index.
@@ -144,6 +159,7 @@ extern void free_graph_node(GraphNode **g);
  *   @dims    Number of dimensions in the input vector.
  *   @R       Top Best Heap size `n` to store the closest matches.
  *   @n       Maximum number of matches to return (top-k).
+ *   @trace   Work counters to fill, or NULL.
  *
  * Returns:
  *   SUCCESS (0) on success.
@@ -162,9 +178,10 @@ extern void free_graph_node(GraphNode **g);
  *   - This function internally allocates and frees a temporary aligned query buffer.
  *   - Uses ef = 1 for higher layers (greedy search), and `ef_search` at layer 0.
  */
-extern int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k);
+extern int graph_knn_search(IndexHNSW *idx, float32_t *vector, Heap *R, int k, SearchTrace *trace);
 
-extern int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, MatchResult *result, int n);
+extern int graph_linear_search(IndexHNSW *idx, uint64_t tag, float32_t *restrict v, MatchResult *result, int n,
+                               SearchTrace *trace, Payload **payloads);
 
 /**
  * @brief Inserts a new node into the HNSW graph index.
@@ -0,0 +1,107 @@
+/*
+ * histogram.c - Log-linear latency histograms
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the histogram declared in histogram.h.
+ */
+
+#include "histogram.h"
+
+/*
+ * Highest value, in nanoseconds, that falls in bucket `b`.
+ */
+static uint64_t bucket_high(int b) {
+    int k, e;
+
+    if (b < HIST_LINEAR)
+        return (uint64_t) b;
+    if (b == HIST_BUCKETS - 1)
+        return UINT64_MAX;
+    k = b - HIST_LINEAR;
+    e = HIST_SUB_BITS + 1 + k / (1 << HIST_SUB_BITS);
+    return ((uint64_t) ((1 << HIST_SUB_BITS) + k % (1 << HIST_SUB_BITS) + 1) << (e - HIST_SUB_BITS)) - 1;
+}
+
+uint64_t hist_load(const Histogram *h, Histogram *out) {
+    uint64_t total = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        out->counts[i] = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        total += out->counts[i];
+    }
+    return total;
+}
+
+uint64_t hist_add(Histogram *h, const Histogram *src) {
+    uint64_t total = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        h->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+        total += h->counts[i];
+    }
+    return total;
+}
+
+uint64_t hist_since(Histogram *h, const Histogram *base) {
+    uint64_t total = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        /* A reset since `base` was taken leaves fewer values than it had */
+        h->counts[i] = h->counts[i] >= base->counts[i] ? h->counts[i] - base->counts[i] : h->counts[i];
+        total += h->counts[i];
+    }
+    return total;
+}
+
+void hist_reset(Histogram *h) {
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        __atomic_store_n(&h->counts[i], 0, __ATOMIC_RELAXED);
+}
+
+double hist_percentile(const Histogram *h, uint64_t total, double q) {
+    uint64_t rank, seen = 0;
+    uint64_t high = 0;
+    double r;
+
+    if (total == 0)
+        return 0.0;
+    if (q < 0)
+        q = 0;
+    if (q > 100)
+        q = 100;
+
+    /* Smallest value with at least `rank` values at or below it */
+    r = q / 100.0 * (double) total;
+    rank = (uint64_t) r;
+    if ((double) rank < r || rank == 0)
+        rank++;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h->counts[i] == 0)
+            continue;
+        high = bucket_high(i);
+        seen += h->counts[i];
+        if (seen >= rank)
+            break;
+    }
+    return high == UINT64_MAX ? (double) ((uint64_t) 1 << HIST_MAX_BITS) / 1e6 : (double) high / 1e6;
+}
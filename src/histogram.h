@@ -0,0 +1,111 @@
+/*
+ * histogram.h - Log-linear latency histograms
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * HDR-style histogram of durations in nanoseconds. Values below
+ * HIST_LINEAR get a bucket each; above that, every power of two is split
+ * in 2^HIST_SUB_BITS equal buckets, so a bucket is never wider than 1/16
+ * of its values and percentiles are exact to about 6%. Values of
+ * 2^HIST_MAX_BITS ns (about 18 minutes) and more share the last bucket.
+ *
+ * Recording is a single relaxed atomic increment, so any number of
+ * threads may record into the same histogram without a lock. Readers
+ * copy the buckets first and compute on the copy.
+ */
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H 1
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_LINEAR   (2 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS  (HIST_LINEAR + (HIST_MAX_BITS - HIST_SUB_BITS - 1) * (1 << HIST_SUB_BITS))
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+} Histogram;
+
+/**
+ * Returns the bucket of a value.
+ */
+static inline int hist_bucket(uint64_t ns) {
+    int e;
+
+    if (ns < HIST_LINEAR)
+        return (int) ns;
+    e = 63 - __builtin_clzll(ns);
+    if (e >= HIST_MAX_BITS)
+        return HIST_BUCKETS - 1;
+    return HIST_LINEAR + (e - HIST_SUB_BITS - 1) * (1 << HIST_SUB_BITS) +
+           (int) ((ns >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/**
+ * Records a duration given in milliseconds. Safe to call concurrently.
+ */
+static inline void hist_record(Histogram *h, double ms) {
+    uint64_t ns = ms > 0 ? (uint64_t) (ms * 1e6) : 0;
+    __atomic_fetch_add(&h->counts[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies the buckets of `h` into `out` (not an atomic snapshot: records
+ * made during the copy may or may not be included).
+ *
+ * @return Number of values in the copy.
+ */
+extern uint64_t hist_load(const Histogram *h, Histogram *out);
+
+/**
+ * Adds the buckets of `src` to those of `h`. `src` is read like
+ * hist_load() does.
+ *
+ * @return Number of values in `h` afterwards.
+ */
+extern uint64_t hist_add(Histogram *h, const Histogram *src);
+
+/**
+ * Replaces `h` by the values recorded since `base` was copied from it.
+ *
+ * @return Number of values left in `h`.
+ */
+extern uint64_t hist_since(Histogram *h, const Histogram *base);
+
+/**
+ * Clears every bucket. Values recorded concurrently may be lost.
+ */
+extern void hist_reset(Histogram *h);
+
+/**
+ * Returns the value below or at which `q` percent of the values fall, in
+ * milliseconds, as the highest value of the bucket holding it (0 if the
+ * histogram is empty).
+ *
+ * @param h     A copy made with hist_load() or hist_since().
+ * @param total Number of values in `h`.
+ * @param q     Percentile, from 0 to 100.
+ */
+extern double hist_percentile(const Histogram *h, uint64_t total, double q);
+
+#endif
@@ -5,6 +5,7 @@
 #include "method.h"
 #include "heap.h"
 #include "panic.h"
+#include "trace.h"
 
 /*
  * insert_node - Inserts a new node at the head of the list.
@@ -50,8 +51,14 @@ INodeFlat *search_node(INodeFlat **head, uint64_t id) {
  *
  * @return SUCCESS if deletion was successful, INVALID_ID if not found.
  */
-int delete_node(INodeFlat **head, INodeFlat *node) {
-    PANIC_IF(head == NULL || *head == NULL || node == NULL, "null pointer in delete_node");
+/*
+ * unlink_node - Removes a node from the list without releasing it.
+ *
+ * @param head - Pointer to the head of the linked list.
+ * @param node - Node to unlink.
+ */
+void unlink_node(INodeFlat **head, INodeFlat *node) {
+    PANIC_IF(head == NULL || *head == NULL || node == NULL, "null pointer in unlink_node");
 
     if (node->prev)
         node->prev->next = node->next;
@@ -60,8 +67,14 @@ int delete_node(INodeFlat **head, INodeFlat *node) {
 
     if (node->next)
         node->next->prev = node->prev;
-    free_mem(node->vector);
-    free_mem(node);
+    node->next = node->prev = NULL;
+}
+
+int delete_node(INodeFlat **head, INodeFlat *node, uint16_t dims_aligned, MemAccount *acct) {
+    PANIC_IF(head == NULL || *head == NULL || node == NULL, "null pointer in delete_node");
+
+    unlink_node(head, node);
+    free_inodeflat(node, dims_aligned, acct);
     return SUCCESS;
 }
 
@@ -81,11 +94,15 @@ int delete_node(INodeFlat **head, INodeFlat *node) {
  * @param result       Output array of MatchResult to store the best matches.
  * @param n            Number of top matches to return.
  * @param cmp          Pointer to the CmpMethod structure for distance comparison.
+ * @param trace        Work counters to fill, or NULL.
+ * @param payloads     Receives the payload of each match, or NULL.
  * @return SUCCESS if the search was successful, SYSTEM_ERROR on memory error.
  */
-int flat_linear_search(INodeFlat *current, uint64_t tag, float32_t *restrict v, uint16_t dims_aligned, MatchResult *result, int n, CmpMethod *cmp) {
+int flat_linear_search(INodeFlat *current, uint64_t tag, float32_t *restrict v, uint16_t dims_aligned, MatchResult *result, int n, CmpMethod *cmp,
+                       SearchTrace *trace, Payload **payloads) {
     Heap heap = HEAP_INIT();
     HeapNode node;
+    double start = TRACE_CLOCK(trace);
 
     if (init_heap(&heap, HEAP_WORST_TOP, n, cmp->is_better_match) == HEAP_ERROR_ALLOC)
         return SYSTEM_ERROR;
@@ -100,6 +117,8 @@ int flat_linear_search(INodeFlat *current, uint64_t tag, float32_t *restrict v,
 			node.distance = cmp->compare_vectors(current->vector->vector, v, dims_aligned);
 			HEAP_NODE_PTR(node) = current;
 			PANIC_IF(heap_insert_or_replace_if_better(&heap, &node) != HEAP_SUCCESS, "error in heap");
+			TRACE_ADD(trace, distances, 1);
+			TRACE_ADD(trace, heap_ops, 1);
 		}
 		current = current->next;
     }
@@ -109,20 +128,30 @@ int flat_linear_search(INodeFlat *current, uint64_t tag, float32_t *restrict v,
 		heap_pop(&heap, &node);
 		result[--k].distance = node.distance;
 		result[k].id = ((INodeFlat *)HEAP_NODE_PTR(node))->vector->id;
+		if (payloads)
+			payloads[k] = ((INodeFlat *)HEAP_NODE_PTR(node))->payload;
 	}
     heap_destroy(&heap);
+    TRACE_SET(trace, base_ms, get_time_ms_monotonic() - start);
     return SUCCESS;
 }
 
 
-INodeFlat *make_inodeflat(uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims) {	
-    INodeFlat *node = (INodeFlat *) calloc_mem(1, sizeof(INodeFlat));
+INodeFlat *make_inodeflat(uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims, MemAccount *acct) {	
+    INodeFlat *node = (INodeFlat *) alloc_object(acct, MEM_NODES, sizeof(INodeFlat), 0);
     
     if (node) {
-        if ((node->vector = make_vector(id, tag, vector, dims)) == NULL) {
-            free_mem(node);
+        node->payload = NULL;
+        if ((node->vector = make_vector_acct(acct, id, tag, vector, dims)) == NULL) {
+            free_object(acct, MEM_NODES, node, sizeof(INodeFlat), 0);
             node = NULL;
         }
     }
     return node;
+}
+
+void free_inodeflat(INodeFlat *node, uint16_t dims_aligned, MemAccount *acct) {
+    free_payload_acct(acct, &node->payload);
+    free_vector_acct(acct, &node->vector, dims_aligned);
+    free_object(acct, MEM_NODES, node, sizeof(INodeFlat), 0);
 }
\ No newline at end of file
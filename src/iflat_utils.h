@@ -3,6 +3,7 @@
 
 #include "vector.h"
 #include "method.h"
+#include "mem.h"
 
 /*
 * INodeFlat - Structure for linked list nodes in the flat index.
@@ -11,6 +12,7 @@
 */
 typedef struct node_flat {
     Vector *vector;          // Pointer to the stored vector
+    Payload *payload;        // Payload of the vector, or NULL
 
     struct node_flat *next;  // Pointer to the next node
     struct node_flat *prev;  // Pointer to the previous node
@@ -36,14 +38,24 @@ extern void insert_node(INodeFlat **head, INodeFlat *node);
 extern INodeFlat *search_node(INodeFlat **head, uint64_t id);
 
 /*
- * delete_node - Deletes a node by its vector ID.
+ * unlink_node - Removes a node from the list without releasing it.
  *
  * @param head - Pointer to the head of the linked list.
- * @param id   - Unique identifier of the vector.
+ * @param node - Node to unlink.
+ */
+extern void unlink_node(INodeFlat **head, INodeFlat *node);
+
+/*
+ * delete_node - Unlinks a node and releases it with free_inodeflat().
+ *
+ * @param head         - Pointer to the head of the linked list.
+ * @param node         - Node to delete.
+ * @param dims_aligned - Aligned dimensions of its vector.
+ * @param acct         - Account the node was charged to, or NULL.
  *
- * @return SUCCESS if deletion was successful, INVALID_ID if not found.
+ * @return SUCCESS.
  */
-extern int delete_node(INodeFlat **head, INodeFlat *node);
+extern int delete_node(INodeFlat **head, INodeFlat *node, uint16_t dims_aligned, MemAccount *acct);
 
 /*
  * flat_linear_search_n - Finds the top-N closest matches in a flat index.
@@ -67,9 +79,21 @@ extern int delete_node(INodeFlat **head, INodeFlat *node);
  * @param result       - Pointer to an array of MatchResult structures to store the top-N matches.
  * @param n            - Number of top matches to find.
  * @param cmp          - Pointer to the CmpMethod structure that defines the comparison functions.
+ * @param trace        - Work counters to fill, or NULL.
+ * @param payloads     - Receives the payload of each match, or NULL.
  */
-extern int flat_linear_search(INodeFlat *current, uint64_t tag, float32_t *v, uint16_t dims_aligned, MatchResult *result, int n, CmpMethod *cmp);
+extern int flat_linear_search(INodeFlat *current, uint64_t tag, float32_t *v, uint16_t dims_aligned, MatchResult *result, int n, CmpMethod *cmp,
+                              SearchTrace *trace, Payload **payloads);
 
 
-extern INodeFlat *make_inodeflat(uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims);
+/*
+ * make_inodeflat - Allocates a node and its vector, charged to `acct`
+ * (may be NULL).
+ */
+extern INodeFlat *make_inodeflat(uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims, MemAccount *acct);
+
+/*
+ * free_inodeflat - Releases a node, its vector and its payload, discharging `acct`.
+ */
+extern void free_inodeflat(INodeFlat *node, uint16_t dims_aligned, MemAccount *acct);
 #endif
\ No newline at end of file
@@ -43,6 +43,7 @@
 #include "config.h"
 #define __LIB_CODE 1
 
+#include <sched.h>
 #include "index.h"
 #include "heap.h"
 #include "mem.h"
@@ -52,6 +53,10 @@
 #include "method.h"
 #include "index_flat.h"
 #include "index_hnsw.h"
+#include "index_shared.h"
+#include "pool.h"
+#include "trace.h"
+#include "arena.h"
 
 
 
@@ -68,6 +73,306 @@
         }                                              \
     } while(0)
 
+/*
+ * Shard of the calling thread. Threads take the next shard the first
+ * time they record anything, whatever the index.
+ */
+static __thread int stat_slot = -1;
+static int stat_slots;
+
+static inline void shard_lock(StatShard *s) {
+    while (__atomic_exchange_n(&s->lock, 1, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&s->lock, __ATOMIC_RELAXED))
+            sched_yield();
+}
+
+static inline void shard_unlock(StatShard *s) {
+    __atomic_store_n(&s->lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Start time of an operation, or 0 when statistics are disabled.
+ */
+static inline double stat_start(const Index *index) {
+    if (!__atomic_load_n(&index->stats_enabled, __ATOMIC_RELAXED))
+        return 0;
+    return get_time_ms_monotonic();
+}
+
+/*
+ * Records an operation that began at `start` (as returned by
+ * stat_start()) in the shard of the calling thread. The shard lock is
+ * only contended when more than STAT_SHARDS threads record or while
+ * stats() reads the shard.
+ */
+static void stat_record(Index *index, int op, double start) {
+    StatShard *s, *fresh = NULL;
+    double end, delta;
+
+    if (start == 0)
+        return;
+    end = get_time_ms_monotonic();
+    delta = end - start;
+
+    if (stat_slot < 0)
+        stat_slot = __atomic_fetch_add(&stat_slots, 1, __ATOMIC_RELAXED) % STAT_SHARDS;
+    if ((s = __atomic_load_n(&index->shards[stat_slot], __ATOMIC_ACQUIRE)) == NULL) {
+        if ((fresh = calloc_mem(1, sizeof(StatShard))) == NULL)
+            return;
+        s = NULL;
+        if (__atomic_compare_exchange_n(&index->shards[stat_slot], &s, fresh, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            s = fresh;
+        else
+            free_mem(fresh);
+    }
+
+    shard_lock(s);
+    UPDATE_TIMESTAT(s->time[op], delta);
+    s->at[op] = end;
+    hist_record(&s->latency[op], delta);
+    shard_unlock(s);
+}
+
+/*
+ * Adds up the shards for operation `op` into `t` and/or `h` (either may
+ * be NULL; `h` must start zeroed).
+ *
+ * @return Number of values in `h`.
+ */
+static uint64_t stat_gather(Index *index, int op, TimeStat *t, Histogram *h) {
+    uint64_t total = 0;
+    double at = 0;
+
+    if (t)
+        memset(t, 0, sizeof(TimeStat));
+    for (int i = 0; i < STAT_SHARDS; i++) {
+        StatShard *s = __atomic_load_n(&index->shards[i], __ATOMIC_ACQUIRE);
+
+        if (s == NULL)
+            continue;
+        shard_lock(s);
+        if (t && s->time[op].count > 0) {
+            if (t->count == 0 || s->time[op].min < t->min)
+                t->min = s->time[op].min;
+            if (t->count == 0 || s->time[op].max > t->max)
+                t->max = s->time[op].max;
+            if (s->at[op] >= at) {
+                at = s->at[op];
+                t->last = s->time[op].last;
+            }
+            t->count += s->time[op].count;
+            t->total += s->time[op].total;
+        }
+        if (h)
+            total = hist_add(h, &s->latency[op]);
+        shard_unlock(s);
+    }
+    return total;
+}
+
+/* Vectors copied per lock acquisition when streaming an export */
+#define EXPORT_BATCH 1024
+
+/* Initial buckets of the change tracking map */
+#define CHANGES_MAP_SIZE 1024
+
+/* Matches kept on the stack by search_with_payload() */
+#define PAYLOAD_STACK_MATCHES 64
+
+/* Attached images do not provide mutating operations */
+#define INDEX_READ_ONLY(index) ((index)->insert == NULL)
+
+/*
+ * ID lookup and element count. Attached images answer them from the
+ * shared ID table instead of the per-process ID map.
+ */
+static inline void *index_lookup(Index *index, uint64_t id) {
+    return index->lookup ? index->lookup(index->data, id) : map_get_p(&index->map, id);
+}
+
+static inline uint64_t index_count(Index *index) {
+    return index->count ? index->count(index->data) : index->map.elements;
+}
+
+/*
+ * Merges `flags` into the tracked changes of `id`. Called with the write lock.
+ */
+static void changes_merge(Index *index, uint64_t id, uint64_t flags) {
+    uint64_t old = 0;
+
+    if (map_get_safe(&index->changes, id, &old) == MAP_OK) {
+        if ((old | flags) == old)
+            return;
+        map_remove(&index->changes, id);
+    }
+    if (map_insert(&index->changes, id, old | flags) != MAP_SUCCESS)
+        index->delta_lost = 1;
+}
+
+/*
+ * Records a mutation for the next delta dump. Called with the write lock,
+ * only does work once a snapshot exists to link deltas to.
+ */
+static inline void track_change(Index *index, uint64_t id, uint64_t flag) {
+    if (index->delta_base != 0 && !index->delta_lost)
+        changes_merge(index, id, flag);
+}
+
+/*
+ * Hands the tracked changes over to a snapshot being taken and starts
+ * tracking against the new snapshot `id`. Called with the read lock held
+ * (no mutation can run); delta_lock orders concurrent snapshots.
+ *
+ * With `require` set, fails with INVALID_ARGUMENT when there is no valid
+ * base to link a delta to.
+ */
+static int changes_take(Index *index, uint64_t id, int require, Map *taken, uint64_t *base) {
+    Map fresh = MAP_INIT();
+    int ret = SUCCESS;
+
+    if (init_map(&fresh, CHANGES_MAP_SIZE, 15) != MAP_SUCCESS)
+        return SYSTEM_ERROR;
+
+    pthread_mutex_lock(&index->delta_lock);
+    if (require && (index->delta_base == 0 || index->delta_lost)) {
+        ret = INVALID_ARGUMENT;
+    } else {
+        *taken = index->changes;
+        *base  = index->delta_base;
+        index->changes    = fresh;
+        index->delta_base = id;
+        index->delta_lost = 0;
+        fresh = MAP_INIT();
+    }
+    pthread_mutex_unlock(&index->delta_lock);
+
+    map_destroy(&fresh);
+    return ret;
+}
+
+/*
+ * Gives back the changes of a snapshot that could not be written, so the
+ * next one still covers them. Called with the write lock held.
+ */
+static void changes_restore(Index *index, Map *taken, uint64_t base, uint64_t id) {
+    MapIter it = MAP_ITER_INIT();
+    MapNode *node;
+
+    while ((node = map_next(taken, &it)) != NULL)
+        changes_merge(index, node->key, node->value);
+    if (index->delta_base == id)
+        index->delta_base = base;
+}
+
+static inline uint64_t mem_load(const MemAccount *acct, int cat) {
+    int64_t bytes = __atomic_load_n(&acct->bytes[cat], __ATOMIC_RELAXED);
+    return bytes > 0 ? (uint64_t) bytes : 0;
+}
+
+/*
+ * Copies `len` bytes into a new Payload; an empty payload is NULL.
+ */
+static int payload_alloc(Index *index, const void *data, uint32_t len, Payload **out) {
+    *out = NULL;
+    if (len == 0)
+        return SUCCESS;
+    if (data == NULL || len > MAX_PAYLOAD_SIZE)
+        return INVALID_ARGUMENT;
+    if ((*out = calloc_mem_acct(&index->mem, MEM_PAYLOADS, 1, sizeof(Payload) + len)) == NULL)
+        return SYSTEM_ERROR;
+    (*out)->length = len;
+    memcpy((*out)->data, data, len);
+    return SUCCESS;
+}
+
+static inline void payload_free(Index *index, Payload *p) {
+    if (p)
+        free_mem_acct(&index->mem, MEM_PAYLOADS, p, sizeof(Payload) + p->length);
+}
+
+/*
+ * Payload held by the node `ref`, or NULL. Attached images keep none.
+ */
+static inline Payload *payload_get(Index *index, const void *ref) {
+    return index->payload ? *index->payload(index->data, ref) : NULL;
+}
+
+/*
+ * Copies the payloads into the snapshot as a StorePayload section; they
+ * may be replaced or released while the file is written. Called with the
+ * read lock held.
+ */
+static int payload_capture(Index *index, IOContext *io) {
+    MapIter it = MAP_ITER_INIT();
+    MapNode *node;
+    size_t bytes = 0;
+    uint32_t count = 0;
+    char *p;
+
+    if (mem_load(&index->mem, MEM_PAYLOADS) == 0)
+        return SUCCESS;
+
+    while ((node = map_next(&index->map, &it)) != NULL) {
+        Payload *pl = payload_get(index, (void *) (uintptr_t) node->value);
+        if (pl) {
+            bytes += sizeof(StorePayload) + pl->length;
+            count++;
+        }
+    }
+    if (count == 0)
+        return SUCCESS;
+    if ((io->payloads = calloc_mem(1, bytes)) == NULL)
+        return SYSTEM_ERROR;
+
+    p = io->payloads;
+    it = MAP_ITER_INIT();
+    while ((node = map_next(&index->map, &it)) != NULL) {
+        Payload *pl = payload_get(index, (void *) (uintptr_t) node->value);
+        StorePayload rec;
+
+        if (pl == NULL)
+            continue;
+        rec.id = node->key;
+        rec.length = pl->length;
+        memcpy(p, &rec, sizeof(StorePayload));
+        memcpy(p + sizeof(StorePayload), pl->data, pl->length);
+        p += sizeof(StorePayload) + pl->length;
+    }
+    io->plength = bytes;
+    io->pcount  = count;
+    return SUCCESS;
+}
+
+/*
+ * Attaches the payload section of a loaded file to the loaded nodes.
+ * Every record must belong to a distinct loaded vector.
+ */
+static int payload_restore(Index *index, IOContext *io) {
+    const char *p = io->payloads, *end = io->payloads + io->plength;
+    int ret;
+
+    for (uint32_t i = 0; i < io->pcount; i++) {
+        StorePayload rec;
+        Payload **slot;
+        void *ref;
+
+        if ((size_t) (end - p) < sizeof(StorePayload))
+            return INVALID_FILE;
+        memcpy(&rec, p, sizeof(StorePayload));
+        p += sizeof(StorePayload);
+
+        if (rec.length == 0 || rec.length > MAX_PAYLOAD_SIZE || (size_t) (end - p) < rec.length ||
+            (ref = map_get_p(&index->map, rec.id)) == NULL ||
+            *(slot = index->payload(index->data, ref)) != NULL)
+            return INVALID_FILE;
+        if ((ret = payload_alloc(index, p, rec.length, slot)) != SUCCESS)
+            return ret;
+        p += rec.length;
+    }
+    return p == end ? SUCCESS : INVALID_FILE;
+}
+
 
 
 /*
@@ -97,9 +402,21 @@
  */
 
 int search(Index *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n) {
-    double start, end, delta;
+    return search_trace(index, tag, vector, dims, results, n, NULL);
+}
+
+/*
+ * Backends fill the counters and phase times of the trace while they
+ * search; the total is measured here, lock wait included.
+ */
+int search_trace(Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
+                 MatchResult *results, int n, SearchTrace *trace) {
+    double start, begin;
     int ret;
 
+    if (trace)
+        memset(trace, 0, sizeof(SearchTrace));
+
     if (index == NULL)  return INVALID_INDEX;
     if (vector == NULL) return INVALID_VECTOR;
     if (results == NULL) return INVALID_RESULT;
@@ -107,16 +424,78 @@ int search(Index *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchRe
     if (index->data == NULL || index->search == NULL)
         return INVALID_INIT;
     
+    begin = TRACE_CLOCK(trace);
     pthread_rwlock_rdlock(&index->rwlock);
-    start = get_time_ms_monotonic();
-    ret = index->search(index->data, tag, vector, dims, results, n);
-    end = get_time_ms_monotonic();
+    start = stat_start(index);
+    ret = index->search(index->data, tag, vector, dims, results, n, trace, NULL);
+    if (ret == SUCCESS)
+        stat_record(index, STAT_SEARCH, start);
+    pthread_rwlock_unlock(&index->rwlock);
+    TRACE_SET(trace, total_ms, get_time_ms_monotonic() - begin);
+    return ret;
+}
+
+/*
+ * Searches like search() and copies the payload of every match into `buf`
+ * while the read lock is still held, so the caller does not need a second
+ * lookup per hit. The backend hands back the payload of the node behind
+ * each match. Payloads start at 8-byte aligned offsets of `buf`; one
+ * that does not fit is reported with its length and a NULL pointer.
+ */
+int search_with_payload(Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
+                        MatchPayload *results, int n, void *buf, size_t buflen) {
+    MatchResult local[PAYLOAD_STACK_MATCHES];
+    Payload *plocal[PAYLOAD_STACK_MATCHES];
+    MatchResult *matches = local;
+    Payload **payloads = plocal;
+    double start;
+    size_t off = 0;
+    int ret;
+
+    if (index == NULL)  return INVALID_INDEX;
+    if (vector == NULL) return INVALID_VECTOR;
+    if (results == NULL) return INVALID_RESULT;
+    if (buf == NULL && buflen > 0)
+        return INVALID_ARGUMENT;
+
+    if (index->data == NULL || index->search == NULL)
+        return INVALID_INIT;
 
+    if (n > PAYLOAD_STACK_MATCHES) {
+        if ((matches = calloc_mem(n, sizeof(MatchResult) + sizeof(Payload *))) == NULL)
+            return SYSTEM_ERROR;
+        payloads = (Payload **) (matches + n);
+    } else if (n > 0) {
+        memset(plocal, 0, n * sizeof(Payload *));
+    }
+
+    pthread_rwlock_rdlock(&index->rwlock);
+    start = stat_start(index);
+    ret = index->search(index->data, tag, vector, dims, matches, n, NULL, payloads);
     if (ret == SUCCESS) {
-        delta = end - start;
-        UPDATE_TIMESTAT(index->stats.search, delta);
+        for (int i = 0; i < n; i++) {
+            Payload *p = matches[i].id != NULL_ID ? payloads[i] : NULL;
+
+            results[i].id = matches[i].id;
+            results[i].distance = matches[i].distance;
+            results[i].plen = p ? p->length : 0;
+            results[i].payload = NULL;
+            if (p == NULL)
+                continue;
+
+            off = (off + 7) & ~(size_t) 7;
+            if (off <= buflen && p->length <= buflen - off) {
+                memcpy((char *) buf + off, p->data, p->length);
+                results[i].payload = (char *) buf + off;
+                off += p->length;
+            }
+        }
+        stat_record(index, STAT_SEARCH, start);
     }
     pthread_rwlock_unlock(&index->rwlock);
+
+    if (matches != local)
+        free_mem(matches);
     return ret;
 }
 
@@ -150,6 +529,7 @@ int filter_subset(Index *index, uint64_t *ids, int i, float32_t *vector, uint16_
 	CmpMethod *cmp;
 	void *node;
 	Heap W;
+	double start;
 	int ret = SUCCESS;
 
 	if (index == NULL)   return INVALID_INDEX;
@@ -166,11 +546,12 @@ int filter_subset(Index *index, uint64_t *ids, int i, float32_t *vector, uint16_
 	if (init_heap(&W, HEAP_WORST_TOP, n, cmp->is_better_match) != HEAP_SUCCESS)
 		return SYSTEM_ERROR;
 
+	start = stat_start(index);
 	pthread_rwlock_rdlock(&index->rwlock);
 	for (int j = 0; j < i; j++) {
 		float32_t distance;
 		
-		if (map_get_safe_p(&index->map, ids[j], &node) != MAP_SUCCESS) 
+		if ((node = index_lookup(index, ids[j])) == NULL)
 			continue;
 
 		if ((ret = index->compare(index->data, node , vector, dims, &distance)) != SUCCESS) {
@@ -196,6 +577,7 @@ int filter_subset(Index *index, uint64_t *ids, int i, float32_t *vector, uint16_
 		results[j].id = 0;
 		results[j].distance = cmp->worst_match_value;
 	}
+	stat_record(index, STAT_FILTER, start);
 end:
 	heap_destroy(&W);
 	return ret;
@@ -231,18 +613,13 @@ end:
  *         or appropriate error code on failure (e.g., INVALID_VECTOR, MAP_ERROR).
  */
 
-int insert(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims) {
-    double start, end, delta;
+static int index_insert(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims, Payload *p) {
+    double start;
+    uint64_t lsn = 0;
+    Wal *wal = NULL;
     void *ref;
     int ret;
 
-    if (id == NULL_ID)  return INVALID_ID;
-    if (index == NULL)  return INVALID_INDEX;
-    if (vector == NULL) return INVALID_VECTOR;
-
-    if (index->data == NULL || index->insert == NULL)
-        return INVALID_INIT;
-    
     pthread_rwlock_wrlock(&index->rwlock);
 
     if (map_has(&index->map, id) == 1) {
@@ -251,23 +628,71 @@ int insert(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t
     }
 
 
-    start = get_time_ms_monotonic();
+    start = stat_start(index);
     ret = index->insert(index->data, id, tag, vector, dims, &ref);
-    end = get_time_ms_monotonic();
     if (ret == SUCCESS) {
         if ((ret = map_insert_p(&index->map, id, ref)) != MAP_SUCCESS) {
             PANIC_IF(index->delete(index->data, ref) != SUCCESS, "lack of consistency on delete after insert");
             goto cleanup;
         }
-        delta = end - start;
-        UPDATE_TIMESTAT(index->stats.insert, delta);
+        if (index->wal && (ret = wal_append(index->wal, WAL_INSERT, id, tag, vector, dims,
+                                            p ? p->data : NULL, p ? p->length : 0, &lsn)) != SUCCESS) {
+            PANIC_IF(index->delete(index->data, ref) != SUCCESS, "lack of consistency on delete after insert");
+            PANIC_IF(map_remove_p(&index->map, id) == NULL, "lack of consistency using map_remove");
+            goto cleanup;
+        }
+        /* The node owns the payload from here on */
+        *index->payload(index->data, ref) = p;
+        wal = index->wal;
+        track_change(index, id, DELTA_CHANGED_PUT);
+        stat_record(index, STAT_INSERT, start);
     }
 
 cleanup:
     pthread_rwlock_unlock(&index->rwlock);
+    if (ret != SUCCESS)
+        payload_free(index, p);
+    if (lsn)
+        ret = wal_wait(wal, lsn);
     return ret;
 }
 
+int insert(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims) {
+    if (id == NULL_ID)  return INVALID_ID;
+    if (index == NULL)  return INVALID_INDEX;
+    if (vector == NULL) return INVALID_VECTOR;
+
+    if (index->data == NULL)
+        return INVALID_INIT;
+    if (INDEX_READ_ONLY(index))
+        return READ_ONLY_INDEX;
+
+    return index_insert(index, id, tag, vector, dims, NULL);
+}
+
+/*
+ * Inserts a vector like insert() and attaches a copy of `payload` to it
+ * in the same critical section (and the same log record).
+ */
+int insert_with_payload(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims,
+                        const void *payload, uint32_t plen) {
+    Payload *p;
+    int ret;
+
+    if (id == NULL_ID)  return INVALID_ID;
+    if (index == NULL)  return INVALID_INDEX;
+    if (vector == NULL) return INVALID_VECTOR;
+
+    if (index->data == NULL)
+        return INVALID_INIT;
+    if (INDEX_READ_ONLY(index))
+        return READ_ONLY_INDEX;
+    if ((ret = payload_alloc(index, payload, plen, &p)) != SUCCESS)
+        return ret;
+
+    return index_insert(index, id, tag, vector, dims, p);
+}
+
 int update_icontext(Index *index, void *context, int mode) {
     int ret;
 	if (index->data == NULL)
@@ -283,26 +708,114 @@ int update_icontext(Index *index, void *context, int mode) {
 }
 
 int set_tag(Index *index, uint64_t id, uint64_t tag) {
+	uint64_t lsn = 0, old;
+	Wal *wal = NULL;
+	double start;
 	void *ref;
 	int  ret;
 	if (id == NULL_ID)  return INVALID_ID;
     if (index == NULL)  return INVALID_INDEX;
+    if (INDEX_READ_ONLY(index))
+        return READ_ONLY_INDEX;
     if (!index->data || !index->set_tag)
         return INVALID_INIT;
 
 	pthread_rwlock_wrlock(&index->rwlock);
+	start = stat_start(index);
 	ref = map_get_p(&index->map, id);
     if (ref == NULL) {
         ret = NOT_FOUND_ID;
         goto cleanup;
     }
-	ret = index->set_tag(index->data, ref, tag);
+	/* Apply first: only a tag change that took place is logged */
+	old = index->get_vector(index->data, ref)->tag;
+	if ((ret = index->set_tag(index->data, ref, tag)) != SUCCESS)
+		goto cleanup;
+	if (index->wal && (ret = wal_append(index->wal, WAL_SET_TAG, id, tag, NULL, 0, NULL, 0, &lsn)) != SUCCESS) {
+		PANIC_IF(index->set_tag(index->data, ref, old) != SUCCESS, "lack of consistency restoring a tag");
+		goto cleanup;
+	}
+	wal = index->wal;
+	track_change(index, id, DELTA_CHANGED_TAG);
+	stat_record(index, STAT_UPDATE, start);
+
+cleanup:
+    pthread_rwlock_unlock(&index->rwlock);
+    if (lsn) {
+        int wret = wal_wait(wal, lsn);
+        if (ret == SUCCESS)
+            ret = wret;
+    }
+    return ret;
+}
+
+int set_payload(Index *index, uint64_t id, const void *payload, uint32_t plen) {
+	Payload *p, *old, **slot;
+	uint64_t lsn = 0;
+	Wal *wal = NULL;
+	double start;
+	void *ref;
+	int  ret;
+	if (id == NULL_ID)  return INVALID_ID;
+    if (index == NULL)  return INVALID_INDEX;
+    if (INDEX_READ_ONLY(index))
+        return READ_ONLY_INDEX;
+    if (!index->data)
+        return INVALID_INIT;
+	if ((ret = payload_alloc(index, payload, plen, &p)) != SUCCESS)
+		return ret;
+
+	pthread_rwlock_wrlock(&index->rwlock);
+	start = stat_start(index);
+	if ((ref = map_get_p(&index->map, id)) == NULL) {
+		ret = NOT_FOUND_ID;
+		goto cleanup;
+	}
+	if (index->wal && (ret = wal_append(index->wal, WAL_SET_PAYLOAD, id, 0, NULL, 0, payload, plen, &lsn)) != SUCCESS)
+		goto cleanup;
+	wal = index->wal;
+	/* The node takes the new payload; the old one is released below */
+	slot = index->payload(index->data, ref);
+	old = *slot;
+	*slot = p;
+	p = old;
+	track_change(index, id, DELTA_CHANGED_PAYLOAD);
+	stat_record(index, STAT_UPDATE, start);
 
 cleanup:
     pthread_rwlock_unlock(&index->rwlock);
+    payload_free(index, p);
+    if (lsn) {
+        int wret = wal_wait(wal, lsn);
+        if (ret == SUCCESS)
+            ret = wret;
+    }
     return ret;
 }
 
+int get_payload(Index *index, uint64_t id, void *buf, uint32_t buflen, uint32_t *plen) {
+	Payload *p;
+	void *ref;
+	int ret = SUCCESS;
+
+	if (index == NULL)
+		return INVALID_INDEX;
+	if (plen == NULL || (buf == NULL && buflen > 0))
+		return INVALID_ARGUMENT;
+
+	pthread_rwlock_rdlock(&index->rwlock);
+	if ((ref = index_lookup(index, id)) == NULL) {
+		ret = NOT_FOUND_ID;
+	} else {
+		p = payload_get(index, ref);
+		*plen = p ? p->length : 0;
+		if (p && p->length <= buflen)
+			memcpy(buf, p->data, p->length);
+	}
+	pthread_rwlock_unlock(&index->rwlock);
+	return ret;
+}
+
 /*
  * Deletes a vector from the index by its ID.
  *
@@ -331,16 +844,20 @@ cleanup:
 
 int delete(Index *index, uint64_t id) {
     void *ref;
-    double start, end, delta;
+    double start;
+    uint64_t lsn = 0;
+    Wal *wal = NULL;
     int ret;
 
     if (id == NULL_ID)  return INVALID_ID;
     if (index == NULL)  return INVALID_INDEX;
+    if (INDEX_READ_ONLY(index))
+        return READ_ONLY_INDEX;
     if (!index->data || !index->delete)
         return INVALID_INIT;
     
     pthread_rwlock_wrlock(&index->rwlock);
-    start = get_time_ms_monotonic();
+    start = stat_start(index);
     
     ref = map_get_p(&index->map, id);
     if (ref == NULL) {
@@ -348,16 +865,21 @@ int delete(Index *index, uint64_t id) {
         goto cleanup;
     }
 
+    /* Log first: once the record is staged the delete cannot fail */
+    if (index->wal && (ret = wal_append(index->wal, WAL_DELETE, id, 0, NULL, 0, NULL, 0, &lsn)) != SUCCESS)
+        goto cleanup;
+    wal = index->wal;
+
     ret = index->delete(index->data, ref);
     PANIC_IF(ret != SUCCESS, "lack of consistency using index->delete");
     PANIC_IF(map_remove_p(&index->map, id) == NULL, "lack of consistency using map_remove");
-
-    end = get_time_ms_monotonic();
-    delta = end - start;
-    UPDATE_TIMESTAT(index->stats.delete, delta);
+    track_change(index, id, DELTA_CHANGED_DEL);
+    stat_record(index, STAT_DELETE, start);
 
 cleanup:
     pthread_rwlock_unlock(&index->rwlock);
+    if (lsn)
+        ret = wal_wait(wal, lsn);
     return ret;
 }
 int cpp_delete(Index *index, uint64_t id) {
@@ -372,9 +894,8 @@ int cpp_delete(Index *index, uint64_t id) {
  *
  * Steps:
  * 1. Validates the input pointers.
- * 2. Acquires a read lock to ensure consistent access to statistics.
- * 3. Copies the internal statistics into the provided `IndexStats` structure.
- * 4. Releases the lock.
+ * 2. Adds up the statistics of every thread shard into the provided
+ *    `IndexStats` structure, locking one shard at a time.
  *
  * @param index - Pointer to the index from which to retrieve statistics.
  * @param stats - Pointer to a user-allocated `IndexStats` struct where results will be stored.
@@ -387,74 +908,384 @@ int stats(Index *index, IndexStats *stats) {
         return INVALID_INDEX;
     if (!stats)
         return INVALID_ARGUMENT;
-    pthread_rwlock_rdlock(&index->rwlock);
-    *stats = index->stats;
-    pthread_rwlock_unlock(&index->rwlock);
+    memset(stats, 0, sizeof(IndexStats));
+    stat_gather(index, STAT_INSERT, &stats->insert, NULL);
+    stat_gather(index, STAT_DELETE, &stats->delete, NULL);
+    stat_gather(index, STAT_DUMP, &stats->dump, NULL);
+    stat_gather(index, STAT_SEARCH, &stats->search, NULL);
+    return SUCCESS;
+}
+
+static int latency_percentiles(Index *index, int op, const double *q, double *ms, int n,
+                               uint64_t *count, int interval) {
+    Histogram *h;
+    uint64_t total;
+
+    if (!index)
+        return INVALID_INDEX;
+    if (op < 0 || op >= STAT_OPS || n < 0 || (n > 0 && (!q || !ms)))
+        return INVALID_ARGUMENT;
+    if ((h = calloc_mem(interval ? 2 : 1, sizeof(Histogram))) == NULL)
+        return SYSTEM_ERROR;
+
+    if (interval) {
+        /* h[1] becomes the start of the next interval */
+        pthread_mutex_lock(&index->stats_lock);
+        stat_gather(index, op, NULL, &h[1]);
+        h[0] = h[1];
+        total = hist_since(&h[0], &index->intervals[op]);
+        index->intervals[op] = h[1];
+        pthread_mutex_unlock(&index->stats_lock);
+    } else {
+        total = stat_gather(index, op, NULL, h);
+    }
+
+    for (int i = 0; i < n; i++)
+        ms[i] = hist_percentile(h, total, q[i]);
+    if (count)
+        *count = total;
+    free_mem(h);
     return SUCCESS;
 }
 
 /*
- * Returns the number of elements currently stored in the index.
- *
- * This function provides the total number of unique vectors inserted
- * and currently active in the index. It does not include deleted or
- * invalidated entries.
- *
- * Steps:
- * 1. Validates the index pointer.
- * 2. Acquires a read lock to safely access the internal map structure.
- * 3. Retrieves the current element count from the map and stores it in `*sz`.
- * 4. Releases the lock.
- *
- * @param index - Pointer to the index whose size will be retrieved.
- * @param sz    - Pointer to a uint64_t variable where the size will be stored.
- *
- * @return SUCCESS on success, INVALID_INDEX if the index is NULL.
+ * Computes latency percentiles of an operation from its histogram. The
+ * histogram is read without stopping concurrent operations.
  */
-int size(Index *index, uint64_t *sz) {
+int stats_percentiles(Index *index, int op, const double *q, double *ms, int n, uint64_t *count) {
+    return latency_percentiles(index, op, q, ms, n, count, 0);
+}
+
+/*
+ * Like stats_percentiles(), limited to the operations recorded since the
+ * previous call: the histogram copied by that call is subtracted.
+ */
+int stats_interval(Index *index, int op, const double *q, double *ms, int n, uint64_t *count) {
+    return latency_percentiles(index, op, q, ms, n, count, 1);
+}
+
+int stats_reset(Index *index) {
     if (!index)
         return INVALID_INDEX;
-    pthread_rwlock_rdlock(&index->rwlock);
-    *sz = index->map.elements;
-    pthread_rwlock_unlock(&index->rwlock);
+
+    pthread_mutex_lock(&index->stats_lock);
+    for (int i = 0; i < STAT_SHARDS; i++) {
+        StatShard *s = __atomic_load_n(&index->shards[i], __ATOMIC_ACQUIRE);
+
+        if (s == NULL)
+            continue;
+        shard_lock(s);
+        memset(s->time, 0, sizeof(s->time));
+        memset(s->at, 0, sizeof(s->at));
+        memset(s->latency, 0, sizeof(s->latency));
+        shard_unlock(s);
+    }
+    memset(index->intervals, 0, sizeof(index->intervals));
+    pthread_mutex_unlock(&index->stats_lock);
     return SUCCESS;
 }
 
 /*
- * Checks whether a vector with the given ID exists in the index.
- *
- * This function determines if a vector with the specified ID is
- * currently present in the index. It uses the internal ID map to
- * perform the lookup efficiently.
+ * Operations already running when collection is switched off may still
+ * record their timing.
+ */
+int stats_enable(Index *index, int enable) {
+    if (!index)
+        return INVALID_INDEX;
+    __atomic_store_n(&index->stats_enabled, enable != 0, __ATOMIC_RELAXED);
+    return SUCCESS;
+}
+
+/*
+ * Reports the memory held by an index, by component.
  *
- * Steps:
- * 1. Validates the index pointer.
- * 2. Acquires a read lock to ensure thread-safe access.
- * 3. Uses the internal map to check for the presence of the ID.
- * 4. Releases the lock and returns the result.
+ * The counters are kept as the structures grow and shrink, so this
+ * function only copies them. Tombstones are bytes still held by deleted
+ * HNSW nodes and are already part of the other components.
  *
  * @param index - Pointer to the index.
- * @param id    - The ID of the vector to check for.
+ * @param mem   - Where the usage is stored.
  *
- * @return 1 if the ID exists, 0 otherwise. Returns 0 if the index is NULL.
+ * @return SUCCESS, INVALID_INDEX or INVALID_ARGUMENT.
  */
-
-int contains(Index *index, uint64_t id) {
-    int ret;
+int memory_usage(Index *index, MemStats *mem) {
     if (!index)
-        return 0;
+        return INVALID_INDEX;
+    if (!mem)
+        return INVALID_ARGUMENT;
+
+    memset(mem, 0, sizeof(MemStats));
     pthread_rwlock_rdlock(&index->rwlock);
-    ret = map_has(&index->map, id);
+    mem->vectors     = mem_load(&index->mem, MEM_VECTORS);
+    mem->nodes       = mem_load(&index->mem, MEM_NODES);
+    mem->map_buckets = mem_load(&index->mem, MEM_MAP_BUCKETS);
+    mem->map_nodes   = mem_load(&index->mem, MEM_MAP_NODES);
+    mem->payloads    = mem_load(&index->mem, MEM_PAYLOADS);
+    mem->tombstones  = mem_load(&index->mem, MEM_TOMBSTONES);
+    mem->overhead    = mem_load(&index->mem, MEM_OVERHEAD);
+    mem->mapped      = mem_load(&index->mem, MEM_MAPPED);
+    for (int l = 0; l < MEM_LEVELS; l++)
+        mem->adjacency[l] = mem_load(&index->mem, MEM_LEVEL(l));
     pthread_rwlock_unlock(&index->rwlock);
-    return ret;
+
+    mem->total = mem->vectors + mem->nodes + mem->map_buckets + mem->map_nodes +
+                 mem->payloads + mem->overhead + mem->mapped;
+    for (int l = 0; l < MEM_LEVELS; l++)
+        mem->total += mem->adjacency[l];
+    return SUCCESS;
 }
 
 /*
- * Dumps the current index state to a file on disk.
+ * Installs the allocator of the nodes and vectors of an index that has
+ * never held any, releasing the one it replaces.
  *
- * This function serializes the internal structure and data of the index,
- * including vectors, metadata, and any algorithm-specific state (e.g., graph links).
- * The resulting file can later be used to restore the index via a corresponding load operation.
+ * @param index - Pointer to the index.
+ * @param alloc - Allocator to copy.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT, READ_ONLY_INDEX or
+ *         INDEX_NOT_EMPTY.
+ */
+int index_allocator(Index *index, const IndexAllocator *alloc) {
+    IndexAllocator old;
+    int ret = SUCCESS;
+
+    if (!index || !index->data)
+        return INVALID_INDEX;
+    if (!alloc || !alloc->alloc || !alloc->free)
+        return INVALID_ARGUMENT;
+    if (INDEX_READ_ONLY(index))
+        return READ_ONLY_INDEX;
+
+    pthread_rwlock_wrlock(&index->rwlock);
+    /* Nodes already allocated, even deleted ones, belong to the current allocator */
+    if (__atomic_load_n(&index->mem.bytes[MEM_NODES], __ATOMIC_RELAXED) != 0 ||
+        __atomic_load_n(&index->mem.bytes[MEM_VECTORS], __ATOMIC_RELAXED) != 0) {
+        ret = INDEX_NOT_EMPTY;
+    } else {
+        old = index->allocator;
+        index->allocator = *alloc;
+        index->mem.alloc = &index->allocator;
+        if (old.release)
+            old.release(old.ctx);
+    }
+    pthread_rwlock_unlock(&index->rwlock);
+    return ret;
+}
+
+static void *index_arena_alloc(void *ctx, size_t size, size_t alignment) {
+    return arena_alloc((Arena *) ctx, size, alignment);
+}
+
+static void index_arena_free(void *ctx, void *ptr, size_t size) {
+    arena_free((Arena *) ctx, ptr, size);
+}
+
+static void index_arena_release(void *ctx) {
+    arena_destroy((Arena *) ctx);
+    free_mem(ctx);
+}
+
+/*
+ * Installs a built-in arena (arena.h) as the allocator of an index; the
+ * arena is destroyed with the index.
+ *
+ * @param index - Pointer to the index.
+ * @param chunk - Chunk size, 0 for ARENA_CHUNK.
+ * @param flags - ARENA_* flags.
+ *
+ * @return SUCCESS, INVALID_INDEX, SYSTEM_ERROR, READ_ONLY_INDEX or
+ *         INDEX_NOT_EMPTY.
+ */
+int index_arena(Index *index, size_t chunk, int flags) {
+    IndexAllocator alloc;
+    Arena *arena;
+    int ret;
+
+    if (!index || !index->data)
+        return INVALID_INDEX;
+    if ((arena = calloc_mem(1, sizeof(Arena))) == NULL)
+        return SYSTEM_ERROR;
+    arena_init(arena, chunk, flags);
+
+    alloc.alloc   = index_arena_alloc;
+    alloc.free    = index_arena_free;
+    alloc.release = index_arena_release;
+    alloc.ctx     = arena;
+    if ((ret = index_allocator(index, &alloc)) != SUCCESS)
+        index_arena_release(arena);
+    return ret;
+}
+
+/*
+ * Returns the number of elements currently stored in the index.
+ *
+ * This function provides the total number of unique vectors inserted
+ * and currently active in the index. It does not include deleted or
+ * invalidated entries.
+ *
+ * Steps:
+ * 1. Validates the index pointer.
+ * 2. Acquires a read lock to safely access the internal map structure.
+ * 3. Retrieves the current element count from the map and stores it in `*sz`.
+ * 4. Releases the lock.
+ *
+ * @param index - Pointer to the index whose size will be retrieved.
+ * @param sz    - Pointer to a uint64_t variable where the size will be stored.
+ *
+ * @return SUCCESS on success, INVALID_INDEX if the index is NULL.
+ */
+int size(Index *index, uint64_t *sz) {
+    if (!index)
+        return INVALID_INDEX;
+    pthread_rwlock_rdlock(&index->rwlock);
+    *sz = index_count(index);
+    pthread_rwlock_unlock(&index->rwlock);
+    return SUCCESS;
+}
+
+/*
+ * Checks whether a vector with the given ID exists in the index.
+ *
+ * This function determines if a vector with the specified ID is
+ * currently present in the index. It uses the internal ID map to
+ * perform the lookup efficiently.
+ *
+ * Steps:
+ * 1. Validates the index pointer.
+ * 2. Acquires a read lock to ensure thread-safe access.
+ * 3. Uses the internal map to check for the presence of the ID.
+ * 4. Releases the lock and returns the result.
+ *
+ * @param index - Pointer to the index.
+ * @param id    - The ID of the vector to check for.
+ *
+ * @return 1 if the ID exists, 0 otherwise. Returns 0 if the index is NULL.
+ */
+
+int contains(Index *index, uint64_t id) {
+    int ret;
+    if (!index)
+        return 0;
+    pthread_rwlock_rdlock(&index->rwlock);
+    ret = index_lookup(index, id) != NULL;
+    pthread_rwlock_unlock(&index->rwlock);
+    return ret;
+}
+
+/*
+ * Pins the index for a lock-free reader. Called with the read lock held.
+ */
+static void index_pin(Index *index) {
+    __atomic_add_fetch(&index->pins, 1, __ATOMIC_ACQ_REL);
+    if (index->pin)
+        index->pin(index->data, 1);
+}
+
+static void index_unpin(Index *index) {
+    pthread_rwlock_wrlock(&index->rwlock);
+    if (index->pin)
+        index->pin(index->data, 0);
+    pthread_rwlock_unlock(&index->rwlock);
+    index_unref(index, &index->pins);
+}
+
+/*
+ * Snapshot - Point-in-time view of the index written without the lock.
+ *
+ * The backend dump/export callback only collects pointers to the live
+ * vectors, so capturing is O(n) pointer copies under the read lock. The
+ * tags are copied as well (set_tag mutates vectors in place), so are the
+ * payloads, and the
+ * backend is pinned so that vectors deleted meanwhile are not freed until
+ * the file has been written.
+ */
+typedef struct {
+    Index *index;
+    IOContext io;
+    Map changes;            // Changes since the previous snapshot
+    uint64_t delta_base;    // Snapshot those changes applied to
+    uint64_t wal_epoch;     // Log the snapshot is consistent with, 0 if none
+    uint64_t wal_lsn;       // Last logged mutation contained in the snapshot
+    double start;
+} Snapshot;
+
+static int snapshot_begin(Index *index, Snapshot *snap) {
+    int ret;
+
+    memset(snap, 0, sizeof(Snapshot));
+    snap->index = index;
+
+    pthread_rwlock_rdlock(&index->rwlock);
+    snap->start = stat_start(index);
+    ret = index->dump(index->data, &snap->io);
+    if (ret == SUCCESS)
+        ret = io_capture_tags(&snap->io);
+    if (ret == SUCCESS)
+        ret = payload_capture(index, &snap->io);
+    if (ret == SUCCESS) {
+        snap->io.snapshot = store_snapshot_id();
+        ret = changes_take(index, snap->io.snapshot, 0, &snap->changes, &snap->delta_base);
+    }
+    if (ret == SUCCESS) {
+        __atomic_add_fetch(&index->pins, 1, __ATOMIC_ACQ_REL);
+        if (index->pin)
+            index->pin(index->data, 1);
+        if (index->wal) {
+            snap->wal_epoch = index->wal_epoch;
+            snap->wal_lsn = wal_lsn(index->wal);
+        }
+    }
+    pthread_rwlock_unlock(&index->rwlock);
+
+    if (ret != SUCCESS)
+        io_free(&snap->io);
+    return ret;
+}
+
+static int snapshot_write(Snapshot *snap, const char *filename) {
+    Index *index = snap->index;
+    int ret;
+
+    ret = store_dump_file(filename, &snap->io);
+
+    /* The file now holds every mutation logged up to wal_lsn; lossy files
+       do not, so the log keeps them */
+    if (ret == SUCCESS && snap->wal_epoch && snap->io.encoding == DUMP_FP32) {
+        pthread_rwlock_rdlock(&index->rwlock);
+        if (index->wal && index->wal_epoch == snap->wal_epoch)
+            ret = wal_checkpoint(index->wal, filename, snap->wal_lsn);
+        pthread_rwlock_unlock(&index->rwlock);
+    }
+    return ret;
+}
+
+static void snapshot_end(Snapshot *snap, int status) {
+    Index *index = snap->index;
+
+    pthread_rwlock_wrlock(&index->rwlock);
+    if (index->pin)
+        index->pin(index->data, 0);
+    if (status == SUCCESS) {
+        stat_record(index, STAT_DUMP, snap->start);
+    } else {
+        changes_restore(index, &snap->changes, snap->delta_base, snap->io.snapshot);
+    }
+    pthread_rwlock_unlock(&index->rwlock);
+    index_unref(index, &index->pins);
+    map_destroy(&snap->changes);
+    io_free(&snap->io);
+}
+
+/*
+ * Dumps the current index state to a file on disk.
+ *
+ * This function serializes the internal structure and data of the index,
+ * including vectors, metadata, and any algorithm-specific state (e.g., graph links).
+ * The resulting file can later be used to restore the index via a corresponding load operation.
+ *
+ * The index is locked only while the snapshot is captured; inserts, deletes
+ * and searches proceed while the file is written, and the file reflects the
+ * state at capture time.
  *
  * @param index - Pointer to the index instance.
  * @param filename - Path to the output file where the index will be saved.
@@ -465,37 +1296,364 @@ int contains(Index *index, uint64_t id) {
  *         or SYSTEM_ERROR on I/O failure.
  */
 int dump(Index *index, const char *filename) {
-    double start, end, delta;
-    IOContext io;
-    
+    Snapshot snap;
     int ret;
+
     if (!index)
         return INVALID_INDEX;
+    if (!filename)
+        return INVALID_ARGUMENT;
     
     if (index->dump == NULL)
         return NOT_IMPLEMENTED;
 
+    if ((ret = snapshot_begin(index, &snap)) != SUCCESS)
+        return ret;
+    ret = snapshot_write(&snap, filename);
+    snapshot_end(&snap, ret);
+    return ret;
+}
+
+/*
+ * Dumps the index with its vectors encoded as fp16 or SQ8.
+ *
+ * Same as dump(), but the vectors section is written in a compact, lossy
+ * encoding that load_index() converts back to fp32. The write-ahead log,
+ * if any, is not checkpointed.
+ *
+ * @param index    - Pointer to the index instance.
+ * @param filename - Path to the output file.
+ * @param encoding - DUMP_FP32, DUMP_FP16 or DUMP_SQ8.
+ *
+ * @return SUCCESS or an error code.
+ */
+int dump_quantized(Index *index, const char *filename, int encoding) {
+    Snapshot snap;
+    int ret;
+
+    if (!index)
+        return INVALID_INDEX;
+    if (!filename || (encoding != DUMP_FP32 && encoding != DUMP_FP16 && encoding != DUMP_SQ8))
+        return INVALID_ARGUMENT;
+
+    if (index->dump == NULL)
+        return NOT_IMPLEMENTED;
+
+    if ((ret = snapshot_begin(index, &snap)) != SUCCESS)
+        return ret;
+    snap.io.encoding = (uint16_t) encoding;
+    ret = snapshot_write(&snap, filename);
+    snapshot_end(&snap, ret);
+    return ret;
+}
+
+typedef struct {
+    Snapshot snap;
+    DumpCallback cb;
+    void *userdata;
+    char filename[];
+} DumpJob;
+
+static void dump_task(void *arg) {
+    DumpJob *job = (DumpJob *) arg;
+    Index *index = job->snap.index;
+    int ret;
+
+    ret = snapshot_write(&job->snap, job->filename);
+    snapshot_end(&job->snap, ret);
+    index_unref(index, &index->async_pending);
+    if (job->cb)
+        job->cb(ret, job->userdata);
+    free_mem(job);
+}
+
+/*
+ * Captures a snapshot of the index and writes it on a library worker.
+ *
+ * The snapshot is taken before the call returns, so the file reflects the
+ * index as of the call. `cb` (optional) is invoked from the worker with the
+ * final status.
+ *
+ * @param index    - Pointer to the index instance.
+ * @param filename - Path to the output file.
+ * @param cb       - Completion callback, or NULL.
+ * @param userdata - Opaque pointer handed to the callback.
+ *
+ * @return SUCCESS if the dump was scheduled, or an error code.
+ */
+int dump_async(Index *index, const char *filename, DumpCallback cb, void *userdata) {
+    DumpJob *job;
+    int ret;
+
+    if (!index)
+        return INVALID_INDEX;
+    if (!filename)
+        return INVALID_ARGUMENT;
+    if (index->dump == NULL)
+        return NOT_IMPLEMENTED;
+
+    if ((job = calloc_mem(1, sizeof(DumpJob) + strlen(filename) + 1)) == NULL)
+        return SYSTEM_ERROR;
+    strcpy(job->filename, filename);
+    job->cb = cb;
+    job->userdata = userdata;
+
+    if ((ret = snapshot_begin(index, &job->snap)) != SUCCESS) {
+        free_mem(job);
+        return ret;
+    }
+
+    __atomic_add_fetch(&index->async_pending, 1, __ATOMIC_ACQ_REL);
+    if ((ret = pool_submit(dump_task, job)) != SUCCESS) {
+        index_unref(index, &index->async_pending);
+        snapshot_end(&job->snap, ret);
+        free_mem(job);
+    }
+    return ret;
+}
+
+/*
+ * Builds the delta entries from the taken changes: the current state of
+ * every changed ID is looked up, so an ID inserted and deleted since the
+ * base becomes a single delete. A put drops the payload when applied, so
+ * it is followed by the current payload if there is one. Payloads are
+ * copied into dc->data. Called with the read lock held.
+ */
+static int delta_capture(Index *index, Map *changes, DeltaContext *dc) {
+    MapIter it = MAP_ITER_INIT();
+    MapNode *node;
+    size_t bytes = 0;
+    char *data;
+    uint32_t n = 0;
+
+    while ((node = map_next(changes, &it)) != NULL) {
+        void *ref = map_get_p(&index->map, node->key);
+        Payload *p = ref ? payload_get(index, ref) : NULL;
+        if (p)
+            bytes += p->length;
+    }
+
+    dc->dims = index->dims;
+    if ((dc->entries = calloc_mem(changes->elements > 0 ? 2 * changes->elements : 1, sizeof(DeltaEntry))) == NULL ||
+        (dc->data = calloc_mem(1, bytes > 0 ? bytes : 1)) == NULL)
+        return SYSTEM_ERROR;
+    data = dc->data;
+
+    it = MAP_ITER_INIT();
+    while ((node = map_next(changes, &it)) != NULL) {
+        void *ref = map_get_p(&index->map, node->key);
+        DeltaEntry *e;
+        Payload *p;
+        Vector *v;
+
+        if (ref == NULL) {
+            e = &dc->entries[n++];
+            e->id = node->key;
+            e->type = DELTA_DELETE;
+            continue;
+        }
+        v = index->get_vector(index->data, ref);
+        if (node->value & (DELTA_CHANGED_PUT | DELTA_CHANGED_DEL | DELTA_CHANGED_TAG)) {
+            e = &dc->entries[n++];
+            e->id = node->key;
+            e->tag = v->tag;
+            if (node->value & (DELTA_CHANGED_PUT | DELTA_CHANGED_DEL)) {
+                e->type = DELTA_PUT;
+                e->vector = v->vector;
+            } else {
+                e->type = DELTA_TAG;
+            }
+        }
+
+        p = payload_get(index, ref);
+        if (p || (node->value & DELTA_CHANGED_PAYLOAD)) {
+            e = &dc->entries[n++];
+            e->id = node->key;
+            e->type = DELTA_PAYLOAD;
+            if (p) {
+                memcpy(data, p->data, p->length);
+                e->payload = data;
+                e->plen = p->length;
+                data += p->length;
+            }
+        }
+    }
+    dc->count = n;
+    return SUCCESS;
+}
+
+/*
+ * Writes the changes made since the last dump() or dump_delta() to a
+ * delta file linked to that snapshot.
+ *
+ * Like dump(), the index is only locked while the changes are collected;
+ * the vectors are pinned while the file is written.
+ *
+ * @param index    - Pointer to the index instance.
+ * @param filename - Path to the delta file.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT if there is no snapshot
+ *         to link to (no dump() or load_index() yet), NOT_IMPLEMENTED,
+ *         SYSTEM_ERROR or FILEIO_ERROR.
+ */
+int dump_delta(Index *index, const char *filename) {
+    DeltaContext dc;
+    Map changes = MAP_INIT();
+    uint64_t base = 0;
+    int pinned = 0;
+    int taken = 0;
+    int ret;
+
+    if (!index)
+        return INVALID_INDEX;
+    if (!filename)
+        return INVALID_ARGUMENT;
+    if (index->get_vector == NULL)
+        return NOT_IMPLEMENTED;
+
+    memset(&dc, 0, sizeof(DeltaContext));
+    dc.snapshot = store_snapshot_id();
+
     pthread_rwlock_rdlock(&index->rwlock);
-    start = get_time_ms_monotonic();
-    ret = index->dump(index->data, &io);
-    if (ret == SUCCESS) {
-        ret = store_dump_file(filename, &io);
-        if (ret == SUCCESS) {
-            end = get_time_ms_monotonic();
-            delta = end - start;
-            UPDATE_TIMESTAT(index->stats.dump, delta);
+    if ((ret = changes_take(index, dc.snapshot, 1, &changes, &base)) == SUCCESS) {
+        taken = 1;
+        dc.base = base;
+        if ((ret = delta_capture(index, &changes, &dc)) == SUCCESS) {
+            index_pin(index);
+            pinned = 1;
         }
     }
     pthread_rwlock_unlock(&index->rwlock);
-    io_free(&io);
+
+    if (ret == SUCCESS)
+        ret = store_dump_delta(filename, &dc);
+
+    if (taken) {
+        pthread_rwlock_wrlock(&index->rwlock);
+        if (pinned && index->pin)
+            index->pin(index->data, 0);
+        if (ret != SUCCESS)
+            changes_restore(index, &changes, base, dc.snapshot);
+        pthread_rwlock_unlock(&index->rwlock);
+        if (pinned)
+            index_unref(index, &index->pins);
+        map_destroy(&changes);
+    }
+    delta_free(&dc);
     return ret;
 }
 
+/*
+ * ExportCursor - Position of a batched walk over the index.
+ *
+ * The index stays pinned while the cursor is open, so the walk position
+ * remains valid between batches even if its vector is deleted. The walk
+ * starts from the head of the index when the cursor is opened; vectors
+ * are inserted at the head, so later ones are never reached.
+ */
+struct ExportCursor {
+    Index *index;
+    void *pos;              // Backend walk position
+    int started;
+    int done;
+    uint32_t count;         // Vectors in the index when the cursor was opened
+    Vector **batch;         // Pointers collected by the last walk
+    int cap;
+};
+
+/*
+ * Collects the next `max` vectors into cursor->batch. Called with the
+ * read lock held; the vectors may only be read until it is released.
+ * Returns the number of vectors, or -SYSTEM_ERROR if the batch could
+ * not be allocated.
+ */
+static int cursor_fetch(ExportCursor *c, int max) {
+    int n;
+
+    if (c->done)
+        return 0;
+    if (max > c->cap) {
+        Vector **batch = realloc_mem(c->batch, max * sizeof(Vector *));
+        if (batch == NULL)
+            return -SYSTEM_ERROR;
+        c->batch = batch;
+        c->cap = max;
+    }
+    n = c->index->walk(c->index->data, &c->pos, c->batch, max);
+    c->started = 1;
+    if (c->pos == NULL)
+        c->done = 1;
+    return n;
+}
+
+int export_begin(Index *index, ExportCursor **cursor, uint16_t *dims) {
+    ExportCursor *c;
+
+    if (!index)
+        return INVALID_INDEX;
+    if (!cursor)
+        return INVALID_ARGUMENT;
+    if (index->walk == NULL)
+        return NOT_IMPLEMENTED;
+
+    if ((c = calloc_mem(1, sizeof(ExportCursor))) == NULL)
+        return SYSTEM_ERROR;
+    c->index = index;
+
+    pthread_rwlock_rdlock(&index->rwlock);
+    c->count = (uint32_t) index_count(index);
+    index->walk(index->data, &c->pos, NULL, 0);
+    c->done = c->pos == NULL;
+    index_pin(index);
+    pthread_rwlock_unlock(&index->rwlock);
+
+    if (dims)
+        *dims = index->dims;
+    *cursor = c;
+    return SUCCESS;
+}
+
+int export_next_batch(ExportCursor *cursor, uint64_t *ids, uint64_t *tags, float32_t *vectors, int max) {
+    Index *index;
+    int n;
+
+    if (cursor == NULL || ids == NULL || max <= 0)
+        return -1;
+    index = cursor->index;
+
+    pthread_rwlock_rdlock(&index->rwlock);
+    n = cursor_fetch(cursor, max);
+    for (int i = 0; i < n; i++) {
+        ids[i] = cursor->batch[i]->id;
+        if (tags)
+            tags[i] = cursor->batch[i]->tag;
+        if (vectors)
+            memcpy(vectors + (size_t) i * index->dims, cursor->batch[i]->vector, index->dims * sizeof(float32_t));
+    }
+    pthread_rwlock_unlock(&index->rwlock);
+    return n;
+}
+
+int export_end(ExportCursor **cursor) {
+    if (cursor == NULL || *cursor == NULL)
+        return INVALID_ARGUMENT;
+
+    index_unpin((*cursor)->index);
+    if ((*cursor)->batch)
+        free_mem((*cursor)->batch);
+    free_mem(*cursor);
+    *cursor = NULL;
+    return SUCCESS;
+}
+
 /*
  * Export the current index state to a file on disk.
  *
  * This function serializes vectors.
  * The resulting file can later be used to import vector in the index via a corresponding import operation.
+ * Vectors are copied in batches through an export cursor straight into
+ * the chunk buffer of the output file, so memory use does not grow with
+ * the index and the lock is only held while each batch is copied.
  *
  * @param index - Pointer to the index instance.
  * @param filename - Path to the output file where the index will be saved.
@@ -506,22 +1664,57 @@ int dump(Index *index, const char *filename) {
  *         or SYSTEM_ERROR on I/O failure.
  */
 int export(Index *index, const char *filename) {
-    IOContext io;
-    
+    ExportCursor *c;
+    StoreStream st;
+    Vector *dst;
+    uint32_t room;
+    size_t vsize;
     int ret;
+
     if (!index)
         return INVALID_INDEX;
-    
-    if (index->export == NULL)
-        return NOT_IMPLEMENTED;
+    if (!filename)
+        return INVALID_ARGUMENT;
+    vsize = VECTORSZ(ALIGN_DIMS(index->dims));
 
-    pthread_rwlock_rdlock(&index->rwlock);
-    ret = index->export(index->data, &io);
-    if (ret == SUCCESS)
-        ret = store_dump_file(filename, &io);
-    pthread_rwlock_unlock(&index->rwlock);
-    io_free(&io);
-    return ret;
+    if ((ret = export_begin(index, &c, NULL)) != SUCCESS)
+        return ret;
+    if ((ret = store_stream_open(&st, filename, index->method, index->dims, c->count)) != SUCCESS) {
+        export_end(&c);
+        return ret;
+    }
+
+    for (;;) {
+        int n;
+
+        dst = store_stream_next(&st, &room);
+        if (room == 0)
+            break;
+        if (room > EXPORT_BATCH)
+            room = EXPORT_BATCH;
+
+        pthread_rwlock_rdlock(&index->rwlock);
+        n = cursor_fetch(c, (int) room);
+        for (int i = 0; i < n; i++)
+            memcpy((char *) dst + i * vsize, c->batch[i], vsize);
+        pthread_rwlock_unlock(&index->rwlock);
+
+        if (n < 0) {
+            ret = SYSTEM_ERROR;
+            break;
+        }
+        if (n == 0)
+            break;
+        if ((ret = store_stream_commit(&st, (uint32_t) n)) != SUCCESS)
+            break;
+    }
+
+    export_end(&c);
+    if (ret != SUCCESS) {
+        store_stream_close(&st, 0);
+        return ret;
+    }
+    return store_stream_close(&st, 1);
 }
 
 /*
@@ -546,6 +1739,8 @@ int import(Index *index, const char *filename, int mode) {
 
 	if (!index)
 		return INVALID_INDEX;
+	if (INDEX_READ_ONLY(index))
+		return READ_ONLY_INDEX;
 	if (index->import == NULL)
 		return NOT_IMPLEMENTED;
 
@@ -553,12 +1748,115 @@ int import(Index *index, const char *filename, int mode) {
 		return ret;
 	
 	pthread_rwlock_wrlock(&index->rwlock);
+	/* Imported IDs may replace existing vectors; skipped ones are written
+	   unchanged by the next delta */
+	for (int i = 0; i < (int) io.elements; i++)
+		track_change(index, io.vectors[i]->id, DELTA_CHANGED_PUT);
+	/* The index owns the loaded block before any vector of it can be
+	   deleted; adopted vectors are cleared from io, the rest (skipped
+	   duplicates) are released here */
+	io_adopt_vectors(&io, &index->mem);
 	ret = index->import(index->data, &io, &index->map, mode);
+	io_free_vectors(&io, &index->mem);
 	pthread_rwlock_unlock(&index->rwlock);
 	io_free(&io);
 	return ret;
 }
 
+/*
+ * Attaches a write-ahead log to the index.
+ *
+ * From this point on every successful insert, delete, set_tag and
+ * set_payload is
+ * recorded in the log before the call returns (or, in synchronous mode,
+ * once it is on stable storage).
+ *
+ * @param index    - Pointer to the index.
+ * @param filename - Path of the log file (appended to if it exists).
+ * @param ctx      - Group commit settings, or NULL for defaults.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT if a log is already
+ *         enabled, or the error returned by wal_open().
+ */
+int enable_wal(Index *index, const char *filename, WALContext *ctx) {
+	Wal *wal;
+	int ret;
+
+	if (!index)
+		return INVALID_INDEX;
+	if (!filename)
+		return INVALID_ARGUMENT;
+
+	if ((ret = wal_open(&wal, filename, ctx)) != SUCCESS)
+		return ret;
+
+	pthread_rwlock_wrlock(&index->rwlock);
+	if (index->wal) {
+		ret = INVALID_ARGUMENT;
+	} else {
+		index->wal = wal;
+		index->wal_epoch++;
+		wal = NULL;
+	}
+	pthread_rwlock_unlock(&index->rwlock);
+	wal_close(&wal);
+	return ret;
+}
+
+/*
+ * Detaches and closes the write-ahead log of the index, syncing any
+ * staged record first.
+ */
+int disable_wal(Index *index) {
+	Wal *wal;
+
+	if (!index)
+		return INVALID_INDEX;
+
+	pthread_rwlock_wrlock(&index->rwlock);
+	wal = index->wal;
+	index->wal = NULL;
+	pthread_rwlock_unlock(&index->rwlock);
+	wal_close(&wal);
+	return SUCCESS;
+}
+
+static int replay_record(void *arg, const WalRecordHDR *rec, float32_t *vector) {
+	Index *index = (Index *) arg;
+	int ret;
+
+	switch (rec->type) {
+	case WAL_INSERT:
+		/* The payload, if any, follows the vector */
+		ret = insert_with_payload(index, rec->id, rec->tag, vector, rec->dims,
+		                          vector + rec->dims, rec->length - rec->dims * sizeof(float32_t));
+		return ret == DUPLICATED_ENTRY ? SUCCESS : ret;
+	case WAL_DELETE:
+		ret = delete(index, rec->id);
+		return ret == NOT_FOUND_ID ? SUCCESS : ret;
+	case WAL_SET_TAG:
+		ret = set_tag(index, rec->id, rec->tag);
+		return ret == NOT_FOUND_ID ? SUCCESS : ret;
+	case WAL_SET_PAYLOAD:
+		ret = set_payload(index, rec->id, vector, rec->length);
+		return ret == NOT_FOUND_ID ? SUCCESS : ret;
+	default:
+		return INVALID_FILE;
+	}
+}
+
+/*
+ * Re-applies the operations of a write-ahead log on top of the index
+ * (typically one just restored with load_index()).
+ */
+int replay_wal(Index *index, const char *filename) {
+	if (!index)
+		return INVALID_INDEX;
+	if (!filename || index->wal)
+		return INVALID_ARGUMENT;
+	return wal_replay(filename, replay_record, index, NULL);
+}
+
 /**
  * @brief Generate a set of centroids for K-Means clustering from an existing index.
  *
@@ -579,42 +1877,43 @@ Index *kmeans_centroids(Index *from, int nprobe) {
 	Index *index = NULL;
 	KMContext *context  = NULL;
 	float32_t **dataset = NULL;
+	Vector *batch[EXPORT_BATCH];
 	int dims_aligned;
-	IOContext io;
-	int ret;
+	uint32_t count = 0;
+	void *pos = NULL;
+	int n;
 
 	if (!from || !from->data)
 		return NULL;
-	if (from->export == NULL || from->insert == NULL)
+	if (from->walk == NULL || from->insert == NULL)
 		return NULL;
 
+	/* Collect the vector pointers and pin them: training runs without
+	   the lock, deleted vectors stay valid until the index is unpinned */
 	pthread_rwlock_rdlock(&from->rwlock);
-    ret = from->export(from->data, &io);
-	if (ret != SUCCESS) {
+	if ((int) from->map.elements <= nprobe ||
+	    (dataset = calloc_mem(from->map.elements, sizeof(float32_t *))) == NULL) {
 		pthread_rwlock_unlock(&from->rwlock);
 		return NULL;
 	}
+	do {
+		n = from->walk(from->data, &pos, batch, EXPORT_BATCH);
+		for (int i = 0; i < n; i++)
+			dataset[count++] = batch[i]->vector;
+	} while (pos != NULL);
+	index_pin(from);
+	pthread_rwlock_unlock(&from->rwlock);
 
-	if ((int)io.elements <= nprobe) 
-		goto unlock_error_return;
-
-	dataset = raw_vectors(io.vectors, io.elements);
-	if (!dataset) 
-		goto unlock_error_return;
-
-
-	context = kmeans_create_context(nprobe, dataset, io.elements, io.dims_aligned, 0.001, 100);
+	dims_aligned = ALIGN_DIMS(from->dims);
+	context = kmeans_create_context(nprobe, dataset, count, dims_aligned, 0.001, 100);
 	if (!context)
-		goto unlock_error_return;
+		goto error_return;
 
 	if (kmeans_pp_train(context) != SUCCESS) 
-		goto unlock_error_return;
+		goto error_return;
 
-	dims_aligned = io.dims_aligned;
-	io_free(&io);
+	index_unpin(from);
 	free_mem(dataset);
-	pthread_rwlock_unlock(&from->rwlock);
-	
 
 	index = alloc_index(FLAT_INDEX, L2NORM, dims_aligned, NULL);
 	if (index == NULL) {
@@ -631,14 +1930,108 @@ Index *kmeans_centroids(Index *from, int nprobe) {
 	kmeans_destroy_context(&context);
 	return index;
 
-unlock_error_return:
-	if (dataset) free_mem(dataset);
+error_return:
 	if (context) kmeans_destroy_context(&context);
-	io_free(&io);
-	pthread_rwlock_unlock(&from->rwlock);
+	index_unpin(from);
+	free_mem(dataset);
 	return NULL;
 }
 
+/*
+ * Publishes a read-only image of the index for other processes.
+ *
+ * The vectors, an ID table and (for HNSW) the graph, with element numbers
+ * in place of pointers, are copied into a shared memory object or a file
+ * mapping under `name`. The index is read-locked during the copy.
+ * Publishing again replaces the image; processes attached to the previous
+ * one keep it until they detach.
+ *
+ * @param index - Pointer to the index.
+ * @param name  - "/name" for a POSIX shared memory object, or a file path.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT, NOT_IMPLEMENTED,
+ *         SYSTEM_ERROR or FILEIO_ERROR.
+ */
+int publish_index(Index *index, const char *name) {
+	ShmBuilder b;
+	int ret, fret;
+
+	if (!index || !index->data)
+		return INVALID_INDEX;
+	if (!name)
+		return INVALID_ARGUMENT;
+	if (index->publish == NULL)
+		return NOT_IMPLEMENTED;
+
+	pthread_rwlock_rdlock(&index->rwlock);
+	ret = index->publish(index->data, &b, name);
+	pthread_rwlock_unlock(&index->rwlock);
+
+	fret = shm_builder_finish(&b, ret == SUCCESS);
+	return ret != SUCCESS ? ret : fret;
+}
+
+/*
+ * Attaches to an image published with publish_index().
+ *
+ * The image is mapped read-only and searched in place: nothing is copied
+ * or rebuilt, so attaching costs the same whatever the index size. The
+ * returned index supports searches, contains, size, filter_subset and
+ * exports; mutations return READ_ONLY_INDEX. Release it with
+ * destroy_index().
+ *
+ * @param name - Name the image was published under.
+ *
+ * @return Pointer to the attached index, or NULL on failure.
+ */
+Index *attach_index(const char *name) {
+	ShmImage img;
+	Index *idx;
+	size_t mapped;
+	int method;
+	uint16_t dims;
+
+	if (!name || shm_attach(&img, name) != SUCCESS)
+		return NULL;
+	method = img.hdr->method;
+	dims = img.hdr->dims;
+	mapped = img.size;
+
+	if ((idx = calloc_mem(1, sizeof(Index))) == NULL) {
+		shm_detach(&img);
+		return NULL;
+	}
+	idx->map = MAP_INIT();
+	idx->changes = MAP_INIT();
+	if (shared_index(idx, &img) != SUCCESS) {
+		shm_detach(&img);
+		free_mem(idx);
+		return NULL;
+	}
+
+	pthread_rwlock_init(&idx->rwlock, NULL);
+	pthread_mutex_init(&idx->delta_lock, NULL);
+	pthread_mutex_init(&idx->stats_lock, NULL);
+	pthread_mutex_init(&idx->idle_lock, NULL);
+	pthread_cond_init(&idx->idle, NULL);
+	idx->stats_enabled = 1;
+	mem_track(&idx->mem, MEM_MAPPED, NULL, (int64_t) mapped);
+	idx->method = method;
+	idx->dims = dims;
+	return idx;
+}
+
+/*
+ * Removes a published image. Attached indexes keep working.
+ *
+ * @param name - Name the image was published under.
+ *
+ * @return SUCCESS, INVALID_ARGUMENT or FILEIO_ERROR.
+ */
+int unpublish_index(const char *name) {
+	return shm_unlink_image(name);
+}
+
 /*
  * Destroys and deallocates an index.
  *
@@ -656,18 +2049,38 @@ unlock_error_return:
  * @return SUCCESS on successful deallocation, INVALID_INIT if the index is already NULL or uninitialized.
  */
 int destroy_index(Index **index) {
+    IndexAllocator alloc;
+
     if (!index || !*index)
         return INVALID_INDEX;
     if (!(*index)->data || !(*index)->release) 
         return INVALID_INIT;
 
+    /* Let asynchronous jobs and snapshots still referencing the index finish */
+    pthread_mutex_lock(&(*index)->idle_lock);
+    while (__atomic_load_n(&(*index)->async_pending, __ATOMIC_ACQUIRE) > 0 ||
+           __atomic_load_n(&(*index)->pins, __ATOMIC_ACQUIRE) > 0)
+        pthread_cond_wait(&(*index)->idle, &(*index)->idle_lock);
+    pthread_mutex_unlock(&(*index)->idle_lock);
+
     pthread_rwlock_wrlock(&(*index)->rwlock);
+    wal_close(&(*index)->wal);
     (*index)->release(&(*index)->data);
     map_destroy(&(*index)->map);
+    map_destroy(&(*index)->changes);
     pthread_rwlock_unlock(&(*index)->rwlock);
     pthread_rwlock_destroy(&(*index)->rwlock); 
+    pthread_mutex_destroy(&(*index)->delta_lock);
+    pthread_mutex_destroy(&(*index)->stats_lock);
+    pthread_mutex_destroy(&(*index)->idle_lock);
+    pthread_cond_destroy(&(*index)->idle);
+    for (int i = 0; i < STAT_SHARDS; i++)
+        free_mem((*index)->shards[i]);
+    alloc = (*index)->allocator;
     free_mem(*index);
     *index = NULL;
+    if (alloc.release)
+        alloc.release(alloc.ctx);
     return SUCCESS;
 }
 
@@ -719,15 +2132,25 @@ Index *alloc_index(int type, int method, uint16_t dims, void *icontext) {
 
     if (ret != SUCCESS || (init_map(&idx->map, 100000, 15) != SUCCESS))
         goto error_return;
+    if (init_map(&idx->changes, CHANGES_MAP_SIZE, 15) != SUCCESS)
+        goto error_return;
+    map_account(&idx->map, &idx->mem);
 
     pthread_rwlock_init(&idx->rwlock, NULL);
+    pthread_mutex_init(&idx->delta_lock, NULL);
+    pthread_mutex_init(&idx->stats_lock, NULL);
+    pthread_mutex_init(&idx->idle_lock, NULL);
+    pthread_cond_init(&idx->idle, NULL);
+    idx->stats_enabled = 1;
 	idx->method = method;
+	idx->dims = dims;
     return idx;
 
 error_return:
     if (idx && idx->data != NULL)
         idx->release(&(idx->data));
     map_destroy(&idx->map);
+    map_destroy(&idx->changes);
     free_mem(idx);
     return NULL;
 }
@@ -761,6 +2184,7 @@ Index *load_index(const char *filename) {
         return NULL;
     }
 
+    io_adopt_vectors(&io, &idx->mem);
     switch (io.itype) {
         case FLAT_INDEX:
             ret = flat_index_load(idx, &io);
@@ -772,25 +2196,102 @@ Index *load_index(const char *filename) {
     if (ret != SUCCESS)
         goto error_return;
     
-    if (init_map(&idx->map, io.elements/10, 15) != SUCCESS) {
+    if (init_map(&idx->map, io.elements/10 + 1, 15) != SUCCESS ||
+        init_map(&idx->changes, CHANGES_MAP_SIZE, 15) != SUCCESS) {
         idx->release(&(idx->data));
-        goto error_return;
+        goto release_return;
     }
+    map_account(&idx->map, &idx->mem);
 
-    if (idx->remap(idx->data, &idx->map) != SUCCESS) {
+    if (idx->remap(idx->data, &idx->map) != SUCCESS ||
+        payload_restore(idx, &io) != SUCCESS) {
         idx->release(&(idx->data));
-        goto error_return;
+        goto release_return;
     }
 
     pthread_rwlock_init(&idx->rwlock, NULL);
+    pthread_mutex_init(&idx->delta_lock, NULL);
+    pthread_mutex_init(&idx->stats_lock, NULL);
+    pthread_mutex_init(&idx->idle_lock, NULL);
+    pthread_cond_init(&idx->idle, NULL);
+    idx->stats_enabled = 1;
 	idx->method = io.method;
+	idx->dims = io.dims;
+	idx->delta_base = io.snapshot;
 	io_free(&io);
     return idx;
 
 error_return:
+    io_free_vectors(&io, &idx->mem);
+release_return:
+    /* Once loaded, the vectors belong to the index and were freed by release */
     map_destroy(&idx->map);
+    map_destroy(&idx->changes);
     free_mem(idx);
-    io_free_vectors(&io);
     io_free(&io);
     return NULL;
-}
\ No newline at end of file
+}
+
+/*
+ * Applies the entries of a delta through the public mutation functions.
+ */
+static int apply_delta(Index *index, DeltaContext *dc) {
+    int ret = SUCCESS;
+
+    for (uint32_t i = 0; i < dc->count && ret == SUCCESS; i++) {
+        DeltaEntry *e = &dc->entries[i];
+
+        switch (e->type) {
+        case DELTA_PUT:
+            if (contains(index, e->id))
+                ret = delete(index, e->id);
+            if (ret == SUCCESS)
+                ret = insert(index, e->id, e->tag, e->vector, dc->dims);
+            break;
+        case DELTA_DELETE:
+            if ((ret = delete(index, e->id)) == NOT_FOUND_ID)
+                ret = SUCCESS;
+            break;
+        case DELTA_TAG:
+            ret = set_tag(index, e->id, e->tag);
+            break;
+        case DELTA_PAYLOAD:
+            ret = set_payload(index, e->id, e->payload, e->plen);
+            break;
+        }
+    }
+    return ret;
+}
+
+Index *load_index_chain(const char *filename, const char **deltas, int ndeltas) {
+    DeltaContext dc;
+    Index *idx;
+    int ret;
+
+    if (ndeltas < 0 || (ndeltas > 0 && deltas == NULL))
+        return NULL;
+    if ((idx = load_index(filename)) == NULL)
+        return NULL;
+
+    for (int i = 0; i < ndeltas; i++) {
+        if (store_load_delta(deltas[i], &dc) != SUCCESS)
+            goto error_return;
+        if (idx->delta_base == 0 || dc.base != idx->delta_base || dc.dims != idx->dims) {
+            delta_free(&dc);
+            goto error_return;
+        }
+        ret = apply_delta(idx, &dc);
+        idx->delta_base = dc.snapshot;
+        delta_free(&dc);
+        if (ret != SUCCESS)
+            goto error_return;
+    }
+
+    /* The loaded state is the last snapshot of the chain */
+    map_purge(&idx->changes);
+    return idx;
+
+error_return:
+    destroy_index(&idx);
+    return NULL;
+}
@@ -33,6 +33,9 @@
 #include "victor.h"
 #include "store.h"
 #include "map.h"
+#include "wal.h"
+#include "shm.h"
+#include "histogram.h"
 #include "version.h"
 
 
@@ -62,6 +65,27 @@
     #define ARCH "Unknown Arch"
 #endif
 
+/* Kinds of change tracked per ID for delta dumps */
+#define DELTA_CHANGED_PUT  0x01   // Inserted
+#define DELTA_CHANGED_DEL  0x02   // Deleted
+#define DELTA_CHANGED_TAG  0x04   // Tag updated
+#define DELTA_CHANGED_PAYLOAD 0x08 // Payload set or cleared
+
+/* Statistics shards; threads are spread over them round-robin */
+#define STAT_SHARDS 16
+
+/**
+ * Timing statistics recorded by the threads of one shard. Each thread
+ * only ever writes to its own shard, so concurrent searches do not share
+ * a cache line; readers add the shards up.
+ */
+typedef struct {
+    int lock;                     // Held while recording or reading (atomic)
+    TimeStat time[STAT_OPS];      // Indexed by STAT_*
+    double at[STAT_OPS];          // When `time[op].last` was recorded
+    Histogram latency[STAT_OPS];  // Latency of each STAT_* operation
+} StatShard;
+
 /**
  * Structure representing an abstract index for vector search.
  * It supports multiple indexing strategies through function pointers.
@@ -70,12 +94,31 @@ typedef struct Index {
     char *name;        // Name of the indexing method (e.g., "Flat", "HNSW")
     void *data;        // Pointer to the specific index data structure
 	int  method;
-    IndexStats stats;  // Accumulated timing statistics for operations
+    uint16_t dims;     // Vector dimensions
+    StatShard *shards[STAT_SHARDS];// Timing statistics, allocated on first use (atomic)
+    int stats_enabled;             // Whether operations are timed (atomic)
+    Histogram intervals[STAT_OPS]; // Copies taken by the last stats_interval()
+    pthread_mutex_t stats_lock;    // Serializes stats_interval() and stats_reset()
 
     Map map;           // ID-to-node hash map used by all index types
+    MemAccount mem;    // Bytes held by the index per MEM_* category
+    IndexAllocator allocator; // Allocator of nodes and vectors once `mem.alloc` points to it
 
     pthread_rwlock_t rwlock; // Read-write lock for thread-safe access
 
+    int async_pending; // Asynchronous searches queued or running (atomic)
+    int pins;          // Snapshots being written without the lock (atomic)
+    pthread_mutex_t idle_lock; // Guards the last release of `async_pending` and `pins`
+    pthread_cond_t idle;       // Signaled when either drops to zero
+
+    Wal *wal;          // Write-ahead log, NULL when disabled
+    uint64_t wal_epoch;// Bumped every time a log is enabled
+
+    pthread_mutex_t delta_lock; // Serializes snapshots taking over `changes`
+    Map changes;       // ID -> DELTA_CHANGED_* flags since `delta_base`
+    uint64_t delta_base;// Snapshot the changes apply to, 0 if untracked
+    int delta_lost;    // Tracking failed; a full dump is required
+
     /**
      * Searches for the `n` closest matches to the given vector with filtering.
      * 
@@ -89,9 +132,12 @@ typedef struct Index {
      * @param dims The number of dimensions in the input vector.
      * @param results Output array to store the filtered closest matches.
      * @param n The maximum number of matches to retrieve.
+     * @param trace Work counters to fill, or NULL.
+     * @param payloads Output array receiving the payload of each match found;
+     *                 other entries are left untouched. NULL if not needed.
      * @return The number of matches found (0 to n), or negative error code on failure.
      */
-	int (*search) (void*, uint64_t, float32_t *, uint16_t, MatchResult *, int);
+	int (*search) (void*, uint64_t, float32_t *, uint16_t, MatchResult *, int, SearchTrace *, Payload **);
 
     /**
      * Inserts a new vector into the index.
@@ -159,18 +205,22 @@ typedef struct Index {
     int (*dump)(void *data, IOContext *io);
 
     /**
-     * Exports the index data in a portable format.
-     * 
-     * This function creates an export of the index that can be transferred
-     * between different systems or used for backup purposes. Unlike dump(),
-     * which creates a native binary format, export() typically creates a
-     * more portable representation that may be platform-independent.
-     * 
-     * @param data The specific index data structure to export.
-     * @param io IOContext for writing the exported data.
-     * @return SUCCESS on successful export, or error code on failure.
+     * Walks the stored vectors in batches.
+     *
+     * Collects up to `max` live vectors starting at the position `*pos`
+     * (NULL for the first one) and stores in `*pos` the position to resume
+     * from, or NULL once the walk is over. Called under the read lock; the
+     * position stays valid across calls as long as the index is pinned,
+     * even if the vector it refers to is deleted meanwhile. Vectors
+     * inserted after the walk started are not returned.
+     *
+     * @param data The specific index data structure.
+     * @param pos  In/out walk position.
+     * @param out  Output array of vector pointers.
+     * @param max  Capacity of `out`.
+     * @return Number of vectors stored in `out`.
      */
-	int (*export)(void *data, IOContext *io);
+	int (*walk)(void *data, void **pos, Vector **out, int max);
 
     /**
      * Imports index data from a previously exported format.
@@ -187,6 +237,73 @@ typedef struct Index {
      */
 	int (*import)(void *data, IOContext *io, Map *map, int mode);
 
+    /**
+     * Returns the vector stored in a node.
+     *
+     * @param data The specific index data structure.
+     * @param ref  Node reference, as stored in the ID map.
+     * @return Pointer to the vector.
+     */
+    Vector *(*get_vector)(void *data, const void *ref);
+
+    /**
+     * Returns the payload slot of a node. The node owns the payload and
+     * releases it when the vector is deleted. May be NULL if the index
+     * type does not keep payloads (attached images).
+     *
+     * @param data The specific index data structure.
+     * @param ref  Node reference, as stored in the ID map.
+     * @return Pointer to the node's payload pointer.
+     */
+    Payload **(*payload)(void *data, const void *ref);
+
+    /**
+     * Copies the index into a shared image (see shm.h).
+     *
+     * Initializes the builder with shm_builder_init() and fills it; the
+     * caller completes the publication. Called under the read lock. May be
+     * NULL if the index type cannot be published.
+     *
+     * @param data The specific index data structure.
+     * @param b    Builder to initialize and fill.
+     * @param name Name the image is published under.
+     * @return SUCCESS or an error code.
+     */
+    int (*publish)(void *data, ShmBuilder *b, const char *name);
+
+    /**
+     * Looks up a node by ID, for indexes that do not keep the ID map
+     * (attached images). NULL for regular indexes.
+     *
+     * @param data The specific index data structure.
+     * @param id   Vector ID.
+     * @return Node reference, or NULL if the ID is not present.
+     */
+    void *(*lookup)(void *data, uint64_t id);
+
+    /**
+     * Number of vectors, for indexes that do not keep the ID map. NULL
+     * for regular indexes.
+     */
+    uint64_t (*count)(void *data);
+
+    /**
+     * Pins or unpins the memory referenced by a snapshot.
+     *
+     * A snapshot captured with dump(), and an export cursor, keep pointers
+     * to the live vectors while the index lock is not held. While
+     * pinned, the backend must not free vectors removed from the index;
+     * it retires them instead and frees them when the last pin is dropped.
+     * A retired entry must still lead a walk() to the entries that
+     * followed it. Pinning is done under the read lock (concurrent pins are possible),
+     * unpinning under the write lock. May be NULL if deleted vectors are
+     * never freed before release().
+     *
+     * @param data The specific index data structure.
+     * @param pin  1 to pin, 0 to unpin.
+     */
+    void (*pin)(void *data, int pin);
+
     /**
      * Releases internal resources allocated by the index (if any).
      * @param ref Double pointer to the data/context to release.
@@ -196,4 +313,16 @@ typedef struct Index {
 
 } Index;
 
+/*
+ * Drops a reference counted in `async_pending` or `pins`. The count is
+ * lowered under `idle_lock` so that destroy_index(), which waits on
+ * `idle`, cannot free the index before this function is done with it.
+ */
+static inline void index_unref(Index *index, int *count) {
+    pthread_mutex_lock(&index->idle_lock);
+    if (__atomic_sub_fetch(count, 1, __ATOMIC_ACQ_REL) == 0)
+        pthread_cond_broadcast(&index->idle);
+    pthread_mutex_unlock(&index->idle_lock);
+}
+
 #endif
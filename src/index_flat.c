@@ -58,6 +58,11 @@ typedef struct {
     uint64_t elements;       // Number of elements stored in the index
     uint16_t dims;           // Number of dimensions for each vector
     uint16_t dims_aligned;   // Aligned dimensions for efficient memory access
+
+    int pinned;              // Snapshots referencing the vectors (atomic)
+    INodeFlat *retired;      // Nodes deleted while pinned, freed on unpin
+
+    MemAccount *mem;         // Account charged with nodes and vectors, or NULL
 } IndexFlat;
 
 
@@ -102,14 +107,54 @@ static IndexFlat *flat_init(int method, uint16_t dims) {
 static int flat_delete(void *index, void *ref) {
     IndexFlat *ptr  = (IndexFlat *)index;
     INodeFlat *node = (INodeFlat *)ref;
-    int ret;
-
-    if ((ret = delete_node(&(ptr->head),node)) == SUCCESS) {
+    int ret = SUCCESS;
+
+    if (__atomic_load_n(&ptr->pinned, __ATOMIC_ACQUIRE) > 0) {
+        /* A snapshot may still be writing this vector, or an export cursor
+           may resume from it: keep the forward link and chain the retired
+           nodes through prev */
+        INodeFlat *next = node->next;
+        unlink_node(&(ptr->head), node);
+        node->next = next;
+        node->prev = ptr->retired;
+        ptr->retired = node;
+        free_payload_acct(ptr->mem, &node->payload);
+        ptr->elements--;
+    } else if ((ret = delete_node(&(ptr->head), node, ptr->dims_aligned, ptr->mem)) == SUCCESS) {
         ptr->elements--;
     }
     return ret;
 }
 
+/**
+ * @brief Frees the nodes retired while a snapshot was pinned.
+ */
+static void flat_reclaim(IndexFlat *idx) {
+    INodeFlat *node;
+
+    while ((node = idx->retired) != NULL) {
+        idx->retired = node->prev;
+        free_inodeflat(node, idx->dims_aligned, idx->mem);
+    }
+}
+
+/**
+ * @brief Pins (pin = 1) or unpins (pin = 0) the vectors of the flat index.
+ *
+ * @param index Pointer to the flat index.
+ * @param pin   1 to pin, 0 to unpin.
+ */
+static void flat_pin(void *index, int pin) {
+    IndexFlat *idx = (IndexFlat *)index;
+
+    if (pin) {
+        __atomic_add_fetch(&idx->pinned, 1, __ATOMIC_ACQ_REL);
+        return;
+    }
+    if (__atomic_sub_fetch(&idx->pinned, 1, __ATOMIC_ACQ_REL) == 0)
+        flat_reclaim(idx);
+}
+
 
 /**
  * @brief Searches for the top-N closest vectors in the flat index with optional tag filtering.
@@ -121,9 +166,12 @@ static int flat_delete(void *index, void *ref) {
  * @param dims   Number of dimensions of the query vector.
  * @param result Output array of MatchResult to store the best matches.
  * @param n      Number of top matches to return.
+ * @param trace  Work counters to fill, or NULL.
+ * @param payloads Receives the payload of each match, or NULL.
  * @return SUCCESS if matches are found, or an error code.
  */
-static int flat_search(void *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *result, int n) {
+static int flat_search(void *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *result, int n,
+                       SearchTrace *trace, Payload **payloads) {
     IndexFlat *idx = (IndexFlat *)index;
     INodeFlat *current;
     float32_t *v;
@@ -145,7 +193,7 @@ static int flat_search(void *index, uint64_t tag, float32_t *vector, uint16_t di
     if (current == NULL) {
         ret = INDEX_EMPTY;
     } else {
-        ret = flat_linear_search(current, tag, v, idx->dims_aligned, result, n, idx->cmp);
+        ret = flat_linear_search(current, tag, v, idx->dims_aligned, result, n, idx->cmp, trace, payloads);
     }
 
     free_aligned_mem(v);
@@ -170,7 +218,7 @@ static int flat_insert(void *index, uint64_t id, uint64_t tag, float32_t *vector
     if (dims != ptr->dims) 
         return INVALID_DIMENSIONS;
 
-    if ((node = make_inodeflat(id, tag, vector, dims)) == NULL)
+    if ((node = make_inodeflat(id, tag, vector, dims, ptr->mem)) == NULL)
         return SYSTEM_ERROR;
 
     insert_node(&(ptr->head), node);
@@ -269,10 +317,10 @@ static int flat_release(void **index) {
     while (ptr) {
         idx->head = ptr->next;
         idx->elements--;
-        free_vector(&ptr->vector);
-        free_mem(ptr);
+        free_inodeflat(ptr, idx->dims_aligned, idx->mem);
         ptr = idx->head;
     }
+    flat_reclaim(idx);
 
     free_mem(idx);  
     *index = NULL;
@@ -308,7 +356,7 @@ static int flat_dump(void *index, IOContext *io) {
     return SUCCESS;
 }
 
-static IndexFlat *flat_load(IOContext *io) {
+static IndexFlat *flat_load(IOContext *io, MemAccount *mem) {
     IndexFlat *index;
     INodeFlat *entry = NULL;
 
@@ -319,17 +367,22 @@ static IndexFlat *flat_load(IOContext *io) {
 
     index->dims = io->dims;
     index->dims_aligned = io->dims_aligned;
+    index->mem = mem;
     
     index->cmp = get_method(io->method);
 
     for (int i = 0; i < (int) io->elements; i++) {
-        entry = calloc_mem(1, sizeof(INodeFlat));
+        entry = alloc_object(mem, MEM_NODES, sizeof(INodeFlat), 0);
         if (entry == NULL)
             goto error_return;
         
         entry->vector = io->vectors[i];
+        entry->payload = NULL;
         insert_node(&index->head, entry);        
     }
+    for (int i = 0; i < (int) io->elements; i++)
+        io->vectors[i] = NULL;
+    mem_track(mem, MEM_VECTORS, NULL, (int64_t) io->elements * VECTORSZ(io->dims_aligned));
     index->elements = io->elements;
     return index;
 
@@ -337,7 +390,7 @@ error_return:
     entry = index->head;
     while (entry) {
         index->head = entry->next;
-        free_mem(entry);
+        free_object(mem, MEM_NODES, entry, sizeof(INodeFlat), 0);
         entry = index->head;    
     }
     free_mem(index);
@@ -366,7 +419,7 @@ static int flat_import(void *idx, IOContext *io, Map *map, int mode) {
 			
 			case IMPORT_OVERWITE:
 				PANIC_IF(map_get_safe_p(map, io->vectors[i]->id, (void **)&node) != MAP_SUCCESS, "failed to get existing node");
-                PANIC_IF(map_remove_p(map, io->vectors[i]->id) != MAP_SUCCESS, "failed to remove duplicate ID from map");
+                PANIC_IF(map_remove_p(map, io->vectors[i]->id) == NULL, "failed to remove duplicate ID from map");
                 PANIC_IF(flat_delete(index, node) != SUCCESS, "failed to delete existing node");
 				node = NULL;
 				break;
@@ -380,18 +433,71 @@ static int flat_import(void *idx, IOContext *io, Map *map, int mode) {
 			}
 
 		}
-        node = calloc_mem(1, sizeof(INodeFlat));
+        node = alloc_object(index->mem, MEM_NODES, sizeof(INodeFlat), 0);
         if (node == NULL)
             return SYSTEM_ERROR;
         node->vector = io->vectors[i];
+        node->payload = NULL;
+        io->vectors[i] = NULL;
+        mem_track(index->mem, MEM_VECTORS, NULL, VECTORSZ(index->dims_aligned));
         insert_node(&index->head, node);
+        index->elements++;
 		if (map_insert_p(map, node->vector->id, node) != MAP_SUCCESS)
             return SYSTEM_ERROR;
     }
     return SUCCESS;
 }
 
-__DEFINE_EXPORT_FN(flat_export, IndexFlat, INodeFlat)
+static Vector *flat_get_vector(void *index, const void *ref) {
+    (void) index;
+    return ((const INodeFlat *) ref)->vector;
+}
+
+static Payload **flat_payload(void *index, const void *ref) {
+    (void) index;
+    return &((INodeFlat *) ref)->payload;
+}
+
+/**
+ * @brief Collects up to `max` vectors following the list from `*pos`.
+ *
+ * @param index Pointer to the flat index.
+ * @param pos   Node to resume from (NULL to start at the head); updated.
+ * @param out   Output array of vector pointers.
+ * @param max   Capacity of `out`.
+ * @return Number of vectors collected.
+ */
+static int flat_walk(void *index, void **pos, Vector **out, int max) {
+    IndexFlat *idx = index;
+    INodeFlat *entry = *pos ? (INodeFlat *) *pos : idx->head;
+    int n = 0;
+
+    for (; entry && n < max; entry = entry->next)
+        out[n++] = entry->vector;
+    *pos = entry;
+    return n;
+}
+
+/**
+ * @brief Copies the vectors into a shared image.
+ *
+ * @param index Pointer to the flat index.
+ * @param b     Builder to initialize and fill.
+ * @param name  Name the image is published under.
+ * @return SUCCESS or an error from shm_builder_init().
+ */
+static int flat_publish(void *index, ShmBuilder *b, const char *name) {
+    IndexFlat *idx = index;
+    INodeFlat *entry;
+    int ret;
+
+    if ((ret = shm_builder_init(b, name, FLAT_INDEX, idx->cmp->type, idx->dims,
+                                idx->elements, idx->elements, 0)) != SUCCESS)
+        return ret;
+    for (entry = idx->head; entry; entry = entry->next)
+        shm_builder_add(b, entry->vector, 1);
+    return SUCCESS;
+}
 
 /*-------------------------------------------------------------------------------------*
  *                                PUBLIC FUNCTIONS                                     *
@@ -412,8 +518,12 @@ __DEFINE_EXPORT_FN(flat_export, IndexFlat, INodeFlat)
     idx->search   = flat_search;
     idx->insert   = flat_insert;
     idx->dump     = flat_dump;
-	idx->export   = flat_export;
+	idx->walk     = flat_walk;
+	idx->get_vector = flat_get_vector;
+	idx->payload  = flat_payload;
+	idx->publish  = flat_publish;
 	idx->import   = flat_import;
+	idx->pin      = flat_pin;
 	idx->set_tag  = flat_set_tag;
 	idx->compare  = flat_compare;
     idx->remap    = flat_remap;
@@ -426,6 +536,7 @@ int flat_index(Index *idx, int method, uint16_t dims) {
     idx->data = flat_init(method, dims);
     if (idx->data == NULL) 
         return SYSTEM_ERROR;
+    ((IndexFlat *) idx->data)->mem = &idx->mem;
     idx->name     = "flat";
     flat_functions(idx);
 
@@ -433,7 +544,7 @@ int flat_index(Index *idx, int method, uint16_t dims) {
 }
 
 int flat_index_load(Index *idx, IOContext *io) {
-    idx->data = flat_load(io);
+    idx->data = flat_load(io, &idx->mem);
     if (idx->data == NULL)
         return SYSTEM_ERROR;
     idx->name     = "flat";
@@ -45,9 +45,12 @@ static void init_random_seed() {
  * @param dims   Number of dimensions of the query vector.
  * @param result Output array of MatchResult to store the best matches.
  * @param n      Number of top matches to return.
+ * @param trace  Work counters to fill, or NULL.
+ * @param payloads Receives the payload of each match, or NULL.
  * @return SUCCESS if matches are found, or an error code.
  */
-static int hnsw_search(void *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *result, int n) {
+static int hnsw_search(void *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *result, int n,
+                       SearchTrace *trace, Payload **payloads) {
     IndexHNSW *idx = (IndexHNSW *)index;
     Heap R = HEAP_INIT();
     HeapNode r;
@@ -59,18 +62,27 @@ static int hnsw_search(void *index, uint64_t tag, float32_t *vector, uint16_t di
 	if (tag == 0) {
 		if (init_heap(&R, HEAP_BETTER_TOP, n, idx->cmp->is_better_match)!= HEAP_SUCCESS)
 			return SYSTEM_ERROR;
-		ret = graph_knn_search(idx, vector, &R, n);
-		if (ret == SUCCESS) 
-			for (int i = 0; i < n && heap_size(&R) > 0; i++) {
+		ret = graph_knn_search(idx, vector, &R, n, trace);
+		if (ret == SUCCESS) {
+			int i;
+			for (i = 0; i < n && heap_size(&R) > 0; i++) {
 				PANIC_IF(heap_pop(&R, &r) != HEAP_SUCCESS, "error in heap");
 				result[i].distance = r.distance;
 				result[i].id = ((GraphNode* )HEAP_NODE_PTR(r))->vector->id; 
+				if (payloads)
+					payloads[i] = ((GraphNode* )HEAP_NODE_PTR(r))->payload;
 			}
+			/* Rows without a match get the empty values */
+			for (; i < n; i++) {
+				result[i].distance = idx->cmp->worst_match_value;
+				result[i].id = NULL_ID;
+			}
+		}
 
 		heap_destroy(&R);
 		return ret;
 	}
-	return graph_linear_search(idx, tag, vector, result, n);
+	return graph_linear_search(idx, tag, vector, result, n, trace, payloads);
 }
 
 /**
@@ -91,12 +103,12 @@ static int hnsw_insert(void *index, uint64_t id, uint64_t tag, float32_t *vector
     if (dims != idx->dims)
         return INVALID_DIMENSIONS;
     
-    node = alloc_graph_node(id, tag, vector, idx->dims_aligned, idx->M0);
+    node = alloc_graph_node(idx, id, tag, vector);
     if (node == NULL)
         return SYSTEM_ERROR;
 
     if (graph_insert(idx, node) != SUCCESS) {
-        free_graph_node(&node);
+        free_graph_node(idx, &node);
         return SYSTEM_ERROR;
     }
 
@@ -113,8 +125,12 @@ static int hnsw_insert(void *index, uint64_t id, uint64_t tag, float32_t *vector
  */
 static int hnsw_delete(void *index, void *ref) {
     if (!index) return INVALID_INDEX;
+    IndexHNSW *idx = (IndexHNSW *) index;
     GraphNode *ptr = (GraphNode *) ref;	
+    if (ptr->alive)
+        mem_track(idx->mem, MEM_TOMBSTONES, NULL, graph_node_size(idx, ptr));
     ptr->alive = 0;
+    free_payload_acct(idx->mem, &ptr->payload);
     return SUCCESS;
 }
 
@@ -154,13 +170,14 @@ static int hnsw_import(void *index, IOContext *io, Map *map, int mode) {
 			}
 
 		}
-		node = alloc_graph_node(NULL_ID, 0, NULL, 0, idx->M0);
+		node = alloc_graph_node(idx, NULL_ID, 0, NULL);
 		if (node == NULL)
 			return SYSTEM_ERROR;
 		
-		node->vector = io->vectors[i];
+		graph_node_adopt(idx, node, io->vectors[i]);
+		io->vectors[i] = NULL;
 		if (graph_insert(idx, node) != SUCCESS) {
-			free_graph_node(&node);
+			free_graph_node(idx, &node);
 			return SYSTEM_ERROR;
 		}
 		if (map_insert_p(map, node->vector->id, node) != MAP_SUCCESS)
@@ -185,7 +202,7 @@ static int hnsw_release(void **index) {
     while (ptr) {
         idx->head = ptr->next;
         idx->elements--;
-        free_graph_node(&ptr);
+        free_graph_node(idx, &ptr);
         ptr = idx->head;
     }
 
@@ -327,14 +344,144 @@ static int hnsw_compare(void *index, const void *node, float32_t *vector, uint16
 	return ret;
 }
 
-__DEFINE_EXPORT_FN(hnsw_export, IndexHNSW, GraphNode)
+static Vector *hnsw_get_vector(void *index, const void *ref) {
+	(void) index;
+	return ((const GraphNode *) ref)->vector;
+}
+
+static Payload **hnsw_payload(void *index, const void *ref) {
+	(void) index;
+	return &((GraphNode *) ref)->payload;
+}
+
+/**
+ * @brief Collects up to `max` live vectors following the node list from `*pos`.
+ *
+ * Nodes are never freed before release, so any position stays valid.
+ *
+ * @param index Pointer to the HNSW index.
+ * @param pos   Node to resume from (NULL to start at the head); updated.
+ * @param out   Output array of vector pointers.
+ * @param max   Capacity of `out`.
+ * @return Number of vectors collected.
+ */
+static int hnsw_walk(void *index, void **pos, Vector **out, int max) {
+	IndexHNSW *idx = (IndexHNSW *)index;
+	GraphNode *ptr = *pos ? (GraphNode *) *pos : idx->head;
+	int n = 0;
+
+	for (; ptr && n < max; ptr = ptr->next)
+		if (ptr->alive && ptr->vector)
+			out[n++] = ptr->vector;
+	*pos = ptr;
+	return n;
+}
+
+/**
+ * @brief Number of non-NULL neighbors of a node at a level.
+ */
+static uint32_t hnsw_degree(const GraphNode *node, int level) {
+	uint32_t d = 0;
+
+	for (uint32_t i = 0; i < ODEGREE(node, level); i++)
+		if (NEIGHBOR_AT(node, level, i) != NULL)
+			d++;
+	return d;
+}
+
+/**
+ * @brief Copies the vectors and the graph into a shared image.
+ *
+ * Nodes are numbered in list order; deleted nodes are kept (they still
+ * route searches) but left out of the ID table. Neighbor pointers become
+ * element numbers.
+ *
+ * @param index Pointer to the HNSW index.
+ * @param b     Builder to initialize and fill.
+ * @param name  Name the image is published under.
+ * @return SUCCESS, SYSTEM_ERROR or an error from shm_builder_init().
+ */
+static int hnsw_publish(void *index, ShmBuilder *b, const char *name) {
+	IndexHNSW *idx = (IndexHNSW *)index;
+	Map numbers = MAP_INIT();
+	ShmGraphHDR *ghdr;
+	uint64_t *offsets;
+	GraphNode *ptr;
+	uint64_t elements = 0, live = 0, gsize, off;
+	char *graph;
+	int ret;
+
+	for (ptr = idx->head; ptr; ptr = ptr->next)
+		elements++;
+	if (init_map(&numbers, elements / 10 + 1, 15) != MAP_SUCCESS)
+		return SYSTEM_ERROR;
+
+	gsize = sizeof(ShmGraphHDR) + elements * sizeof(uint64_t);
+	elements = 0;
+	for (ptr = idx->head; ptr; ptr = ptr->next) {
+		uint64_t edges = 0;
+		for (int l = 0; l <= ptr->level; l++)
+			edges += hnsw_degree(ptr, l);
+		gsize += SHM_NODESZ(ptr->level, edges);
+		if (ptr->alive)
+			live++;
+		if (map_insert(&numbers, (uint64_t) (uintptr_t) ptr, elements++) != MAP_SUCCESS) {
+			map_destroy(&numbers);
+			return SYSTEM_ERROR;
+		}
+	}
+
+	if ((ret = shm_builder_init(b, name, HNSW_INDEX, idx->cmp->type, idx->dims,
+	                            elements, live, gsize)) != SUCCESS) {
+		map_destroy(&numbers);
+		return ret;
+	}
+
+	graph = shm_builder_graph(b);
+	ghdr = (ShmGraphHDR *) graph;
+	ghdr->entry     = idx->gentry ? map_get(&numbers, (uint64_t) (uintptr_t) idx->gentry) : 0;
+	ghdr->top_level = idx->top_level;
+	ghdr->ef_search = idx->ef_search;
+	ghdr->M0        = idx->M0;
+	offsets = (uint64_t *) (graph + sizeof(ShmGraphHDR));
+	off = sizeof(ShmGraphHDR) + elements * sizeof(uint64_t);
+
+	for (ptr = idx->head; ptr; ptr = ptr->next) {
+		uint64_t i = shm_builder_add(b, ptr->vector, ptr->alive);
+		ShmGraphNode *node = (ShmGraphNode *) (graph + off);
+		uint32_t *degrees = (uint32_t *) (node + 1);
+		uint32_t *edges = degrees + ptr->level + 1;
+		uint64_t n = 0;
+
+		offsets[i] = off;
+		node->level = ptr->level;
+		node->alive = ptr->alive ? 1 : 0;
+		for (int l = 0; l <= ptr->level; l++) {
+			degrees[l] = hnsw_degree(ptr, l);
+			for (uint32_t k = 0; k < ODEGREE(ptr, l); k++) {
+				GraphNode *nb = NEIGHBOR_AT(ptr, l, k);
+				if (nb != NULL)
+					edges[n++] = (uint32_t) map_get(&numbers, (uint64_t) (uintptr_t) nb);
+			}
+		}
+		off += SHM_NODESZ(ptr->level, n);
+	}
+	PANIC_IF(off != gsize, "shared graph size mismatch");
+
+	map_destroy(&numbers);
+	return SUCCESS;
+}
 
 static inline void hnsw_functions(Index *idx) {
 	idx->search   = hnsw_search;
     idx->insert   = hnsw_insert;
     idx->dump     = NULL;
-	idx->export   = hnsw_export;
+	idx->walk     = hnsw_walk;
+	idx->get_vector = hnsw_get_vector;
+	idx->payload  = hnsw_payload;
+	idx->publish  = hnsw_publish;
 	idx->import   = hnsw_import;
+	idx->pin      = NULL;
     idx->compare  = hnsw_compare;
 	idx->remap    = hnsw_remap;
 	idx->set_tag  = hnsw_set_tag;
@@ -347,6 +494,7 @@ int hnsw_index(Index *idx, int method, uint16_t dims, HNSWContext *context) {
     idx->data = hnsw_init(method, dims, context);
     if (idx->data == NULL) 
         return SYSTEM_ERROR;
+    ((IndexHNSW *) idx->data)->mem = &idx->mem;
     idx->name     = "hnsw";
     hnsw_functions(idx);
     return SUCCESS;
@@ -0,0 +1,360 @@
+/*
+* index_shared.c - Read-only index attached to a shared image
+*
+* Copyright (C) 2025 Emiliano A. Billi
+*
+*
+* License:
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <https://www.gnu.org/licenses/>.
+*
+* Contact: emiliano.billi@gmail.com
+*
+* Purpose:
+* Backend for indexes attached with attach_index(). Vectors, the ID table
+* and (for HNSW images) the graph are read in place from the mapping
+* shared by every attached process; nothing is copied at attach time.
+* Searches follow the same algorithms as the flat and HNSW backends, with
+* element numbers instead of node pointers. Mutating operations are not
+* provided, which makes the index read-only.
+*/
+#include "config.h"
+#include <string.h>
+#include "index_shared.h"
+#include "method.h"
+#include "heap.h"
+#include "map.h"
+#include "mem.h"
+#include "trace.h"
+
+typedef struct {
+    ShmImage img;
+    CmpMethod *cmp;
+    const char *graph;       // Graph section, NULL for flat images
+    const uint64_t *offsets; // Node offsets within the graph section
+} IndexShared;
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+static inline const ShmGraphNode *shared_node(const IndexShared *s, uint64_t i) {
+    return (const ShmGraphNode *) (s->graph + s->offsets[i]);
+}
+
+static inline int shared_alive(const IndexShared *s, uint64_t i) {
+    return s->graph == NULL || shared_node(s, i)->alive;
+}
+
+/*
+ * Returns the neighbors of node `i` at `level` and their number.
+ */
+static const uint32_t *shared_edges(const IndexShared *s, uint64_t i, int level, uint32_t *degree) {
+    const ShmGraphNode *node = shared_node(s, i);
+    const uint32_t *degrees = (const uint32_t *) (node + 1);
+    const uint32_t *edges = degrees + node->level + 1;
+
+    if (level > node->level) {
+        *degree = 0;
+        return edges;
+    }
+    for (int l = 0; l < level; l++)
+        edges += degrees[l];
+    *degree = degrees[level];
+    return edges;
+}
+
+static inline float32_t shared_distance(const IndexShared *s, uint64_t i, float32_t *q) {
+    return s->cmp->compare_vectors(shm_vector(&s->img, i)->vector, q, s->img.hdr->dims_aligned);
+}
+
+/*
+ * Greedy best-first search of one graph level (same procedure as the
+ * HNSW backend). `W` receives up to `ef` element numbers; with
+ * `filter_alive` deleted nodes are traversed but not returned.
+ */
+static int shared_search_layer(IndexShared *s, float32_t *q, uint64_t ep, int ef, int level,
+                               int filter_alive, Heap *W, SearchTrace *t) {
+    Map  visited = MAP_INIT();
+    Heap C = HEAP_INIT();
+    HeapNode c, w, n;
+    const uint32_t *edges;
+    uint32_t degree;
+    float32_t d;
+    int ret = SYSTEM_ERROR;
+
+    if (init_map(&visited, 1000, 15) != MAP_SUCCESS)
+        goto cleanup_return;
+    if (init_heap(&C, HEAP_BETTER_TOP, NOLIMIT_HEAP, s->cmp->is_better_match) != HEAP_SUCCESS)
+        goto cleanup_return;
+    if (init_heap(W, HEAP_WORST_TOP, ef, s->cmp->is_better_match) != HEAP_SUCCESS)
+        goto cleanup_return;
+
+    n = HEAP_NODE_SET_U64(ep, shared_distance(s, ep, q));
+    if (map_insert(&visited, ep, 0) != MAP_SUCCESS) {
+        heap_destroy(W);
+        goto cleanup_return;
+    }
+    PANIC_IF(heap_insert(&C, &n) != HEAP_SUCCESS, "invalid heap");
+    TRACE_VISIT(t, level);
+    TRACE_ADD(t, heap_ops, 1);
+    TRACE_PEAK(t, 1);
+    if (!filter_alive || shared_alive(s, ep)) {
+        PANIC_IF(heap_insert(W, &n) != HEAP_SUCCESS, "invalid heap");
+        TRACE_ADD(t, heap_ops, 1);
+    } else {
+        TRACE_ADD(t, tombstones, 1);
+    }
+    TRACE_SET(t, stop, TRACE_STOP_EXHAUSTED);
+
+    while (heap_size(&C) > 0) {
+        PANIC_IF(heap_pop(&C, &c) != HEAP_SUCCESS, "lack of consistency");
+        TRACE_ADD(t, heap_ops, 1);
+
+        if (heap_size(W) > 0) {
+            PANIC_IF(heap_peek(W, &w) != HEAP_SUCCESS, "lack of consistency");
+            if (heap_full(W) && s->cmp->is_better_match(w.distance, c.distance)) {
+                TRACE_SET(t, stop, TRACE_STOP_BOUND);
+                break;
+            }
+        }
+
+        edges = shared_edges(s, HEAP_NODE_U64(c), level, &degree);
+        for (uint32_t i = 0; i < degree; i++) {
+            uint64_t e = edges[i];
+
+            if (map_has(&visited, e))
+                continue;
+            if (map_insert(&visited, e, 0) != MAP_SUCCESS) {
+                heap_destroy(W);
+                goto cleanup_return;
+            }
+            d = shared_distance(s, e, q);
+            n = HEAP_NODE_SET_U64(e, d);
+            TRACE_VISIT(t, level);
+
+            if (heap_size(W) > 0)
+                PANIC_IF(heap_peek(W, &w) != HEAP_SUCCESS, "lack of consistency");
+            if (!heap_full(W) || s->cmp->is_better_match(d, w.distance)) {
+                PANIC_IF(heap_insert(&C, &n) == HEAP_ERROR_FULL, "bad initialization");
+                TRACE_ADD(t, heap_ops, 1);
+                TRACE_PEAK(t, heap_size(&C));
+            }
+
+            if (!filter_alive || shared_alive(s, e)) {
+                PANIC_IF(heap_insert_or_replace_if_better(W, &n) != HEAP_SUCCESS, "lack of consistency");
+                TRACE_ADD(t, heap_ops, 1);
+            } else {
+                TRACE_ADD(t, tombstones, 1);
+            }
+        }
+    }
+    ret = SUCCESS;
+
+cleanup_return:
+    map_destroy(&visited);
+    heap_destroy(&C);
+    return ret;
+}
+
+/*
+ * Moves the best `n` entries of a worst-top heap into `result`, best first.
+ */
+static void shared_results(IndexShared *s, Heap *W, MatchResult *result, int n) {
+    HeapNode w;
+    int k = heap_size(W);
+
+    for (; k > n; k--)
+        PANIC_IF(heap_pop(W, &w) != HEAP_SUCCESS, "invalid pop");
+    while (k > 0) {
+        PANIC_IF(heap_pop(W, &w) != HEAP_SUCCESS, "invalid pop");
+        result[--k].distance = w.distance;
+        result[k].id = shm_vector(&s->img, HEAP_NODE_U64(w))->id;
+    }
+}
+
+static int shared_knn_search(IndexShared *s, float32_t *q, MatchResult *result, int n, SearchTrace *t) {
+    const ShmGraphHDR *ghdr = (const ShmGraphHDR *) s->graph;
+    Heap W = HEAP_INIT();
+    HeapNode w;
+    uint64_t ep = ghdr->entry;
+    double start = TRACE_CLOCK(t), base;
+    int ef;
+
+    TRACE_SET(t, levels, ghdr->top_level + 1);
+    for (int l = ghdr->top_level; l > 0; l--) {
+        if (shared_search_layer(s, q, ep, 1, l, 0, &W, t) != SUCCESS)
+            return SYSTEM_ERROR;
+        PANIC_IF(heap_pop(&W, &w) != HEAP_SUCCESS, "invalid pop");
+        ep = HEAP_NODE_U64(w);
+        heap_destroy(&W);
+    }
+    base = TRACE_CLOCK(t);
+    TRACE_SET(t, descent_ms, base - start);
+
+    ef = n > ghdr->ef_search ? n * 2 : ghdr->ef_search;
+    if (shared_search_layer(s, q, ep, ef, 0, 1, &W, t) != SUCCESS)
+        return SYSTEM_ERROR;
+    shared_results(s, &W, result, n);
+    heap_destroy(&W);
+    TRACE_SET(t, base_ms, get_time_ms_monotonic() - base);
+    return SUCCESS;
+}
+
+static int shared_linear_search(IndexShared *s, uint64_t tag, float32_t *q, MatchResult *result, int n,
+                                SearchTrace *t) {
+    Heap W = HEAP_INIT();
+    HeapNode w;
+    double start = TRACE_CLOCK(t);
+
+    if (init_heap(&W, HEAP_WORST_TOP, n, s->cmp->is_better_match) != HEAP_SUCCESS)
+        return SYSTEM_ERROR;
+
+    for (uint64_t i = 0; i < s->img.hdr->elements; i++) {
+        Vector *v = shm_vector(&s->img, i);
+        if (!shared_alive(s, i)) {
+            TRACE_ADD(t, tombstones, 1);
+            continue;
+        }
+        if (tag && !(tag & v->tag))
+            continue;
+        w = HEAP_NODE_SET_U64(i, s->cmp->compare_vectors(v->vector, q, s->img.hdr->dims_aligned));
+        PANIC_IF(heap_insert_or_replace_if_better(&W, &w) != HEAP_SUCCESS, "error in heap");
+        TRACE_ADD(t, distances, 1);
+        TRACE_ADD(t, heap_ops, 1);
+    }
+    shared_results(s, &W, result, n);
+    heap_destroy(&W);
+    TRACE_SET(t, base_ms, get_time_ms_monotonic() - start);
+    return SUCCESS;
+}
+
+/**
+ * @brief Searches the image: graph search for HNSW images without a tag
+ * filter, linear scan otherwise. Images carry no payloads.
+ */
+static int shared_search(void *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *result, int n,
+                         SearchTrace *trace, Payload **payloads) {
+    IndexShared *s = (IndexShared *) index;
+    float32_t *q;
+    int ret;
+
+    (void) payloads;
+    if (dims != s->img.hdr->dims)
+        return INVALID_DIMENSIONS;
+    if (s->img.hdr->live == 0)
+        return INDEX_EMPTY;
+
+    q = (float32_t *) aligned_calloc_mem(16, s->img.hdr->dims_aligned * sizeof(float32_t));
+    if (q == NULL)
+        return SYSTEM_ERROR;
+    memcpy(q, vector, dims * sizeof(float32_t));
+
+    for (int i = 0; i < n; i++) {
+        result[i].id = NULL_ID;
+        result[i].distance = s->cmp->worst_match_value;
+    }
+    if (s->graph && tag == 0)
+        ret = shared_knn_search(s, q, result, n, trace);
+    else
+        ret = shared_linear_search(s, tag, q, result, n, trace);
+
+    free_aligned_mem(q);
+    return ret;
+}
+
+static int shared_compare(void *index, const void *node, float32_t *vector, uint16_t dims, float32_t *distance) {
+    IndexShared *s = (IndexShared *) index;
+    float32_t *q;
+
+    if (dims != s->img.hdr->dims)
+        return INVALID_DIMENSIONS;
+    q = (float32_t *) aligned_calloc_mem(16, s->img.hdr->dims_aligned * sizeof(float32_t));
+    if (q == NULL)
+        return SYSTEM_ERROR;
+    memcpy(q, vector, dims * sizeof(float32_t));
+    *distance = s->cmp->compare_vectors(((Vector *) node)->vector, q, s->img.hdr->dims_aligned);
+    free_aligned_mem(q);
+    return SUCCESS;
+}
+
+static void *shared_lookup(void *index, uint64_t id) {
+    return shm_lookup(&((IndexShared *) index)->img, id);
+}
+
+static uint64_t shared_count(void *index) {
+    return ((IndexShared *) index)->img.hdr->live;
+}
+
+static Vector *shared_get_vector(void *index, const void *ref) {
+    (void) index;
+    return (Vector *) ref;
+}
+
+/**
+ * @brief Collects up to `max` live vectors, `*pos` holding the next element
+ * number plus one.
+ */
+static int shared_walk(void *index, void **pos, Vector **out, int max) {
+    IndexShared *s = (IndexShared *) index;
+    uint64_t i = *pos ? (uint64_t) (uintptr_t) *pos - 1 : 0;
+    int n = 0;
+
+    for (; i < s->img.hdr->elements && n < max; i++)
+        if (shared_alive(s, i))
+            out[n++] = shm_vector(&s->img, i);
+    *pos = i < s->img.hdr->elements ? (void *) (uintptr_t) (i + 1) : NULL;
+    return n;
+}
+
+static int shared_release(void **index) {
+    IndexShared *s = (IndexShared *) *index;
+
+    shm_detach(&s->img);
+    free_mem(s);
+    *index = NULL;
+    return SUCCESS;
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int shared_index(Index *idx, ShmImage *img) {
+    IndexShared *s;
+    CmpMethod *cmp;
+
+    if ((cmp = get_method(img->hdr->method)) == NULL)
+        return INVALID_METHOD;
+    if ((s = calloc_mem(1, sizeof(IndexShared))) == NULL)
+        return SYSTEM_ERROR;
+
+    s->img = *img;
+    s->cmp = cmp;
+    if (img->hdr->goff != 0) {
+        s->graph = (const char *) img->hdr + img->hdr->goff;
+        s->offsets = (const uint64_t *) (s->graph + sizeof(ShmGraphHDR));
+    }
+    memset(img, 0, sizeof(ShmImage));
+
+    idx->data       = s;
+    idx->name       = s->graph ? "shared-hnsw" : "shared-flat";
+    idx->search     = shared_search;
+    idx->compare    = shared_compare;
+    idx->lookup     = shared_lookup;
+    idx->count      = shared_count;
+    idx->get_vector = shared_get_vector;
+    idx->walk       = shared_walk;
+    idx->release    = shared_release;
+    return SUCCESS;
+}
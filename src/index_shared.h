@@ -0,0 +1,34 @@
+/*
+* index_shared.h - Read-only index attached to a shared image
+*
+* Copyright (C) 2025 Emiliano A. Billi
+*
+* License:
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <https://www.gnu.org/licenses/>.
+*
+* Contact: emiliano.billi@gmail.com
+*/
+#ifndef _SHARED_INDEX_H
+#define _SHARED_INDEX_H 1
+#include "index.h"
+
+/**
+ * Sets up `idx` to search a mapped image. The index takes ownership of
+ * the mapping and unmaps it on release.
+ *
+ * @return SUCCESS, INVALID_METHOD or SYSTEM_ERROR.
+ */
+extern int shared_index(Index *idx, ShmImage *img);
+
+#endif
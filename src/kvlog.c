@@ -0,0 +1,528 @@
+/*
+ * kvlog.c - Append-only data file backing a persistent KVTable
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the data file declared in kvlog.h. Each file is mapped
+ * read-only past its end, so appends only need a new mapping when they
+ * outgrow it; outgrown mappings stay valid until the file is released, so
+ * value pointers handed out earlier never dangle. Readers resolve a
+ * KVLogRef without taking the log lock.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#ifndef OS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+#include "kvlog.h"
+#include "file.h"
+#include "mem.h"
+
+#ifndef OS_WINDOWS
+
+#define KVLOG_MAP_MIN (1024 * 1024)
+
+typedef struct KVLogMap {
+    char   *addr;
+    size_t  len;
+    struct KVLogMap *next;
+} KVLogMap;
+
+typedef struct {
+    IOFile   *file;
+    uint32_t  gen;
+    uint64_t  size;        // End of the last record
+    uint64_t  garbage;     // Bytes of obsolete records
+    char     *map;         // Current mapping, loaded by readers without the lock
+    size_t    mapcap;
+    KVLogMap *old;         // Outgrown mappings
+} KVLogFile;
+
+struct KVLog {
+    char *filename;
+    char *nextname;        // `<filename>.next`, target of compactions
+
+    pthread_mutex_t lock;  // Appends, mappings and counters
+    KVLogFile *files[2];   // By generation & 1: active file and, while compacting, the drained one
+    KVLogFile *retired;    // File drained by the last compaction
+    uint32_t gen;          // Generation of the active file
+    int compacting;
+
+    int sync;
+    double compact_ratio;
+    uint64_t compact_min;
+
+    char  *buff;           // Record being assembled
+    size_t bcap;
+};
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+static inline uint64_t record_size(uint32_t klen, uint32_t vlen) {
+    return sizeof(KVLogRecordHDR) + (uint64_t) klen + vlen;
+}
+
+/*
+ * Maps the file with room to grow to twice `need` bytes. The previous
+ * mapping is kept for the pointers already handed out.
+ */
+static int file_map(KVLogFile *f, uint64_t need) {
+    size_t cap = need * 2 > KVLOG_MAP_MIN ? (size_t) need * 2 : KVLOG_MAP_MIN;
+    KVLogMap *m = NULL;
+    char *addr;
+
+    if (f->map && (m = calloc_mem(1, sizeof(KVLogMap))) == NULL)
+        return KV_ERROR_SYSTEM;
+    addr = mmap(NULL, cap, PROT_READ, MAP_SHARED, f->file->fd, 0);
+    if (addr == MAP_FAILED) {
+        if (m)
+            free_mem(m);
+        return KV_ERROR_SYSTEM;
+    }
+    if (m) {
+        m->addr = f->map;
+        m->len = f->mapcap;
+        m->next = f->old;
+        f->old = m;
+    }
+    f->mapcap = cap;
+    __atomic_store_n(&f->map, addr, __ATOMIC_RELEASE);
+    return KV_SUCCESS;
+}
+
+static void file_release(KVLogFile *f) {
+    KVLogMap *m, *next;
+
+    if (!f)
+        return;
+    if (f->map)
+        munmap(f->map, f->mapcap);
+    for (m = f->old; m; m = next) {
+        next = m->next;
+        munmap(m->addr, m->len);
+        free_mem(m);
+    }
+    if (f->file)
+        file_close(f->file);
+    free_mem(f);
+}
+
+/*
+ * Opens a data file, writing the header if it is new, and maps it.
+ */
+static int file_load(const char *path, uint32_t gen, KVLogFile **out) {
+    KVLogHDR hdr = { .magic = KVLOG_MAGIC, .major = 1, .minor = 0, .patch = 0, .hsize = sizeof(KVLogHDR) };
+    KVLogFile *f;
+    off_t size;
+    int ret;
+
+    if ((f = calloc_mem(1, sizeof(KVLogFile))) == NULL)
+        return KV_ERROR_SYSTEM;
+    f->gen = gen;
+    if ((f->file = file_open(path, "a+b")) == NULL) {
+        free_mem(f);
+        return KV_ERROR_FILEIO;
+    }
+
+    size = lseek(f->file->fd, 0, SEEK_END);
+    if (size == 0) {
+        if (file_write(&hdr, sizeof(hdr), 1, f->file) != 1 || file_sync(f->file) != 0) {
+            file_release(f);
+            return KV_ERROR_FILEIO;
+        }
+        size = sizeof(hdr);
+    } else if (size < (off_t) sizeof(hdr) || file_pread(f->file, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+               hdr.magic != KVLOG_MAGIC || hdr.hsize != sizeof(KVLogHDR)) {
+        file_release(f);
+        return KV_ERROR_FILE_INVALID;
+    }
+    f->size = (uint64_t) size;
+
+    if ((ret = file_map(f, f->size)) != KV_SUCCESS) {
+        file_release(f);
+        return ret;
+    }
+    *out = f;
+    return KV_SUCCESS;
+}
+
+/*
+ * Applies the valid records of a file and truncates what follows them.
+ */
+static int file_replay(KVLogFile *f, KVLogApply apply, void *arg) {
+    uint64_t pos = sizeof(KVLogHDR), len;
+    KVLogRecordHDR hdr;
+    KVLogRef ref;
+    int ret = KV_SUCCESS;
+
+    while (pos + sizeof(hdr) <= f->size) {
+        memcpy(&hdr, f->map + pos, sizeof(hdr));
+        if (hdr.klen == 0 || (hdr.type != KVLOG_PUT && hdr.type != KVLOG_DEL) ||
+            (hdr.type == KVLOG_DEL && hdr.vlen != 0))
+            break;
+        len = record_size(hdr.klen, hdr.vlen);
+        if (pos + len > f->size ||
+            XXH64(f->map + pos + sizeof(uint64_t), len - sizeof(uint64_t), 0) != hdr.checksum)
+            break;
+
+        if (hdr.type == KVLOG_PUT) {
+            ref.offset = pos + sizeof(hdr) + hdr.klen;
+            ref.vlen = hdr.vlen;
+            ref.gen = f->gen;
+            ret = apply(arg, KVLOG_PUT, f->map + pos + sizeof(hdr), hdr.klen, &ref);
+        } else {
+            f->garbage += len;
+            ret = apply(arg, KVLOG_DEL, f->map + pos + sizeof(hdr), hdr.klen, NULL);
+        }
+        if (ret != KV_SUCCESS)
+            return ret;
+        pos += len;
+    }
+
+    if (pos != f->size) {
+        if (file_resize(f->file, (off_t) pos) != 0)
+            return KV_ERROR_FILEIO;
+        f->size = pos;
+    }
+    return KV_SUCCESS;
+}
+
+static int due_locked(KVLog *log) {
+    KVLogFile *f = log->files[log->gen & 1];
+
+    return !log->compacting && log->compact_ratio <= 1.0 && f->size >= log->compact_min &&
+           (double) f->garbage > log->compact_ratio * (double) f->size;
+}
+
+/*
+ * Makes a rename in the directory of `path` durable.
+ */
+static void sync_dir(const char *path) {
+    char dir[4096];
+    const char *slash = strrchr(path, '/');
+    int fd;
+
+    if (!slash) {
+        strcpy(dir, ".");
+    } else {
+        size_t n = slash == path ? 1 : (size_t) (slash - path);
+        if (n >= sizeof(dir))
+            return;
+        memcpy(dir, path, n);
+        dir[n] = '\0';
+    }
+    if ((fd = open(dir, O_RDONLY)) >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int kvlog_open(KVLog **log, const char *filename, const KVLogContext *ctx) {
+    size_t n = strlen(filename);
+    KVLog *l;
+    int ret;
+
+    if ((l = calloc_mem(1, sizeof(KVLog))) == NULL)
+        return KV_ERROR_SYSTEM;
+    pthread_mutex_init(&l->lock, NULL);
+    l->filename = calloc_mem(1, n + 1);
+    l->nextname = calloc_mem(1, n + sizeof(".next"));
+    if (!l->filename || !l->nextname) {
+        kvlog_close(&l);
+        return KV_ERROR_SYSTEM;
+    }
+    memcpy(l->filename, filename, n);
+    memcpy(l->nextname, filename, n);
+    memcpy(l->nextname + n, ".next", sizeof(".next"));
+
+    l->sync = ctx ? ctx->sync : 0;
+    l->compact_ratio = ctx && ctx->compact_ratio > 0 ? ctx->compact_ratio : KVLOG_DEFAULT_COMPACT_RATIO;
+    l->compact_min = ctx && ctx->compact_min > 0 ? ctx->compact_min : KVLOG_DEFAULT_COMPACT_MIN;
+
+    if ((ret = file_load(l->filename, 0, &l->files[0])) != KV_SUCCESS) {
+        kvlog_close(&l);
+        return ret;
+    }
+    if (access(l->nextname, F_OK) == 0) {
+        if ((ret = file_load(l->nextname, 1, &l->files[1])) != KV_SUCCESS) {
+            kvlog_close(&l);
+            return ret;
+        }
+        l->gen = 1;
+        l->compacting = 1;
+    }
+    *log = l;
+    return KV_SUCCESS;
+}
+
+int kvlog_replay(KVLog *log, KVLogApply apply, void *arg) {
+    int ret = KV_SUCCESS;
+
+    if (log->compacting)
+        ret = file_replay(log->files[(log->gen - 1) & 1], apply, arg);
+    if (ret == KV_SUCCESS)
+        ret = file_replay(log->files[log->gen & 1], apply, arg);
+    return ret;
+}
+
+int kvlog_append(KVLog *log, int type, const void *key, uint32_t klen,
+                 const void *value, uint32_t vlen, KVLogRef *ref) {
+    KVLogRecordHDR hdr = { .klen = klen, .vlen = vlen, .type = (uint8_t) type };
+    uint64_t len = record_size(klen, vlen);
+    KVLogFile *f;
+    int ret = KV_SUCCESS;
+
+    pthread_mutex_lock(&log->lock);
+    f = log->files[log->gen & 1];
+
+    if (len > log->bcap) {
+        char *tmp = realloc_mem(log->buff, len);
+        if (!tmp) {
+            ret = KV_ERROR_SYSTEM;
+            goto unlock_return;
+        }
+        log->buff = tmp;
+        log->bcap = len;
+    }
+    memcpy(log->buff, &hdr, sizeof(hdr));
+    memcpy(log->buff + sizeof(hdr), key, klen);
+    if (vlen)
+        memcpy(log->buff + sizeof(hdr) + klen, value, vlen);
+    hdr.checksum = XXH64(log->buff + sizeof(uint64_t), len - sizeof(uint64_t), 0);
+    memcpy(log->buff, &hdr.checksum, sizeof(uint64_t));
+
+    /* The mapping must cover the record before anyone is told where it is */
+    if (f->size + len > f->mapcap && (ret = file_map(f, f->size + len)) != KV_SUCCESS)
+        goto unlock_return;
+
+    if (file_write(log->buff, 1, len, f->file) != len ||
+        (log->sync && file_sync(f->file) != 0)) {
+        file_resize(f->file, (off_t) f->size);
+        ret = KV_ERROR_FILEIO;
+        goto unlock_return;
+    }
+
+    if (ref) {
+        ref->offset = f->size + sizeof(hdr) + klen;
+        ref->vlen = vlen;
+        ref->gen = log->gen;
+    }
+    if (type == KVLOG_DEL)
+        f->garbage += len;
+    f->size += len;
+
+unlock_return:
+    pthread_mutex_unlock(&log->lock);
+    return ret;
+}
+
+const void *kvlog_value(KVLog *log, const KVLogRef *ref) {
+    KVLogFile *f = __atomic_load_n(&log->files[ref->gen & 1], __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&f->map, __ATOMIC_ACQUIRE) + ref->offset;
+}
+
+int kvlog_release(KVLog *log, const KVLogRef *ref, uint32_t klen) {
+    KVLogFile *f;
+    int due;
+
+    pthread_mutex_lock(&log->lock);
+    if ((f = log->files[ref->gen & 1]) != NULL && f->gen == ref->gen)
+        f->garbage += record_size(klen, ref->vlen);
+    due = due_locked(log);
+    pthread_mutex_unlock(&log->lock);
+    return due;
+}
+
+int kvlog_due(KVLog *log) {
+    int due;
+
+    pthread_mutex_lock(&log->lock);
+    due = due_locked(log);
+    pthread_mutex_unlock(&log->lock);
+    return due;
+}
+
+int kvlog_sync(KVLog *log) {
+    int ret;
+
+    pthread_mutex_lock(&log->lock);
+    ret = file_sync(log->files[log->gen & 1]->file) == 0 ? KV_SUCCESS : KV_ERROR_FILEIO;
+    pthread_mutex_unlock(&log->lock);
+    return ret;
+}
+
+int kvlog_compact_begin(KVLog *log, uint32_t *gen) {
+    KVLogFile *f;
+    int ret = KV_SUCCESS;
+
+    pthread_mutex_lock(&log->lock);
+    if (!log->compacting) {
+        unlink(log->nextname);
+        if ((ret = file_load(log->nextname, log->gen + 1, &f)) != KV_SUCCESS)
+            goto unlock_return;
+        __atomic_store_n(&log->files[(log->gen + 1) & 1], f, __ATOMIC_RELEASE);
+        log->gen++;
+        log->compacting = 1;
+    }
+    *gen = log->gen - 1;
+
+unlock_return:
+    pthread_mutex_unlock(&log->lock);
+    return ret;
+}
+
+int kvlog_compact_end(KVLog *log) {
+    KVLogFile *drained;
+    int ret = KV_SUCCESS;
+
+    pthread_mutex_lock(&log->lock);
+    if (!log->compacting)
+        goto unlock_return;
+    if (file_sync(log->files[log->gen & 1]->file) != 0 || rename(log->nextname, log->filename) != 0) {
+        ret = KV_ERROR_FILEIO;
+        goto unlock_return;
+    }
+    sync_dir(log->filename);
+
+    drained = log->files[(log->gen - 1) & 1];
+    log->files[(log->gen - 1) & 1] = NULL;
+    file_close(drained->file);
+    drained->file = NULL;
+    file_release(log->retired);
+    log->retired = drained;
+    log->compacting = 0;
+
+unlock_return:
+    pthread_mutex_unlock(&log->lock);
+    return ret;
+}
+
+int kvlog_compacting(KVLog *log) {
+    int compacting;
+
+    pthread_mutex_lock(&log->lock);
+    compacting = log->compacting;
+    pthread_mutex_unlock(&log->lock);
+    return compacting;
+}
+
+void kvlog_close(KVLog **log) {
+    KVLog *l;
+
+    if (!log || !*log)
+        return;
+    l = *log;
+    for (int i = 0; i < 2; i++) {
+        if (l->files[i]) {
+            file_sync(l->files[i]->file);
+            file_release(l->files[i]);
+        }
+    }
+    file_release(l->retired);
+    pthread_mutex_destroy(&l->lock);
+    if (l->filename)
+        free_mem(l->filename);
+    if (l->nextname)
+        free_mem(l->nextname);
+    if (l->buff)
+        free_mem(l->buff);
+    free_mem(l);
+    *log = NULL;
+}
+
+#else /* OS_WINDOWS */
+
+/* Data files are read through mmap: persistent tables cannot be opened */
+
+int kvlog_open(KVLog **log, const char *filename, const KVLogContext *ctx) {
+    (void) filename; (void) ctx;
+    *log = NULL;
+    return KV_ERROR_NOT_IMPLEMENTED;
+}
+
+int kvlog_replay(KVLog *log, KVLogApply apply, void *arg) {
+    (void) log; (void) apply; (void) arg;
+    return KV_ERROR_NOT_IMPLEMENTED;
+}
+
+int kvlog_append(KVLog *log, int type, const void *key, uint32_t klen,
+                 const void *value, uint32_t vlen, KVLogRef *ref) {
+    (void) log; (void) type; (void) key; (void) klen;
+    (void) value; (void) vlen; (void) ref;
+    return KV_ERROR_NOT_IMPLEMENTED;
+}
+
+const void *kvlog_value(KVLog *log, const KVLogRef *ref) {
+    (void) log; (void) ref;
+    return NULL;
+}
+
+int kvlog_release(KVLog *log, const KVLogRef *ref, uint32_t klen) {
+    (void) log; (void) ref; (void) klen;
+    return 0;
+}
+
+int kvlog_due(KVLog *log) {
+    (void) log;
+    return 0;
+}
+
+int kvlog_sync(KVLog *log) {
+    (void) log;
+    return KV_ERROR_NOT_IMPLEMENTED;
+}
+
+int kvlog_compact_begin(KVLog *log, uint32_t *gen) {
+    (void) log; (void) gen;
+    return KV_ERROR_NOT_IMPLEMENTED;
+}
+
+int kvlog_compact_end(KVLog *log) {
+    (void) log;
+    return KV_ERROR_NOT_IMPLEMENTED;
+}
+
+int kvlog_compacting(KVLog *log) {
+    (void) log;
+    return 0;
+}
+
+void kvlog_close(KVLog **log) {
+    if (log)
+        *log = NULL;
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * kvlog.h - Append-only data file backing a persistent KVTable
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Every put and delete of a persistent table is appended to a data file,
+ * and the table only keeps, next to each key, a KVLogRef with the offset
+ * of its latest value. Values are read in place from a shared mapping of
+ * the file. Records made obsolete by later writes are counted as garbage;
+ * compaction appends the live records to `<file>.next` and renames it over
+ * the data file.
+ *
+ * File layout: an 8-byte KVLogHDR followed by records. Each record is a
+ * KVLogRecordHDR, the key and the value (none for deletes). The checksum
+ * covers the record from `klen` to the end of the value; replay stops at
+ * the first short or corrupt record (torn tail after a crash) and the file
+ * is truncated there.
+ */
+
+#ifndef _KVLOG_H
+#define _KVLOG_H 1
+
+#include <stdint.h>
+#include "victorkv.h"
+
+#define KVLOG_MAGIC  0x4B564C47  /**< 'KVLG' */
+
+#define KVLOG_PUT    0x01
+#define KVLOG_DEL    0x02
+
+#define KVLOG_DEFAULT_COMPACT_RATIO 0.5
+#define KVLOG_DEFAULT_COMPACT_MIN   (64ULL * 1024 * 1024)
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;         /**< KVLOG_MAGIC. */
+    uint8_t  major;         /**< Major version. */
+    uint8_t  minor;         /**< Minor version. */
+    uint8_t  patch;         /**< Patch version. */
+    uint8_t  hsize;         /**< Size of this header in bytes. */
+} KVLogHDR;
+
+typedef struct {
+    uint64_t checksum;      /**< XXH64 of the record after this field. */
+    uint32_t klen;          /**< Key size in bytes. */
+    uint32_t vlen;          /**< Value size in bytes (0 for deletes). */
+    uint8_t  type;          /**< KVLOG_PUT or KVLOG_DEL. */
+    uint8_t  reserved[3];
+} KVLogRecordHDR;
+
+/**
+ * Location of a value, stored by the table in place of the value itself.
+ */
+typedef struct {
+    uint64_t offset;        /**< Offset of the value in its file. */
+    uint32_t vlen;          /**< Value size in bytes. */
+    uint32_t gen;           /**< Generation of the file (bumped by compaction). */
+} KVLogRef;
+#pragma pack(pop)
+
+_Static_assert(sizeof(KVLogHDR) == 8, "KVLogHDR must be exactly 8 bytes");
+_Static_assert(sizeof(KVLogRecordHDR) == 20, "KVLogRecordHDR must be exactly 20 bytes");
+
+typedef struct KVLog KVLog;
+
+/**
+ * Called by kvlog_replay() for every valid record, in file order. `ref` is
+ * NULL for deletes. A non-KV_SUCCESS return aborts the replay.
+ */
+typedef int (*KVLogApply)(void *arg, int type, const void *key, uint32_t klen, const KVLogRef *ref);
+
+/**
+ * Opens (or creates) the data file and maps it. If `<file>.next` exists a
+ * compaction was interrupted: both files are opened and the log is left
+ * compacting, to be finished with kvlog_compact_end().
+ *
+ * @return KV_SUCCESS, KV_ERROR_FILEIO, KV_ERROR_FILE_INVALID or KV_ERROR_SYSTEM.
+ */
+extern int kvlog_open(KVLog **log, const char *filename, const KVLogContext *ctx);
+
+/**
+ * Feeds every record of the log to `apply`: the data file first, then the
+ * file being compacted into. Torn tails are truncated.
+ */
+extern int kvlog_replay(KVLog *log, KVLogApply apply, void *arg);
+
+/**
+ * Appends a record to the active file and fills `ref` with the location of
+ * its value (puts only). Delete records count as garbage right away.
+ *
+ * @return KV_SUCCESS, KV_ERROR_FILEIO or KV_ERROR_SYSTEM.
+ */
+extern int kvlog_append(KVLog *log, int type, const void *key, uint32_t klen,
+                        const void *value, uint32_t vlen, KVLogRef *ref);
+
+/**
+ * Returns a pointer to the value of `ref`, valid until the second
+ * compaction that follows.
+ */
+extern const void *kvlog_value(KVLog *log, const KVLogRef *ref);
+
+/**
+ * Marks the record of `ref` (with a key of `klen` bytes) as garbage.
+ *
+ * @return Non-zero when the active file is due for compaction.
+ */
+extern int kvlog_release(KVLog *log, const KVLogRef *ref, uint32_t klen);
+
+/**
+ * Non-zero when the active file is due for compaction.
+ */
+extern int kvlog_due(KVLog *log);
+
+/**
+ * Flushes the active file to stable storage.
+ */
+extern int kvlog_sync(KVLog *log);
+
+/**
+ * Starts a compaction: new records go to `<file>.next` from now on. `gen`
+ * receives the generation to drain, i.e. whose live records must be
+ * appended again before kvlog_compact_end(). Resumes an interrupted
+ * compaction if there is one.
+ *
+ * @return KV_SUCCESS, KV_ERROR_FILEIO or KV_ERROR_SYSTEM.
+ */
+extern int kvlog_compact_begin(KVLog *log, uint32_t *gen);
+
+/**
+ * Finishes a compaction: syncs `<file>.next` and renames it over the data
+ * file. The mappings of the drained file are kept until the next
+ * compaction ends.
+ *
+ * @return KV_SUCCESS or KV_ERROR_FILEIO.
+ */
+extern int kvlog_compact_end(KVLog *log);
+
+/**
+ * Non-zero while a compaction is started but not finished.
+ */
+extern int kvlog_compacting(KVLog *log);
+
+/**
+ * Syncs and closes the log and unmaps its files.
+ */
+extern void kvlog_close(KVLog **log);
+
+#endif
@@ -7,9 +7,18 @@
 #include "file.h"
 #include "panic.h"
 #include "mem.h"
+#include "skiplist.h"
+#include "slab.h"
+#include "kvlog.h"
+#include "pool.h"
+#include "vtime.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-
-#define DEFAULT_LOAD_FACTOR  15
 #define DEFAULT_INIT_SIZE   100
 #define MAX_NAME_LEN        150
 #define MAGIC_HEADER 0x4B565354
@@ -39,12 +48,26 @@ typedef struct {
 } KVEntry;
 #pragma pack(pop)
 
+/*
+ * In memory every entry is preceded by a KVMeta, which is not part of
+ * the dump format.
+ *
+ * `refs` counts the table's own reference (while the entry is in a slot)
+ * and the handles of kv_get_handle(). Handles are taken under the shard
+ * read lock and released without it. A writer that finds an entry pinned
+ * by handles leaves it untouched: an update stores the new value in a new
+ * entry, and a removal only drops the table's reference. The last handle
+ * frees the entry.
+ */
+typedef struct {
+    uint32_t expire;       // Second of the table clock at which the entry expires, 0 for never
+    uint16_t refs;         // References: the table's and the handles'
+    uint8_t  ref;          // CLOCK reference bit, set by lookups on a table with a budget
+    uint8_t  _res;
+} KVMeta;
+
+#define KV_MAX_REFS    0x7FFF
 
-typedef struct KVNode {
-    KVEntry *entry;
-    struct KVNode *next;
-    struct KVNode *prev;
-} KVNode;
 
 typedef struct {
     int elements;
@@ -52,21 +75,619 @@ typedef struct {
     KVEntry **entries;
 } KVIO;
 
+/*
+ * The table is an open addressing ("Swiss") hash table. Every slot has a
+ * control byte: CTRL_EMPTY, CTRL_DELETED, or the low 7 bits of the hash
+ * of the entry it holds (H2). A lookup starts at the group of KV_GROUP
+ * slots selected by the rest of the hash (H1), compares H2 against the
+ * whole group at once, and only reads the entries whose control byte
+ * matches. Groups are probed in triangular steps until one contains an
+ * empty slot.
+ *
+ * The first KV_GROUP - 1 control bytes are mirrored after the last slot,
+ * so a group that wraps around the end can be loaded in one read.
+ */
+#define KV_GROUP       16
+#define CTRL_EMPTY     ((uint8_t) 0x80)
+#define CTRL_DELETED   ((uint8_t) 0xFE)
+#define CTRL_FULL(c)   (((c) & 0x80) == 0)
+
+/*
+ * A table may be given a byte budget, split evenly between the shards.
+ * A write that leaves its shard above budget evicts entries with the
+ * CLOCK algorithm: the hand of the shard walks the slots, clearing the
+ * reference bit of entries that lookups have touched since it last went
+ * by, and evicts the first entry whose bit is already clear. Setting the
+ * bit is a plain byte store, so lookups keep their read lock.
+ *
+ * Entries put with a TTL are hidden from lookups once expired. Writes to
+ * a shard that holds such entries also move its hand over the next
+ * KV_REHASH_STEP slots and remove the expired entries they find.
+ */
+
+/*
+ * The table is split into KV_SHARDS shards, each with its own lock and
+ * slot array, selected by the top bits of the hash. Writers to different
+ * shards do not block each other.
+ *
+ * A shard is rehashed incrementally: the new slot array receives every
+ * insert while each write to the shard moves the next KV_REHASH_STEP slots
+ * of the old one, and lookups search both arrays until the old one is
+ * empty. No single operation pays for moving the whole shard.
+ */
+#define KV_SHARD_BITS  5
+#define KV_SHARDS      (1 << KV_SHARD_BITS)
+#define KV_REHASH_STEP 32
+
+/*
+ * kv_mget() and kv_mput() take the keys of a batch KV_BATCH at a time,
+ * grouped by shard, so each shard is locked once per group of keys.
+ */
+#define KV_BATCH       256
+
+typedef struct {
+    uint32_t mapsize;      // Number of slots, a power of two >= KV_GROUP (0 if unused)
+    uint64_t growth_left;  // Inserts into empty slots left before a rehash
+    uint8_t  *ctrl;        // mapsize + KV_GROUP - 1 control bytes
+    KVEntry **slots;
+} KVSlots;
+
+typedef struct {
+    _Alignas(64) pthread_rwlock_t rwlock;  // Shards start on their own cache line
+    uint16_t rehash;
+    uint32_t rehashidx;    // Next slot of `old` to move
+    uint64_t elements;     // Entries in both slot arrays
+    KVSlots  cur;          // Slot array receiving inserts
+    KVSlots  old;          // Slot array being moved to `cur` (mapsize 0 if none)
+    Slab     slab;         // Memory of the entries of the shard
+    uint64_t bytes;        // Bytes reserved for the entries
+    uint64_t budget;       // Bytes above which entries are evicted, 0 for no limit
+    uint64_t hand;         // CLOCK hand, a position as in next_entry()
+    uint64_t expiring;     // Entries with a TTL
+    SkipList order;        // Entries of the shard in key order, on an ordered table
+} KVShard;
+
+/*
+ * With kv_enable_ordered() the entries of each shard are also kept in key
+ * order in a skiplist guarded by the shard lock, so prefix and range scans
+ * start at the first matching key instead of walking every slot. Writers
+ * only lock their shard; scans merge the lists of all the shards.
+ */
 typedef struct KVTable {
     char name[MAX_NAME_LEN];
-    pthread_rwlock_t rwlock;
-    uint16_t rehash;
-    uint16_t lfactor_thrhold;
-    uint32_t mapsize;
-    uint64_t elements;
-    KVNode **map;
+    KVShard shards[KV_SHARDS];
+    int      ordered;        // The shard lists are maintained (set with all shards locked)
+    KVLog   *log;            // Data file of a persistent table, NULL if in memory
+    pthread_mutex_t clock;   // Serializes compactions
+    int      compact_pending; // Background compaction queued or running
+    pthread_mutex_t idle_lock; // Guards the release of `compact_pending`
+    pthread_cond_t idle;       // Signaled when `compact_pending` drops to zero
+    double   epoch;          // Start of the table clock (get_time_ms_monotonic())
 } KVTable;
 
+struct KVCursor {
+    KVTable  *table;
+    uint8_t  *bound;         // Prefix or exclusive upper bound, NULL for none
+    uint32_t  blen;
+    int       prefix;        // `bound` is a prefix rather than an upper bound
+    uint8_t  *last;          // Key to resume from, NULL for the first key
+    uint32_t  llen;
+    size_t    lcap;
+    int       inclusive;     // `last` itself is still to be returned
+    int       done;
+    char     *buff;          // Keys and values of the last batch
+    size_t    bsize;
+};
+
+/*
+ * Bit mask of the slots of a group that match a condition; slots are
+ * 1 << GROUP_SHIFT bits apart.
+ */
+typedef uint64_t GroupMask;
+
+#if defined(__SSE2__)
+
+#define GROUP_SHIFT 0
+
+static inline GroupMask group_match(const uint8_t *g, uint8_t c) {
+	__m128i ctrl = _mm_loadu_si128((const __m128i *) g);
+	return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) c)));
+}
+
+static inline GroupMask group_match_free(const uint8_t *g) {
+	return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) g));
+}
+
+#elif defined(__ARM_NEON)
+
+#define GROUP_SHIFT 2
+
+/* Narrows a byte mask to one nibble per slot and keeps one bit of each */
+static inline GroupMask neon_mask(uint8x16_t m) {
+	uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+	return vget_lane_u64(vreinterpret_u64_u8(n), 0) & 0x8888888888888888ULL;
+}
+
+static inline GroupMask group_match(const uint8_t *g, uint8_t c) {
+	return neon_mask(vceqq_u8(vld1q_u8(g), vdupq_n_u8(c)));
+}
+
+static inline GroupMask group_match_free(const uint8_t *g) {
+	return neon_mask(vtstq_u8(vld1q_u8(g), vdupq_n_u8(0x80)));
+}
+
+#else
+
+#define GROUP_SHIFT 0
+
+static inline GroupMask group_match(const uint8_t *g, uint8_t c) {
+	GroupMask m = 0;
+	for (int i = 0; i < KV_GROUP; i++)
+		m |= (GroupMask) (g[i] == c) << i;
+	return m;
+}
+
+static inline GroupMask group_match_free(const uint8_t *g) {
+	GroupMask m = 0;
+	for (int i = 0; i < KV_GROUP; i++)
+		m |= (GroupMask) (g[i] >> 7) << i;
+	return m;
+}
+
+#endif
+
+/* First matching slot of a non-empty mask */
+static inline int mask_first(GroupMask m) {
+	return __builtin_ctzll(m) >> GROUP_SHIFT;
+}
+
+/* Non-matching slots at the start and at the end of the group */
+static inline int mask_trailing(GroupMask m) {
+	return m ? __builtin_ctzll(m) >> GROUP_SHIFT : KV_GROUP;
+}
+
+static inline int mask_leading(GroupMask m) {
+	return m ? (__builtin_clzll(m) - (64 - (KV_GROUP << GROUP_SHIFT))) >> GROUP_SHIFT : KV_GROUP;
+}
+
+static inline uint64_t hash_h1(uint64_t hash) {
+	return hash >> 7;
+}
+
+static inline uint8_t hash_h2(uint64_t hash) {
+	return (uint8_t) (hash & 0x7F);
+}
+
+/* Slots that can be filled before the load reaches 7/8 */
+static inline uint64_t max_load(uint64_t mapsize) {
+	return mapsize - mapsize / 8;
+}
+
+/* Smallest number of slots that holds `elements` entries */
+static uint64_t slots_for(uint64_t elements) {
+	uint64_t n = KV_GROUP;
+	while (max_load(n) < elements)
+		n <<= 1;
+	return n;
+}
+
+static inline KVShard *get_shard(KVTable *table, uint64_t hash) {
+	return &table->shards[hash >> (64 - KV_SHARD_BITS)];
+}
+
+/* Sets the control byte of slot `i` and its mirror */
+static inline void set_ctrl(KVSlots *t, uint64_t i, uint8_t c) {
+	t->ctrl[i] = c;
+	t->ctrl[((i - (KV_GROUP - 1)) & (t->mapsize - 1)) + (KV_GROUP - 1)] = c;
+}
+
+/* Allocates `nsize` empty slots */
+static int alloc_slots(KVSlots *t, uint64_t nsize) {
+	if (nsize > UINT32_MAX)
+		return KV_ERROR_SYSTEM;
+	t->ctrl = (uint8_t *) calloc_mem(1, nsize + KV_GROUP - 1);
+	t->slots = (KVEntry **) calloc_mem(nsize, sizeof(KVEntry *));
+	if (!t->ctrl || !t->slots) {
+		if (t->ctrl) free_mem(t->ctrl);
+		if (t->slots) free_mem(t->slots);
+		memset(t, 0, sizeof(KVSlots));
+		return KV_ERROR_SYSTEM;
+	}
+	memset(t->ctrl, CTRL_EMPTY, nsize + KV_GROUP - 1);
+	t->mapsize = (uint32_t) nsize;
+	t->growth_left = max_load(nsize);
+	return KV_SUCCESS;
+}
+
+/* Bytes of an entry, as dumped */
+static inline size_t entry_size(const KVEntry *entry) {
+	return sizeof(KVEntry) + entry->klen + entry->vlen;
+}
+
+static inline KVMeta *entry_meta(const KVEntry *entry) {
+	return (KVMeta *) entry - 1;
+}
+
+/* Allocates an entry of `size` bytes, referenced by the table only */
+static KVEntry *alloc_entry(KVShard *shard, size_t size) {
+	KVMeta *meta = (KVMeta *) slab_alloc(&shard->slab, sizeof(KVMeta) + size);
+
+	if (!meta)
+		return NULL;
+	memset(meta, 0, sizeof(KVMeta));
+	meta->refs = 1;
+	shard->bytes += slab_size(sizeof(KVMeta) + size);
+	return (KVEntry *) (meta + 1);
+}
+
+/* Resizes an entry, which moves when its size class changes */
+static KVEntry *realloc_entry(KVShard *shard, KVEntry *entry, size_t osize, size_t nsize) {
+	KVMeta *meta = (KVMeta *) slab_realloc(&shard->slab, entry_meta(entry),
+										   sizeof(KVMeta) + osize, sizeof(KVMeta) + nsize);
+	if (!meta)
+		return NULL;
+	shard->bytes += slab_size(sizeof(KVMeta) + nsize) - slab_size(sizeof(KVMeta) + osize);
+	return (KVEntry *) (meta + 1);
+}
+
+static void free_entry(KVShard *shard, KVEntry *entry) {
+	size_t size = sizeof(KVMeta) + entry_size(entry);
+
+	if (entry_meta(entry)->expire)
+		shard->expiring--;
+	shard->bytes -= slab_size(size);
+	slab_free(&shard->slab, entry_meta(entry), size);
+}
+
+/* Whether handles pin the entry; stable under the shard write lock */
+static inline int entry_pinned(const KVEntry *entry) {
+	return __atomic_load_n(&entry_meta(entry)->refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+/*
+ * Drops the table's reference to an entry that has left its slot. A
+ * pinned entry is freed by the release of its last handle instead.
+ */
+static void drop_entry(KVShard *shard, KVEntry *entry) {
+	KVMeta *meta = entry_meta(entry);
+
+	if (entry_pinned(entry)) {
+		/* No longer an entry of the shard for the TTL sweep */
+		shard->expiring -= meta->expire != 0;
+		meta->expire = 0;
+		if (__atomic_sub_fetch(&meta->refs, 1, __ATOMIC_ACQ_REL) > 0)
+			return;
+	}
+	free_entry(shard, entry);
+}
+
+/* Milliseconds since the table was created */
+static inline uint64_t table_clock(const KVTable *table) {
+	return (uint64_t) (get_time_ms_monotonic() - table->epoch);
+}
+
+static inline int meta_expired(const KVMeta *meta, uint64_t now) {
+	return meta->expire && now >= (uint64_t) meta->expire * 1000;
+}
+
+/* Whether an entry is past its TTL; for scans, which leave the reference bits alone */
+static inline int entry_expired(const KVTable *table, const KVEntry *entry) {
+	const KVMeta *meta = entry_meta(entry);
+	return meta->expire && meta_expired(meta, table_clock(table));
+}
+
+/*
+ * Whether a lookup may return an entry of `shard`. On a table with a
+ * budget this also sets the reference bit of the entry.
+ */
+static inline int entry_visible(const KVTable *table, const KVShard *shard, const KVEntry *entry) {
+	KVMeta *meta = entry_meta(entry);
+
+	if (meta->expire && meta_expired(meta, table_clock(table)))
+		return 0;
+	if (shard->budget && !__atomic_load_n(&meta->ref, __ATOMIC_RELAXED))
+		__atomic_store_n(&meta->ref, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/*
+ * Value of an entry. Entries of a persistent table hold a KVLogRef in
+ * place of the value, which is read from the mapped data file.
+ */
+static inline void *entry_value(const KVTable *table, const KVEntry *entry, uint32_t *vlen) {
+	KVLogRef ref;
+
+	if (!table->log) {
+		*vlen = entry->vlen;
+		return (void *) &entry->buff[entry->klen];
+	}
+	memcpy(&ref, &entry->buff[entry->klen], sizeof(KVLogRef));
+	*vlen = ref.vlen;
+	return (void *) kvlog_value(table->log, &ref);
+}
+
+static inline void set_result(const KVTable *table, KVResult *result, KVEntry *entry) {
+	uint32_t vlen;
+
+	result->key   = entry->buff;
+	result->value = entry_value(table, entry, &vlen);
+	result->klen  = entry->klen;
+	result->vlen  = vlen;
+}
+
+/* Marks the record of a replaced or deleted entry as garbage */
+static inline int release_value(KVTable *table, const KVEntry *entry) {
+	KVLogRef ref;
+
+	memcpy(&ref, &entry->buff[entry->klen], sizeof(KVLogRef));
+	return kvlog_release(table->log, &ref, entry->klen);
+}
+
+static void schedule_compaction(KVTable *table);
+
+/*
+ * Releases a slot array. With a `slab`, the entries above SLAB_MAX_SIZE
+ * are freed too; the rest go away with the slab pages.
+ */
+static void free_slots(KVSlots *t, Slab *slab) {
+	if (!t->slots)
+		return;
+	if (slab)
+		for (uint32_t i = 0; i < t->mapsize; ++i)
+			if (CTRL_FULL(t->ctrl[i]) && sizeof(KVMeta) + entry_size(t->slots[i]) > SLAB_MAX_SIZE)
+				slab_free(slab, entry_meta(t->slots[i]), sizeof(KVMeta) + entry_size(t->slots[i]));
+	free_mem(t->ctrl);
+	free_mem(t->slots);
+	memset(t, 0, sizeof(KVSlots));
+}
+
+/*
+ * Returns the first empty or deleted slot on the probe sequence of `hash`.
+ * The table must have room (growth_left > 0 or a deleted slot on the way).
+ */
+static uint64_t find_free_slot(KVSlots *t, uint64_t hash) {
+	uint64_t mask = t->mapsize - 1;
+	uint64_t pos = hash_h1(hash) & mask;
+	uint64_t step = 0;
+	GroupMask m;
+
+	while ((m = group_match_free(t->ctrl + pos)) == 0) {
+		step += KV_GROUP;
+		pos = (pos + step) & mask;
+	}
+	return (pos + mask_first(m)) & mask;
+}
+
+/*
+ * Stores an entry whose key is not in the slot array.
+ */
+static void place_entry(KVSlots *t, KVEntry *entry) {
+	uint64_t i = find_free_slot(t, entry->hash);
+
+	if (t->ctrl[i] == CTRL_EMPTY)
+		t->growth_left--;
+	set_ctrl(t, i, hash_h2(entry->hash));
+	t->slots[i] = entry;
+}
+
+/*
+ * Frees slot `i`. It becomes empty again when no probe sequence can have
+ * passed over it (its group never filled up), and deleted otherwise so
+ * that lookups keep probing past it.
+ */
+static void clear_slot(KVSlots *t, uint64_t i) {
+	uint64_t mask = t->mapsize - 1;
+	GroupMask after  = group_match(t->ctrl + i, CTRL_EMPTY);
+	GroupMask before = group_match(t->ctrl + ((i - KV_GROUP) & mask), CTRL_EMPTY);
+
+	if (after && before && mask_trailing(after) + mask_leading(before) < KV_GROUP) {
+		set_ctrl(t, i, CTRL_EMPTY);
+		t->growth_left++;
+	} else {
+		set_ctrl(t, i, CTRL_DELETED);
+	}
+	t->slots[i] = NULL;
+}
+
+/*
+ * Stores an entry whose key is not in the shard.
+ */
+static void insert_entry(KVShard *shard, KVEntry *entry) {
+	place_entry(&shard->cur, entry);
+	shard->elements++;
+}
+
+/*
+ * Removes the entry in slot `i` of `t`, one of the slot arrays of `shard`.
+ * The caller holds the shard lock.
+ */
+static void remove_slot(KVTable *table, KVShard *shard, KVSlots *t, uint64_t i) {
+	KVEntry *entry = t->slots[i];
+
+	if (table->ordered)
+		PANIC_IF(skiplist_remove(&shard->order, entry->buff, entry->klen) != entry,
+				 "ordered index out of sync");
+	clear_slot(t, i);
+	drop_entry(shard, entry);
+	shard->elements--;
+}
+
+/*
+ * Moves the CLOCK hand of a shard over up to `n` slots and removes the
+ * expired entries it passes. With `evict` the hand also clears the
+ * reference bits it passes and stops after removing the first entry
+ * whose bit was already clear. `keep` is never removed.
+ *
+ * @return Whether an entry was removed.
+ */
+static int clock_step(KVTable *table, KVShard *shard, uint64_t n, int evict, const KVEntry *keep, uint64_t now) {
+	uint64_t total = (uint64_t) shard->cur.mapsize + shard->old.mapsize;
+	int removed = 0;
+
+	for (; n > 0 && total > 0; n--) {
+		uint64_t pos = shard->hand++ % total;
+		int in_cur = pos < shard->cur.mapsize;
+		KVSlots *t = in_cur ? &shard->cur : &shard->old;
+		uint64_t i = in_cur ? pos : pos - shard->cur.mapsize;
+		KVMeta *meta;
+
+		if (!CTRL_FULL(t->ctrl[i]) || t->slots[i] == keep)
+			continue;
+		meta = entry_meta(t->slots[i]);
+		if (meta_expired(meta, now) || (evict && !meta->ref)) {
+			remove_slot(table, shard, t, i);
+			removed = 1;
+			if (evict)
+				break;
+		} else if (evict) {
+			meta->ref = 0;
+		}
+	}
+	return removed;
+}
+
+/*
+ * Evicts entries other than `keep` until the shard is within its budget.
+ * Two turns of the hand clear every reference bit, so each call of
+ * clock_step() removes an entry while there is one to remove.
+ */
+static void enforce_budget(KVTable *table, KVShard *shard, const KVEntry *keep) {
+	uint64_t now = table_clock(table);
+
+	while (shard->bytes > shard->budget && shard->elements > (keep ? 1u : 0u)) {
+		uint64_t turns = 2 * ((uint64_t) shard->cur.mapsize + shard->old.mapsize) + 1;
+		if (!clock_step(table, shard, turns, 1, keep, now))
+			break;
+	}
+}
+
+/* Key of an entry, for the ordered index */
+static const void *entry_key(const void *item, uint32_t *len) {
+	const KVEntry *entry = (const KVEntry *) item;
+	*len = entry->klen;
+	return entry->buff;
+}
+
+/*
+ * Whether the entry of `node` is still within the bounds of a scan.
+ */
+static int cursor_within(const struct KVCursor *c, const SkipNode *node) {
+	const KVEntry *entry = (const KVEntry *) node->item;
+
+	if (c->bound == NULL)
+		return 1;
+	if (c->prefix)
+		return entry->klen >= c->blen && memcmp(entry->buff, c->bound, c->blen) == 0;
+	return skiplist_compare(entry->buff, entry->klen, c->bound, c->blen) < 0;
+}
+
+/*
+ * Positions `pos[s]` at the first node of shard `s` the scan returns: at
+ * `last`, or after it when it was already returned. NULL past the bounds.
+ */
+static void cursor_seek(KVTable *table, const struct KVCursor *c, SkipNode **pos) {
+	for (int s = 0; s < KV_SHARDS; s++) {
+		SkipNode *node = skiplist_seek(&table->shards[s].order, c->last, c->last ? c->llen : 0);
+
+		if (node && !c->inclusive && c->last) {
+			const KVEntry *entry = (const KVEntry *) node->item;
+			if (skiplist_compare(entry->buff, entry->klen, c->last, c->llen) == 0)
+				node = skiplist_next(node);
+		}
+		pos[s] = node && cursor_within(c, node) ? node : NULL;
+	}
+}
+
+/*
+ * Returns the smallest key among the shard positions and moves past it,
+ * or NULL once every shard is exhausted. A key lives in a single shard.
+ */
+static SkipNode *cursor_pop(const struct KVCursor *c, SkipNode **pos) {
+	const KVEntry *a, *b;
+	SkipNode *node;
+	int best = -1;
+
+	for (int s = 0; s < KV_SHARDS; s++) {
+		if (!pos[s])
+			continue;
+		if (best >= 0) {
+			a = (const KVEntry *) pos[s]->item;
+			b = (const KVEntry *) pos[best]->item;
+			if (skiplist_compare(a->buff, a->klen, b->buff, b->klen) >= 0)
+				continue;
+		}
+		best = s;
+	}
+	if (best < 0)
+		return NULL;
+	node = pos[best];
+	pos[best] = skiplist_next(node);
+	if (pos[best] && !cursor_within(c, pos[best]))
+		pos[best] = NULL;
+	return node;
+}
+
+/*
+ * Makes room for `size` bytes in `*buff`, of capacity `*cap`.
+ */
+static int cursor_reserve(void **buff, size_t *cap, size_t size) {
+	void *tmp;
+
+	if (size <= *cap)
+		return KV_SUCCESS;
+	if (size < *cap * 2)
+		size = *cap * 2;
+	if ((tmp = realloc_mem(*buff, size)) == NULL)
+		return KV_ERROR_SYSTEM;
+	*buff = tmp;
+	*cap = size;
+	return KV_SUCCESS;
+}
+
+/*
+ * Returns the first entry of a shard at or after position `*pos` (the slots
+ * of the current array, then those of the old one) and moves `*pos` past
+ * it, or NULL when there are no more entries.
+ */
+static KVEntry *next_entry(KVShard *shard, uint64_t *pos) {
+	for (; *pos < (uint64_t) shard->cur.mapsize + shard->old.mapsize; (*pos)++) {
+		int in_cur = *pos < shard->cur.mapsize;
+		KVSlots *t = in_cur ? &shard->cur : &shard->old;
+		uint64_t i = in_cur ? *pos : *pos - shard->cur.mapsize;
+		if (CTRL_FULL(t->ctrl[i])) {
+			(*pos)++;
+			return t->slots[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Moves up to `n` slots of the old slot array to the current one and
+ * releases the old array once it has been walked entirely.
+ */
+static void rehash_step(KVShard *shard, uint64_t n) {
+	KVSlots *old = &shard->old;
+
+	for (; n > 0 && shard->rehashidx < old->mapsize; n--, shard->rehashidx++) {
+		uint32_t i = shard->rehashidx;
+		if (!CTRL_FULL(old->ctrl[i]))
+			continue;
+		place_entry(&shard->cur, old->slots[i]);
+		set_ctrl(old, i, CTRL_DELETED);
+		old->slots[i] = NULL;
+	}
+	if (old->mapsize > 0 && shard->rehashidx == old->mapsize) {
+		free_slots(old, NULL);
+		shard->rehashidx = 0;
+	}
+}
+
 /**
  * @brief Acquires a read lock on the table without any safety checks.
  *
- * This function directly acquires the internal read lock of the table
- * without performing any validation. It should only be used in scenarios
+ * This function directly acquires the read locks of all the shards of the
+ * table, in order, without performing any validation. It should only be used in scenarios
  * where you need manual lock control and are certain the table is valid.
  *
  * @param table Pointer to the KVTable to lock.
@@ -76,14 +697,15 @@ typedef struct KVTable {
  * @warning The caller is responsible for ensuring the table pointer is valid.
  */
 void kv_unsafe_lock(KVTable *table) {
-	pthread_rwlock_rdlock(&table->rwlock);
+	for (int i = 0; i < KV_SHARDS; i++)
+		pthread_rwlock_rdlock(&table->shards[i].rwlock);
 }
 
 /**
  * @brief Releases a read lock on the table without any safety checks.
  *
- * This function directly releases the internal read lock of the table
- * without performing any validation. It should only be used to unlock
+ * This function directly releases the read locks of all the shards of the
+ * table without performing any validation. It should only be used to unlock
  * a table that was previously locked with kv_unsafe_lock().
  *
  * @param table Pointer to the KVTable to unlock.
@@ -93,7 +715,8 @@ void kv_unsafe_lock(KVTable *table) {
  * @warning The caller is responsible for ensuring the table pointer is valid.
  */
 void kv_unsafe_unlock(KVTable *table) {
-	pthread_rwlock_unlock(&table->rwlock);
+	for (int i = KV_SHARDS - 1; i >= 0; i--)
+		pthread_rwlock_unlock(&table->shards[i].rwlock);
 }
 
 /**
@@ -124,11 +747,14 @@ void kv_unsafe_unlock(KVTable *table) {
  * @note Use "*" with ilen=1 to retrieve all entries in the table.
  * @note The caller only needs to allocate the array of structures, not individual pointers.
  * @note The returned key and value pointers point to internal memory - do not free.
- * @note Results are returned in hash table traversal order, not sorted.
+ * @note Results are returned in hash table traversal order, not sorted, unless the
+ *       table is ordered (kv_enable_ordered()): then only the matching keys are visited
+ *       and results come in key order.
  */
 int kv_unsafe_prefix_scan(KVTable *table, void *ilike, int ilen, KVResult *results, int rlen, int *found) {
-    int i, r = 0;
-    KVNode *node;
+    int r = 0;
+    KVShard *shard;
+    KVEntry *entry;
     
     if (!table) 
         return KV_ERROR_INVALID_TABLE;
@@ -137,22 +763,30 @@ int kv_unsafe_prefix_scan(KVTable *table, void *ilike, int ilen, KVResult *resul
     if (!results || rlen <= 0 || !found)
         return KV_ERROR_INVALID_VALUE;
 
-    for (i = 0; i < (int)table->mapsize && r < rlen; i++) {
-        node = table->map[i];
-        while (node && r < rlen) {
-            if (node->entry && 
-                (
-					((uint32_t)ilen <= node->entry->klen && !memcmp(ilike, node->entry->buff, ilen)) || 
-					(ilen == 1 && ((char *)ilike)[0] == '*')
-				)
-			) {
-                results[r].key   = node->entry->buff;
-                results[r].value = &node->entry->buff[node->entry->klen];
-                results[r].klen  = node->entry->klen;
-                results[r].vlen  = node->entry->vlen;
-                r++;
+    if (table->ordered) {
+        struct KVCursor c = { .bound = ilike, .blen = ilen, .prefix = 1, .inclusive = 1 };
+        SkipNode *pos[KV_SHARDS], *node;
+
+        if (ilen == 1 && ((char *)ilike)[0] == '*')
+            c.bound = NULL;
+        c.last = c.bound;
+        c.llen = c.blen;
+        cursor_seek(table, &c, pos);
+        while (r < rlen && (node = cursor_pop(&c, pos)) != NULL) {
+            if (!entry_expired(table, (KVEntry *) node->item))
+                set_result(table, &results[r++], (KVEntry *) node->item);
+        }
+        *found = r;
+        return KV_SUCCESS;
+    }
+
+    for (shard = table->shards; shard < table->shards + KV_SHARDS && r < rlen; shard++) {
+        uint64_t pos = 0;
+        while (r < rlen && (entry = next_entry(shard, &pos)) != NULL) {
+            if ((((uint32_t)ilen <= entry->klen && !memcmp(ilike, entry->buff, ilen)) || 
+                (ilen == 1 && ((char *)ilike)[0] == '*')) && !entry_expired(table, entry)) {
+                set_result(table, &results[r++], entry);
             }
-            node = node->next;
         }
     }
 	*found = r;
@@ -220,14 +854,16 @@ static int kv_store_io_dump(KVIO *io, IOFile *file) {
  *
  * @note The function zeros out the entire KVIO structure before initialization.
  * @note If allocation fails, any partially allocated memory is automatically freed.
- * @note The elements parameter must be greater than 0.
+ * @note An empty table (0 elements) allocates no arrays.
  */
 static int kvio_init(KVIO *io, int elements) {
 	PANIC_IF(io == NULL, "invalid io pointer");
-	PANIC_IF(elements <= 0, "invalid number of elements");
+	PANIC_IF(elements < 0, "invalid number of elements");
 
 	memset(io, 0, sizeof(KVIO));
 	io->elements = elements;
+	if (elements == 0)
+		return KV_SUCCESS;
 	io->entry_index = (KVStoreEntry *)calloc_mem(elements, sizeof(KVStoreEntry));
 	if (!io->entry_index)
 		return KV_ERROR_SYSTEM;
@@ -306,7 +942,7 @@ static int kv_store_io_load(KVIO *io, IOFile *file) {
 	}
 
 	offset = sizeof(KVStoreHeader) + header.elements * sizeof(KVStoreEntry);
-	if (offset != io->entry_index[0].entry_offset || 
+	if ((header.elements > 0 && offset != io->entry_index[0].entry_offset) || 
 	   (uint64_t)offset != (uint64_t)file_tello(file)) {
 		kvio_free(io);
 		return KV_ERROR_FILE_INVALID;
@@ -334,33 +970,71 @@ error_cleanup:
 }
 
 /**
- * @brief Searches for a node in the hash table based on the given key.
+ * @brief Searches a slot array for the slot holding the given key.
  *
- * This function performs a hash-based lookup to find a node that matches the provided key.
- * It computes the hash of the key, determines the appropriate bucket, and then traverses
- * the linked list in that bucket to find a node with matching hash, key length, and key content.
+ * This function probes the groups of the probe sequence of `hash` (the hash
+ * of the key, which also selected the shard). Within a group, only the slots
+ * whose control byte matches the 7-bit hash fragment are read; their full
+ * hash and key length are compared before the key itself. The search stops
+ * at the first group that has an empty slot.
  *
- * @param table Pointer to the hash table (KVTable).
+ * @param t Pointer to the slot array.
+ * @param hash Hash of the key.
  * @param key Pointer to the key to search for.
  * @param klen Length of the key in bytes.
  *
- * @return Pointer to the matching KVNode if found, NULL otherwise.
+ * @return Pointer to the slot of the matching entry if found, NULL otherwise.
  *
  * @note This function does not acquire any locks; the caller is responsible for thread safety.
- * @note The function performs a full key comparison using memcmp for collision resolution.
  */
-static KVNode *get_node(KVTable *table, void *key, int klen) {
-	if (!table || !key || klen < 0)
+static KVEntry **find_slot(KVSlots *t, uint64_t hash, void *key, int klen) {
+	uint64_t mask = t->mapsize - 1;
+	uint64_t pos = hash_h1(hash) & mask;
+	uint64_t step = 0;
+	uint8_t h2 = hash_h2(hash);
+
+	if (t->mapsize == 0)
 		return NULL;
-	uint64_t hash = XXH64(key, klen, 0);
-	int bucket = hash % table->mapsize;
-	KVNode *node = table->map[bucket];
-	while (node) {
-		if (hash == node->entry->hash && 
-			(uint32_t)klen == node->entry->klen && 
-			memcmp(node->entry->buff, key, klen) == 0)
-			return node;
-		node = node->next;
+	for (;;) {
+		const uint8_t *g = t->ctrl + pos;
+		for (GroupMask m = group_match(g, h2); m; m &= m - 1) {
+			KVEntry **slot = &t->slots[(pos + mask_first(m)) & mask];
+			if (hash == (*slot)->hash && 
+				(uint32_t)klen == (*slot)->klen && 
+				memcmp((*slot)->buff, key, klen) == 0)
+				return slot;
+		}
+		if (group_match(g, CTRL_EMPTY))
+			return NULL;
+		step += KV_GROUP;
+		pos = (pos + step) & mask;
+	}
+}
+
+/**
+ * @brief Searches a shard for the slot holding the given key.
+ *
+ * While the shard is being rehashed the key may still be in the old slot
+ * array, which is searched after the current one.
+ *
+ * @param shard Pointer to the shard of the key.
+ * @param hash Hash of the key.
+ * @param key Pointer to the key to search for.
+ * @param klen Length of the key in bytes.
+ * @param where If not NULL, receives the slot array holding the slot.
+ *
+ * @return Pointer to the slot of the matching entry if found, NULL otherwise.
+ */
+static KVEntry **get_slot(KVShard *shard, uint64_t hash, void *key, int klen, KVSlots **where) {
+	KVEntry **slot;
+
+	if ((slot = find_slot(&shard->cur, hash, key, klen)) != NULL) {
+		if (where) *where = &shard->cur;
+		return slot;
+	}
+	if ((slot = find_slot(&shard->old, hash, key, klen)) != NULL) {
+		if (where) *where = &shard->old;
+		return slot;
 	}
 	return NULL;
 }
@@ -397,15 +1071,20 @@ int kv_get(KVTable *table, void *key, int klen, void **value, int *vlen) {
 	if (!value || !vlen)
 		return KV_ERROR_INVALID_VALUE;
 
-	pthread_rwlock_rdlock(&table->rwlock);
-	KVNode *node = get_node(table, key, klen);
-	pthread_rwlock_unlock(&table->rwlock);
-	if (node) {
-		*value = &node->entry->buff[node->entry->klen];
-		*vlen  = node->entry->vlen;
-		return KV_SUCCESS; 
+	uint64_t hash = XXH64(key, klen, 0);
+	KVShard *shard = get_shard(table, hash);
+
+	pthread_rwlock_rdlock(&shard->rwlock);
+	KVEntry **slot = get_slot(shard, hash, key, klen, NULL);
+	if (slot && !entry_visible(table, shard, *slot))
+		slot = NULL;
+	if (slot) {
+		uint32_t len;
+		*value = entry_value(table, *slot, &len);
+		*vlen  = len;
 	}
-	return KV_KEY_NOT_FOUND;
+	pthread_rwlock_unlock(&shard->rwlock);
+	return slot ? KV_SUCCESS : KV_KEY_NOT_FOUND;
 }
 
 /**
@@ -441,32 +1120,157 @@ int kv_get_copy(KVTable *table, void *key, int klen,void **value, int *vlen) {
 	if (!value || !vlen)
 		return KV_ERROR_INVALID_VALUE;
 
-	pthread_rwlock_rdlock(&table->rwlock);
-	KVNode *node = get_node(table, key, klen);
-	if (node) {
-		*value = global_calloc_mem(1, node->entry->vlen);
+	uint64_t hash = XXH64(key, klen, 0);
+	KVShard *shard = get_shard(table, hash);
+
+	pthread_rwlock_rdlock(&shard->rwlock);
+	KVEntry **slot = get_slot(shard, hash, key, klen, NULL);
+	if (slot && !entry_visible(table, shard, *slot))
+		slot = NULL;
+	if (slot) {
+		uint32_t len;
+		void *src = entry_value(table, *slot, &len);
+		*value = global_calloc_mem(1, len);
 		if (!*value) {
-			pthread_rwlock_unlock(&table->rwlock);
+			pthread_rwlock_unlock(&shard->rwlock);
 			return KV_ERROR_SYSTEM;
 		}
-		memcpy(*value, &node->entry->buff[node->entry->klen],node->entry->vlen);
-		*vlen  = node->entry->vlen;
-		pthread_rwlock_unlock(&table->rwlock);
+		memcpy(*value, src, len);
+		*vlen  = len;
+		pthread_rwlock_unlock(&shard->rwlock);
 		return KV_SUCCESS; 
 	} else {
 		*value = NULL;
 	}
-	pthread_rwlock_unlock(&table->rwlock);
+	pthread_rwlock_unlock(&shard->rwlock);
 	return KV_KEY_NOT_FOUND;
 }
 
+/**
+ * @brief Retrieves a value without copying it and pins it until the handle is released.
+ *
+ * The entry of the key gets one more reference under the shard read lock.
+ * While the handle holds it, writers leave the entry untouched: kv_put()
+ * stores the new value in a new entry and kv_del() or an eviction only
+ * drops the table's reference. The last reference frees the entry.
+ *
+ * @param table Pointer to the KVTable.
+ * @param key Pointer to the key to look up.
+ * @param klen Length of the key in bytes.
+ * @param handle Receives the value; release it with kv_release_handle().
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_INVALID_KEY,
+ *         KV_ERROR_INVALID_VALUE, KV_ERROR_PERSISTENT, KV_ERROR_SYSTEM
+ *         (KV_MAX_REFS handles on the entry) or KV_KEY_NOT_FOUND.
+ */
+int kv_get_handle(KVTable *table, void *key, int klen, KVHandle *handle) {
+	int ret = KV_KEY_NOT_FOUND;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!key || klen <= 0)
+		return KV_ERROR_INVALID_KEY;
+	if (!handle)
+		return KV_ERROR_INVALID_VALUE;
+	/* Values of a persistent table live in the log, not in the entries */
+	if (table->log)
+		return KV_ERROR_PERSISTENT;
+
+	uint64_t hash = XXH64(key, klen, 0);
+	KVShard *shard = get_shard(table, hash);
+
+	memset(handle, 0, sizeof(KVHandle));
+	pthread_rwlock_rdlock(&shard->rwlock);
+	KVEntry **slot = get_slot(shard, hash, key, klen, NULL);
+	if (slot && entry_visible(table, shard, *slot)) {
+		KVMeta *meta = entry_meta(*slot);
+
+		if (__atomic_add_fetch(&meta->refs, 1, __ATOMIC_ACQ_REL) > KV_MAX_REFS) {
+			__atomic_sub_fetch(&meta->refs, 1, __ATOMIC_ACQ_REL);
+			ret = KV_ERROR_SYSTEM;
+		} else {
+			handle->value = &(*slot)->buff[(*slot)->klen];
+			handle->vlen  = (*slot)->vlen;
+			handle->table = table;
+			handle->entry = *slot;
+			ret = KV_SUCCESS;
+		}
+	}
+	pthread_rwlock_unlock(&shard->rwlock);
+	return ret;
+}
+
+/**
+ * @brief Releases a handle of kv_get_handle().
+ *
+ * Takes no lock unless the entry was replaced or removed meanwhile and this
+ * is its last reference, in which case the entry is freed under the shard
+ * write lock.
+ *
+ * @param handle Handle to release; cleared.
+ *
+ * @return KV_SUCCESS or KV_ERROR_INVALID_VALUE if the handle holds no value.
+ */
+int kv_release_handle(KVHandle *handle) {
+	KVEntry *entry;
+
+	if (!handle || !handle->entry)
+		return KV_ERROR_INVALID_VALUE;
+
+	entry = (KVEntry *) handle->entry;
+	if (__atomic_sub_fetch(&entry_meta(entry)->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		KVShard *shard = get_shard(handle->table, entry->hash);
+
+		pthread_rwlock_wrlock(&shard->rwlock);
+		free_entry(shard, entry);
+		pthread_rwlock_unlock(&shard->rwlock);
+	}
+	memset(handle, 0, sizeof(KVHandle));
+	return KV_SUCCESS;
+}
+
+/*
+ * Deletes an entry. On a persistent table a delete record is appended
+ * first when `append` is set (replay applies records already in the log).
+ */
+static int table_del(KVTable *table, void *key, int klen, int append) {
+	uint64_t hash = XXH64(key, klen, 0);
+	KVShard *shard = get_shard(table, hash);
+	KVSlots *t;
+	int ret, due = 0, expired;
+
+	pthread_rwlock_wrlock(&shard->rwlock);
+	rehash_step(shard, KV_REHASH_STEP);
+    KVEntry **slot = get_slot(shard, hash, key, klen, &t);
+    if (!slot) {
+		pthread_rwlock_unlock(&shard->rwlock);
+		return KV_KEY_NOT_FOUND;
+	}
+	PANIC_IF(*slot == NULL, "invalid entry");
+	/* An expired entry is removed all the same, but was already gone for lookups */
+	expired = entry_expired(table, *slot);
+
+	if (table->log) {
+		if (append && (ret = kvlog_append(table->log, KVLOG_DEL, key, klen, NULL, 0, NULL)) != KV_SUCCESS) {
+			pthread_rwlock_unlock(&shard->rwlock);
+			return ret;
+		}
+		due = release_value(table, *slot);
+	}
+    remove_slot(table, shard, t, slot - t->slots);
+	pthread_rwlock_unlock(&shard->rwlock);
+	if (due)
+		schedule_compaction(table);
+    return expired ? KV_KEY_NOT_FOUND : KV_SUCCESS;
+}
 
 /**
  * @brief Deletes a key-value pair from the hash map.
  *
  * This function searches for a key in the hash map and removes the corresponding entry
- * if found. It safely unlinks the node from its bucket's linked list and releases the
- * memory associated with the key-value entry.
+ * if found. The slot becomes empty again when no probe sequence can have passed over it
+ * (its group never filled up), and is marked deleted otherwise so that lookups keep
+ * probing past it. The memory associated with the key-value entry is released.
  *
  * Thread-safety is ensured by acquiring a write lock during the deletion process.
  *
@@ -488,82 +1292,157 @@ int kv_del(KVTable *table, void *key, int klen) {
 	if (!key || klen <= 0)
         return KV_ERROR_INVALID_KEY;
 
-	pthread_rwlock_wrlock(&table->rwlock);
-    KVNode *node = get_node(table, key, klen);
-    if (!node) {
-		pthread_rwlock_unlock(&table->rwlock);
-		return KV_KEY_NOT_FOUND;
-	}
-	PANIC_IF(node->entry == NULL, "invalid entry");
-
-    int bucket = node->entry->hash % table->mapsize;
-
-    if (table->map[bucket] == node)
-        table->map[bucket] = node->next;
-
-    if (node->prev)
-        node->prev->next = node->next;
-
-    if (node->next)
-        node->next->prev = node->prev;
-
-    free_mem(node->entry);
-    free_mem(node);
-
-    table->elements--;
-	pthread_rwlock_unlock(&table->rwlock);
-    return KV_SUCCESS;
+	return table_del(table, key, klen, 1);
 }
 
 /**
- * @brief Rehashes the hash map to a new size.
+ * @brief Starts rehashing a shard to a new size.
  *
- * This function redistributes all existing entries in the hash map to a new bucket array
- * of size `nsize`. It is typically called when the current load factor exceeds a predefined
- * threshold, in order to maintain efficient access times. The hash of each entry is reused
- * to compute the new bucket table modulo the new size.
+ * This function is called when no empty slot is left within the maximum load
+ * (7/8 of the slots, deleted slots included): with the same size the rehash
+ * only clears the deleted slots, with a larger size it grows the shard. The
+ * current slot array becomes the old one and a new array of `nsize` slots
+ * receives the inserts; rehash_step() then moves the old entries a few at a
+ * time. The stored hash of each entry is reused, so keys are not hashed again.
  *
- * @param table Pointer to the hash map structure (`KVTable`).
- * @param nsize New size of the hash map (must be greater than current size).
+ * @param shard Pointer to the shard.
+ * @param nsize New number of slots (a power of two, large enough for all entries).
  *
- * @note This function assumes that the caller has acquired a write lock (`rwlock`)
- *       on the table if concurrent access is expected.
+ * @note This function assumes that the caller has acquired the write lock (`rwlock`)
+ *       of the shard if concurrent access is expected.
  *
  * @return KV_SUCCESS on success.
- *         KV_ERROR_SYSTEM if memory allocation for the new bucket array fails.
- *
- * @warning The original map is freed and replaced with the new one. All internal node pointers
- *          are adjusted accordingly. This function does not modify the number of elements.
+ *         KV_ERROR_SYSTEM if memory allocation for the new slot array fails.
  */
-static int rehash(KVTable *table, uint32_t nsize) {
-	int bucket;
-	PANIC_IF(table == NULL, "invalid table parameter");
-	PANIC_IF(nsize == 0 || nsize < table->mapsize, "invalid size parameter");
-
-	KVNode **tmp = (KVNode **) calloc_mem(nsize, sizeof(KVNode*));
-	if (!tmp)
+static int rehash(KVShard *shard, uint64_t nsize) {
+	KVSlots t;
+	PANIC_IF(shard == NULL, "invalid shard parameter");
+	PANIC_IF(shard->old.mapsize != 0, "rehash already in progress");
+	PANIC_IF(nsize < KV_GROUP || (nsize & (nsize - 1)) != 0 || max_load(nsize) < shard->elements,
+			 "invalid size parameter");
+
+	if (alloc_slots(&t, nsize) != KV_SUCCESS)
 		return KV_ERROR_SYSTEM;
 
-	for (uint32_t i = 0; i < table->mapsize; ++i) {
-		KVNode *ptr;
-		while (table->map[i]) {
-			ptr = table->map[i];
-			table->map[i] = ptr->next;
-			ptr->next = NULL;
-			ptr->prev = NULL;
-			bucket = ptr->entry->hash % nsize;
-			if (tmp[bucket]) {
-				tmp[bucket]->prev = ptr;
-				ptr->next = tmp[bucket];
+	shard->old = shard->cur;
+	shard->cur = t;
+	shard->rehashidx = 0;
+    shard->rehash++;
+    return KV_SUCCESS;
+}
+
+/*
+ * Makes room for one more entry: when no empty slot is left, the shard
+ * grows if more than half of its load is live, otherwise its deleted
+ * slots are cleared. A rehash in progress is completed first; with
+ * KV_REHASH_STEP slots moved per write it is always over long before
+ * the new array fills up.
+ */
+static int reserve_slot(KVShard *shard) {
+	uint64_t nsize;
+
+	if (shard->cur.growth_left > 0)
+		return KV_SUCCESS;
+	rehash_step(shard, UINT64_MAX);
+	if (shard->cur.growth_left > 0)
+		return KV_SUCCESS;
+	nsize = shard->elements >= max_load(shard->cur.mapsize) / 2 ? 
+			(uint64_t) shard->cur.mapsize * 2 : shard->cur.mapsize;
+	return rehash(shard, nsize);
+}
+
+/*
+ * Stores a value in a shard whose write lock the caller holds. On a persistent table the value is appended to
+ * the log when `append` is set, and the entry keeps a KVLogRef to it;
+ * replay passes the KVLogRef of a record already in the log instead.
+ * `expire` is the second of the table clock at which the entry expires
+ * (0 for never). `due` is set when the log asks for a compaction.
+ */
+static int shard_put(KVTable *table, KVShard *shard, uint64_t hash, void *key, int klen,
+					 const void *value, int vlen, int append, uint32_t expire, int *due) {
+	KVEntry *tmp, **slot;
+	KVMeta *meta;
+	KVLogRef ref;
+	int ret;
+
+	rehash_step(shard, KV_REHASH_STEP);
+	if (shard->expiring)
+		clock_step(table, shard, KV_REHASH_STEP, 0, NULL, table_clock(table));
+
+	if (table->log && append) {
+		if ((ret = kvlog_append(table->log, KVLOG_PUT, key, klen, value, vlen, &ref)) != KV_SUCCESS)
+			return ret;
+		value = &ref;
+		vlen = sizeof(KVLogRef);
+	}
+
+	slot = get_slot(shard, hash, key, klen, NULL);
+	if (slot) {
+		if (table->log)
+			*due |= release_value(table, *slot);
+		size_t osize = entry_size(*slot), nsize = sizeof(KVEntry) + klen + vlen;
+		int pinned = entry_pinned(*slot);
+		/* The entry moves when the value changes size class or handles pin it */
+		if (pinned || slab_size(sizeof(KVMeta) + osize) != slab_size(sizeof(KVMeta) + nsize)) {
+			SkipNode *node = table->ordered ? skiplist_find(&shard->order, key, klen) : NULL;
+			if (pinned) {
+				if ((tmp = alloc_entry(shard, nsize)) == NULL)
+					return KV_ERROR_SYSTEM;
+				memcpy(tmp, *slot, sizeof(KVEntry) + klen);
+				drop_entry(shard, *slot);
+			} else if ((tmp = realloc_entry(shard, *slot, osize, nsize)) == NULL) {
+				return KV_ERROR_SYSTEM;
 			}
-			tmp[bucket] = ptr;
+			*slot = tmp;
+			if (node)
+				node->item = tmp;
 		}
+		tmp = *slot;
+		memcpy(&tmp->buff[tmp->klen], value, vlen);
+		tmp->vlen = vlen;
+		entry_meta(tmp)->ref = 1;
+		goto set_meta;
 	}
-    free_mem(table->map);
-    table->map = tmp;
-    table->mapsize = nsize;
-    table->rehash++;
-    return KV_SUCCESS;
+
+	if (reserve_slot(shard) != KV_SUCCESS)
+		return KV_ERROR_SYSTEM;
+
+	tmp = alloc_entry(shard, sizeof(KVEntry) + klen + vlen);
+	if (!tmp)
+		return KV_ERROR_SYSTEM;
+	tmp->hash = hash;
+	tmp->klen = klen;
+	tmp->vlen = vlen;
+	memcpy(tmp->buff, key, klen);
+	memcpy(&tmp->buff[klen], value, vlen);
+
+	if (table->ordered && skiplist_insert(&shard->order, tmp) != SKIPLIST_SUCCESS) {
+		free_entry(shard, tmp);
+		return KV_ERROR_SYSTEM;
+	}
+	insert_entry(shard, tmp);
+
+set_meta:
+	meta = entry_meta(tmp);
+	shard->expiring += expire != 0;
+	shard->expiring -= meta->expire != 0;
+	meta->expire = expire;
+	if (shard->budget)
+		enforce_budget(table, shard, tmp);
+	return KV_SUCCESS;
+}
+
+static int table_put(KVTable *table, void *key, int klen, const void *value, int vlen, int append, uint32_t expire) {
+	uint64_t hash = XXH64(key, klen, 0);
+	KVShard *shard = get_shard(table, hash);
+	int ret, due = 0;
+
+	pthread_rwlock_wrlock(&shard->rwlock);
+	ret = shard_put(table, shard, hash, key, klen, value, vlen, append, expire, &due);
+	pthread_rwlock_unlock(&shard->rwlock);
+	if (due)
+		schedule_compaction(table);
+	return ret;
 }
 
 /**
@@ -571,11 +1450,11 @@ static int rehash(KVTable *table, uint32_t nsize) {
  *
  * This function inserts a new entry or updates an existing one in the hash map represented
  * by `KVTable`. If the key already exists, the value is updated in-place (reallocating memory
- * if necessary). If the key does not exist, a new node is created and inserted into the corresponding
- * bucket based on the key's hash.
+ * if necessary). If the key does not exist, a new entry is stored in the first free slot of
+ * the key's probe sequence.
  *
- * The function also performs rehashing if the load factor exceeds the configured threshold,
- * and ensures thread-safety using a write lock.
+ * The function also rehashes the table when it runs out of free slots, and ensures
+ * thread-safety using a write lock.
  *
  * @param table Pointer to the hash map (KVTable).
  * @param key Pointer to the key to insert.
@@ -598,81 +1477,243 @@ static int rehash(KVTable *table, uint32_t nsize) {
  *       or validate the content beyond size and NULL checks.
  */
 int kv_put(KVTable *table, void *key, int klen, void *value, int vlen) {
-	KVEntry *tmp;
-	KVNode *node;
-	int bucket;
 	if (!table)
 		return KV_ERROR_INVALID_TABLE;
 	if (!key || klen <= 0)
 		return KV_ERROR_INVALID_KEY;
 	if (!value || vlen <= 0)
 		return KV_ERROR_INVALID_VALUE;
-	
-	pthread_rwlock_wrlock(&table->rwlock);
 
-	if (table->mapsize > 0 && (table->elements / table->mapsize) > table->lfactor_thrhold) {
-		if (rehash(table, table->mapsize * 2) != KV_SUCCESS) {
-			pthread_rwlock_unlock(&table->rwlock);
-			return KV_ERROR_SYSTEM;
-		}
+	return table_put(table, key, klen, value, vlen, 1, 0);
+}
+
+/**
+ * @brief Inserts or updates a key-value pair that expires after `ttl` seconds.
+ *
+ * Works as kv_put(), but lookups and scans stop returning the entry once
+ * `ttl` seconds have passed (and less than `ttl` + 1). Expired entries are
+ * reclaimed by later writes to the same shard. kv_put() on the key clears
+ * the TTL.
+ *
+ * @param table Pointer to the KVTable.
+ * @param key Pointer to the key to insert.
+ * @param klen Length of the key in bytes.
+ * @param value Pointer to the value to insert.
+ * @param vlen Length of the value in bytes.
+ * @param ttl Lifetime of the entry in seconds; 0 for no expiry.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_INVALID_KEY,
+ *         KV_ERROR_INVALID_VALUE, KV_ERROR_PERSISTENT or KV_ERROR_SYSTEM.
+ */
+int kv_put_ttl(KVTable *table, void *key, int klen, void *value, int vlen, uint32_t ttl) {
+	uint64_t expire;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!key || klen <= 0)
+		return KV_ERROR_INVALID_KEY;
+	if (!value || vlen <= 0)
+		return KV_ERROR_INVALID_VALUE;
+	if (table->log)
+		return KV_ERROR_PERSISTENT;
+
+	/* Rounded up to the next second of the table clock */
+	expire = ttl ? (table_clock(table) + (uint64_t) ttl * 1000 + 999) / 1000 : 0;
+	return table_put(table, key, klen, value, vlen, 1, expire > UINT32_MAX ? UINT32_MAX : (uint32_t) expire);
+}
+
+/**
+ * @brief Caps the memory of the entries of a table.
+ *
+ * The budget is split evenly between the shards of the table. A write that
+ * leaves its shard above its share evicts other entries of the shard, least
+ * recently looked up first (CLOCK approximation), until the shard fits.
+ * Entries above the budget are evicted immediately.
+ *
+ * @param table Pointer to the KVTable.
+ * @param bytes Budget in bytes of the entries (keys, values and per-entry
+ *              overhead, not the slot arrays); 0 removes the budget.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE or KV_ERROR_PERSISTENT.
+ */
+int kv_set_budget(KVTable *table, uint64_t bytes) {
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (table->log)
+		return KV_ERROR_PERSISTENT;
+
+	for (KVShard *shard = table->shards; shard < table->shards + KV_SHARDS; shard++) {
+		pthread_rwlock_wrlock(&shard->rwlock);
+		shard->budget = bytes ? (bytes + KV_SHARDS - 1) / KV_SHARDS : 0;
+		if (shard->budget)
+			enforce_budget(table, shard, NULL);
+		pthread_rwlock_unlock(&shard->rwlock);
 	}
+	return KV_SUCCESS;
+}
 
+/*
+ * Hashes `n` <= KV_BATCH keys and groups them by shard: the keys of shard
+ * `s` are items[order[first[s]]] .. items[order[first[s + 1] - 1]], in the
+ * order of `items`.
+ */
+static void batch_group(const KVResult *items, int n, uint64_t *hash, uint16_t *order, uint16_t *first) {
+	uint16_t count[KV_SHARDS + 1] = {0};
 
-	node = get_node(table, key, klen);
-	if (node) {
-		if (node->entry->vlen < (uint32_t)vlen) {
-			tmp = (KVEntry *) realloc_mem(node->entry, sizeof(KVEntry) + klen + vlen);
-			if (!tmp) {
-				pthread_rwlock_unlock(&table->rwlock);
-				return KV_ERROR_SYSTEM;
+	for (int i = 0; i < n; i++) {
+		hash[i] = XXH64(items[i].key, items[i].klen, 0);
+		count[(hash[i] >> (64 - KV_SHARD_BITS)) + 1]++;
+	}
+	for (int s = 0; s < KV_SHARDS; s++)
+		count[s + 1] += count[s];
+	memcpy(first, count, sizeof(count));
+	for (int i = 0; i < n; i++)
+		order[count[hash[i] >> (64 - KV_SHARD_BITS)]++] = (uint16_t) i;
+}
+
+/* Prefetches the first control group and slots probed for `hash` */
+static inline void prefetch_slot(const KVSlots *t, uint64_t hash) {
+	uint64_t pos;
+
+	if (t->mapsize == 0)
+		return;
+	pos = hash_h1(hash) & (t->mapsize - 1);
+	__builtin_prefetch(t->ctrl + pos);
+	__builtin_prefetch(t->slots + pos);
+}
+
+/**
+ * @brief Retrieves the values of a batch of keys.
+ *
+ * The keys are hashed up front and grouped by shard, and each shard is
+ * read-locked once for all of its keys in a group of KV_BATCH, with the
+ * slots of every key prefetched before they are probed.
+ *
+ * @param table Pointer to the KVTable.
+ * @param items Keys to look up in `key` and `klen`; `value` and `vlen`
+ *              receive the value of each key, or NULL and 0 if not found.
+ * @param n Number of items.
+ * @param found If not NULL, receives the number of keys found.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_INVALID_KEY or
+ *         KV_ERROR_INVALID_VALUE.
+ *
+ * @note The values are pointers to internal memory, as with kv_get().
+ */
+int kv_mget(KVTable *table, KVResult *items, int n, int *found) {
+	uint64_t hash[KV_BATCH];
+	uint16_t order[KV_BATCH], first[KV_SHARDS + 1];
+	int hits = 0;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!items || n < 0)
+		return KV_ERROR_INVALID_VALUE;
+	for (int i = 0; i < n; i++)
+		if (!items[i].key || items[i].klen <= 0)
+			return KV_ERROR_INVALID_KEY;
+
+	for (int base = 0; base < n; base += KV_BATCH) {
+		KVResult *batch = items + base;
+		int m = n - base < KV_BATCH ? n - base : KV_BATCH;
+
+		batch_group(batch, m, hash, order, first);
+		for (int s = 0; s < KV_SHARDS; s++) {
+			KVShard *shard = &table->shards[s];
+
+			if (first[s] == first[s + 1])
+				continue;
+			pthread_rwlock_rdlock(&shard->rwlock);
+			for (int j = first[s]; j < first[s + 1]; j++)
+				prefetch_slot(&shard->cur, hash[order[j]]);
+			for (int j = first[s]; j < first[s + 1]; j++) {
+				KVResult *item = &batch[order[j]];
+				KVEntry **slot = get_slot(shard, hash[order[j]], item->key, item->klen, NULL);
+				uint32_t len = 0;
+
+				if (slot && !entry_visible(table, shard, *slot))
+					slot = NULL;
+
+				item->value = slot ? entry_value(table, *slot, &len) : NULL;
+				item->vlen  = len;
+				hits += slot != NULL;
 			}
-			node->entry = tmp;
-		} 
-		memcpy(&node->entry->buff[node->entry->klen], value, vlen);
-		node->entry->vlen = vlen;
-		pthread_rwlock_unlock(&table->rwlock);
-		return KV_SUCCESS;
+			pthread_rwlock_unlock(&shard->rwlock);
+		}
 	}
-	tmp = (KVEntry *) calloc_mem(1, sizeof(KVEntry) + klen + vlen);
-	if (!tmp) {
-		pthread_rwlock_unlock(&table->rwlock);
-		return KV_ERROR_SYSTEM;
+	if (found)
+		*found = hits;
+	return KV_SUCCESS;
+}
+
+/**
+ * @brief Inserts or updates a batch of key-value pairs.
+ *
+ * The keys are hashed up front and grouped by shard, and each shard is
+ * write-locked once for all of its keys in a group of KV_BATCH. Pairs
+ * with the same key are applied in the order of `items`, so the last one
+ * wins.
+ *
+ * @param table Pointer to the KVTable.
+ * @param items Pairs to store in `key`, `klen`, `value` and `vlen`.
+ * @param n Number of items.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_INVALID_KEY,
+ *         KV_ERROR_INVALID_VALUE, KV_ERROR_SYSTEM or KV_ERROR_FILEIO.
+ *
+ * @note Invalid pairs are reported before anything is stored. After a
+ *       system or I/O error some of the pairs may have been stored.
+ */
+int kv_mput(KVTable *table, KVResult *items, int n) {
+	uint64_t hash[KV_BATCH];
+	uint16_t order[KV_BATCH], first[KV_SHARDS + 1];
+	int ret = KV_SUCCESS, due = 0;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!items || n < 0)
+		return KV_ERROR_INVALID_VALUE;
+	for (int i = 0; i < n; i++) {
+		if (!items[i].key || items[i].klen <= 0)
+			return KV_ERROR_INVALID_KEY;
+		if (!items[i].value || items[i].vlen <= 0)
+			return KV_ERROR_INVALID_VALUE;
 	}
-	tmp->hash = XXH64(key, klen, 0);
-	tmp->klen = klen;
-	tmp->vlen = vlen;
-	memcpy(tmp->buff, key, klen);
-	memcpy(&tmp->buff[klen], value, vlen);
 
-	node = (KVNode *) calloc_mem(1, sizeof(KVNode));
-	if (!node) {
-		free_mem(tmp);
-		pthread_rwlock_unlock(&table->rwlock);
-		return KV_ERROR_SYSTEM;
+	for (int base = 0; base < n && ret == KV_SUCCESS; base += KV_BATCH) {
+		KVResult *batch = items + base;
+		int m = n - base < KV_BATCH ? n - base : KV_BATCH;
+
+		batch_group(batch, m, hash, order, first);
+		for (int s = 0; s < KV_SHARDS && ret == KV_SUCCESS; s++) {
+			KVShard *shard = &table->shards[s];
+
+			if (first[s] == first[s + 1])
+				continue;
+			pthread_rwlock_wrlock(&shard->rwlock);
+			for (int j = first[s]; j < first[s + 1] && ret == KV_SUCCESS; j++) {
+				KVResult *item = &batch[order[j]];
+				ret = shard_put(table, shard, hash[order[j]], item->key, item->klen,
+								item->value, item->vlen, 1, 0, &due);
+			}
+			pthread_rwlock_unlock(&shard->rwlock);
+		}
 	}
-	bucket = tmp->hash % table->mapsize;
-	node->entry = tmp;
-	node->next = table->map[bucket];
-	node->prev = NULL;
-	if (node->next)
-		node->next->prev = node;
-	table->map[bucket] = node;
-	table->elements++;
-	pthread_rwlock_unlock(&table->rwlock);
-	return KV_SUCCESS;
+	if (due)
+		schedule_compaction(table);
+	return ret;
 }
 
 /**
  * @brief Allocates and initializes a new key-value table with custom parameters.
  *
- * This function creates a new key-value table with the specified name, initial size,
- * and load factor threshold. It allocates all necessary internal structures including
- * the hash bucket array and initializes the read-write lock for thread safety.
+ * This function creates a new key-value table with the specified name, whose shards
+ * have enough slots to hold `size` entries in total, evenly spread, without rehashing.
+ * It allocates the slot array and initializes the read-write lock of every shard.
  * The returned pointer must be released with destroy_kvtable() when no longer needed.
  *
  * @param name Name for the table (must not exceed MAX_NAME_LEN characters).
- * @param size Initial size of the hash table (number of buckets).
- * @param loadfactor Load factor threshold that triggers rehashing when exceeded.
+ * @param size Number of entries the table must hold before its first rehash.
  *
  * @return Pointer to the newly allocated KVTable on success, or NULL on failure.
  *
@@ -680,33 +1721,37 @@ int kv_put(KVTable *table, void *key, int klen, void *value, int vlen) {
  * @note The function will fail if name is longer than MAX_NAME_LEN or memory allocation fails.
  * @note The table starts with zero elements and will grow dynamically as needed.
  */
-static KVTable *alloc_kv_table_base(const char *name, int size, int loadfactor) {
+static KVTable *alloc_kv_table_base(const char *name, uint64_t size) {
 	if (strlen(name) > MAX_NAME_LEN)
 		return NULL;
 
-	KVTable *idx = (KVTable *) calloc_mem(1, sizeof(KVTable));
+	KVTable *idx = (KVTable *) aligned_calloc_mem(64, sizeof(KVTable));
 	if (!idx) 
 		return NULL;
 
 	strcpy(idx->name, name);
+	pthread_mutex_init(&idx->clock, NULL);
+	pthread_mutex_init(&idx->idle_lock, NULL);
+	pthread_cond_init(&idx->idle, NULL);
+	idx->epoch = get_time_ms_monotonic();
 	
-	pthread_rwlock_init(&idx->rwlock, NULL);
-	idx->map = (KVNode **) calloc_mem(size, sizeof(KVNode*));
-	if (!idx->map) {
-		free_mem(idx);
-		return NULL;
+	uint64_t nsize = slots_for((size + KV_SHARDS - 1) / KV_SHARDS);
+	for (int i = 0; i < KV_SHARDS; i++) {
+		KVShard *shard = &idx->shards[i];
+		if (alloc_slots(&shard->cur, nsize) != KV_SUCCESS) {
+			destroy_kvtable(&idx);
+			return NULL;
+		}
+		pthread_rwlock_init(&shard->rwlock, NULL);
+		shard->elements = 0;
+		shard->rehash = 0;
 	}
 
-	idx->mapsize = size;
-	idx->lfactor_thrhold = loadfactor;
-	idx->elements = 0;
-	idx->rehash = 0;
-
 	return idx;
 }
 
 KVTable *alloc_kvtable(const char *name) {
-	return alloc_kv_table_base(name, DEFAULT_INIT_SIZE, DEFAULT_LOAD_FACTOR);
+	return alloc_kv_table_base(name, DEFAULT_INIT_SIZE);
 }
 
 /**
@@ -716,8 +1761,8 @@ KVTable *alloc_kvtable(const char *name) {
  * and writes them to a binary file in a compact format. It generates a header with
  * versioning information and an index of all entries, followed by the serialized entries.
  *
- * @param table Pointer to the KVTable to be dumped. The table must be write-locked
- *              internally to avoid concurrent modifications during serialization.
+ * @param table Pointer to the KVTable to be dumped. All the shards are read-locked
+ *              to avoid concurrent modifications during serialization.
  * @param filename Name of the output file to store the serialized table contents.
  *
  * @return KV_SUCCESS on success. Returns a negative error code on failure:
@@ -725,45 +1770,68 @@ KVTable *alloc_kvtable(const char *name) {
  *         - KV_ERROR_FILEIO if the file could not be opened or written.
  *         - Other errors may be propagated from `kvio_init()` or `kv_store_io_dump()`.
  *
- * @note The function uses a write lock on the table to ensure thread-safety.
+ * @note The function holds the read locks of all the shards to ensure thread-safety.
  * @note The caller must ensure the file system is writable and that `filename` is valid.
  */
 int kv_dump(KVTable *table, const char *filename) {
 	uint64_t base_offset;
-	KVNode *node = NULL;
+	KVEntry *entry;
 	IOFile *file = NULL;
 	KVIO io;
-	int ret = KV_SUCCESS, i, e;
+	KVShard *shard;
+	uint64_t elements = 0, expired = 0;
+	int ret = KV_SUCCESS, e;
 	
 	
-	pthread_rwlock_wrlock(&table->rwlock);
+	kv_unsafe_lock(table);
+	for (shard = table->shards; shard < table->shards + KV_SHARDS; shard++)
+		elements += shard->elements;
 
-	if ((ret = kvio_init(&io, table->elements)) != KV_SUCCESS) {
-		pthread_rwlock_unlock(&table->rwlock);
+	if ((ret = kvio_init(&io, elements)) != KV_SUCCESS) {
+		kv_unsafe_unlock(table);
 		return ret;
 	}
 	
-	base_offset = sizeof(KVStoreHeader) + table->elements * sizeof(KVStoreEntry);
 	e = 0;
-	for ( i = 0; i < (int)table->mapsize; i ++ ) {
-		node = table->map[i];
-		while (node) {
-			if (node->entry) {
-				io.entry_index[e].entry_size   = sizeof(KVEntry) + node->entry->klen + node->entry->vlen;
-				io.entry_index[e].entry_offset = base_offset;
-				io.entries[e] = node->entry;
-				base_offset += io.entry_index[e].entry_size;
-				e++;
+	for (shard = table->shards; shard < table->shards + KV_SHARDS; shard++) {
+		uint64_t pos = 0;
+		while ((entry = next_entry(shard, &pos)) != NULL) {
+			/* The file has no TTLs; expired entries are left out */
+			if (entry_expired(table, entry)) {
+				expired++;
+				continue;
+			}
+			if (table->log) {
+				/* The file holds values, not the references of the table */
+				uint32_t vlen;
+				void *value = entry_value(table, entry, &vlen);
+				KVEntry *copy = (KVEntry *) calloc_mem(1, sizeof(KVEntry) + entry->klen + vlen);
+				if (!copy) {
+					ret = KV_ERROR_SYSTEM;
+					goto cleanup;
+				}
+				memcpy(copy, entry, sizeof(KVEntry) + entry->klen);
+				memcpy(&copy->buff[copy->klen], value, vlen);
+				copy->vlen = vlen;
+				entry = copy;
 			}
-			node = node->next;
+			io.entry_index[e].entry_size   = entry_size(entry);
+			io.entries[e] = entry;
+			e++;
 		}
 	}
-	if ( e != (int) table->elements ) {
+	if ( e + expired != elements ) {
 		ret = KV_ERROR_MISMATCH_ELEMENT_COUNT;
 		goto cleanup;
 	}
 	io.elements = e;
 
+	base_offset = sizeof(KVStoreHeader) + e * sizeof(KVStoreEntry);
+	for (int i = 0; i < e; i++) {
+		io.entry_index[i].entry_offset = base_offset;
+		base_offset += io.entry_index[i].entry_size;
+	}
+
 	file = file_open(filename, "wb");
 	if (!file) {
 		ret = KV_ERROR_FILEIO;
@@ -772,7 +1840,11 @@ int kv_dump(KVTable *table, const char *filename) {
 	ret = kv_store_io_dump(&io, file);
 	file_close(file);
 cleanup:
-	pthread_rwlock_unlock(&table->rwlock);
+	kv_unsafe_unlock(table);
+	if (table->log)
+		for (e = 0; e < (int) elements; e++)
+			if (io.entries[e])
+				free_mem(io.entries[e]);
 	kvio_free(&io);
 	return ret;
 }
@@ -785,7 +1857,7 @@ cleanup:
  * reconstructs the internal structure into a `KVTable`, and returns a pointer to the newly created table.
  *
  * The data is read into a temporary `KVIO` structure and then transferred into a new `KVTable` 
- * by allocating and inserting each `KVNode` into the appropriate hash bucket based on the stored hash value.
+ * by storing each entry in a slot chosen from its stored hash value, so keys are not hashed again.
  *
  * @param filename The path to the binary file containing the serialized key-value store.
  *
@@ -796,7 +1868,6 @@ cleanup:
  */
 KVTable *load_kvtable(const char *filename) {
 	KVTable *table;
-	KVNode  *node;
 	IOFile  *file;
 	KVIO io;
 	
@@ -810,28 +1881,29 @@ KVTable *load_kvtable(const char *filename) {
 	}
 
 	file_close(file);
-	table = alloc_kv_table_base("table-loaded", 2 * io.elements, DEFAULT_LOAD_FACTOR);
+	table = alloc_kv_table_base("table-loaded", 2 * io.elements);
 	if (!table) {
+		for ( int i = 0; i < io.elements; i ++ )
+			free_mem(io.entries[i]);
 		kvio_free(&io);
 		return NULL;
 	}
 
 	for ( int i = 0; i < io.elements; i ++ ) {
-		int bucket;
-		node = (KVNode *) calloc_mem(1, sizeof(KVNode));
-		if (!node) {
+		KVShard *shard = get_shard(table, io.entries[i]->hash);
+		size_t size = entry_size(io.entries[i]);
+		KVEntry *entry = NULL;
+		if (reserve_slot(shard) != KV_SUCCESS ||
+			(entry = alloc_entry(shard, size)) == NULL) {
+			for (int j = i; j < io.elements; j ++ )
+				free_mem(io.entries[j]);
 			destroy_kvtable(&table);
 			kvio_free(&io);
 			return NULL;
 		}
-		node->entry = io.entries[i];
-		bucket = node->entry->hash % table->mapsize;
-		node->next = table->map[bucket];
-		node->prev = NULL;
-		if (node->next)
-			node->next->prev = node;
-		table->map[bucket] = node;
-		table->elements++;
+		memcpy(entry, io.entries[i], size);
+		free_mem(io.entries[i]);
+		insert_entry(shard, entry);
 	}
 	kvio_free(&io);
 	return table;
@@ -847,25 +1919,30 @@ KVTable *load_kvtable(const char *filename) {
  * @param KVTable Pointer to the KVTable pointer to destroy.
  */
 void destroy_kvtable(KVTable **table) {
-    KVNode *node;
-	if (!table || !*table || !(*table)->map)
+	if (!table || !*table)
         return;
 
-    for (uint32_t i = 0; i < (*table)->mapsize; ++i) {
-        while ((*table)->map[i]) {
-            node = (*table)->map[i];
-            (*table)->map[i] = node->next;
-			if (node->entry)
-				free_mem(node->entry);
-			free_mem(node);
-        }
+    if ((*table)->log) {
+        /* Let a background compaction finish before the shards go away */
+        pthread_mutex_lock(&(*table)->idle_lock);
+        while (__atomic_load_n(&(*table)->compact_pending, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&(*table)->idle, &(*table)->idle_lock);
+        pthread_mutex_unlock(&(*table)->idle_lock);
+        kvlog_close(&(*table)->log);
     }
-
-    free_mem((*table)->map);
-    (*table)->map = NULL;
-    (*table)->elements = 0;
-    (*table)->mapsize = 0;
-	free_mem(*table);
+    for (KVShard *shard = (*table)->shards; shard < (*table)->shards + KV_SHARDS; shard++) {
+        if (!shard->cur.slots)
+            continue;
+        free_slots(&shard->cur, &shard->slab);
+        free_slots(&shard->old, &shard->slab);
+        slab_destroy(&shard->slab);
+        skiplist_destroy(&shard->order);
+        pthread_rwlock_destroy(&shard->rwlock);
+    }
+    pthread_mutex_destroy(&(*table)->clock);
+    pthread_mutex_destroy(&(*table)->idle_lock);
+    pthread_cond_destroy(&(*table)->idle);
+	free_aligned_mem(*table);
 	*table = NULL;
 }
 
@@ -873,8 +1950,8 @@ void destroy_kvtable(KVTable **table) {
  * @brief Retrieves the current number of elements in the key-value table.
  *
  * This function returns the total count of key-value pairs currently
- * stored in the table. The operation is thread-safe and uses a read lock
- * to ensure consistency during concurrent access.
+ * stored in the table. The operation is thread-safe: each shard is counted
+ * under its read lock, one shard at a time.
  *
  * @param table Pointer to the KVTable to query.
  * @param sz Pointer to a uint64_t variable to store the size.
@@ -889,8 +1966,382 @@ void destroy_kvtable(KVTable **table) {
 int kv_size(KVTable *table, uint64_t *sz) {
     if (!table)
         return KV_ERROR_INVALID_TABLE;
-    pthread_rwlock_rdlock(&table->rwlock);
-    *sz = table->elements;
-    pthread_rwlock_unlock(&table->rwlock);
+    *sz = 0;
+    for (KVShard *shard = table->shards; shard < table->shards + KV_SHARDS; shard++) {
+        pthread_rwlock_rdlock(&shard->rwlock);
+        *sz += shard->elements;
+        pthread_rwlock_unlock(&shard->rwlock);
+    }
     return KV_SUCCESS;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Keeps the entries of the table in key order from now on.
+ *
+ * The ordered index is built from the current entries with every shard
+ * locked, and is then maintained by kv_put() and kv_del(). Calling it on
+ * an ordered table does nothing.
+ *
+ * @param table Pointer to the KVTable.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE or KV_ERROR_SYSTEM.
+ */
+int kv_enable_ordered(KVTable *table) {
+	KVShard *shard;
+	KVEntry *entry;
+	int ret = KV_SUCCESS;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+
+	for (shard = table->shards; shard < table->shards + KV_SHARDS; shard++)
+		pthread_rwlock_wrlock(&shard->rwlock);
+
+	if (table->ordered)
+		goto unlock_return;
+	for (shard = table->shards; shard < table->shards + KV_SHARDS && ret == KV_SUCCESS; shard++) {
+		uint64_t pos = 0;
+
+		if (skiplist_init(&shard->order, entry_key) != SKIPLIST_SUCCESS) {
+			ret = KV_ERROR_SYSTEM;
+			break;
+		}
+		while ((entry = next_entry(shard, &pos)) != NULL) {
+			if (skiplist_insert(&shard->order, entry) != SKIPLIST_SUCCESS) {
+				ret = KV_ERROR_SYSTEM;
+				break;
+			}
+		}
+	}
+	if (ret == KV_SUCCESS)
+		table->ordered = 1;
+	else
+		for (shard = table->shards; shard < table->shards + KV_SHARDS; shard++)
+			skiplist_destroy(&shard->order);
+
+unlock_return:
+	for (int i = KV_SHARDS - 1; i >= 0; i--)
+		pthread_rwlock_unlock(&table->shards[i].rwlock);
+	return ret;
+}
+
+/*
+ * Opens a cursor positioned at `from` (or at the first key). No lock is
+ * held until the first kv_cursor_next().
+ */
+static int cursor_open(KVTable *table, const void *from, int flen, const void *bound, int blen,
+					   int prefix, KVCursor **cursor) {
+	struct KVCursor *c;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!cursor || flen < 0 || blen < 0 || (flen > 0 && !from) || (blen > 0 && !bound))
+		return KV_ERROR_INVALID_KEY;
+	if (!table->ordered)
+		return KV_ERROR_NOT_ORDERED;
+
+	if ((c = calloc_mem(1, sizeof(struct KVCursor))) == NULL)
+		return KV_ERROR_SYSTEM;
+	if (blen > 0) {
+		if ((c->bound = calloc_mem(1, blen)) == NULL) {
+			free_mem(c);
+			return KV_ERROR_SYSTEM;
+		}
+		memcpy(c->bound, bound, blen);
+		c->blen = blen;
+		c->prefix = prefix;
+	}
+	if (flen > 0) {
+		if ((c->last = calloc_mem(1, flen)) == NULL) {
+			if (c->bound)
+				free_mem(c->bound);
+			free_mem(c);
+			return KV_ERROR_SYSTEM;
+		}
+		memcpy(c->last, from, flen);
+		c->llen = c->lcap = flen;
+	}
+	c->inclusive = 1;
+	c->table = table;
+	*cursor = c;
+	return KV_SUCCESS;
+}
+
+/**
+ * @brief Opens a cursor over the keys that start with a prefix, in key order.
+ *
+ * @param table Pointer to an ordered KVTable (see kv_enable_ordered()).
+ * @param prefix Pointer to the prefix.
+ * @param plen Length of the prefix in bytes; 0 scans the whole table.
+ * @param cursor Receives the cursor, to be closed with kv_cursor_close().
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_INVALID_KEY,
+ *         KV_ERROR_NOT_ORDERED or KV_ERROR_SYSTEM.
+ */
+int kv_scan_prefix(KVTable *table, const void *prefix, int plen, KVCursor **cursor) {
+	return cursor_open(table, prefix, plen, prefix, plen, 1, cursor);
+}
+
+/**
+ * @brief Opens a cursor over the keys in [from, to), in key order.
+ *
+ * @param table Pointer to an ordered KVTable (see kv_enable_ordered()).
+ * @param from Pointer to the first key of the range.
+ * @param flen Length of `from` in bytes; 0 starts at the first key.
+ * @param to Pointer to the end of the range (excluded).
+ * @param tlen Length of `to` in bytes; 0 scans up to the last key.
+ * @param cursor Receives the cursor, to be closed with kv_cursor_close().
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_INVALID_KEY,
+ *         KV_ERROR_NOT_ORDERED or KV_ERROR_SYSTEM.
+ */
+int kv_scan_range(KVTable *table, const void *from, int flen, const void *to, int tlen, KVCursor **cursor) {
+	return cursor_open(table, from, flen, to, tlen, 0, cursor);
+}
+
+/**
+ * @brief Returns the next entries of a scan.
+ *
+ * @param cursor Cursor opened with kv_scan_prefix() or kv_scan_range().
+ * @param results Array of at least `max` results.
+ * @param max Maximum number of entries to return.
+ * @param found Receives the number of entries returned; 0 at the end of the scan.
+ *
+ * The shards are read-locked, in order, only while the batch is merged
+ * from their lists and copied to the cursor: the walk resumes at the
+ * first key after the last one it visited.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_VALUE or KV_ERROR_SYSTEM.
+ */
+int kv_cursor_next(KVCursor *cursor, KVResult *results, int max, int *found) {
+	struct KVCursor *c = cursor;
+	const KVEntry *entry = NULL;
+	SkipNode *pos[KV_SHARDS], *node = NULL;
+	KVShard *shard;
+	size_t used = 0;
+	int r = 0, ret = KV_SUCCESS;
+
+	if (!c || !results || max <= 0 || !found)
+		return KV_ERROR_INVALID_VALUE;
+	*found = 0;
+	if (c->done)
+		return KV_SUCCESS;
+
+	for (shard = c->table->shards; shard < c->table->shards + KV_SHARDS; shard++)
+		pthread_rwlock_rdlock(&shard->rwlock);
+	cursor_seek(c->table, c, pos);
+	while (r < max && (node = cursor_pop(c, pos)) != NULL) {
+		KVResult *res = &results[r];
+
+		entry = (const KVEntry *) node->item;
+		if (entry_expired(c->table, (KVEntry *) entry))
+			continue;
+		set_result(c->table, res, (KVEntry *) entry);
+		if ((ret = cursor_reserve((void **) &c->buff, &c->bsize, used + res->klen + res->vlen)) != KV_SUCCESS)
+			break;
+		/* Offsets until the buffer stops moving */
+		memcpy(c->buff + used, res->key, res->klen);
+		res->key = (void *) (uintptr_t) used;
+		used += res->klen;
+		memcpy(c->buff + used, res->value, res->vlen);
+		res->value = (void *) (uintptr_t) used;
+		used += res->vlen;
+		r++;
+	}
+	if (ret == KV_SUCCESS) {
+		if (r < max)
+			c->done = 1;
+		if (entry) {
+			ret = cursor_reserve((void **) &c->last, &c->lcap, entry->klen);
+			if (ret == KV_SUCCESS) {
+				memcpy(c->last, entry->buff, entry->klen);
+				c->llen = entry->klen;
+				c->inclusive = 0;
+			}
+		}
+	}
+	for (int s = KV_SHARDS - 1; s >= 0; s--)
+		pthread_rwlock_unlock(&c->table->shards[s].rwlock);
+
+	if (ret != KV_SUCCESS)
+		return ret;
+	for (int i = 0; i < r; i++) {
+		results[i].key   = c->buff + (uintptr_t) results[i].key;
+		results[i].value = c->buff + (uintptr_t) results[i].value;
+	}
+	*found = r;
+	return KV_SUCCESS;
+}
+
+/**
+ * @brief Closes a cursor and releases its buffers.
+ *
+ * @param cursor Pointer to the cursor; set to NULL.
+ *
+ * @return KV_SUCCESS or KV_ERROR_INVALID_VALUE.
+ */
+int kv_cursor_close(KVCursor **cursor) {
+	if (!cursor || !*cursor)
+		return KV_ERROR_INVALID_VALUE;
+
+	if ((*cursor)->bound)
+		free_mem((*cursor)->bound);
+	if ((*cursor)->last)
+		free_mem((*cursor)->last);
+	if ((*cursor)->buff)
+		free_mem((*cursor)->buff);
+	free_mem(*cursor);
+	*cursor = NULL;
+	return KV_SUCCESS;
+}
+
+/*
+ * Applies a record of the data file of a persistent table.
+ */
+static int replay_record(void *arg, int type, const void *key, uint32_t klen, const KVLogRef *ref) {
+	KVTable *table = (KVTable *) arg;
+	int ret;
+
+	if (type == KVLOG_PUT)
+		return table_put(table, (void *) key, (int) klen, ref, sizeof(KVLogRef), 0, 0);
+	ret = table_del(table, (void *) key, (int) klen, 0);
+	return ret == KV_KEY_NOT_FOUND ? KV_SUCCESS : ret;
+}
+
+/*
+ * Clears `compact_pending` and wakes destroy_kvtable() if it is waiting.
+ */
+static void compact_done(KVTable *table) {
+	pthread_mutex_lock(&table->idle_lock);
+	__atomic_store_n(&table->compact_pending, 0, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&table->idle);
+	pthread_mutex_unlock(&table->idle_lock);
+}
+
+static void compact_task(void *arg) {
+	KVTable *table = (KVTable *) arg;
+
+	kv_compact(table);
+	compact_done(table);
+}
+
+/*
+ * Queues a compaction on the library pool unless one is pending.
+ */
+static void schedule_compaction(KVTable *table) {
+	int idle = 0;
+
+	if (!__atomic_compare_exchange_n(&table->compact_pending, &idle, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return;
+	if (pool_submit(compact_task, table) != 0)
+		compact_done(table);
+}
+
+/**
+ * @brief Opens a persistent table backed by an append-only data file.
+ *
+ * The file is created if it does not exist. Otherwise its records are
+ * replayed to rebuild the in-memory index of keys (values stay in the
+ * file), a torn tail left by a crash is truncated, and a compaction
+ * interrupted by a crash is finished.
+ *
+ * @param filename Path of the data file.
+ * @param ctx Durability and compaction settings, or NULL for defaults.
+ *
+ * @return A pointer to the table, or NULL on error.
+ */
+KVTable *open_kvtable(const char *filename, KVLogContext *ctx) {
+	KVTable *table;
+	KVLog *log;
+	int ret;
+
+	if (!filename || kvlog_open(&log, filename, ctx) != KV_SUCCESS)
+		return NULL;
+	if ((table = alloc_kv_table_base("table-persistent", DEFAULT_INIT_SIZE)) == NULL) {
+		kvlog_close(&log);
+		return NULL;
+	}
+	table->log = log;
+
+	/* No background compaction while the table is being rebuilt */
+	table->compact_pending = 1;
+	ret = kvlog_replay(log, replay_record, table);
+	if (ret == KV_SUCCESS && kvlog_compacting(log))
+		ret = kv_compact(table);
+	compact_done(table);
+
+	if (ret != KV_SUCCESS) {
+		destroy_kvtable(&table);
+		return NULL;
+	}
+	if (kvlog_due(log))
+		schedule_compaction(table);
+	return table;
+}
+
+/**
+ * @brief Flushes the data file of a persistent table to stable storage.
+ *
+ * @param table Pointer to a table opened with open_kvtable().
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_NOT_PERSISTENT or KV_ERROR_FILEIO.
+ */
+int kv_sync(KVTable *table) {
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!table->log)
+		return KV_ERROR_NOT_PERSISTENT;
+	return kvlog_sync(table->log);
+}
+
+/**
+ * @brief Rewrites the live records of a persistent table into a new data file.
+ *
+ * New writes go to the new file as soon as the compaction starts. The live
+ * entries still in the old file are then copied shard by shard, each shard
+ * being locked while its entries are moved, and the new file replaces the
+ * old one.
+ *
+ * @param table Pointer to a table opened with open_kvtable().
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_NOT_PERSISTENT,
+ *         KV_ERROR_FILEIO or KV_ERROR_SYSTEM.
+ */
+int kv_compact(KVTable *table) {
+	KVShard *shard;
+	KVEntry *entry;
+	KVLogRef ref;
+	uint32_t gen;
+	int ret;
+
+	if (!table)
+		return KV_ERROR_INVALID_TABLE;
+	if (!table->log)
+		return KV_ERROR_NOT_PERSISTENT;
+
+	pthread_mutex_lock(&table->clock);
+	if ((ret = kvlog_compact_begin(table->log, &gen)) != KV_SUCCESS)
+		goto unlock_return;
+
+	for (shard = table->shards; shard < table->shards + KV_SHARDS && ret == KV_SUCCESS; shard++) {
+		uint64_t pos = 0;
+
+		pthread_rwlock_wrlock(&shard->rwlock);
+		while (ret == KV_SUCCESS && (entry = next_entry(shard, &pos)) != NULL) {
+			memcpy(&ref, &entry->buff[entry->klen], sizeof(KVLogRef));
+			if (ref.gen != gen)
+				continue;
+			ret = kvlog_append(table->log, KVLOG_PUT, entry->buff, entry->klen,
+							   kvlog_value(table->log, &ref), ref.vlen, &ref);
+			if (ret == KV_SUCCESS)
+				memcpy(&entry->buff[entry->klen], &ref, sizeof(KVLogRef));
+		}
+		pthread_rwlock_unlock(&shard->rwlock);
+	}
+	if (ret == KV_SUCCESS)
+		ret = kvlog_compact_end(table->log);
+
+unlock_return:
+	pthread_mutex_unlock(&table->clock);
+	return ret;
+}
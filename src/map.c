@@ -27,6 +27,9 @@
 
 #include "map.h"
 
+/* Non-empty buckets moved from the old array by each insert or removal */
+#define MAP_REHASH_STEP  4
+
 
 /**
  * Computes the bucket index for a given ID using modulo hashing.
@@ -41,19 +44,67 @@ static inline int LOAD_FACTOR(const Map *map) {
 }
 
 /**
- * Checks whether an entry with the given key exists in the map.
+ * Returns the link pointing to the node of `key` (or to the end of its
+ * bucket), looking in the old bucket array too while rehashing.
  */
-int map_has(const Map *map, uint64_t key) {
-    int i = map_hash(map, key);
-    MapNode *ptr;
+static MapNode **map_find(const Map *map, uint64_t key) {
+    MapNode **pp = &map->map[map_hash(map, key)];
+
+    while (*pp && (*pp)->key != key)
+        pp = &(*pp)->next;
+    if (*pp == NULL && map->old) {
+        pp = &map->old[key % map->oldsize];
+        while (*pp && (*pp)->key != key)
+            pp = &(*pp)->next;
+    }
+    return pp;
+}
+
+/**
+ * Moves up to `n` non-empty buckets of the old array into the new one, and
+ * releases the old array once all its buckets are moved. At most 10 empty
+ * buckets per moved bucket are skipped, to bound the work of a single call.
+ */
+static void map_rehash_step(Map *map, int n) {
+    uint32_t empty_visits = n * 10;
+    MapNode *curr, *next;
+    uint32_t j;
+
+    if (map->old == NULL)
+        return;
+
+    while (n > 0 && map->rehashidx < map->oldsize) {
+        curr = map->old[map->rehashidx];
+        if (curr == NULL) {
+            map->rehashidx++;
+            if (--empty_visits == 0)
+                break;
+            continue;
+        }
+        while (curr) {
+            next = curr->next;
+            j = map_hash(map, curr->key);
+            curr->next = map->map[j];
+            map->map[j] = curr;
+            curr = next;
+        }
+        map->old[map->rehashidx++] = NULL;
+        n--;
+    }
 
-    ptr = map->map[i];
-    while (ptr) {
-        if (ptr->key == key)
-            return 1;
-        ptr = ptr->next;
+    if (map->rehashidx == map->oldsize) {
+        free_mem_acct(map->acct, MEM_MAP_BUCKETS, map->old, map->oldsize * sizeof(MapNode *));
+        map->old = NULL;
+        map->oldsize = 0;
+        map->rehashidx = 0;
     }
-    return 0;
+}
+
+/**
+ * Checks whether an entry with the given key exists in the map.
+ */
+int map_has(const Map *map, uint64_t key) {
+    return *map_find(map, key) != NULL;
 }
 
 /**
@@ -71,15 +122,11 @@ void *map_get_p(const Map *map, uint64_t key) {
 }
 
 int map_get_safe(const Map *map, uint64_t key, uint64_t *out) {
-    int i = map_hash(map, key);
-    MapNode *ptr = map->map[i];
+    MapNode *ptr = *map_find(map, key);
 
-    while (ptr) {
-        if (ptr->key == key) {
-            *out = ptr->value;
-            return MAP_OK;
-        }
-        ptr = ptr->next;
+    if (ptr) {
+        *out = ptr->value;
+        return MAP_OK;
     }
 
     return MAP_KEY_NOT_FOUND;
@@ -94,19 +141,17 @@ int map_get_safe_p(const Map *map, uint64_t key, void **out) {
 }
 
 int map_remove_safe(Map *map, uint64_t key, uint64_t *out) {
-    int i = map_hash(map, key);
-    MapNode **pp = &map->map[i];
-    MapNode *node;
+    MapNode **pp, *node;
 
-    while ((node = *pp)) {
-        if (node->key == key) {
-            *pp = node->next;
-            *out = node->value;
-            free_mem(node);
-            map->elements--;
-            return MAP_OK;
-        }
-        pp = &node->next;
+    map_rehash_step(map, MAP_REHASH_STEP);
+
+    pp = map_find(map, key);
+    if ((node = *pp)) {
+        *pp = node->next;
+        *out = node->value;
+        free_mem_acct(map->acct, MEM_MAP_NODES, node, sizeof(MapNode));
+        map->elements--;
+        return MAP_OK;
     }
 
     return MAP_KEY_NOT_FOUND;
@@ -133,31 +178,34 @@ void *map_remove_p(Map *map, uint64_t key) {
     void *ptr;
     return map_remove_safe_p(map, key, &ptr) == MAP_OK ? ptr : NULL;
 }
+
+int map_replace(Map *map, uint64_t key, uint64_t value) {
+    MapNode *node = *map_find(map, key);
+
+    if (node == NULL)
+        return MAP_KEY_NOT_FOUND;
+    node->value = value;
+    return MAP_OK;
+}
+
+int map_replace_p(Map *map, uint64_t key, void *value) {
+    return map_replace(map, key, (uint64_t)(uintptr_t) value);
+}
 /**
- * Internal function that resizes the hash map and re-distributes entries.
+ * Internal function that starts resizing the hash map: the current buckets
+ * become the old array, whose entries map_rehash_step() re-distributes.
  */
 static int map_rehash(Map *map, uint32_t new_mapsize) {
-    MapNode *next, *curr;
-    uint32_t j;
-
     PANIC_IF(map == NULL, "map is null in rehash");
+    PANIC_IF(map->old != NULL, "rehash already in progress");
 
-    MapNode **new_map = (MapNode **) calloc_mem(new_mapsize, sizeof(MapNode*));
+    MapNode **new_map = (MapNode **) calloc_mem_acct(map->acct, MEM_MAP_BUCKETS, new_mapsize, sizeof(MapNode*));
     if (new_map == NULL)
         return MAP_ERROR_ALLOC;
 
-    for (uint32_t i = 0; i < map->mapsize; ++i) {
-        curr = map->map[i];
-        while (curr) {
-            next = curr->next;
-            j = curr->key % new_mapsize;
-            curr->next = new_map[j];
-            new_map[j] = curr;
-            curr = next;
-        }
-    }
-
-    free_mem(map->map);
+    map->old = map->map;
+    map->oldsize = map->mapsize;
+    map->rehashidx = 0;
     map->map = new_map;
     map->mapsize = new_mapsize;
 	map->rehash++;
@@ -171,7 +219,8 @@ int map_insert(Map *map, uint64_t key, uint64_t value) {
     PANIC_IF(map == NULL, "map null in map_insert");
     PANIC_IF(map->mapsize == 0, "map has invalid mapsize in insert");
 
-    if (LOAD_FACTOR(map) > map->lfactor_thrhold) {
+    map_rehash_step(map, MAP_REHASH_STEP);
+    if (LOAD_FACTOR(map) > map->lfactor_thrhold && map->old == NULL) {
         uint32_t new_size = map->mapsize * 2;
         if (map_rehash(map, new_size) != MAP_SUCCESS)
             return MAP_ERROR_ALLOC;
@@ -179,7 +228,7 @@ int map_insert(Map *map, uint64_t key, uint64_t value) {
 
     int i = map_hash(map, key);
 
-    MapNode *node = (MapNode *) calloc_mem(1, sizeof(MapNode));
+    MapNode *node = (MapNode *) calloc_mem_acct(map->acct, MEM_MAP_NODES, 1, sizeof(MapNode));
     if (!node)
         return MAP_ERROR_ALLOC;
 
@@ -212,23 +261,68 @@ int init_map(Map *map, uint32_t initial_size, uint16_t lfactor_thrhold) {
     map->lfactor_thrhold = lfactor_thrhold;
     map->elements = 0;
 	map->rehash = 0;
+    map->old = NULL;
+    map->oldsize = 0;
+    map->rehashidx = 0;
+    map->acct = NULL;
 
     return MAP_SUCCESS;
 }
 
+void map_account(Map *map, MemAccount *acct) {
+    MapIter it = MAP_ITER_INIT();
+    MapNode *node;
+
+    map->acct = acct;
+    mem_track(acct, MEM_MAP_BUCKETS, map->map, map->mapsize * sizeof(MapNode *));
+    if (map->old)
+        mem_track(acct, MEM_MAP_BUCKETS, map->old, map->oldsize * sizeof(MapNode *));
+    while ((node = map_next(map, &it)) != NULL)
+        mem_track(acct, MEM_MAP_NODES, node, sizeof(MapNode));
+}
+
+/**
+ * Returns the next entry of an iteration.
+ */
+MapNode *map_next(const Map *map, MapIter *it) {
+    uint64_t total = (uint64_t) map->mapsize + (map->old ? map->oldsize : 0);
+    MapNode *node = it->next;
+
+    while (node == NULL && it->bucket < total) {
+        node = it->bucket < map->mapsize ? map->map[it->bucket] : map->old[it->bucket - map->mapsize];
+        it->bucket++;
+    }
+    it->next = node ? node->next : NULL;
+    return node;
+}
+
+/**
+ * Frees the nodes of a bucket array.
+ */
+static void map_free_nodes(Map *map, MapNode **buckets, uint32_t size) {
+    MapNode *node;
+    for (uint32_t i = 0; i < size; ++i) {
+        while (buckets[i]) {
+            node = buckets[i];
+            buckets[i] = node->next;
+            free_mem_acct(map->acct, MEM_MAP_NODES, node, sizeof(MapNode));
+        }
+    }
+}
+
 /**
  * Reset the map
  */
 void map_purge(Map *map) {
-    MapNode *node;
     if (!map || !map->map)
         return;
-    for (uint32_t i = 0; i < map->mapsize; ++i) {
-        while (map->map[i]) {
-            node = map->map[i];
-            map->map[i] = node->next;
-            free_mem(node);
-        }
+    map_free_nodes(map, map->map, map->mapsize);
+    if (map->old) {
+        map_free_nodes(map, map->old, map->oldsize);
+        free_mem_acct(map->acct, MEM_MAP_BUCKETS, map->old, map->oldsize * sizeof(MapNode *));
+        map->old = NULL;
+        map->oldsize = 0;
+        map->rehashidx = 0;
     }
     map->elements = 0;
 }
@@ -239,16 +333,9 @@ void map_destroy(Map *map) {
     if (!map || !map->map)
         return;
 
-    for (uint32_t i = 0; i < map->mapsize; ++i) {
-        MapNode *node = map->map[i];
-        while (node) {
-            MapNode *next = node->next;
-            free_mem(node);
-            node = next;
-        }
-    }
+    map_purge(map);
 
-    free_mem(map->map);
+    free_mem_acct(map->acct, MEM_MAP_BUCKETS, map->map, map->mapsize * sizeof(MapNode *));
     map->map = NULL;
     map->elements = 0;
     map->mapsize = 0;
@@ -25,6 +25,10 @@
 * to vector objects indexed by 64-bit unique IDs. The structure supports dynamic
 * resizing (rehashing) based on a configurable load factor threshold, providing
 * efficient insertions, lookups, and deletions.
+*
+* Rehashing is incremental: the old bucket array is kept next to the new one
+* and every insert or removal moves a few of its buckets, while lookups search
+* both arrays until the old one is empty.
 */
 
 #ifndef __MAP_H
@@ -62,6 +66,12 @@ typedef struct {
 	
     uint64_t elements;            // Total number of elements stored
     MapNode  **map;               // Array of buckets
+
+    MapNode  **old;               // Buckets being rehashed into `map`, or NULL
+    uint32_t oldsize;             // Number of buckets in `old`
+    uint32_t rehashidx;           // Next bucket of `old` to move
+
+    MemAccount *acct;             // Account charged with buckets and nodes, or NULL
 } Map;
 
 #define MAP_INIT() ((Map){ \
@@ -69,9 +79,23 @@ typedef struct {
     .lfactor_thrhold = 0, \
     .mapsize = 0, \
     .elements = 0, \
-    .map = NULL \
+    .map = NULL, \
+    .old = NULL, \
+    .oldsize = 0, \
+    .rehashidx = 0, \
+    .acct = NULL \
 })
 
+/**
+ * Position of an iteration over the entries of a map.
+ */
+typedef struct {
+    uint64_t bucket;              // Next bucket: those of `map`, then those of `old`
+    MapNode  *next;               // Next node of the current bucket
+} MapIter;
+
+#define MAP_ITER_INIT() ((MapIter){ .bucket = 0, .next = NULL })
+
 /**
  * Checks whether the specified ID exists in the map.
  *
@@ -104,6 +128,17 @@ extern uint64_t map_remove(Map *map, uint64_t key);
 extern void *map_remove_p(Map *map, uint64_t key);
 extern int map_remove_safe(Map *map, uint64_t key, uint64_t *out);
 extern int map_remove_safe_p(Map *map, uint64_t key, void **out);
+
+/**
+ * Replaces the value of an existing entry. Never allocates.
+ *
+ * @param map Pointer to the Map structure.
+ * @param key Key of the entry.
+ * @param value New value.
+ * @return MAP_OK, or MAP_KEY_NOT_FOUND if the key is not in the map.
+ */
+extern int map_replace(Map *map, uint64_t key, uint64_t value);
+extern int map_replace_p(Map *map, uint64_t key, void *value);
 /**
  * Inserts a new entry into the map.
  * Triggers a rehash if the load factor exceeds the threshold.
@@ -115,6 +150,16 @@ extern int map_remove_safe_p(Map *map, uint64_t key, void **out);
  */
 extern int map_insert(Map *map, uint64_t key, uint64_t value);
 extern int map_insert_p(Map *map, uint64_t key, void *value);
+/**
+ * Returns the next entry of an iteration started with MAP_ITER_INIT().
+ * The map must not be modified while it is being iterated.
+ *
+ * @param map Pointer to the Map structure.
+ * @param it  Iteration position.
+ * @return The next node, or NULL at the end of the map.
+ */
+extern MapNode *map_next(const Map *map, MapIter *it);
+
 /**
  * Initializes the map with a given initial size and load factor threshold.
  *
@@ -125,6 +170,12 @@ extern int map_insert_p(Map *map, uint64_t key, void *value);
  */
 extern int init_map(Map *map, uint32_t initial_size, uint16_t lfactor_thrhold);
 
+/**
+ * Charges the buckets and entries of the map, present and future, to
+ * `acct` (MEM_MAP_BUCKETS and MEM_MAP_NODES). Call after init_map().
+ */
+extern void map_account(Map *map, MemAccount *acct);
+
 /**
  * Reset the map
  */
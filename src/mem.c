@@ -30,7 +30,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "mem.h"
 
+/* Installed by set_mem_hooks(); `hooked` is set when they replace the heap */
+static MemHooks hooks;
+static int hooked = 0;
+
+int set_mem_hooks(const MemHooks *h) {
+    if (h == NULL) {
+        memset(&hooks, 0, sizeof(MemHooks));
+        hooked = 0;
+        return SUCCESS;
+    }
+    if (!h->calloc || !h->realloc || !h->free || !h->aligned_calloc != !h->aligned_free)
+        return INVALID_ARGUMENT;
+    hooks = *h;
+    hooked = 1;
+    return SUCCESS;
+}
 
 /**
   * Allocates memory for an array of `__count` elements of `__size` bytes each.
@@ -57,20 +74,29 @@ static void ensure_heap() {
 }
 
 void *calloc_mem(size_t count, size_t size) {
+    if (hooked)
+        return hooks.calloc(count, size);
     ensure_heap();
     return mi_heap_calloc(thread_heap, count, size);
 }
 
 void *realloc_mem(void *ptr, size_t size) {
+    if (hooked)
+        return hooks.realloc(ptr, size);
 	ensure_heap();
     return mi_heap_realloc(ptr, size);
 }
 
 void free_mem(void *ptr) {
-    mi_free(ptr);
+    if (hooked)
+        hooks.free(ptr);
+    else
+        mi_free(ptr);
 }
 
 void *aligned_calloc_mem(size_t alignment, size_t size) {
+    if (hooks.aligned_calloc)
+        return hooks.aligned_calloc(alignment, size);
     ensure_heap();
     void *ptr = mi_heap_malloc_aligned(thread_heap, size, alignment);
     if (ptr) memset(ptr, 0, size);
@@ -78,7 +104,10 @@ void *aligned_calloc_mem(size_t alignment, size_t size) {
 }
 
 void free_aligned_mem(void *ptr) {
-    mi_free(ptr); // same as normal
+    if (hooks.aligned_free)
+        hooks.aligned_free(ptr);
+    else
+        mi_free(ptr); // same as normal
 }
 
 void destroy_thread_heap() {
@@ -94,6 +123,8 @@ void destroy_thread_heap() {
   * This function abstracts `calloc` to allow for future optimizations.
   */
 void *calloc_mem(size_t __count, size_t __size) {
+    if (hooked)
+        return hooks.calloc(__count, __size);
     return calloc(__count, __size);
 }
  
@@ -102,6 +133,8 @@ void *calloc_mem(size_t __count, size_t __size) {
   * This function abstracts `realloc` to allow for future optimizations or custom allocators.
   */
 void *realloc_mem(void *__ptr, size_t __size) {
+    if (hooked)
+        return hooks.realloc(__ptr, __size);
     return realloc(__ptr, __size);
 }
 
@@ -111,7 +144,10 @@ void *realloc_mem(void *__ptr, size_t __size) {
   * This function abstracts `free` to allow for future memory management strategies.
   */
 void free_mem(void *__mem) {
-    free(__mem);
+    if (hooked)
+        hooks.free(__mem);
+    else
+        free(__mem);
 }
 
 
@@ -131,6 +167,9 @@ void free_mem(void *__mem) {
 void *aligned_calloc_mem(size_t alignment, size_t size) {
     void *ptr = NULL;
 
+    if (hooks.aligned_calloc)
+        return hooks.aligned_calloc(alignment, size);
+
 #if defined(_WIN32)
     ptr = _aligned_malloc(size, alignment);
     if (ptr) memset(ptr, 0, size);
@@ -153,6 +192,10 @@ void *aligned_calloc_mem(size_t alignment, size_t size) {
  * @param ptr Pointer to memory previously allocated with aligned_calloc_mem.
  */
 void free_aligned_mem(void *ptr) {
+    if (hooks.aligned_free) {
+        hooks.aligned_free(ptr);
+        return;
+    }
 #if defined(_WIN32)
     _aligned_free(ptr);
 #else
@@ -160,4 +203,78 @@ void free_aligned_mem(void *ptr) {
 #endif
 }
 
-#endif
\ No newline at end of file
+#endif
+
+/*
+ * Usable size of a block and bytes the allocator keeps in front of it;
+ * both only known for glibc and mimalloc, and only while no hooks are
+ * installed.
+ */
+#if defined(__USE_THREAD_MEM)
+#define usable_size(p) mi_usable_size(p)
+#define CHUNK_HEADER   0
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#define usable_size(p) malloc_usable_size((void *) (p))
+#define CHUNK_HEADER   sizeof(size_t)
+#else
+#define usable_size(p) 0
+#define CHUNK_HEADER   0
+#endif
+
+void mem_track(MemAccount *acct, int cat, const void *block, int64_t bytes) {
+    int64_t size = bytes < 0 ? -bytes : bytes;
+    int64_t extra;
+
+    if (acct == NULL)
+        return;
+    __atomic_add_fetch(&acct->bytes[cat], bytes, __ATOMIC_RELAXED);
+    if (block == NULL || hooked)
+        return;
+    extra = (int64_t) usable_size(block) - size;
+    extra = (extra > 0 ? extra : 0) + (int64_t) CHUNK_HEADER;
+    __atomic_add_fetch(&acct->bytes[MEM_OVERHEAD], bytes < 0 ? -extra : extra, __ATOMIC_RELAXED);
+}
+
+void *calloc_mem_acct(MemAccount *acct, int cat, size_t count, size_t size) {
+    void *ptr = calloc_mem(count, size);
+
+    if (ptr)
+        mem_track(acct, cat, ptr, (int64_t) (count * size));
+    return ptr;
+}
+
+void free_mem_acct(MemAccount *acct, int cat, void *ptr, size_t size) {
+    if (ptr)
+        mem_track(acct, cat, ptr, -(int64_t) size);
+    free_mem(ptr);
+}
+
+void *alloc_object(MemAccount *acct, int cat, size_t size, size_t alignment) {
+    void *ptr;
+
+    if (acct && acct->alloc) {
+        if ((ptr = acct->alloc->alloc(acct->alloc->ctx, size, alignment)) != NULL)
+            mem_track(acct, cat, NULL, (int64_t) size);
+        return ptr;
+    }
+    ptr = alignment ? aligned_calloc_mem(alignment, size) : calloc_mem(1, size);
+    if (ptr)
+        mem_track(acct, cat, ptr, (int64_t) size);
+    return ptr;
+}
+
+void free_object(MemAccount *acct, int cat, void *ptr, size_t size, size_t alignment) {
+    if (ptr == NULL)
+        return;
+    if (acct && acct->alloc) {
+        mem_track(acct, cat, NULL, -(int64_t) size);
+        acct->alloc->free(acct->alloc->ctx, ptr, size);
+        return;
+    }
+    mem_track(acct, cat, ptr, -(int64_t) size);
+    if (alignment)
+        free_aligned_mem(ptr);
+    else
+        free_mem(ptr);
+}
@@ -28,6 +28,37 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include "victor.h"
+
+/* Categories of a MemAccount; see MemStats */
+#define MEM_VECTORS     0
+#define MEM_NODES       1
+#define MEM_MAP_BUCKETS 2
+#define MEM_MAP_NODES   3
+#define MEM_PAYLOADS    4
+#define MEM_TOMBSTONES  5   // Bytes of other categories held by deleted vectors
+#define MEM_OVERHEAD    6
+#define MEM_MAPPED      7
+#define MEM_ADJACENCY   8   // First of MEM_LEVELS, one per graph level
+#define MEM_CATEGORIES  (MEM_ADJACENCY + MEM_LEVELS)
+
+#define MEM_LEVEL(l) (MEM_ADJACENCY + ((l) < MEM_LEVELS ? (l) : MEM_LEVELS - 1))
+
+struct VectorBlock;
+
+/*
+ * Bytes held per category by the owner of the account (an index), and
+ * the allocator of its nodes and vectors. Updated with relaxed atomics.
+ * `blocks` lists the loaded vector blocks still referenced by the owner,
+ * guarded by the `block_lock` spinlock (see vector.c).
+ */
+typedef struct {
+    int64_t bytes[MEM_CATEGORIES];
+    const IndexAllocator *alloc;    // NULL for the library heap
+    struct VectorBlock *blocks;
+    char block_lock;
+} MemAccount;
 
 extern void *calloc_mem(size_t __count, size_t __size);
 
@@ -42,4 +73,28 @@ extern void free_aligned_mem(void *ptr);
 extern void *global_calloc_mem(size_t __count, size_t __size);
 
 extern void global_free_mem(void *__mem);
+
+/*
+ * Adds `bytes` (negative to subtract) to a category of `acct`. When
+ * `block` is the allocation holding them, its allocator overhead is added
+ * to (or subtracted from) MEM_OVERHEAD as well. `acct` may be NULL.
+ */
+extern void mem_track(MemAccount *acct, int cat, const void *block, int64_t bytes);
+
+/*
+ * calloc_mem() and free_mem() accounting the block to `cat`. `size` given
+ * to free_mem_acct() must be the `count * size` it was allocated with.
+ */
+extern void *calloc_mem_acct(MemAccount *acct, int cat, size_t __count, size_t __size);
+
+extern void free_mem_acct(MemAccount *acct, int cat, void *__mem, size_t __size);
+
+/*
+ * Allocates a zeroed node or vector with the allocator of `acct` and
+ * accounts it to `cat`. An `alignment` of 0 asks for calloc_mem()
+ * alignment. free_object() must be given the same size and alignment.
+ */
+extern void *alloc_object(MemAccount *acct, int cat, size_t size, size_t alignment);
+
+extern void free_object(MemAccount *acct, int cat, void *ptr, size_t size, size_t alignment);
 #endif
\ No newline at end of file
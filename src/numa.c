@@ -0,0 +1,273 @@
+/*
+ * numa.c - NUMA topology, memory binding and index replicas
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the topology functions declared in numa.h and of the
+ * index replicas declared in victor.h.
+ */
+
+#define _GNU_SOURCE   // sched_getcpu(), pthread_setaffinity_np()
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#ifdef OS_LINUX
+#include <sys/syscall.h>
+#endif
+#include "numa.h"
+#include "mem.h"
+
+#define MPOL_PREFERRED 1
+
+/* Nodes are numbered densely; `node_id` holds the kernel number of each */
+static int nnodes = 0;
+static int node_id[NUMA_MAX_NODES];
+static int node_first[NUMA_MAX_NODES + 1];  // First entry of each node in `cpus`
+static int cpus[NUMA_MAX_CPUS];             // CPUs grouped by node
+static int cpu_nodes[NUMA_MAX_CPUS];        // Node of each CPU
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+/*
+ * Adds the CPUs of a sysfs cpulist ("0-3,8,10-11") to node `node`.
+ */
+static int parse_cpulist(FILE *fp, int node, int n) {
+    int lo, hi, c;
+
+    while (fscanf(fp, "%d", &lo) == 1) {
+        hi = lo;
+        if ((c = fgetc(fp)) == '-') {
+            if (fscanf(fp, "%d", &hi) != 1)
+                break;
+            c = fgetc(fp);
+        }
+        for (int cpu = lo; cpu <= hi && n < NUMA_MAX_CPUS; cpu++) {
+            if (cpu < 0 || cpu >= NUMA_MAX_CPUS)
+                continue;
+            cpus[n++] = cpu;
+            cpu_nodes[cpu] = node;
+        }
+        if (c != ',')
+            break;
+    }
+    return n;
+}
+
+static void load_topology(void) {
+    char path[64];
+    FILE *fp;
+    long online;
+    int n = 0;
+
+#ifdef OS_LINUX
+    for (int id = 0; id < NUMA_MAX_NODES; id++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        node_first[nnodes] = n;
+        n = parse_cpulist(fp, nnodes, n);
+        fclose(fp);
+        /* Nodes without CPUs (memory expanders) cannot run a replica's searches */
+        if (n > node_first[nnodes])
+            node_id[nnodes++] = id;
+    }
+#endif
+    if (nnodes > 0) {
+        node_first[nnodes] = n;
+        return;
+    }
+
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    online = online > 0 ? (online < NUMA_MAX_CPUS ? online : NUMA_MAX_CPUS) : 1;
+    memset(cpu_nodes, 0, sizeof(cpu_nodes));
+    for (n = 0; n < online; n++)
+        cpus[n] = n;
+    nnodes = 1;
+    node_id[0] = 0;
+    node_first[0] = 0;
+    node_first[1] = n;
+}
+
+static inline void topology(void) {
+    pthread_once(&topology_once, load_topology);
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int node_count(void) {
+    topology();
+    return nnodes;
+}
+
+int cpu_node(int cpu) {
+    topology();
+    return cpu >= 0 && cpu < NUMA_MAX_CPUS ? cpu_nodes[cpu] : 0;
+}
+
+int current_node(void) {
+#ifdef OS_LINUX
+    topology();
+    if (nnodes > 1)
+        return cpu_node(sched_getcpu());
+#endif
+    return 0;
+}
+
+int node_cpus(int node, int *out, int max) {
+    int n;
+
+    topology();
+    if (node < 0 || node >= nnodes)
+        return 0;
+    n = node_first[node + 1] - node_first[node];
+    for (int i = 0; i < n && i < max; i++)
+        out[i] = cpus[node_first[node] + i];
+    return n;
+}
+
+int node_bind(void *addr, size_t len, int node) {
+#if defined(OS_LINUX) && defined(SYS_mbind)
+    unsigned long mask;
+
+    topology();
+    if (nnodes <= 1 || node < 0 || node >= nnodes)
+        return SUCCESS;
+    mask = 1UL << node_id[node];
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0) != 0)
+        return SYSTEM_ERROR;
+#else
+    (void) addr;
+    (void) len;
+    (void) node;
+#endif
+    return SUCCESS;
+}
+
+int pin_thread(int cpu) {
+#ifdef OS_LINUX
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return THREAD_ERROR;
+#else
+    (void) cpu;
+#endif
+    return SUCCESS;
+}
+
+/**
+ * Creates one index per node, each allocating its nodes and vectors from
+ * an arena bound to that node.
+ */
+IndexReplicas *alloc_replicas(int type, int method, uint16_t dims, void *icontext, int flags) {
+    IndexReplicas *r;
+
+    if ((r = calloc_mem(1, sizeof(IndexReplicas))) == NULL)
+        return NULL;
+    pthread_mutex_init(&r->lock, NULL);
+
+    for (r->count = 0; r->count < node_count(); r->count++) {
+        Index **idx = &r->replicas[r->count];
+
+        if ((*idx = alloc_index(type, method, dims, icontext)) == NULL)
+            goto error_return;
+        if (index_arena(*idx, 0, (flags & ARENA_HUGEPAGES) | ARENA_NODE(r->count)) != SUCCESS) {
+            destroy_index(idx);
+            goto error_return;
+        }
+    }
+    return r;
+
+error_return:
+    destroy_replicas(&r);
+    return NULL;
+}
+
+int destroy_replicas(IndexReplicas **r) {
+    if (!r || !*r)
+        return INVALID_INDEX;
+    for (int i = 0; i < (*r)->count; i++)
+        destroy_index(&(*r)->replicas[i]);
+    pthread_mutex_destroy(&(*r)->lock);
+    free_mem(*r);
+    *r = NULL;
+    return SUCCESS;
+}
+
+/**
+ * Inserts into every replica; on failure the replicas that took the
+ * vector drop it again, so they never diverge.
+ */
+int replicas_insert(IndexReplicas *r, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims) {
+    int ret = SUCCESS;
+    int i;
+
+    if (!r)
+        return INVALID_INDEX;
+
+    pthread_mutex_lock(&r->lock);
+    for (i = 0; i < r->count; i++)
+        if ((ret = insert(r->replicas[i], id, tag, vector, dims)) != SUCCESS)
+            break;
+    if (ret != SUCCESS)
+        while (--i >= 0)
+            delete(r->replicas[i], id);
+    pthread_mutex_unlock(&r->lock);
+    return ret;
+}
+
+int replicas_delete(IndexReplicas *r, uint64_t id) {
+    int ret = SUCCESS;
+
+    if (!r)
+        return INVALID_INDEX;
+
+    pthread_mutex_lock(&r->lock);
+    for (int i = 0; i < r->count; i++) {
+        int err = delete(r->replicas[i], id);
+        if (ret == SUCCESS)
+            ret = err;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ret;
+}
+
+Index *replicas_local(IndexReplicas *r) {
+    if (!r)
+        return NULL;
+    return r->replicas[current_node() % r->count];
+}
+
+int replicas_search(IndexReplicas *r, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n) {
+    if (!r)
+        return INVALID_INDEX;
+    return search(replicas_local(r), tag, vector, dims, results, n);
+}
@@ -0,0 +1,89 @@
+/*
+ * numa.h - NUMA topology, memory binding and index replicas
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Topology of the host, read once from /sys/devices/system/node: which
+ * CPUs belong to which memory node. Memory is bound with the mbind system
+ * call directly, so libnuma is not required. Hosts without the sysfs tree
+ * (and other systems) are seen as a single node holding every CPU, on
+ * which binding and pinning are no-ops.
+ *
+ * An IndexReplicas keeps a copy of an index on every node, each with its
+ * nodes and vectors in an arena bound to that node, and routes searches
+ * to the copy local to the calling thread.
+ */
+
+#ifndef _NUMA_H
+#define _NUMA_H 1
+
+#include <stddef.h>
+#include <pthread.h>
+#include "index.h"
+
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS  4096
+
+struct IndexReplicas {
+    int count;                        // One replica per node
+    Index *replicas[NUMA_MAX_NODES];  // Replica whose memory lives on node `i`
+    unsigned int next;                // Round-robin cursor of replicas_search_async() (atomic)
+    pthread_mutex_t lock;             // Serializes mutations so replicas apply them in the same order
+};
+
+/**
+ * Returns the number of memory nodes (at least 1).
+ */
+extern int node_count(void);
+
+/**
+ * Returns the node of a CPU, 0 if unknown.
+ */
+extern int cpu_node(int cpu);
+
+/**
+ * Returns the node of the CPU the calling thread runs on.
+ */
+extern int current_node(void);
+
+/**
+ * Stores up to `max` CPUs of `node` in `cpus`.
+ *
+ * @return Number of CPUs of the node.
+ */
+extern int node_cpus(int node, int *cpus, int max);
+
+/**
+ * Asks for the pages of a mapping not touched yet to be taken from
+ * `node`, falling back to other nodes when it is full (MPOL_PREFERRED).
+ *
+ * @return SUCCESS, or SYSTEM_ERROR if the kernel refused the policy.
+ */
+extern int node_bind(void *addr, size_t len, int node);
+
+/**
+ * Restricts the calling thread to one CPU.
+ *
+ * @return SUCCESS or THREAD_ERROR.
+ */
+extern int pin_thread(int cpu);
+
+#endif
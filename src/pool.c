@@ -0,0 +1,419 @@
+/*
+ * pool.c - Internal work-stealing thread pool
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the library thread pool. Submissions are spread
+ * round-robin over per-worker deques; a worker pops from the front of its
+ * own deque (FIFO, to keep request latency fair) and, when it runs dry,
+ * steals from the back of the others before going to sleep.
+ *
+ * A pinned pool spreads its workers evenly over the NUMA nodes, binds each
+ * to one CPU of its node and lets them steal from workers of their own
+ * node first, so work submitted for a node tends to stay there.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include "victor.h"
+#include "pool.h"
+#include "panic.h"
+#include "mem.h"
+#include "numa.h"
+
+#define POOL_DEQUE_INIT 64
+
+typedef struct {
+    PoolTask fn;
+    void    *arg;
+} PoolJob;
+
+/*
+ * PoolDeque - Growable ring buffer of jobs owned by one worker.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    PoolJob *jobs;
+    int cap;
+    int head;
+    int count;
+} PoolDeque;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+    ThreadPool *pool;
+    int id;
+    int node;                // NUMA node, -1 if not pinned
+    int cpu;                 // CPU the worker is bound to, -1 if not pinned
+} PoolWorker;
+
+struct ThreadPool {
+    int nthreads;
+    pthread_t  *threads;
+    PoolWorker *workers;
+    PoolDeque  *queues;
+
+    pthread_mutex_t lock;    // Guards sleeping workers and shutdown
+    pthread_cond_t  wake;
+    int pending;             // Jobs queued and not yet taken (atomic)
+    int shutdown;
+    unsigned int next;       // Round-robin cursor for submissions (atomic)
+
+    int pinned;              // Workers are bound to CPUs
+    int nnodes;              // Nodes with workers when pinned
+    int *node_workers;       // Worker IDs grouped by node
+    int node_first[NUMA_MAX_NODES + 1];   // First entry of each node in `node_workers`
+    unsigned int node_next[NUMA_MAX_NODES];// Round-robin cursors per node (atomic)
+};
+
+static ThreadPool *__pool = NULL;
+static int __pinned = 0;
+static __thread PoolWorker *__worker = NULL;   // Set on pool threads
+static pthread_rwlock_t __pool_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+static int deque_init(PoolDeque *dq) {
+    dq->jobs = calloc_mem(POOL_DEQUE_INIT, sizeof(PoolJob));
+    if (!dq->jobs)
+        return SYSTEM_ERROR;
+    dq->cap = POOL_DEQUE_INIT;
+    dq->head = dq->count = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return SUCCESS;
+}
+
+static void deque_destroy(PoolDeque *dq) {
+    if (!dq->jobs)
+        return;
+    pthread_mutex_destroy(&dq->lock);
+    free_mem(dq->jobs);
+    dq->jobs = NULL;
+}
+
+/*
+ * Appends a job at the back of the deque, doubling the ring when full.
+ */
+static int deque_push(PoolDeque *dq, PoolJob *job) {
+    PoolJob *jobs;
+    int ret = SUCCESS;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->cap) {
+        jobs = calloc_mem(dq->cap * 2, sizeof(PoolJob));
+        if (!jobs) {
+            ret = SYSTEM_ERROR;
+            goto unlock;
+        }
+        for (int i = 0; i < dq->count; i++)
+            jobs[i] = dq->jobs[(dq->head + i) % dq->cap];
+        free_mem(dq->jobs);
+        dq->jobs = jobs;
+        dq->head = 0;
+        dq->cap *= 2;
+    }
+    dq->jobs[(dq->head + dq->count) % dq->cap] = *job;
+    dq->count++;
+unlock:
+    pthread_mutex_unlock(&dq->lock);
+    return ret;
+}
+
+/*
+ * Takes a job from the front (owner) or the back (thief) of the deque.
+ */
+static int deque_take(PoolDeque *dq, PoolJob *job, int steal) {
+    int found = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        if (steal) {
+            *job = dq->jobs[(dq->head + dq->count - 1) % dq->cap];
+        } else {
+            *job = dq->jobs[dq->head];
+            dq->head = (dq->head + 1) % dq->cap;
+        }
+        dq->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+/*
+ * Takes a job from the worker's own deque, or steals one: from workers of
+ * the same node first, then from the rest.
+ */
+static int pool_take(ThreadPool *pool, int id, PoolJob *job) {
+    int node = pool->workers[id].node;
+    int v;
+
+    if (deque_take(&pool->queues[id], job, 0))
+        return 1;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 1; i < pool->nthreads; i++) {
+            v = (id + i) % pool->nthreads;
+            if ((pool->workers[v].node == node) != (pass == 0))
+                continue;
+            if (deque_take(&pool->queues[v], job, 1))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    PoolWorker *w = (PoolWorker *) arg;
+    ThreadPool *pool = w->pool;
+    PoolJob job;
+
+    __worker = w;
+    if (w->cpu >= 0)
+        pin_thread(w->cpu);
+
+    for (;;) {
+        if (pool_take(pool, w->id, &job)) {
+            __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+            job.fn(job.arg);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0 && !pool->shutdown)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->shutdown && __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Stops the workers once every queued job has run and releases the pool.
+ */
+static void pool_destroy(ThreadPool **pool) {
+    ThreadPool *p = *pool;
+    int started;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->shutdown = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    started = p->threads ? p->nthreads : 0;
+    for (int i = 0; i < started; i++)
+        if (p->threads[i])
+            pthread_join(p->threads[i], NULL);
+
+    for (int i = 0; p->queues && i < p->nthreads; i++)
+        deque_destroy(&p->queues[i]);
+
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+    if (p->queues)  free_mem(p->queues);
+    if (p->workers) free_mem(p->workers);
+    if (p->node_workers) free_mem(p->node_workers);
+    if (p->threads) free_mem(p->threads);
+    free_mem(p);
+    *pool = NULL;
+}
+
+/*
+ * Spreads the workers over the nodes (worker `i` on node `i % nodes`) and
+ * the CPUs of each node, and groups their IDs by node.
+ */
+static int pool_place(ThreadPool *p) {
+    int cpus[NUMA_MAX_CPUS];
+    int ncpus, node, n = 0;
+
+    p->nnodes = node_count() < p->nthreads ? node_count() : p->nthreads;
+    if ((p->node_workers = calloc_mem(p->nthreads, sizeof(int))) == NULL)
+        return SYSTEM_ERROR;
+
+    for (node = 0; node < p->nnodes; node++) {
+        ncpus = node_cpus(node, cpus, NUMA_MAX_CPUS);
+        if (ncpus > NUMA_MAX_CPUS)
+            ncpus = NUMA_MAX_CPUS;
+        p->node_first[node] = n;
+        for (int i = node; i < p->nthreads; i += p->nnodes) {
+            p->workers[i].node = node;
+            p->workers[i].cpu = ncpus > 0 ? cpus[(i / p->nnodes) % ncpus] : -1;
+            p->node_workers[n++] = i;
+        }
+    }
+    p->node_first[node] = n;
+    p->pinned = 1;
+    return SUCCESS;
+}
+
+static int pool_create(ThreadPool **pool, int nthreads, int pinned) {
+    ThreadPool *p;
+    int ret = SYSTEM_ERROR;
+
+    PANIC_IF(nthreads <= 0, "invalid number of pool workers");
+
+    if ((p = calloc_mem(1, sizeof(ThreadPool))) == NULL)
+        return SYSTEM_ERROR;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    p->nthreads = nthreads;
+
+    p->threads = calloc_mem(nthreads, sizeof(pthread_t));
+    p->workers = calloc_mem(nthreads, sizeof(PoolWorker));
+    p->queues  = calloc_mem(nthreads, sizeof(PoolDeque));
+    if (!p->threads || !p->workers || !p->queues)
+        goto error_return;
+
+    for (int i = 0; i < nthreads; i++)
+        if (deque_init(&p->queues[i]) != SUCCESS)
+            goto error_return;
+
+    for (int i = 0; i < nthreads; i++) {
+        p->workers[i].node = -1;
+        p->workers[i].cpu = -1;
+    }
+    if (pinned && pool_place(p) != SUCCESS)
+        goto error_return;
+
+    for (int i = 0; i < nthreads; i++) {
+        p->workers[i].pool = p;
+        p->workers[i].id = i;
+        if (pthread_create(&p->threads[i], NULL, pool_worker, &p->workers[i]) != 0) {
+            ret = THREAD_ERROR;
+            goto error_return;
+        }
+    }
+    *pool = p;
+    return SUCCESS;
+
+error_return:
+    pool_destroy(&p);
+    return ret;
+}
+
+static int default_pool_size(void) {
+#ifdef OS_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+#endif
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int pool_submit(PoolTask fn, void *arg) {
+    return pool_submit_node(fn, arg, -1);
+}
+
+int pool_submit_node(PoolTask fn, void *arg, int node) {
+    ThreadPool *pool;
+    PoolJob job = { .fn = fn, .arg = arg };
+    unsigned int slot;
+    int ret;
+
+    PANIC_IF(fn == NULL, "invalid pool task");
+
+    pthread_rwlock_rdlock(&__pool_lock);
+    if (__pool == NULL) {
+        /* Upgrade to create the pool lazily; re-check after relocking. */
+        pthread_rwlock_unlock(&__pool_lock);
+        pthread_rwlock_wrlock(&__pool_lock);
+        if (__pool == NULL &&
+            (ret = pool_create(&__pool, default_pool_size(), __atomic_load_n(&__pinned, __ATOMIC_RELAXED))) != SUCCESS) {
+            pthread_rwlock_unlock(&__pool_lock);
+            return ret;
+        }
+        pthread_rwlock_unlock(&__pool_lock);
+        pthread_rwlock_rdlock(&__pool_lock);
+        if (__pool == NULL) {
+            pthread_rwlock_unlock(&__pool_lock);
+            return THREAD_ERROR;
+        }
+    }
+    pool = __pool;
+
+    if (pool->pinned && node >= 0 && node < pool->nnodes) {
+        slot = __atomic_fetch_add(&pool->node_next[node], 1, __ATOMIC_RELAXED) %
+               (unsigned int) (pool->node_first[node + 1] - pool->node_first[node]);
+        slot = pool->node_workers[pool->node_first[node] + slot];
+    } else {
+        slot = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) % pool->nthreads;
+    }
+    if ((ret = deque_push(&pool->queues[slot], &job)) == SUCCESS) {
+        __atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    pthread_rwlock_unlock(&__pool_lock);
+    return ret;
+}
+
+int pool_resize(int nthreads) {
+    ThreadPool *pool = NULL, *old;
+    int ret = SUCCESS;
+
+    if (nthreads < 0)
+        return INVALID_ARGUMENT;
+    /* The pool being replaced would join the calling worker */
+    if (__worker != NULL)
+        return THREAD_ERROR;
+
+    if (nthreads > 0 && (ret = pool_create(&pool, nthreads, __atomic_load_n(&__pinned, __ATOMIC_RELAXED))) != SUCCESS)
+        return ret;
+
+    pthread_rwlock_wrlock(&__pool_lock);
+    old = __pool;
+    __pool = pool;
+    pthread_rwlock_unlock(&__pool_lock);
+    /* Tasks of the old pool may submit to the new one while it drains */
+    pool_destroy(&old);
+    return SUCCESS;
+}
+
+int pool_size(void) {
+    int n;
+    pthread_rwlock_rdlock(&__pool_lock);
+    n = __pool ? __pool->nthreads : 0;
+    pthread_rwlock_unlock(&__pool_lock);
+    return n;
+}
+
+int pool_pin(int enable) {
+    int n;
+
+    __atomic_store_n(&__pinned, enable != 0, __ATOMIC_RELAXED);
+    n = pool_size();
+    return n > 0 ? pool_resize(n) : SUCCESS;
+}
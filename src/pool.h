@@ -0,0 +1,84 @@
+/*
+ * pool.h - Internal work-stealing thread pool
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Library-wide pool of worker threads used to run asynchronous operations
+ * (e.g. search_async). Every worker owns a deque of pending tasks; idle
+ * workers steal from the back of their siblings' deques, so a burst of
+ * submissions landing on one queue is spread across all cores.
+ */
+
+#ifndef _POOL_H
+#define _POOL_H 1
+
+/**
+ * Task executed by a pool worker. `arg` is owned by the task.
+ */
+typedef void (*PoolTask)(void *arg);
+
+/**
+ * Queues a task on the library pool.
+ *
+ * The pool is created lazily on first use with one worker per online CPU,
+ * unless a size was set before with pool_resize().
+ *
+ * @param fn  Task function.
+ * @param arg Opaque argument passed to the task.
+ * @return SUCCESS, or SYSTEM_ERROR / THREAD_ERROR on failure.
+ */
+extern int pool_submit(PoolTask fn, void *arg);
+
+/**
+ * Queues a task on a worker of NUMA node `node` (see numa.h). Without
+ * pinning, or with a node that has no worker, same as pool_submit().
+ *
+ * @return SUCCESS, or SYSTEM_ERROR / THREAD_ERROR on failure.
+ */
+extern int pool_submit_node(PoolTask fn, void *arg, int node);
+
+/**
+ * Replaces the library pool with one of `nthreads` workers.
+ *
+ * Tasks already queued on the current pool are drained before its workers
+ * exit. A value of 0 shuts the pool down; it is recreated on the next submit.
+ * Must not be called from a pool task (THREAD_ERROR).
+ *
+ * @param nthreads Number of workers (0 to shut down).
+ * @return SUCCESS, INVALID_ARGUMENT, SYSTEM_ERROR or THREAD_ERROR.
+ */
+extern int pool_resize(int nthreads);
+
+/**
+ * Returns the number of workers of the current pool (0 if not started).
+ */
+extern int pool_size(void);
+
+/**
+ * Binds the workers to CPUs spread over the NUMA nodes (or lets them
+ * float again), replacing the current pool if there is one. Must not be
+ * called from a pool task (THREAD_ERROR).
+ *
+ * @return SUCCESS, SYSTEM_ERROR or THREAD_ERROR.
+ */
+extern int pool_pin(int enable);
+
+#endif
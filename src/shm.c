@@ -0,0 +1,404 @@
+/*
+ * shm.c - Read-only index images in shared memory
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Creation, mapping and lookup of index images (see shm.h).
+ */
+
+#include "config.h"
+#include <string.h>
+#include <errno.h>
+
+#ifndef OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "shm.h"
+#include "panic.h"
+#include "mem.h"
+
+/* Start of the vectors section: keeps records on their own cache lines */
+#define SHM_VECTORS_ALIGN 64
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+static inline uint64_t shm_hash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint64_t *shm_table(const ShmImage *img) {
+    return (uint64_t *) ((char *) img->hdr + img->hdr->toff);
+}
+
+#ifndef OS_WINDOWS
+/*
+ * A name with a single leading '/' is a POSIX shared memory object; any
+ * other name is a file path.
+ */
+static int is_shm_name(const char *name) {
+    return name[0] == '/' && name[1] != '\0' && strchr(name + 1, '/') == NULL;
+}
+
+static int open_image(const char *name, int flags, mode_t mode) {
+    if (is_shm_name(name))
+        return shm_open(name, flags, mode);
+    return open(name, flags, mode);
+}
+#endif
+
+/*
+ * Checks the graph section of an HNSW image: the entry point and every
+ * node offset, record and neighbor must stay within the image, and no
+ * node may have more neighbors than M0 (level 0) or M0 / 2 (upper
+ * levels). The section itself is already known to fit in the mapping.
+ */
+static int shm_validate_graph(const ShmHDR *hdr) {
+    const char *graph = (const char *) hdr + hdr->goff;
+    const ShmGraphHDR *ghdr = (const ShmGraphHDR *) graph;
+    const uint64_t *offsets = (const uint64_t *) (graph + sizeof(ShmGraphHDR));
+    uint64_t first = sizeof(ShmGraphHDR) + hdr->elements * sizeof(uint64_t);
+
+    if (ghdr->M0 <= 0 || ghdr->top_level < 0 ||
+        (hdr->elements > 0 && ghdr->entry >= hdr->elements))
+        return INVALID_FILE;
+
+    for (uint64_t i = 0; i < hdr->elements; i++) {
+        const ShmGraphNode *node;
+        const uint32_t *degrees, *edges;
+        uint64_t off = offsets[i], room, nedges = 0;
+
+        if (off < first || off % sizeof(uint32_t) != 0 || off > hdr->gsize - sizeof(ShmGraphNode))
+            return INVALID_FILE;
+        node = (const ShmGraphNode *) (graph + off);
+        room = (hdr->gsize - off - sizeof(ShmGraphNode)) / sizeof(uint32_t);
+        if (node->level < 0 || (uint64_t) node->level >= room)
+            return INVALID_FILE;
+
+        degrees = (const uint32_t *) (node + 1);
+        for (int l = 0; l <= node->level; l++) {
+            if (degrees[l] > (uint32_t) (l == 0 ? ghdr->M0 : ghdr->M0 / 2))
+                return INVALID_FILE;
+            nedges += degrees[l];
+        }
+        if (nedges > room - (uint64_t) node->level - 1)
+            return INVALID_FILE;
+
+        edges = degrees + node->level + 1;
+        for (uint64_t k = 0; k < nedges; k++)
+            if (edges[k] >= hdr->elements)
+                return INVALID_FILE;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Checks that the header describes a layout that fits in the mapping,
+ * and for HNSW images that the graph does (see shm_validate_graph()).
+ */
+static int shm_validate(const ShmHDR *hdr, size_t size) {
+    uint64_t vbytes;
+
+    if (hdr->major != SHM_MAJOR || hdr->hsize != sizeof(ShmHDR) || hdr->size != size)
+        return INVALID_FILE;
+    if (hdr->itype != FLAT_INDEX && hdr->itype != HNSW_INDEX)
+        return INVALID_FILE;
+    if (hdr->dims == 0 || hdr->dims_aligned != ALIGN_DIMS(hdr->dims) ||
+        hdr->vsize != VECTORSZ(hdr->dims_aligned))
+        return INVALID_FILE;
+    if (hdr->voff < sizeof(ShmHDR) || hdr->voff % 16 != 0 || hdr->elements > size / hdr->vsize)
+        return INVALID_FILE;
+
+    vbytes = hdr->elements * hdr->vsize;
+    if (hdr->toff != hdr->voff + vbytes || hdr->live > hdr->elements)
+        return INVALID_FILE;
+    if (hdr->tslots == 0 || (hdr->tslots & (hdr->tslots - 1)) != 0 || hdr->tslots <= hdr->live ||
+        hdr->tslots > (size - hdr->toff) / sizeof(uint64_t))
+        return INVALID_FILE;
+
+    if (hdr->itype == HNSW_INDEX) {
+        if (hdr->goff < hdr->toff + hdr->tslots * sizeof(uint64_t) || hdr->goff > size ||
+            hdr->gsize > size - hdr->goff ||
+            hdr->gsize < sizeof(ShmGraphHDR) + hdr->elements * sizeof(uint64_t) ||
+            hdr->goff % sizeof(uint64_t) != 0)
+            return INVALID_FILE;
+        return shm_validate_graph(hdr);
+    } else if (hdr->goff != 0 || hdr->gsize != 0) {
+        return INVALID_FILE;
+    }
+    return SUCCESS;
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+#ifndef OS_WINDOWS
+
+int shm_builder_init(ShmBuilder *b, const char *name, int itype, int method, uint16_t dims,
+                     uint64_t elements, uint64_t live, uint64_t gsize) {
+    ShmHDR hdr;
+    const char *path;
+    void *base;
+    int fd;
+
+    memset(b, 0, sizeof(ShmBuilder));
+    memset(&hdr, 0, sizeof(ShmHDR));
+
+    if (name == NULL || name[0] == '\0' || live > elements)
+        return INVALID_ARGUMENT;
+    /* Graph nodes refer to their neighbors with 32-bit element numbers */
+    if (gsize > 0 && elements > UINT32_MAX)
+        return INVALID_ARGUMENT;
+
+    hdr.major        = SHM_MAJOR;
+    hdr.hsize        = sizeof(ShmHDR);
+    hdr.itype        = (uint16_t) itype;
+    hdr.method       = (uint16_t) method;
+    hdr.dims         = dims;
+    hdr.dims_aligned = ALIGN_DIMS(dims);
+    hdr.vsize        = VECTORSZ(hdr.dims_aligned);
+    hdr.elements     = elements;
+    hdr.live         = live;
+    hdr.voff         = (sizeof(ShmHDR) + SHM_VECTORS_ALIGN - 1) & ~(uint64_t) (SHM_VECTORS_ALIGN - 1);
+    hdr.toff         = hdr.voff + elements * hdr.vsize;
+    for (hdr.tslots = 16; hdr.tslots < live * 2; hdr.tslots <<= 1);
+    hdr.size         = hdr.toff + hdr.tslots * sizeof(uint64_t);
+    if (gsize > 0) {
+        hdr.goff  = hdr.size;
+        hdr.gsize = gsize;
+        hdr.size += gsize;
+    }
+
+    b->shm = is_shm_name(name);
+    if ((b->name = calloc_mem(1, strlen(name) + 1)) == NULL)
+        return SYSTEM_ERROR;
+    strcpy(b->name, name);
+
+    /* A file is built aside and renamed; a shared memory object cannot be
+       renamed, so the previous one is removed first */
+    if (b->shm) {
+        shm_unlink(name);
+        path = name;
+    } else {
+        if ((b->tmpname = calloc_mem(1, strlen(name) + 5)) == NULL) {
+            free_mem(b->name);
+            return SYSTEM_ERROR;
+        }
+        strcpy(b->tmpname, name);
+        strcat(b->tmpname, ".tmp");
+        path = b->tmpname;
+    }
+
+    if ((fd = open_image(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        goto error_return;
+    if (ftruncate(fd, (off_t) hdr.size) != 0) {
+        close(fd);
+        goto error_return;
+    }
+    base = mmap(NULL, hdr.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        goto error_return;
+
+    b->img.hdr  = (ShmHDR *) base;
+    b->img.size = hdr.size;
+    memcpy(b->img.hdr, &hdr, sizeof(ShmHDR));
+    return SUCCESS;
+
+error_return:
+    if (b->shm)
+        shm_unlink(path);
+    else
+        unlink(path);
+    if (b->tmpname) free_mem(b->tmpname);
+    free_mem(b->name);
+    memset(b, 0, sizeof(ShmBuilder));
+    return FILEIO_ERROR;
+}
+
+uint64_t shm_builder_add(ShmBuilder *b, const Vector *v, int live) {
+    ShmHDR *hdr = b->img.hdr;
+    uint64_t i = b->next++;
+
+    PANIC_IF(i >= hdr->elements, "shared image vectors overflow");
+    memcpy(shm_vector(&b->img, i), v, hdr->vsize);
+
+    if (live) {
+        uint64_t *table = shm_table(&b->img);
+        uint64_t mask = hdr->tslots - 1;
+        uint64_t s = shm_hash(v->id) & mask;
+
+        while (table[s] != 0)
+            s = (s + 1) & mask;
+        table[s] = i + 1;
+    }
+    return i;
+}
+
+void *shm_builder_graph(ShmBuilder *b) {
+    PANIC_IF(b->img.hdr->goff == 0, "shared image without graph section");
+    return (char *) b->img.hdr + b->img.hdr->goff;
+}
+
+int shm_builder_finish(ShmBuilder *b, int commit) {
+    int ret = SUCCESS;
+
+    if (b->img.hdr == NULL)
+        return commit ? FILEIO_ERROR : SUCCESS;
+
+    if (commit) {
+        PANIC_IF(b->next != b->img.hdr->elements, "shared image partially filled");
+        __atomic_store_n(&b->img.hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    munmap(b->img.hdr, b->img.size);
+
+    if (b->shm) {
+        if (!commit)
+            shm_unlink(b->name);
+    } else if (!commit || rename(b->tmpname, b->name) != 0) {
+        unlink(b->tmpname);
+        if (commit)
+            ret = FILEIO_ERROR;
+    }
+
+    if (b->tmpname) free_mem(b->tmpname);
+    free_mem(b->name);
+    memset(b, 0, sizeof(ShmBuilder));
+    return ret;
+}
+
+int shm_attach(ShmImage *img, const char *name) {
+    struct stat st;
+    void *base;
+    int fd, ret;
+
+    memset(img, 0, sizeof(ShmImage));
+    if ((fd = open_image(name, O_RDONLY, 0)) < 0)
+        return FILEIO_ERROR;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return FILEIO_ERROR;
+    }
+    if ((size_t) st.st_size < sizeof(ShmHDR)) {
+        close(fd);
+        return INVALID_FILE;
+    }
+    base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return FILEIO_ERROR;
+
+    img->hdr  = (ShmHDR *) base;
+    img->size = (size_t) st.st_size;
+    if (__atomic_load_n(&img->hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC)
+        ret = INVALID_FILE;
+    else
+        ret = shm_validate(img->hdr, img->size);
+
+    if (ret != SUCCESS)
+        shm_detach(img);
+    return ret;
+}
+
+void shm_detach(ShmImage *img) {
+    if (img->hdr)
+        munmap(img->hdr, img->size);
+    img->hdr = NULL;
+    img->size = 0;
+}
+
+int shm_unlink_image(const char *name) {
+    if (name == NULL)
+        return INVALID_ARGUMENT;
+    if ((is_shm_name(name) ? shm_unlink(name) : unlink(name)) != 0)
+        return FILEIO_ERROR;
+    return SUCCESS;
+}
+
+#else /* OS_WINDOWS */
+
+int shm_builder_init(ShmBuilder *b, const char *name, int itype, int method, uint16_t dims,
+                     uint64_t elements, uint64_t live, uint64_t gsize) {
+    (void) name; (void) itype; (void) method; (void) dims;
+    (void) elements; (void) live; (void) gsize;
+    memset(b, 0, sizeof(ShmBuilder));
+    return NOT_IMPLEMENTED;
+}
+
+uint64_t shm_builder_add(ShmBuilder *b, const Vector *v, int live) {
+    (void) b; (void) v; (void) live;
+    PANIC_IF(1, "shared images are not supported");
+    return 0;
+}
+
+void *shm_builder_graph(ShmBuilder *b) {
+    (void) b;
+    return NULL;
+}
+
+int shm_builder_finish(ShmBuilder *b, int commit) {
+    (void) b;
+    return commit ? NOT_IMPLEMENTED : SUCCESS;
+}
+
+int shm_attach(ShmImage *img, const char *name) {
+    (void) name;
+    memset(img, 0, sizeof(ShmImage));
+    return NOT_IMPLEMENTED;
+}
+
+void shm_detach(ShmImage *img) {
+    img->hdr = NULL;
+    img->size = 0;
+}
+
+int shm_unlink_image(const char *name) {
+    (void) name;
+    return NOT_IMPLEMENTED;
+}
+
+#endif
+
+Vector *shm_lookup(const ShmImage *img, uint64_t id) {
+    const uint64_t *table = shm_table(img);
+    uint64_t mask = img->hdr->tslots - 1;
+    uint64_t s = shm_hash(id) & mask;
+
+    for (; table[s] != 0; s = (s + 1) & mask) {
+        Vector *v;
+        if (table[s] > img->hdr->elements)
+            return NULL;
+        v = shm_vector(img, table[s] - 1);
+        if (v->id == id)
+            return v;
+    }
+    return NULL;
+}
@@ -0,0 +1,200 @@
+/*
+ * shm.h - Read-only index images in shared memory
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * An index image is a self-contained, position independent copy of an
+ * index laid out in one mapping, so that several processes can map it
+ * and search it without copying. Every reference inside the image is an
+ * element number or an offset from the start of the image, never a
+ * pointer.
+ *
+ * Image layout:
+ *
+ *   ShmHDR
+ *   vectors    `elements` Vector records of `vsize` bytes (16-byte aligned)
+ *   ID table   `tslots` uint64_t slots, open addressing with linear probing;
+ *              a slot holds the element number + 1 of a live vector, 0 if
+ *              empty
+ *   graph      HNSW images only: ShmGraphHDR, `elements` uint64_t node
+ *              offsets (relative to the graph section) and the ShmGraphNode
+ *              records
+ *
+ * Images are published either as a POSIX shared memory object (a name
+ * like "/victor", without any other '/') or as a file that is mapped
+ * shared (any other path, e.g. a file on a tmpfs or hugetlbfs mount).
+ */
+
+#ifndef _SHM_H
+#define _SHM_H 1
+
+#include <stdint.h>
+#include "vector.h"
+
+#define SHM_MAGIC       0x5653484D  /**< 'VSHM' */
+#define SHM_MAJOR       1
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;         /**< SHM_MAGIC, written last. */
+    uint8_t  major;         /**< Major version. */
+    uint8_t  minor;         /**< Minor version. */
+    uint8_t  patch;         /**< Patch version. */
+    uint8_t  hsize;         /**< Size of this header in bytes. */
+    uint16_t itype;         /**< FLAT_INDEX or HNSW_INDEX. */
+    uint16_t method;        /**< Comparison method. */
+    uint16_t dims;          /**< Vector dimensions. */
+    uint16_t dims_aligned;  /**< Aligned vector dimensions. */
+    uint32_t vsize;         /**< Size of a vector record. */
+    uint32_t reserved;
+    uint64_t elements;      /**< Vector records (dead graph nodes included). */
+    uint64_t live;          /**< Live vectors, i.e. entries in the ID table. */
+    uint64_t voff;          /**< Offset of the vectors section. */
+    uint64_t toff;          /**< Offset of the ID table. */
+    uint64_t tslots;        /**< ID table slots (a power of two). */
+    uint64_t goff;          /**< Offset of the graph section, 0 if none. */
+    uint64_t gsize;         /**< Size of the graph section. */
+    uint64_t size;          /**< Size of the whole image. */
+} ShmHDR;
+
+typedef struct {
+    uint64_t entry;         /**< Element number of the entry point. */
+    int32_t  top_level;     /**< Level of the entry point. */
+    int32_t  ef_search;     /**< Search expansion factor. */
+    int32_t  M0;            /**< Maximum number of neighbors at level 0. */
+    uint32_t reserved;
+} ShmGraphHDR;
+
+/**
+ * A graph node is followed by `level + 1` uint32_t degrees and then, level
+ * after level, the element numbers of its neighbors (uint32_t).
+ */
+typedef struct {
+    int32_t  level;         /**< Top level of the node. */
+    uint32_t alive;         /**< Zero for deleted nodes (kept for routing). */
+} ShmGraphNode;
+#pragma pack(pop)
+
+_Static_assert(sizeof(ShmHDR) == 88, "ShmHDR must be exactly 88 bytes");
+_Static_assert(sizeof(ShmGraphHDR) == 24, "ShmGraphHDR must be exactly 24 bytes");
+_Static_assert(sizeof(ShmGraphNode) == 8, "ShmGraphNode must be exactly 8 bytes");
+
+/** @brief Size of a graph node record with `level` levels and `edges` neighbors. */
+#define SHM_NODESZ(level, edges) \
+    (sizeof(ShmGraphNode) + ((uint64_t) (level) + 1 + (edges)) * sizeof(uint32_t))
+
+/**
+ * @brief A mapped image.
+ */
+typedef struct {
+    ShmHDR *hdr;            /**< Start of the mapping. */
+    size_t  size;           /**< Size of the mapping. */
+} ShmImage;
+
+/**
+ * @brief Image being published.
+ *
+ * The mapping is created with its final size up front, so the backend
+ * writes vectors and graph nodes straight into it.
+ */
+typedef struct {
+    ShmImage img;
+    char    *name;          /**< Published name. */
+    char    *tmpname;       /**< Temporary file renamed over `name`, or NULL. */
+    int      shm;           /**< 1 for a shared memory object. */
+    uint64_t next;          /**< Next vector record to fill. */
+} ShmBuilder;
+
+/**
+ * @brief Creates an image being published under `name`.
+ *
+ * @param b        Builder to initialize.
+ * @param name     Shared memory object name or file path.
+ * @param itype    Index type.
+ * @param method   Comparison method.
+ * @param dims     Vector dimensions.
+ * @param elements Number of vector records the backend will add.
+ * @param live     How many of them are live (ID table entries).
+ * @param gsize    Size of the graph section, 0 for none.
+ * @return SUCCESS, INVALID_ARGUMENT, SYSTEM_ERROR or FILEIO_ERROR.
+ */
+extern int shm_builder_init(ShmBuilder *b, const char *name, int itype, int method, uint16_t dims,
+                            uint64_t elements, uint64_t live, uint64_t gsize);
+
+/**
+ * @brief Appends a vector record and returns its element number.
+ *
+ * Live vectors are entered in the ID table.
+ */
+extern uint64_t shm_builder_add(ShmBuilder *b, const Vector *v, int live);
+
+/**
+ * @brief Returns the graph section, `gsize` zeroed bytes.
+ */
+extern void *shm_builder_graph(ShmBuilder *b);
+
+/**
+ * @brief Completes (or abandons) the publication and unmaps the image.
+ *
+ * The header magic is written last and a file image is renamed over its
+ * final path, so attach never sees a partial image; processes attached
+ * to a previous image keep using it until they detach.
+ *
+ * @param b      Builder.
+ * @param commit Zero to drop the image.
+ * @return SUCCESS or FILEIO_ERROR.
+ */
+extern int shm_builder_finish(ShmBuilder *b, int commit);
+
+/**
+ * @brief Maps a published image read-only and validates its layout.
+ *
+ * @return SUCCESS, FILEIO_ERROR, INVALID_FILE or NOT_IMPLEMENTED.
+ */
+extern int shm_attach(ShmImage *img, const char *name);
+
+/**
+ * @brief Unmaps an image.
+ */
+extern void shm_detach(ShmImage *img);
+
+/**
+ * @brief Removes a published image; attached processes are not affected.
+ *
+ * @return SUCCESS or FILEIO_ERROR.
+ */
+extern int shm_unlink_image(const char *name);
+
+/**
+ * @brief Looks up a live vector by ID.
+ *
+ * @return The vector record, or NULL.
+ */
+extern Vector *shm_lookup(const ShmImage *img, uint64_t id);
+
+/**
+ * @brief Returns the vector record `i`.
+ */
+static inline Vector *shm_vector(const ShmImage *img, uint64_t i) {
+    return (Vector *) ((char *) img->hdr + img->hdr->voff + i * img->hdr->vsize);
+}
+
+#endif
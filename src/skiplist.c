@@ -0,0 +1,173 @@
+/*
+ * skiplist.c - Ordered skiplist of byte-string keys
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the skiplist declared in skiplist.h. Node levels are
+ * drawn with p = 1/4, which keeps the expected number of links per node
+ * at 4/3.
+ */
+
+#include "config.h"
+#include <string.h>
+#include "skiplist.h"
+#include "mem.h"
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+static SkipNode *alloc_node(void *item, int level) {
+    SkipNode *node = calloc_mem(1, sizeof(SkipNode) + level * sizeof(SkipNode *));
+    if (node) {
+        node->item = item;
+        node->level = level;
+    }
+    return node;
+}
+
+/*
+ * Level of a new node: each extra level with probability 1/4.
+ */
+static int random_level(SkipList *sl) {
+    uint64_t x = sl->seed;
+    int level = 1;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    sl->seed = x;
+
+    while (level < SKIPLIST_MAX_LEVEL && (x & 3) == 0) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+static inline int node_compare(const SkipList *sl, const SkipNode *node, const void *key, uint32_t klen) {
+    uint32_t nlen;
+    const void *nkey = sl->key(node->item, &nlen);
+    return skiplist_compare(nkey, nlen, key, klen);
+}
+
+/*
+ * Fills `update` with the last node before `key` at every level and
+ * returns the first node whose key is not less than `key`.
+ */
+static SkipNode *find_prev(const SkipList *sl, const void *key, uint32_t klen, SkipNode **update) {
+    SkipNode *x = sl->head;
+
+    for (int l = sl->level - 1; l >= 0; l--) {
+        while (x->next[l] && node_compare(sl, x->next[l], key, klen) < 0)
+            x = x->next[l];
+        if (update)
+            update[l] = x;
+    }
+    return x->next[0];
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int skiplist_compare(const void *a, uint32_t alen, const void *b, uint32_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0)
+        return c;
+    return alen < blen ? -1 : alen > blen;
+}
+
+int skiplist_init(SkipList *sl, SkipKey key) {
+    memset(sl, 0, sizeof(SkipList));
+    if ((sl->head = alloc_node(NULL, SKIPLIST_MAX_LEVEL)) == NULL)
+        return SKIPLIST_ERROR_ALLOC;
+    sl->level = 1;
+    sl->seed = 0x9E3779B97F4A7C15ULL ^ (uint64_t) (uintptr_t) sl;
+    sl->key = key;
+    return SKIPLIST_SUCCESS;
+}
+
+void skiplist_destroy(SkipList *sl) {
+    SkipNode *node, *next;
+
+    if (!sl->head)
+        return;
+    for (node = sl->head; node; node = next) {
+        next = node->next[0];
+        free_mem(node);
+    }
+    memset(sl, 0, sizeof(SkipList));
+}
+
+int skiplist_insert(SkipList *sl, void *item) {
+    SkipNode *update[SKIPLIST_MAX_LEVEL];
+    SkipNode *node;
+    uint32_t klen;
+    const void *key = sl->key(item, &klen);
+    int level = random_level(sl);
+
+    find_prev(sl, key, klen, update);
+    if ((node = alloc_node(item, level)) == NULL)
+        return SKIPLIST_ERROR_ALLOC;
+
+    for (int l = sl->level; l < level; l++)
+        update[l] = sl->head;
+    if (level > sl->level)
+        sl->level = level;
+
+    for (int l = 0; l < level; l++) {
+        node->next[l] = update[l]->next[l];
+        update[l]->next[l] = node;
+    }
+    sl->count++;
+    return SKIPLIST_SUCCESS;
+}
+
+void *skiplist_remove(SkipList *sl, const void *key, uint32_t klen) {
+    SkipNode *update[SKIPLIST_MAX_LEVEL];
+    SkipNode *node = find_prev(sl, key, klen, update);
+    void *item;
+
+    if (!node || node_compare(sl, node, key, klen) != 0)
+        return NULL;
+
+    for (int l = 0; l < node->level; l++)
+        update[l]->next[l] = node->next[l];
+    while (sl->level > 1 && sl->head->next[sl->level - 1] == NULL)
+        sl->level--;
+
+    item = node->item;
+    free_mem(node);
+    sl->count--;
+    return item;
+}
+
+SkipNode *skiplist_find(const SkipList *sl, const void *key, uint32_t klen) {
+    SkipNode *node = find_prev(sl, key, klen, NULL);
+    return node && node_compare(sl, node, key, klen) == 0 ? node : NULL;
+}
+
+SkipNode *skiplist_seek(const SkipList *sl, const void *key, uint32_t klen) {
+    if (klen == 0)
+        return sl->head->next[0];
+    return find_prev(sl, key, klen, NULL);
+}
@@ -0,0 +1,116 @@
+/*
+ * skiplist.h - Ordered skiplist of byte-string keys
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * A skiplist that keeps items sorted by a byte-string key (memcmp order,
+ * shorter keys first on a common prefix). Items are owned by the caller;
+ * the list only stores pointers to them and reads their keys through the
+ * SkipKey callback. Lookups, inserts and removals cost O(log N) on
+ * average, and an ordered walk from any key costs O(log N + items).
+ *
+ * The list is not thread-safe; callers provide their own locking.
+ */
+
+#ifndef _SKIPLIST_H
+#define _SKIPLIST_H 1
+
+#include <stdint.h>
+
+#define SKIPLIST_MAX_LEVEL 32
+
+#define SKIPLIST_SUCCESS      0
+#define SKIPLIST_ERROR_ALLOC -1
+
+/**
+ * Returns the key of an item and its length.
+ */
+typedef const void *(*SkipKey)(const void *item, uint32_t *len);
+
+typedef struct SkipNode {
+    void *item;
+    int   level;                  // Number of forward links
+    struct SkipNode *next[];      // Forward links, level 0 first
+} SkipNode;
+
+typedef struct {
+    SkipNode *head;               // Sentinel with SKIPLIST_MAX_LEVEL links
+    int       level;              // Highest level in use
+    uint64_t  count;              // Number of items
+    uint64_t  seed;               // State of the level generator
+    SkipKey   key;
+} SkipList;
+
+/**
+ * Initializes an empty list.
+ *
+ * @param sl  Pointer to the list.
+ * @param key Callback returning the key of an item.
+ * @return SKIPLIST_SUCCESS or SKIPLIST_ERROR_ALLOC.
+ */
+extern int skiplist_init(SkipList *sl, SkipKey key);
+
+/**
+ * Releases the nodes of the list (not the items).
+ */
+extern void skiplist_destroy(SkipList *sl);
+
+/**
+ * Inserts an item whose key is not in the list.
+ *
+ * @return SKIPLIST_SUCCESS or SKIPLIST_ERROR_ALLOC.
+ */
+extern int skiplist_insert(SkipList *sl, void *item);
+
+/**
+ * Removes the item with the given key.
+ *
+ * @return The removed item, or NULL if the key is not in the list.
+ */
+extern void *skiplist_remove(SkipList *sl, const void *key, uint32_t klen);
+
+/**
+ * Returns the node of the given key, or NULL.
+ */
+extern SkipNode *skiplist_find(const SkipList *sl, const void *key, uint32_t klen);
+
+/**
+ * Returns the first node whose key is greater than or equal to `key`
+ * (the first node of the list if `klen` is 0), or NULL.
+ */
+extern SkipNode *skiplist_seek(const SkipList *sl, const void *key, uint32_t klen);
+
+/**
+ * Returns the node that follows `node` in key order, or NULL.
+ */
+static inline SkipNode *skiplist_next(const SkipNode *node) {
+    return node->next[0];
+}
+
+/**
+ * Compares two keys in list order.
+ *
+ * @return A negative value, zero or a positive value if `a` sorts before,
+ *         equal to or after `b`.
+ */
+extern int skiplist_compare(const void *a, uint32_t alen, const void *b, uint32_t blen);
+
+#endif
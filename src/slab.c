@@ -0,0 +1,254 @@
+/*
+ * slab.c - Size-class slab allocator for small objects
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Implementation of the allocator declared in slab.h. Pages are mapped
+ * directly from the system, aligned to their size, and start with a
+ * SlabPage header; memory is only resident once touched and goes back to
+ * the system as soon as a page is released. A page is linked in the
+ * partial list of its class while it has free objects; objects are taken
+ * first from the page free list and then from the never used tail of the
+ * page ("bump" allocation), so a new page is only touched as it fills.
+ */
+
+#include "config.h"
+#include <string.h>
+#ifndef OS_WINDOWS
+#include <sys/mman.h>
+#endif
+#include "slab.h"
+#include "panic.h"
+#include "mem.h"
+
+struct SlabPage {
+    SlabPage *prev, *next;   // Partial list of the class
+    SlabPage *aprev, *anext; // List of every page of the slab
+    void     *free;          // Freed objects, linked through their first word
+    uint32_t  cls;           // Size class
+    uint32_t  osize;         // Object size
+    uint32_t  used;          // Objects handed out
+    uint32_t  bump;          // Offset of the first never used object
+    uint32_t  capacity;      // Objects in the page
+    uint32_t  listed;        // Linked in the partial list
+};
+
+#define SLAB_HDR ((sizeof(SlabPage) + 15) & ~(size_t) 15)
+
+_Static_assert(SLAB_HDR <= 64, "slab page header too large");
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+/*
+ * Class of a size in (0, SLAB_MAX_SIZE]: 16-byte steps up to 128 bytes,
+ * then four steps per power of two.
+ */
+static inline int size_class(size_t size) {
+    size_t v;
+    int b;
+
+    if (size <= 128)
+        return size == 0 ? 0 : (int) ((size - 1) >> 4);
+    v = size - 1;
+    b = 63 - __builtin_clzll(v);
+    return 8 + (b - 7) * 4 + (int) ((v - ((size_t) 1 << b)) >> (b - 2));
+}
+
+static inline size_t class_size(int cls) {
+    int k, b;
+
+    if (cls < 8)
+        return (size_t) (cls + 1) << 4;
+    k = cls - 8;
+    b = 7 + k / 4;
+    return ((size_t) 1 << b) + ((size_t) (k % 4 + 1) << (b - 2));
+}
+
+static inline SlabPage *page_of(const void *ptr) {
+    return (SlabPage *) ((uintptr_t) ptr & ~(uintptr_t) (SLAB_PAGE - 1));
+}
+
+static void page_link(Slab *s, SlabPage *p) {
+    p->prev = NULL;
+    p->next = s->partial[p->cls];
+    if (p->next)
+        p->next->prev = p;
+    s->partial[p->cls] = p;
+    p->listed = 1;
+}
+
+static void page_unlink(Slab *s, SlabPage *p) {
+    if (p->prev)
+        p->prev->next = p->next;
+    else
+        s->partial[p->cls] = p->next;
+    if (p->next)
+        p->next->prev = p->prev;
+    p->prev = p->next = NULL;
+    p->listed = 0;
+}
+
+#ifndef OS_WINDOWS
+/*
+ * Maps a zeroed page aligned to SLAB_PAGE: twice the size is mapped and
+ * the misaligned head and tail are unmapped.
+ */
+static void *page_map(void) {
+    char *base = mmap(NULL, 2 * SLAB_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uintptr_t page;
+    size_t head;
+
+    if (base == MAP_FAILED)
+        return NULL;
+    page = ((uintptr_t) base + SLAB_PAGE - 1) & ~(uintptr_t) (SLAB_PAGE - 1);
+    head = page - (uintptr_t) base;
+    if (head)
+        munmap(base, head);
+    munmap((char *) page + SLAB_PAGE, SLAB_PAGE - head);
+    return (void *) page;
+}
+
+static void page_unmap(void *page) {
+    munmap(page, SLAB_PAGE);
+}
+#else
+/* Without mmap the pages come from the aligned heap */
+static void *page_map(void) {
+    return aligned_calloc_mem(SLAB_PAGE, SLAB_PAGE);
+}
+
+static void page_unmap(void *page) {
+    free_aligned_mem(page);
+}
+#endif
+
+static SlabPage *page_alloc(Slab *s, int cls) {
+    SlabPage *p = (SlabPage *) page_map();
+
+    if (!p)
+        return NULL;
+    p->cls = cls;
+    p->osize = (uint32_t) class_size(cls);
+    p->bump = SLAB_HDR;
+    p->capacity = (uint32_t) ((SLAB_PAGE - SLAB_HDR) / p->osize);
+    page_link(s, p);
+    p->anext = s->all;
+    if (s->all)
+        s->all->aprev = p;
+    s->all = p;
+    s->pages++;
+    return p;
+}
+
+static void page_free(Slab *s, SlabPage *p) {
+    if (p->aprev)
+        p->aprev->anext = p->anext;
+    else
+        s->all = p->anext;
+    if (p->anext)
+        p->anext->aprev = p->aprev;
+    page_unmap(p);
+    s->pages--;
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+size_t slab_size(size_t size) {
+    return size > SLAB_MAX_SIZE ? size : class_size(size_class(size));
+}
+
+void *slab_alloc(Slab *s, size_t size) {
+    SlabPage *p;
+    void *obj;
+    int cls;
+
+    if (size > SLAB_MAX_SIZE) {
+        if ((obj = calloc_mem(1, size)) != NULL)
+            s->large += size;
+        return obj;
+    }
+
+    cls = size_class(size);
+    if ((p = s->partial[cls]) == NULL && (p = page_alloc(s, cls)) == NULL)
+        return NULL;
+
+    if (p->free) {
+        obj = p->free;
+        p->free = *(void **) obj;
+    } else {
+        obj = (char *) p + p->bump;
+        p->bump += p->osize;
+    }
+    if (++p->used == p->capacity)
+        page_unlink(s, p);
+    return obj;
+}
+
+void *slab_realloc(Slab *s, void *ptr, size_t osize, size_t nsize) {
+    void *obj;
+
+    if (osize > SLAB_MAX_SIZE && nsize > SLAB_MAX_SIZE) {
+        if ((obj = realloc_mem(ptr, nsize)) != NULL)
+            s->large += nsize - osize;
+        return obj;
+    }
+    if (slab_size(osize) == slab_size(nsize))
+        return ptr;
+    if ((obj = slab_alloc(s, nsize)) == NULL)
+        return NULL;
+    memcpy(obj, ptr, osize < nsize ? osize : nsize);
+    slab_free(s, ptr, osize);
+    return obj;
+}
+
+void slab_free(Slab *s, void *ptr, size_t size) {
+    SlabPage *p;
+
+    if (size > SLAB_MAX_SIZE) {
+        s->large -= size;
+        free_mem(ptr);
+        return;
+    }
+
+    p = page_of(ptr);
+    PANIC_IF(p->cls != (uint32_t) size_class(size) || p->used == 0, "invalid slab object");
+    *(void **) ptr = p->free;
+    p->free = ptr;
+    p->used--;
+
+    if (!p->listed) {
+        page_link(s, p);
+    } else if (p->used == 0 && (p->prev || p->next)) {
+        /* Keep one page per class to avoid thrashing at the boundary */
+        page_unlink(s, p);
+        page_free(s, p);
+    }
+}
+
+void slab_destroy(Slab *s) {
+    while (s->all)
+        page_free(s, s->all);
+    memset(s->partial, 0, sizeof(s->partial));
+}
@@ -0,0 +1,92 @@
+/*
+ * slab.h - Size-class slab allocator for small objects
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Objects of up to SLAB_MAX_SIZE bytes are rounded up to one of
+ * SLAB_CLASSES size classes (16-byte steps up to 128 bytes, then four
+ * classes per power of two) and carved out of SLAB_PAGE-byte pages that
+ * only hold objects of one class. Freed objects go back to the free list
+ * of their page, so churn reuses memory of the same size instead of
+ * fragmenting the heap, and a page is returned once all its objects are
+ * free. Larger objects are passed through to the heap allocator.
+ *
+ * Objects carry no header: the caller gives the size back on free, and
+ * the page of a small object is found by masking its address.
+ *
+ * A Slab is not thread-safe; callers provide their own locking.
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_PAGE     (64 * 1024)
+#define SLAB_MAX_SIZE 4096
+#define SLAB_CLASSES  28
+
+typedef struct SlabPage SlabPage;
+
+typedef struct {
+    SlabPage *partial[SLAB_CLASSES];  // Pages of each class with free objects
+    SlabPage *all;                    // Every page
+    uint64_t  pages;                  // Pages in use
+    uint64_t  large;                  // Bytes in objects above SLAB_MAX_SIZE
+} Slab;
+
+#define SLAB_INIT() { {NULL}, NULL, 0, 0 }
+
+/**
+ * Returns the number of bytes actually reserved for an object of `size`
+ * bytes: the size of its class, or `size` itself above SLAB_MAX_SIZE.
+ */
+extern size_t slab_size(size_t size);
+
+/**
+ * Allocates an object of `size` bytes. The memory is not zeroed.
+ *
+ * @return Pointer to the object, or NULL on allocation failure.
+ */
+extern void *slab_alloc(Slab *s, size_t size);
+
+/**
+ * Resizes an object. The object stays in place when the new size falls in
+ * the same class; otherwise the first min(osize, nsize) bytes are moved
+ * to a new object and the old one is freed.
+ *
+ * @return Pointer to the object, or NULL (the old object is kept) on failure.
+ */
+extern void *slab_realloc(Slab *s, void *ptr, size_t osize, size_t nsize);
+
+/**
+ * Frees an object allocated with `size` bytes.
+ */
+extern void slab_free(Slab *s, void *ptr, size_t size);
+
+/**
+ * Releases every page of the slab, and with them every small object.
+ * Objects above SLAB_MAX_SIZE must be freed by the owner.
+ */
+extern void slab_destroy(Slab *s);
+
+#endif
@@ -18,11 +18,39 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include "config.h"
 #include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
 #include "store.h"
 #include "vector.h"
 #include "file.h"
 
+/*
+ * StoreJob - Shared state of a parallel dump or load. Workers take chunks
+ * from the table in order through `next` and stop at the first error.
+ */
+typedef struct StoreJob {
+    IOFile     *fp;
+    IOContext  *io;
+    StoreChunk *chunks;
+    uint32_t    nchunks;
+    size_t      bsize;      // Per-worker buffer size (0: none needed)
+    uint16_t    vsize;      // Size of a vector record on disk
+    char       *block;      // Load: vector block
+    int (*run)(struct StoreJob *job, StoreChunk *chunk, char *buff);
+
+    uint32_t    next;       // Next chunk to process (atomic)
+    int         error;      // First error reported (atomic)
+} StoreJob;
+
 /**
  * @brief Converts an index type to its corresponding magic number.
  *
@@ -53,15 +81,39 @@ int magic_to_index(uint32_t magic) {
     }
 }
 
+/**
+ * @brief Hands the block of the loaded vectors to the account of an index.
+ *
+ * @param io   Pointer to the IOContext.
+ * @param acct Account of the index.
+ */
+void io_adopt_vectors(IOContext *io, MemAccount *acct) {
+    if (io->block) {
+        vector_block_adopt(acct, io->block);
+        io->block = NULL;
+    }
+}
+
 /**
  * @brief Frees all allocated vectors in an IOContext.
  *
- * @param io Pointer to the IOContext containing vectors to free.
+ * @param io   Pointer to the IOContext containing vectors to free.
+ * @param acct Account the vector block was handed to, or NULL.
  */
-void io_free_vectors(IOContext *io) {
-    for (int i = 0; i < (int)io->elements; i++) 
-        if (io->vectors[i])
+void io_free_vectors(IOContext *io, MemAccount *acct) {
+    if (io->vectors == NULL)
+        return;
+    if (io->block) {
+        free_vector_block(io->block);
+        io->block = NULL;
+        memset(io->vectors, 0, io->elements * sizeof(Vector *));
+        return;
+    }
+    for (int i = 0; i < (int)io->elements; i++) {
+        if (io->vectors[i] && !vector_block_release(acct, io->vectors[i]))
             free_vector(&io->vectors[i]);
+        io->vectors[i] = NULL;
+    }
 }
 
 
@@ -77,6 +129,8 @@ void io_free(IOContext *io) {
     PANIC_IF(io == NULL, "invalid load context");
     if (io->header)  free_mem(io->header);
     if (io->vectors) free_mem(io->vectors);
+    if (io->tags)    free_mem(io->tags);
+    if (io->payloads) free_mem(io->payloads);
     if (io->nodes) {
         int elements = io->elements;
         for (int i = 0; i < elements; i++) {
@@ -103,7 +157,7 @@ void io_free(IOContext *io) {
  * @param io Pointer to the IOContext to initialize.
  * @param elements Number of elements to allocate.
  * @param hdrsz Size of the header in bytes.
- * @param maps Non-zero to initialize maps, zero to skip.
+ * @param mode IO_INIT_* flags; the maps are only built with IO_INIT_MAPS.
  * @return 0 on success, or an error code on failure.
  */
 int io_init(IOContext *io, int elements, int hdrsz, int mode) {
@@ -113,10 +167,17 @@ int io_init(IOContext *io, int elements, int hdrsz, int mode) {
     io->header  = NULL;
     io->nodes   = NULL;
     io->vectors = NULL;
+    io->block   = NULL;
+    io->tags    = NULL;
     io->elements = elements;
     io->itype = -1;
     io->hsize = hdrsz;
     io->vsize = io->nsize = 0;
+    io->snapshot = 0;
+    io->encoding = DUMP_FP32;
+    io->payloads = NULL;
+    io->plength = 0;
+    io->pcount = 0;
     io->nat = MAP_INIT();
     io->vat = MAP_INIT();
 
@@ -133,13 +194,12 @@ int io_init(IOContext *io, int elements, int hdrsz, int mode) {
             goto error_return;
 
 
-    if (mode & (IO_INIT_VECTORS | IO_INIT_MAPS))
+    if (mode & IO_INIT_MAPS) {
         if (init_map(&io->vat, elements/10, 15) == MAP_ERROR_ALLOC)
             goto error_return;
-
-    if (mode & (IO_INIT_NODES | IO_INIT_MAPS))
         if (init_map(&io->nat, elements/10, 15) == MAP_ERROR_ALLOC) 
             goto error_return;
+    }
 
     return SUCCESS;
 error_return:
@@ -148,126 +208,579 @@ error_return:
 }
 
 
+int io_capture_tags(IOContext *io) {
+    PANIC_IF(io == NULL || io->vectors == NULL, "invalid io context");
+    if ((io->tags = calloc_mem(io->elements > 0 ? io->elements : 1, sizeof(uint64_t))) == NULL)
+        return SYSTEM_ERROR;
+    for (int i = 0; i < (int) io->elements; i++)
+        io->tags[i] = io->vectors[i]->tag;
+    return SUCCESS;
+}
+
 /**
- * @brief Dumps an IOContext to a binary file.
+ * @brief Number of elements per chunk for an IOContext.
+ */
+static uint32_t store_chunk_elements(uint16_t vsize, uint16_t nsize) {
+    size_t unit = vsize > nsize ? vsize : nsize;
+    size_t n = unit ? STORE_CHUNK_BYTES / unit : 0;
+    return n > 0 ? (uint32_t) n : 1;
+}
+
+/**
+ * @brief Size of a vector record on disk, 0 for an unknown encoding.
+ */
+static uint16_t store_vector_size(uint16_t encoding, uint16_t dims) {
+    switch (encoding) {
+    case DUMP_FP32:
+        return VECTORSZ(ALIGN_DIMS(dims));
+    case DUMP_FP16:
+        return 2 * sizeof(uint64_t) + dims * sizeof(uint16_t);
+    case DUMP_SQ8:
+        return 2 * sizeof(uint64_t) + 2 * sizeof(float32_t) + dims;
+    }
+    return 0;
+}
+
+/**
+ * @brief Converts a float to IEEE half precision, rounding to nearest even.
+ */
+static uint16_t fp32_to_fp16(float32_t f) {
+    uint32_t x, mant, rem, halfway;
+    uint16_t sign, h;
+    int32_t exp;
+    int shift;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (uint16_t) ((x >> 16) & 0x8000);
+    exp  = (int32_t) ((x >> 23) & 0xFF);
+    mant = x & 0x7FFFFF;
+
+    if (exp == 0xFF)                            /* Inf and NaN */
+        return sign | 0x7C00 | (mant ? 0x200 : 0);
+    exp = exp - 127 + 15;
+    if (exp >= 31)                              /* Overflow */
+        return sign | 0x7C00;
+
+    if (exp <= 0) {                             /* Subnormal half */
+        if (exp < -10)
+            return sign;
+        mant |= 0x800000;
+        shift = 14 - exp;
+    } else {
+        mant |= (uint32_t) exp << 23;
+        shift = 13;
+    }
+    h = (uint16_t) (mant >> shift);
+    rem = mant & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+    /* A carry out of the mantissa correctly bumps the exponent */
+    if (rem > halfway || (rem == halfway && (h & 1)))
+        h++;
+    return sign | h;
+}
+
+static float32_t fp16_to_fp32(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp  = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t x;
+    float32_t f;
+
+    if (exp == 0x1F) {
+        x = sign | 0x7F800000 | (mant << 13);
+    } else if (exp == 0) {
+        if (mant == 0) {
+            x = sign;
+        } else {
+            /* Subnormal half: normalize it */
+            exp = 1;
+            while ((mant & 0x400) == 0) {
+                mant <<= 1;
+                exp--;
+            }
+            x = sign | ((exp + 112) << 23) | ((mant & 0x3FF) << 13);
+        }
+    } else {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief Writes a vector as a DUMP_FP16 or DUMP_SQ8 record.
+ */
+static void encode_vector(char *p, const Vector *v, uint64_t tag, uint16_t encoding, uint16_t dims) {
+    memcpy(p, &v->id, sizeof(uint64_t));
+    memcpy(p + sizeof(uint64_t), &tag, sizeof(uint64_t));
+    p += 2 * sizeof(uint64_t);
+
+    if (encoding == DUMP_FP16) {
+        for (int i = 0; i < dims; i++, p += sizeof(uint16_t)) {
+            uint16_t h = fp32_to_fp16(v->vector[i]);
+            memcpy(p, &h, sizeof(h));
+        }
+    } else {
+        float32_t min = v->vector[0], max = v->vector[0], scale;
+
+        for (int i = 1; i < dims; i++) {
+            if (v->vector[i] < min) min = v->vector[i];
+            if (v->vector[i] > max) max = v->vector[i];
+        }
+        scale = (max - min) / 255.0f;
+        memcpy(p, &min, sizeof(min));
+        memcpy(p + sizeof(min), &scale, sizeof(scale));
+        p += 2 * sizeof(float32_t);
+        for (int i = 0; i < dims; i++) {
+            long q = scale > 0 ? lrintf((v->vector[i] - min) / scale) : 0;
+            p[i] = (char) (uint8_t) (q < 0 ? 0 : q > 255 ? 255 : q);
+        }
+    }
+}
+
+/**
+ * @brief Rebuilds a zeroed fp32 vector from a DUMP_FP16 or DUMP_SQ8 record.
+ */
+static void decode_vector(Vector *v, const char *p, uint16_t encoding, uint16_t dims) {
+    memcpy(&v->id, p, sizeof(uint64_t));
+    memcpy(&v->tag, p + sizeof(uint64_t), sizeof(uint64_t));
+    p += 2 * sizeof(uint64_t);
+
+    if (encoding == DUMP_FP16) {
+        for (int i = 0; i < dims; i++, p += sizeof(uint16_t)) {
+            uint16_t h;
+            memcpy(&h, p, sizeof(h));
+            v->vector[i] = fp16_to_fp32(h);
+        }
+    } else {
+        float32_t min, scale;
+
+        memcpy(&min, p, sizeof(min));
+        memcpy(&scale, p + sizeof(min), sizeof(scale));
+        p += 2 * sizeof(float32_t);
+        for (int i = 0; i < dims; i++)
+            v->vector[i] = min + (float32_t) (uint8_t) p[i] * scale;
+    }
+}
+
+/**
+ * @brief Fills the chunk table of a file (checksums excluded).
+ *
+ * The layout is fully determined by the element count and sizes, so the
+ * same function is used to plan a dump and to validate a table on load.
+ *
+ * @return Number of chunks.
+ */
+static uint32_t store_layout(StoreChunk *chunks, uint32_t elements, uint32_t ce,
+                             uint16_t vsize, uint16_t nsize, uint64_t voff, int nodes) {
+    uint64_t noff = voff + (uint64_t) elements * vsize;
+    uint32_t n = 0;
+
+    for (int s = 0; s < (nodes ? 2 : 1); s++) {
+        uint16_t  size = s == 0 ? vsize : nsize;
+        uint64_t  base = s == 0 ? voff : noff;
+        for (uint64_t first = 0; first < elements; first += ce, n++) {
+            if (chunks == NULL)
+                continue;
+            chunks[n].section = s == 0 ? STORE_SECTION_VECTORS : STORE_SECTION_NODES;
+            chunks[n].count   = (uint32_t) (elements - first < ce ? elements - first : ce);
+            chunks[n].first   = first;
+            chunks[n].offset  = base + first * size;
+            chunks[n].length  = (uint64_t) chunks[n].count * size;
+        }
+    }
+    return n;
+}
+
+static int store_threads(uint32_t nchunks) {
+    int n = 1;
+#ifndef OS_WINDOWS
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n = cpus > 0 ? (int) cpus : 1;
+    if (n > STORE_MAX_THREADS)
+        n = STORE_MAX_THREADS;
+#endif
+    /* On Windows positioned I/O is emulated with a seek: one thread only */
+    return (uint32_t) n > nchunks ? (int) nchunks : n;
+}
+
+static void *store_worker(void *arg) {
+    StoreJob *job = (StoreJob *) arg;
+    char *buff = NULL;
+    uint32_t k;
+    int ret;
+
+    if (job->bsize > 0 && (buff = calloc_mem(1, job->bsize)) == NULL) {
+        int none = SUCCESS;
+        __atomic_compare_exchange_n(&job->error, &none, SYSTEM_ERROR, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        return NULL;
+    }
+
+    while (__atomic_load_n(&job->error, __ATOMIC_ACQUIRE) == SUCCESS &&
+           (k = __atomic_fetch_add(&job->next, 1, __ATOMIC_ACQ_REL)) < job->nchunks) {
+        if ((ret = job->run(job, &job->chunks[k], buff)) != SUCCESS) {
+            int none = SUCCESS;
+            __atomic_compare_exchange_n(&job->error, &none, ret, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    if (buff)
+        free_mem(buff);
+    return NULL;
+}
+
+/**
+ * @brief Processes every chunk of the job, in parallel when possible.
+ *
+ * The calling thread works as well; if a thread cannot be started the
+ * remaining ones simply take more chunks.
  *
- * Writes the header, vectors, and nodes sequentially to the file.
- * Updates offsets for vectors and nodes in the StoreHDR structure.
+ * @return SUCCESS or the first error reported by a worker.
+ */
+static int store_run(StoreJob *job) {
+    pthread_t threads[STORE_MAX_THREADS];
+    int nthreads = store_threads(job->nchunks);
+    int started = 0;
+
+    for (int i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, store_worker, job) != 0)
+            break;
+        started++;
+    }
+    store_worker(job);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    return job->error;
+}
+
+/**
+ * @brief Gathers one chunk into the worker buffer, checksums it and writes it.
+ */
+static int dump_chunk(StoreJob *job, StoreChunk *c, char *buff) {
+    IOContext *io = job->io;
+    char *p = buff;
+
+    if (c->section == STORE_SECTION_VECTORS) {
+        size_t vdata = io->vsize - offsetof(Vector, vector);
+        for (uint64_t i = c->first; i < c->first + c->count; i++, p += job->vsize) {
+            const Vector *v = io->vectors[i];
+            /* Snapshot vectors are shared with the live index: the tag is
+               taken from io->tags and never read from the vector itself */
+            if (io->encoding != DUMP_FP32) {
+                encode_vector(p, v, io->tags ? io->tags[i] : v->tag, io->encoding, io->dims);
+            } else if (io->tags) {
+                memcpy(p + offsetof(Vector, id), &v->id, sizeof(v->id));
+                memcpy(p + offsetof(Vector, tag), &io->tags[i], sizeof(uint64_t));
+                memcpy(p + offsetof(Vector, vector), v->vector, vdata);
+            } else {
+                memcpy(p, v, io->vsize);
+            }
+        }
+    } else {
+        for (uint64_t i = c->first; i < c->first + c->count; i++, p += io->nsize)
+            memcpy(p, io->nodes[i], io->nsize);
+    }
+
+    c->checksum = XXH64(buff, c->length, 0);
+    if (file_pwrite(job->fp, buff, c->length, (off_t) c->offset) != c->length)
+        return FILEIO_ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief Reads and verifies one chunk.
+ * fp32 vectors go straight into the block; encoded vectors and nodes are
+ * read into the worker buffer, then decoded into the block or copied to
+ * their own allocations.
+ */
+static int load_chunk(StoreJob *job, StoreChunk *c, char *buff) {
+    IOContext *io = job->io;
+    char *dst;
+
+    if (c->section == STORE_SECTION_VECTORS && io->encoding == DUMP_FP32)
+        dst = (char *) job->block + c->first * io->vsize;
+    else
+        dst = buff;
+
+    if (file_pread(job->fp, dst, c->length, (off_t) c->offset) != c->length)
+        return FILEIO_ERROR;
+    if (XXH64(dst, c->length, 0) != c->checksum)
+        return INVALID_FILE;
+
+    if (c->section == STORE_SECTION_VECTORS && io->encoding != DUMP_FP32) {
+        char *v = (char *) job->block + c->first * io->vsize;
+        for (uint64_t i = 0; i < c->count; i++, dst += job->vsize, v += io->vsize)
+            decode_vector((Vector *) v, dst, io->encoding, io->dims);
+    }
+
+    if (c->section == STORE_SECTION_NODES) {
+        for (uint64_t i = c->first; i < c->first + c->count; i++, dst += io->nsize) {
+            if ((io->nodes[i] = calloc_mem(1, io->nsize)) == NULL)
+                return SYSTEM_ERROR;
+            memcpy(io->nodes[i], dst, io->nsize);
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Dumps an IOContext to a binary file.
+ * Writes the header, the chunk table, and the vectors and nodes sections.
  * Validates the IOContext before dumping.
  *
+ * The chunk layout is computed up front, so every chunk has a fixed offset
+ * and the sections are written with positioned writes by several threads.
+ * The payload section, if any, is written after the sections by the
+ * calling thread. The StoreHDR, the table (with the checksums) and the
+ * index header are written last, in a single write.
+ *
  * @param filename Path to the output file.
  * @param io Pointer to the IOContext to dump.
  * @return 0 on success, or an error code on failure.
  */
 int store_dump_file(const char *filename, IOContext *io) {
-    IOFile *fp = NULL;
+    StoreJob job;
     StoreHDR hdr;
+    StoreChunkHDR chdr;
+    char *prefix = NULL;
+    StoreChunk *pc = NULL;
+    uint32_t ce, n;
     uint64_t voff;
-    uint64_t noff;
+    uint16_t vsize;
     int ret = SUCCESS;
 
 
     memset(&hdr, 0, sizeof(StoreHDR));
+    memset(&chdr, 0, sizeof(StoreChunkHDR));
+    memset(&job, 0, sizeof(StoreJob));
 
     PANIC_IF(filename == NULL, "invalid filename pointer");
     PANIC_IF(io == NULL, "invalid io context");
     PANIC_IF(io->vectors == NULL, "vectors could not be null");
 
     PANIC_IF(index_to_magic(io->itype) == 0, "invalid index type");
+    PANIC_IF((vsize = store_vector_size(io->encoding, io->dims)) == 0, "invalid vector encoding");
 
-    if ((fp = file_open(filename, "wb")) == NULL)
-        return FILEIO_ERROR;
+    ce = store_chunk_elements(vsize, io->nodes ? io->nsize : 0);
+    n = store_layout(NULL, io->elements, ce, vsize, io->nsize, 0, io->nodes != NULL);
+    chdr.nchunks = n + (io->pcount > 0);
+    chdr.chunk_elements = ce;
+    chdr.snapshot = io->snapshot;
+    chdr.encoding = io->encoding;
 
-    if (file_seek(fp, sizeof(StoreHDR), SEEK_SET) != 0) {
-        ret = FILEIO_ERROR;
-        goto end;
+    voff = sizeof(StoreHDR) + sizeof(StoreChunkHDR) + (uint64_t) chdr.nchunks * sizeof(StoreChunk) + io->hsize;
+
+    if ((prefix = calloc_mem(1, voff)) == NULL)
+        return SYSTEM_ERROR;
+    job.chunks = (StoreChunk *) (prefix + sizeof(StoreHDR) + sizeof(StoreChunkHDR));
+    store_layout(job.chunks, io->elements, ce, vsize, io->nsize, voff, io->nodes != NULL);
+    if (io->pcount > 0) {
+        pc = &job.chunks[n];
+        pc->section = STORE_SECTION_PAYLOADS;
+        pc->count   = io->pcount;
+        pc->offset  = voff + (uint64_t) io->elements * (vsize + (io->nodes ? io->nsize : 0));
+        pc->length  = io->plength;
     }
 
-    if (io->hsize > 0)
-        if (file_write(io->header, io->hsize, 1, fp) != 1) {
-            ret = FILEIO_ERROR;
-            goto end;
-        }
+    if ((job.fp = file_open(filename, "wb")) == NULL) {
+        free_mem(prefix);
+        return FILEIO_ERROR;
+    }
 
-    voff = (uint64_t)file_tello(fp);
-    for (int i = 0; i < (int)io->elements; i++) {
-        if (file_write(io->vectors[i], io->vsize, 1, fp) != 1) {
+    job.io      = io;
+    job.nchunks = n;
+    job.vsize   = vsize;
+    job.bsize   = (size_t) ce * (vsize > io->nsize ? vsize : io->nsize);
+    job.run     = dump_chunk;
+    if ((ret = store_run(&job)) != SUCCESS)
+        goto end;
+
+    if (pc != NULL) {
+        pc->checksum = XXH64(io->payloads, pc->length, 0);
+        if (file_pwrite(job.fp, io->payloads, pc->length, (off_t) pc->offset) != pc->length) {
             ret = FILEIO_ERROR;
             goto end;
         }
     }
 
-    if (io->nodes != NULL) {
-        noff = (uint64_t) file_tello(fp);
-        for (int i = 0; i < (int) io->elements; i++) {
-            if (file_write(io->nodes[i], io->nsize, 1, fp) != 1) {
-                ret = FILEIO_ERROR;
-                goto end;
-            }
-        }
-        hdr.only_vectors = 0;
-    } else {
-        hdr.only_vectors = 1;
-        noff = 0;
-    }
     hdr.magic = index_to_magic(io->itype);
+    hdr.major = STORE_MAJOR;
     hdr.hsize = io->hsize;
     hdr.nsize = io->nsize;
-    hdr.vsize = io->vsize;
-    hdr.noff = noff;
+    hdr.vsize = vsize;
     hdr.voff = voff;
+    hdr.noff = io->nodes ? voff + (uint64_t) io->elements * vsize : 0;
+    hdr.only_vectors = io->nodes ? 0 : 1;
     hdr.elements = io->elements;
     hdr.method = io->method;
     hdr.dims = io->dims;
     hdr.dims_aligned = io->dims_aligned;
-    
-    if (file_seek(fp, 0, SEEK_SET) != 0) {
-        ret = FILEIO_ERROR;
-        goto end;
-    }
 
-    if (file_write(&hdr, sizeof(StoreHDR), 1, fp) != 1)
+    chdr.checksum = XXH64(job.chunks, (size_t) chdr.nchunks * sizeof(StoreChunk), 0);
+
+    memcpy(prefix, &hdr, sizeof(StoreHDR));
+    memcpy(prefix + sizeof(StoreHDR), &chdr, sizeof(StoreChunkHDR));
+    if (io->hsize > 0)
+        memcpy(prefix + sizeof(StoreHDR) + sizeof(StoreChunkHDR) + (size_t) chdr.nchunks * sizeof(StoreChunk),
+               io->header, io->hsize);
+
+    if (file_pwrite(job.fp, prefix, voff, 0) != voff)
         ret = FILEIO_ERROR;
 
 end:
-    file_close(fp);
+    file_close(job.fp);
+    free_mem(prefix);
     return ret;
 }
 
 /**
- * @brief Loads an index and its associated vectors and nodes from a binary file.
+ * @brief Reads and validates the chunk table of a format 2 or 3 file.
+ *
+ * The table must match exactly the layout store_dump_file() would produce
+ * for the header values and vectors offset, so chunk offsets can be
+ * trusted afterwards. A payload chunk, if present, is the last entry and
+ * must start right after the last section.
  *
+ * @param chdr Output: chunk table header (format 2 ones are fp32).
+ * @param hoff Output: offset of the index header.
+ * @return SUCCESS, INVALID_FILE, FILEIO_ERROR or SYSTEM_ERROR.
+ */
+static int load_chunk_table(IOFile *fp, StoreHDR *hdr, StoreChunkHDR *chdr, StoreChunk **chunks,
+                            uint32_t *nchunks, uint64_t *hoff) {
+    size_t chsize = hdr->major == 2 ? STORE_CHUNKHDR_V2 : sizeof(StoreChunkHDR);
+    StoreChunk *table, *expect;
+    uint32_t n, total;
+    size_t tsize;
+
+    memset(chdr, 0, sizeof(StoreChunkHDR));
+    if (file_pread(fp, chdr, chsize, sizeof(StoreHDR)) != chsize)
+        return FILEIO_ERROR;
+
+    if (hdr->vsize != store_vector_size(chdr->encoding, hdr->dims))
+        return INVALID_FILE;
+    if (chdr->chunk_elements != store_chunk_elements(hdr->vsize, hdr->only_vectors ? 0 : hdr->nsize))
+        return INVALID_FILE;
+    n = store_layout(NULL, hdr->elements, chdr->chunk_elements, hdr->vsize, hdr->nsize, 0, !hdr->only_vectors);
+    total = chdr->nchunks;
+    if (total != n && (total != n + 1 || hdr->elements == 0))
+        return INVALID_FILE;
+
+    /* The index header follows the table; streamed exports may leave
+       unused table space before the vectors */
+    *hoff = sizeof(StoreHDR) + chsize + (uint64_t) total * sizeof(StoreChunk);
+    if (hdr->voff < *hoff + hdr->hsize)
+        return INVALID_FILE;
+    if (!hdr->only_vectors && hdr->noff != hdr->voff + (uint64_t) hdr->elements * hdr->vsize)
+        return INVALID_FILE;
+
+    tsize = (size_t) total * sizeof(StoreChunk);
+    table  = calloc_mem(total > 0 ? total : 1, sizeof(StoreChunk));
+    expect = calloc_mem(total > 0 ? total : 1, sizeof(StoreChunk));
+    if (table == NULL || expect == NULL) {
+        if (table)  free_mem(table);
+        if (expect) free_mem(expect);
+        return SYSTEM_ERROR;
+    }
+
+    store_layout(expect, hdr->elements, chdr->chunk_elements, hdr->vsize, hdr->nsize, hdr->voff, !hdr->only_vectors);
+    if (total > n) {
+        expect[n].section = STORE_SECTION_PAYLOADS;
+        expect[n].offset  = hdr->voff + (uint64_t) hdr->elements * (hdr->vsize + (hdr->only_vectors ? 0 : hdr->nsize));
+    }
+    if (file_pread(fp, table, tsize, sizeof(StoreHDR) + chsize) != tsize ||
+        XXH64(table, tsize, 0) != chdr->checksum) {
+        free_mem(expect);
+        free_mem(table);
+        return INVALID_FILE;
+    }
+    if (total > n) {
+        expect[n].count  = table[n].count;
+        expect[n].length = table[n].length;
+        if (table[n].count == 0 || table[n].length < (uint64_t) table[n].count * sizeof(StorePayload))
+            expect[n].section = 0;
+    }
+    for (uint32_t i = 0; i < total; i++) {
+        expect[i].checksum = table[i].checksum;
+        if (memcmp(&expect[i], &table[i], sizeof(StoreChunk)) != 0) {
+            free_mem(expect);
+            free_mem(table);
+            return INVALID_FILE;
+        }
+    }
+
+    free_mem(expect);
+    *chunks = table;
+    *nchunks = total;
+    return SUCCESS;
+}
+
+/**
+ * @brief Loads an index and its associated vectors and nodes from a binary file.
  * Parses the file header, initializes the IOContext, and loads vectors and nodes
  * into memory. Validates file structure and internal offsets during the load.
  *
+ * All vectors are placed in a single block (alloc_vector_block). Chunked
+ * files are read by several threads, each chunk straight into its place in
+ * the block (or decoded into it for fp16/SQ8 files), and verified against
+ * the chunk checksum. Files written before the chunked format (major
+ * version 0) are read sequentially.
+ *
  * @param filename Path to the binary file to load.
  * @param io Pointer to an IOContext structure to initialize and populate.
  * @return 0 on success, or an error code on failure.
  */
 int store_load_file(const char *filename, IOContext *io) {
     IOFile *fp = NULL;
-    off_t pos;
     StoreHDR hdr;
+    StoreChunkHDR chdr;
+    StoreChunk *chunks = NULL;
+    StoreChunk *pc = NULL;
+    uint32_t nchunks = 0;
+    uint64_t hoff;
+    VectorBlock *block = NULL;
+    char *nodes = NULL;
     int ret = SUCCESS;
     int mode = 0;
     int itype;
 
     memset(&hdr, 0, sizeof(StoreHDR));
+    memset(&chdr, 0, sizeof(StoreChunkHDR));
 
 
     if ((fp = file_open(filename, "rb")) == NULL)
         return FILEIO_ERROR;
 
-    if (file_read(&hdr, sizeof(StoreHDR), 1, fp) != 1) {
+    if (file_pread(fp, &hdr, sizeof(StoreHDR), 0) != sizeof(StoreHDR)) {
         file_close(fp);
         return FILEIO_ERROR;
     }
 
-    if ((itype = magic_to_index(hdr.magic)) == -1) {
+    if ((itype = magic_to_index(hdr.magic)) == -1 || hdr.dims_aligned != ALIGN_DIMS(hdr.dims)) {
         file_close(fp);
         return INVALID_FILE;
     }
 
+    switch (hdr.major) {
+    case 2:
+    case STORE_MAJOR:
+        ret = load_chunk_table(fp, &hdr, &chdr, &chunks, &nchunks, &hoff);
+        break;
+    case 0:
+        hoff = sizeof(StoreHDR);
+        if (hdr.vsize != VECTORSZ(hdr.dims_aligned) || hdr.voff != hoff + hdr.hsize ||
+            (!hdr.only_vectors && hdr.noff != hdr.voff + (uint64_t) hdr.elements * hdr.vsize))
+            ret = INVALID_FILE;
+        break;
+    default:
+        ret = INVALID_FILE;
+        break;
+    }
+    if (ret != SUCCESS) {
+        file_close(fp);
+        return ret;
+    }
+
     if (hdr.hsize != 0)
         mode = IO_INIT_HEADER;
 
@@ -277,6 +790,7 @@ int store_load_file(const char *filename, IOContext *io) {
         mode |= IO_INIT_NODES | IO_INIT_VECTORS;
 
     if (io_init(io, hdr.elements, hdr.hsize, mode) != SUCCESS) {
+        if (chunks) free_mem(chunks);
         file_close(fp);
         return SYSTEM_ERROR;
     }
@@ -286,47 +800,94 @@ int store_load_file(const char *filename, IOContext *io) {
     io->method       = hdr.method;
     io->elements     = hdr.elements;
     io->itype        = itype;
+    io->vsize        = VECTORSZ(hdr.dims_aligned);
+    io->nsize        = hdr.nsize;
+    io->snapshot     = chdr.snapshot;
+    io->encoding     = chdr.encoding;
 
     if (mode & IO_INIT_HEADER) {
-        if (file_read(io->header, hdr.hsize, 1, fp) != 1) {
-            file_close(fp);
-            return FILEIO_ERROR;
+        if (file_pread(fp, io->header, hdr.hsize, (off_t) hoff) != hdr.hsize) {
+            ret = FILEIO_ERROR;
+            goto error_return;
         }
     }
 
-    if ((pos = file_tello(fp)) != (off_t)-1 && (uint64_t) pos != hdr.voff) {
-        ret = INVALID_FILE;
-        goto error_return;
-    }
-
-    for (int i = 0; i < (int) hdr.elements; i++ ) {
-        io->vectors[i] = alloc_vector(hdr.dims_aligned);
-        if (io->vectors[i] == NULL) {
+    if (hdr.elements > 0) {
+        if ((block = alloc_vector_block(hdr.dims_aligned, hdr.elements)) == NULL) {
             ret = SYSTEM_ERROR;
             goto error_return;
         }
-        if (file_read(io->vectors[i], hdr.vsize, 1, fp) != 1) {
-            ret = FILEIO_ERROR;
+        io->block = block;
+        for (int i = 0; i < (int) hdr.elements; i++)
+            io->vectors[i] = (Vector *) (block->base + (size_t) i * io->vsize);
+    }
+
+    if (chunks != NULL) {
+        StoreJob job;
+
+        if (nchunks > 0 && chunks[nchunks - 1].section == STORE_SECTION_PAYLOADS)
+            pc = &chunks[--nchunks];
+
+        memset(&job, 0, sizeof(StoreJob));
+        job.fp      = fp;
+        job.io      = io;
+        job.chunks  = chunks;
+        job.nchunks = nchunks;
+        job.block   = block ? block->base : NULL;
+        job.vsize   = hdr.vsize;
+        job.bsize   = (size_t) chunks[0].count * (io->encoding != DUMP_FP32 ? hdr.vsize : 0);
+        if (mode & IO_INIT_NODES && (size_t) chunks[0].count * hdr.nsize > job.bsize)
+            job.bsize = (size_t) chunks[0].count * hdr.nsize;
+        job.run     = load_chunk;
+        if ((ret = store_run(&job)) != SUCCESS)
             goto error_return;
+
+        if (pc != NULL) {
+            if ((io->payloads = calloc_mem(1, pc->length)) == NULL) {
+                ret = SYSTEM_ERROR;
+                goto error_return;
+            }
+            if (file_pread(fp, io->payloads, pc->length, (off_t) pc->offset) != pc->length) {
+                ret = FILEIO_ERROR;
+                goto error_return;
+            }
+            if (XXH64(io->payloads, pc->length, 0) != pc->checksum) {
+                ret = INVALID_FILE;
+                goto error_return;
+            }
+            io->plength = pc->length;
+            io->pcount  = pc->count;
         }
-    }
+        free_mem(chunks);
+        chunks = NULL;
+    } else if (hdr.elements > 0) {
+        size_t vbytes = (size_t) hdr.elements * hdr.vsize;
 
-    if (mode & IO_INIT_NODES) {
-        if ((pos = file_tello(fp)) != (off_t)-1 && (uint64_t) pos != hdr.noff) {
-            ret = INVALID_FILE;
+        if (file_pread(fp, block->base, vbytes, (off_t) hdr.voff) != vbytes) {
+            ret = FILEIO_ERROR;
             goto error_return;
         }
 
-        for (int i = 0; i < (int) hdr.elements; i++ ) {
-            io->nodes[i] = calloc_mem(1, hdr.nsize);
-            if (io->nodes[i] == NULL) {
+        if (mode & IO_INIT_NODES) {
+            size_t nbytes = (size_t) hdr.elements * hdr.nsize;
+
+            if ((nodes = calloc_mem(1, nbytes)) == NULL) {
                 ret = SYSTEM_ERROR;
                 goto error_return;
             }
-            if (file_read(io->nodes[i], hdr.nsize, 1, fp) != 1) {
+            if (file_pread(fp, nodes, nbytes, (off_t) hdr.noff) != nbytes) {
                 ret = FILEIO_ERROR;
                 goto error_return;
             }
+            for (int i = 0; i < (int) hdr.elements; i++ ) {
+                io->nodes[i] = calloc_mem(1, hdr.nsize);
+                if (io->nodes[i] == NULL) {
+                    ret = SYSTEM_ERROR;
+                    goto error_return;
+                }
+                memcpy(io->nodes[i], nodes + (size_t) i * hdr.nsize, hdr.nsize);
+            }
+            free_mem(nodes);
         }
     }
 
@@ -334,10 +895,289 @@ int store_load_file(const char *filename, IOContext *io) {
     return SUCCESS;
 
 error_return:
+    if (chunks) free_mem(chunks);
+    if (nodes) free_mem(nodes);
     if (fp != NULL) file_close(fp);
-    io_free_vectors(io);
+    io_free_vectors(io, NULL);
     io_free(io);
     return ret;
 }
 
+int store_stream_open(StoreStream *st, const char *filename, uint16_t method, uint16_t dims, uint32_t capacity) {
+    memset(st, 0, sizeof(StoreStream));
+
+    st->hdr.magic        = VEC_MAGIC;
+    st->hdr.major        = STORE_MAJOR;
+    st->hdr.method       = method;
+    st->hdr.dims         = dims;
+    st->hdr.dims_aligned = ALIGN_DIMS(dims);
+    st->hdr.vsize        = VECTORSZ(st->hdr.dims_aligned);
+    st->hdr.only_vectors = 1;
+
+    st->capacity = capacity;
+    st->ce       = store_chunk_elements(st->hdr.vsize, 0);
+    st->reserved = store_layout(NULL, capacity, st->ce, st->hdr.vsize, 0, 0, 0);
+    st->hdr.voff = sizeof(StoreHDR) + sizeof(StoreChunkHDR) + (uint64_t) st->reserved * sizeof(StoreChunk);
+
+    st->chunks = calloc_mem(st->reserved > 0 ? st->reserved : 1, sizeof(StoreChunk));
+    st->buff   = calloc_mem(1, (size_t) st->ce * st->hdr.vsize);
+    if (st->chunks == NULL || st->buff == NULL) {
+        store_stream_close(st, 0);
+        return SYSTEM_ERROR;
+    }
+
+    if ((st->fp = file_open(filename, "wb")) == NULL) {
+        store_stream_close(st, 0);
+        return FILEIO_ERROR;
+    }
+    return SUCCESS;
+}
+
+Vector *store_stream_next(StoreStream *st, uint32_t *room) {
+    uint32_t left = st->capacity - st->hdr.elements;
+
+    *room = st->ce - st->fill;
+    if (*room > left)
+        *room = left;
+    return (Vector *) (st->buff + (size_t) st->fill * st->hdr.vsize);
+}
+
+/**
+ * @brief Checksums and writes the current chunk.
+ */
+static int stream_write_chunk(StoreStream *st) {
+    StoreChunk *c;
+
+    if (st->fill == 0)
+        return SUCCESS;
+    PANIC_IF(st->nchunks >= st->reserved, "store stream chunk table overflow");
+
+    c = &st->chunks[st->nchunks];
+    c->section  = STORE_SECTION_VECTORS;
+    c->count    = st->fill;
+    c->first    = (uint64_t) st->nchunks * st->ce;
+    c->offset   = st->hdr.voff + c->first * st->hdr.vsize;
+    c->length   = (uint64_t) c->count * st->hdr.vsize;
+    c->checksum = XXH64(st->buff, c->length, 0);
+
+    if (file_pwrite(st->fp, st->buff, c->length, (off_t) c->offset) != c->length)
+        return FILEIO_ERROR;
+    st->nchunks++;
+    st->fill = 0;
+    return SUCCESS;
+}
 
+int store_stream_commit(StoreStream *st, uint32_t n) {
+    PANIC_IF(st->fill + n > st->ce || st->hdr.elements + n > st->capacity, "store stream overflow");
+
+    st->fill += n;
+    st->hdr.elements += n;
+    if (st->fill == st->ce)
+        return stream_write_chunk(st);
+    return SUCCESS;
+}
+
+int store_stream_close(StoreStream *st, int commit) {
+    StoreChunkHDR chdr;
+    int ret = SUCCESS;
+
+    if (commit && (ret = stream_write_chunk(st)) == SUCCESS) {
+        memset(&chdr, 0, sizeof(StoreChunkHDR));
+        chdr.nchunks = st->nchunks;
+        chdr.chunk_elements = st->ce;
+        chdr.snapshot = 0;
+        chdr.checksum = XXH64(st->chunks, (size_t) st->nchunks * sizeof(StoreChunk), 0);
+
+        if (file_pwrite(st->fp, &st->hdr, sizeof(StoreHDR), 0) != sizeof(StoreHDR) ||
+            file_pwrite(st->fp, &chdr, sizeof(StoreChunkHDR), sizeof(StoreHDR)) != sizeof(StoreChunkHDR) ||
+            file_pwrite(st->fp, st->chunks, (size_t) st->nchunks * sizeof(StoreChunk),
+                        sizeof(StoreHDR) + sizeof(StoreChunkHDR)) != (size_t) st->nchunks * sizeof(StoreChunk))
+            ret = FILEIO_ERROR;
+    }
+
+    if (st->fp)     file_close(st->fp);
+    if (st->chunks) free_mem(st->chunks);
+    if (st->buff)   free_mem(st->buff);
+    memset(st, 0, sizeof(StoreStream));
+    return ret;
+}
+
+uint64_t store_snapshot_id(void) {
+    static uint64_t counter = 0;
+    struct {
+        struct timespec ts;
+        uint64_t seq;
+        const void *addr;
+    } seed;
+    uint64_t id;
+
+    memset(&seed, 0, sizeof(seed));
+    timespec_get(&seed.ts, TIME_UTC);
+    seed.seq  = __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+    seed.addr = &seed;
+    id = XXH64(&seed, sizeof(seed), 0);
+    return id ? id : 1;
+}
+
+int store_dump_delta(const char *filename, DeltaContext *dc) {
+    IOFile *fp;
+    IOWriter w = {0};
+    XXH64_state_t state;
+    DeltaHDR hdr;
+    int ret = SUCCESS;
+
+    PANIC_IF(filename == NULL || dc == NULL, "invalid delta context");
+
+    memset(&hdr, 0, sizeof(DeltaHDR));
+    hdr.magic    = DELTA_MAGIC;
+    hdr.major    = STORE_MAJOR;
+    hdr.hsize    = sizeof(DeltaHDR);
+    hdr.records  = dc->count;
+    hdr.dims     = dc->dims;
+    hdr.base     = dc->base;
+    hdr.snapshot = dc->snapshot;
+
+    if ((fp = file_open(filename, "wb")) == NULL)
+        return FILEIO_ERROR;
+
+    if (writer_init(&w, fp, IO_BUFFER_SIZE) != 0) {
+        ret = SYSTEM_ERROR;
+        goto end;
+    }
+    if (file_seek(fp, sizeof(DeltaHDR), SEEK_SET) != 0) {
+        ret = FILEIO_ERROR;
+        goto end;
+    }
+
+    XXH64_reset(&state, 0);
+    for (uint32_t i = 0; i < dc->count; i++) {
+        DeltaEntry *e = &dc->entries[i];
+        DeltaRecord rec;
+        size_t vlen = e->type == DELTA_PUT ? dc->dims * sizeof(float32_t) : 0;
+        const void *data = e->type == DELTA_PAYLOAD ? e->payload : e->vector;
+
+        if (e->type == DELTA_PAYLOAD)
+            vlen = e->plen;
+
+        memset(&rec, 0, sizeof(DeltaRecord));
+        rec.type   = (uint8_t) e->type;
+        rec.length = e->type == DELTA_PAYLOAD ? e->plen : 0;
+        rec.id     = e->id;
+        rec.tag    = e->tag;
+
+        XXH64_update(&state, &rec, sizeof(DeltaRecord));
+        if (vlen)
+            XXH64_update(&state, data, vlen);
+        if (writer_put(&w, &rec, sizeof(DeltaRecord)) != 0 ||
+            (vlen && writer_put(&w, data, vlen) != 0)) {
+            ret = FILEIO_ERROR;
+            goto end;
+        }
+    }
+    hdr.checksum = XXH64_digest(&state);
+
+    if (writer_flush(&w) != 0 ||
+        file_pwrite(fp, &hdr, sizeof(DeltaHDR), 0) != sizeof(DeltaHDR))
+        ret = FILEIO_ERROR;
+
+end:
+    writer_free(&w);
+    file_close(fp);
+    return ret;
+}
+
+int store_load_delta(const char *filename, DeltaContext *dc) {
+    IOFile *fp;
+    DeltaHDR hdr;
+    char *data = NULL, *p, *end;
+    off_t length;
+    size_t body;
+
+    memset(dc, 0, sizeof(DeltaContext));
+
+    if ((fp = file_open(filename, "rb")) == NULL)
+        return FILEIO_ERROR;
+
+    if (file_pread(fp, &hdr, sizeof(DeltaHDR), 0) != sizeof(DeltaHDR) ||
+        file_seek(fp, 0, SEEK_END) != 0 || (length = file_tello(fp)) < (off_t) sizeof(DeltaHDR)) {
+        file_close(fp);
+        return FILEIO_ERROR;
+    }
+    if (hdr.magic != DELTA_MAGIC || (hdr.major != 2 && hdr.major != STORE_MAJOR) || hdr.hsize != sizeof(DeltaHDR) || hdr.dims == 0) {
+        file_close(fp);
+        return INVALID_FILE;
+    }
+
+    body = (size_t) length - sizeof(DeltaHDR);
+    if ((data = calloc_mem(1, body > 0 ? body : 1)) == NULL ||
+        (dc->entries = calloc_mem(hdr.records > 0 ? hdr.records : 1, sizeof(DeltaEntry))) == NULL) {
+        if (data) free_mem(data);
+        file_close(fp);
+        return SYSTEM_ERROR;
+    }
+    dc->data = data;
+
+    if (file_pread(fp, data, body, sizeof(DeltaHDR)) != body) {
+        file_close(fp);
+        delta_free(dc);
+        return FILEIO_ERROR;
+    }
+    file_close(fp);
+
+    if (XXH64(data, body, 0) != hdr.checksum)
+        goto invalid;
+
+    p = data;
+    end = data + body;
+    for (uint32_t i = 0; i < hdr.records; i++) {
+        DeltaRecord rec;
+        DeltaEntry *e = &dc->entries[i];
+
+        if ((size_t) (end - p) < sizeof(DeltaRecord))
+            goto invalid;
+        memcpy(&rec, p, sizeof(DeltaRecord));
+        p += sizeof(DeltaRecord);
+
+        e->type = rec.type;
+        e->id   = rec.id;
+        e->tag  = rec.tag;
+        switch (rec.type) {
+        case DELTA_PUT:
+            if ((size_t) (end - p) < hdr.dims * sizeof(float32_t))
+                goto invalid;
+            e->vector = (float32_t *) p;
+            p += hdr.dims * sizeof(float32_t);
+            break;
+        case DELTA_PAYLOAD:
+            if ((size_t) (end - p) < rec.length)
+                goto invalid;
+            e->payload = p;
+            e->plen    = rec.length;
+            p += rec.length;
+            break;
+        case DELTA_DELETE:
+        case DELTA_TAG:
+            break;
+        default:
+            goto invalid;
+        }
+    }
+    if (p != end)
+        goto invalid;
+
+    dc->base     = hdr.base;
+    dc->snapshot = hdr.snapshot;
+    dc->dims     = hdr.dims;
+    dc->count    = hdr.records;
+    return SUCCESS;
+
+invalid:
+    delta_free(dc);
+    return INVALID_FILE;
+}
+
+void delta_free(DeltaContext *dc) {
+    if (dc->entries) free_mem(dc->entries);
+    if (dc->data)    free_mem(dc->data);
+    memset(dc, 0, sizeof(DeltaContext));
+}
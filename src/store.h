@@ -24,6 +24,7 @@
 
 #include "vector.h"
 #include "map.h"
+#include "file.h"
 
 #define MAGIC_SZ size_t(uint32_t)
 
@@ -38,6 +39,17 @@
 #define IO_INIT_HEADER    (1 << 2) // 0100
 #define IO_INIT_NODES     (1 << 3) // 1000
 
+/** @brief Current dump format: chunked sections with a chunk table. */
+#define STORE_MAJOR        3
+/** @brief Target size of a chunk; the element count is derived from it. */
+#define STORE_CHUNK_BYTES  (8 * 1024 * 1024)
+/** @brief Upper bound of I/O threads used by a single dump or load. */
+#define STORE_MAX_THREADS  8
+
+#define STORE_SECTION_VECTORS  1
+#define STORE_SECTION_NODES    2
+#define STORE_SECTION_PAYLOADS 3
+
 
 /**
  * @brief Header structure stored at the beginning of the dump file.
@@ -62,6 +74,131 @@ typedef struct {
 #pragma pack(pop)
 
 _Static_assert(sizeof(StoreHDR) == 40, "StoreHDR must be exactly 40 bytes");
+
+/**
+ * @brief Chunk table header, right after the StoreHDR (format 2 and later).
+ *
+ * File layout: StoreHDR, StoreChunkHDR, `nchunks` StoreChunk entries, the
+ * index header (`hsize` bytes), the vectors section and the nodes section.
+ * Each section is split in chunks of `chunk_elements` elements that can be
+ * written and read independently.
+ *
+ * Format 2 headers end after `checksum` (24 bytes) and always hold fp32
+ * vectors. From format 3 on, `encoding` selects how vector records are
+ * stored (StoreHDR.vsize is then the size of an encoded record):
+ *
+ *  - DUMP_FP32: a Vector, `dims_aligned` floats.
+ *  - DUMP_FP16: id, tag and `dims` IEEE half floats.
+ *  - DUMP_SQ8:  id, tag, float min, float scale and `dims` bytes; each
+ *               value is `min + q * scale`.
+ *
+ * Vector payloads, if any, follow the last section as a single
+ * STORE_SECTION_PAYLOADS chunk, the last entry of the table: `count`
+ * StorePayload records, each followed by its `length` bytes. Files without
+ * payloads have no such chunk and are readable by older versions.
+ */
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t nchunks;        /**< Number of StoreChunk entries. */
+    uint32_t chunk_elements; /**< Elements per chunk (the last one may be shorter). */
+    uint64_t snapshot;       /**< Snapshot ID deltas link to, 0 for exports. */
+    uint64_t checksum;       /**< XXH64 of the chunk table. */
+    uint16_t encoding;       /**< DUMP_FP32, DUMP_FP16 or DUMP_SQ8 (format 3). */
+    uint16_t reserved;
+    uint32_t reserved2;
+} StoreChunkHDR;
+
+typedef struct {
+    uint32_t section;        /**< STORE_SECTION_VECTORS, _NODES or _PAYLOADS. */
+    uint32_t count;          /**< Elements in the chunk. */
+    uint64_t first;          /**< Index of the first element. */
+    uint64_t offset;         /**< Absolute file offset. */
+    uint64_t length;         /**< Length in bytes. */
+    uint64_t checksum;       /**< XXH64 of the chunk bytes. */
+} StoreChunk;
+
+typedef struct {
+    uint64_t id;             /**< Vector ID. */
+    uint32_t length;         /**< Payload bytes that follow. */
+} StorePayload;
+#pragma pack(pop)
+
+_Static_assert(sizeof(StoreChunkHDR) == 32, "StoreChunkHDR must be exactly 32 bytes");
+
+/** @brief Size of a format 2 StoreChunkHDR. */
+#define STORE_CHUNKHDR_V2  24
+_Static_assert(sizeof(StoreChunk) == 40, "StoreChunk must be exactly 40 bytes");
+_Static_assert(sizeof(StorePayload) == 12, "StorePayload must be exactly 12 bytes");
+
+/** @brief Magic value for delta files. */
+#define DELTA_MAGIC     0x444C5441  /**< 'DLTA' */
+
+#define DELTA_PUT       0x01        /**< Insert or replace a vector. */
+#define DELTA_DELETE    0x02        /**< Remove a vector. */
+#define DELTA_TAG       0x03        /**< Change the tag of a vector. */
+#define DELTA_PAYLOAD   0x04        /**< Set (or clear, if empty) the payload of a vector. */
+
+/**
+ * @brief Header of a delta file.
+ *
+ * A delta holds the changes made since the snapshot `base` (a full dump or
+ * the previous delta); applying it yields the state identified by
+ * `snapshot`. The header is followed by `records` DeltaRecord entries,
+ * each DELTA_PUT one followed by `dims` floats and each DELTA_PAYLOAD one
+ * by `length` bytes. The layout is the same in formats 2 and 3, so deltas
+ * written by either are accepted.
+ */
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;         /**< DELTA_MAGIC. */
+    uint8_t  major;         /**< Major version. */
+    uint8_t  minor;         /**< Minor version. */
+    uint8_t  patch;         /**< Patch version. */
+    uint8_t  hsize;         /**< Size of this header in bytes. */
+    uint32_t records;       /**< Number of records. */
+    uint16_t dims;          /**< Vector dimensions. */
+    uint16_t reserved;
+    uint64_t base;          /**< Snapshot the delta applies to. */
+    uint64_t snapshot;      /**< Snapshot produced by applying it. */
+    uint64_t checksum;      /**< XXH64 of everything after the header. */
+} DeltaHDR;
+
+typedef struct {
+    uint8_t  type;          /**< DELTA_PUT, DELTA_DELETE, DELTA_TAG or DELTA_PAYLOAD. */
+    uint8_t  reserved[3];
+    uint32_t length;        /**< Payload bytes (payload records). */
+    uint64_t id;            /**< Vector ID. */
+    uint64_t tag;           /**< Tag (put and tag records). */
+} DeltaRecord;
+#pragma pack(pop)
+
+_Static_assert(sizeof(DeltaHDR) == 40, "DeltaHDR must be exactly 40 bytes");
+_Static_assert(sizeof(DeltaRecord) == 24, "DeltaRecord must be exactly 24 bytes");
+
+/**
+ * @brief In-memory delta entry.
+ */
+typedef struct {
+    int       type;         /**< DELTA_PUT, DELTA_DELETE, DELTA_TAG or DELTA_PAYLOAD. */
+    uint64_t  id;
+    uint64_t  tag;
+    float32_t *vector;      /**< `dims` floats, DELTA_PUT only. */
+    const void *payload;    /**< `plen` bytes, DELTA_PAYLOAD only. */
+    uint32_t  plen;
+} DeltaEntry;
+
+/**
+ * @brief A delta being written or read.
+ */
+typedef struct {
+    uint64_t    base;       /**< Snapshot the delta applies to. */
+    uint64_t    snapshot;   /**< Snapshot produced by applying it. */
+    uint16_t    dims;       /**< Vector dimensions. */
+    uint32_t    count;      /**< Number of entries. */
+    DeltaEntry *entries;    /**< Entries, in order. */
+    void       *data;       /**< File contents backing the vectors (load), or
+                                 copied payloads (dump). */
+} DeltaContext;
 /**
  * @brief I/O context used for loading or dumping index structures.
  */
@@ -82,31 +219,35 @@ typedef struct {
     void   *header;          /**< Pointer to header data. */
     void   **nodes;          /**< Pointer array to nodes. */
     Vector **vectors;        /**< Pointer array to vectors. */
+    VectorBlock *block;      /**< Block backing `vectors` (load), or NULL. */
+    uint64_t *tags;          /**< Tags captured by io_capture_tags(), or NULL. */
+    uint64_t snapshot;       /**< Snapshot ID stored in / read from the file. */
+    uint16_t encoding;       /**< Vector encoding on disk (DUMP_FP32 by default). */
+    char    *payloads;       /**< Payload section (StorePayload records), or NULL. */
+    uint64_t plength;        /**< Size of the payload section in bytes. */
+    uint32_t pcount;         /**< Number of payload records. */
 } IOContext;
 
 
-#define __DEFINE_EXPORT_FN(FUNC_NAME, IndexType, NodeType)               \
-static int FUNC_NAME(void *index, IOContext *io) {                       \
-    IndexType *idx = index;                                              \
-    NodeType   *entry = NULL;                                            \
-    if (io_init(io, idx->elements, 0, IO_INIT_VECTORS) != SUCCESS)       \
-        return SYSTEM_ERROR;                                             \
-    io->nsize = 0;                                                       \
-    io->vsize = VECTORSZ(idx->dims_aligned);                             \
-    io->dims = idx->dims;                                                \
-    io->dims_aligned = idx->dims_aligned;                                \
-    io->itype = VEC_MAGIC;                                               \
-    io->method = idx->cmp->type;                                         \
-    io->hsize  = 0;                                                      \
-    entry = idx->head;                                                   \
-    for (int i = 0; entry; entry = entry->next, i++) {                   \
-        PANIC_IF(i >= (int) io->elements, "index overflow while mapping entries"); \
-        io->vectors[i] = entry->vector;                                  \
-    }                                                                    \
-    return SUCCESS;                                                      \
-}
-
-
+/**
+ * @brief Sequential writer of a vectors-only store file.
+ *
+ * Used to stream an export without materializing an IOContext: vectors
+ * are copied into the current chunk buffer, which is checksummed and
+ * written once full. Space for the chunk table is reserved for `capacity`
+ * vectors up front; the file may end up holding fewer.
+ */
+typedef struct {
+    IOFile  *fp;
+    StoreHDR hdr;            /**< Header, completed by store_stream_close(). */
+    uint32_t capacity;       /**< Maximum number of vectors. */
+    uint32_t reserved;       /**< Chunk table entries reserved in the file. */
+    uint32_t ce;             /**< Elements per chunk. */
+    uint32_t fill;           /**< Vectors in the current chunk. */
+    uint32_t nchunks;        /**< Chunks written. */
+    StoreChunk *chunks;      /**< Chunk table. */
+    char    *buff;           /**< Current chunk. */
+} StoreStream;
 
 /**
  * @brief Initializes an IOContext structure.
@@ -119,12 +260,37 @@ static int FUNC_NAME(void *index, IOContext *io) {                       \
  */
 extern int io_init(IOContext *io, int elements, int hdrsz, int mode);
 
+/**
+ * @brief Copies the current tag of every vector into io->tags.
+ *
+ * Used by snapshots: the vectors stay shared with the live index while the
+ * file is written without the index lock, and store_dump_file() writes the
+ * captured tags instead of the (possibly updated) live ones.
+ *
+ * @param io Pointer to IOContext with vectors set.
+ * @return SUCCESS or SYSTEM_ERROR.
+ */
+extern int io_capture_tags(IOContext *io);
+
+/**
+ * @brief Hands the block backing the loaded vectors to an index.
+ *
+ * Must be called before the index takes (or frees) any of the vectors.
+ *
+ * @param io   Pointer to IOContext.
+ * @param acct Account of the index.
+ */
+extern void io_adopt_vectors(IOContext *io, MemAccount *acct);
+
 /**
  * @brief Frees all vectors stored in the IOContext.
  *
- * @param io Pointer to IOContext.
+ * Entries set to NULL were taken by an index and are left alone.
+ *
+ * @param io   Pointer to IOContext.
+ * @param acct Account given to io_adopt_vectors(), or NULL if none.
  */
-extern void io_free_vectors(IOContext *io);
+extern void io_free_vectors(IOContext *io, MemAccount *acct);
 
 /**
  * @brief Frees all memory associated with an IOContext.
@@ -136,6 +302,9 @@ extern void io_free(IOContext *io);
 /**
  * @brief Dumps the IOContext to a binary file.
  *
+ * Chunks are filled, checksummed and written with positioned writes by up
+ * to STORE_MAX_THREADS threads. Vectors are encoded as io->encoding.
+ *
  * @param filename Path to the output file.
  * @param io Pointer to IOContext.
  * @return 0 on success, error code on failure.
@@ -145,11 +314,85 @@ extern int store_dump_file(const char *filename, IOContext *io);
 /**
  * @brief Loads an IOContext from a binary file.
  *
+ * Chunked files are read in parallel and every chunk is verified against
+ * its checksum; files written before the chunked format are still accepted.
+ * Encoded vectors are converted back to fp32.
+ *
  * @param filename Path to the input file.
  * @param io Pointer to IOContext.
  * @return 0 on success, error code on failure.
  */
 extern int store_load_file(const char *filename, IOContext *io);
 
+/**
+ * @brief Creates a vectors-only store file for streaming.
+ *
+ * @param st       Stream to initialize.
+ * @param filename Path to the output file.
+ * @param method   Index method recorded in the header.
+ * @param dims     Vector dimensions.
+ * @param capacity Maximum number of vectors that will be written.
+ * @return SUCCESS, SYSTEM_ERROR or FILEIO_ERROR.
+ */
+extern int store_stream_open(StoreStream *st, const char *filename, uint16_t method, uint16_t dims, uint32_t capacity);
+
+/**
+ * @brief Returns where the next vectors must be copied.
+ *
+ * @param st   Stream.
+ * @param room Output: number of vectors (of hdr.vsize bytes each) that fit;
+ *             0 once `capacity` vectors were written.
+ * @return Pointer into the current chunk buffer.
+ */
+extern Vector *store_stream_next(StoreStream *st, uint32_t *room);
+
+/**
+ * @brief Accounts for `n` vectors copied at store_stream_next(); writes
+ * the chunk when it becomes full.
+ *
+ * @return SUCCESS or FILEIO_ERROR.
+ */
+extern int store_stream_commit(StoreStream *st, uint32_t n);
+
+/**
+ * @brief Writes the last chunk, the chunk table and the header, and
+ * releases the stream.
+ *
+ * @param st     Stream.
+ * @param commit Zero to just release the stream (the file is left invalid).
+ * @return SUCCESS or FILEIO_ERROR.
+ */
+extern int store_stream_close(StoreStream *st, int commit);
+
+/**
+ * @brief Returns a new, practically unique, snapshot ID (never 0).
+ */
+extern uint64_t store_snapshot_id(void);
+
+/**
+ * @brief Writes a delta file.
+ *
+ * @param filename Path to the output file.
+ * @param dc       Delta to write.
+ * @return SUCCESS, FILEIO_ERROR or SYSTEM_ERROR.
+ */
+extern int store_dump_delta(const char *filename, DeltaContext *dc);
+
+/**
+ * @brief Reads and verifies a delta file.
+ *
+ * The entries point into dc->data; release them with delta_free().
+ *
+ * @param filename Path to the delta file.
+ * @param dc       Output delta.
+ * @return SUCCESS, INVALID_FILE, FILEIO_ERROR or SYSTEM_ERROR.
+ */
+extern int store_load_delta(const char *filename, DeltaContext *dc);
+
+/**
+ * @brief Releases the memory of a DeltaContext.
+ */
+extern void delta_free(DeltaContext *dc);
+
 #endif /* _STORE_H */
  
\ No newline at end of file
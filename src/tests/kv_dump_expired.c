@@ -0,0 +1,57 @@
+/*
+ * kv_dump_expired.c - Dumps and reloads tables with no live entries
+ *
+ * Both an empty table and one whose entries have all expired are dumped
+ * with no elements; loading the file must give back an empty table.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "victorkv.h"
+
+#define DUMP_FILE "kv_dump_expired.kvt"
+
+static int dump_and_reload(KVTable *table, const char *what) {
+	KVTable *loaded;
+	uint64_t size = 1;
+	int ret;
+
+	if ((ret = kv_dump(table, DUMP_FILE)) != KV_SUCCESS) {
+		printf("%s: kv_dump failed (%d)\n", what, ret);
+		return 1;
+	}
+	if ((loaded = load_kvtable(DUMP_FILE)) == NULL) {
+		printf("%s: load_kvtable failed\n", what);
+		return 1;
+	}
+	kv_size(loaded, &size);
+	if (kv_put(loaded, "k", 1, "v", 1) != KV_SUCCESS)
+		size = (uint64_t) -1;
+	destroy_kvtable(&loaded);
+	if (size != 0) {
+		printf("%s: reloaded table is not empty\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+	KVTable *table = alloc_kvtable("expired");
+	char key[16];
+	int fail = 0;
+
+	fail |= dump_and_reload(table, "empty table");
+
+	for (int i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		kv_put_ttl(table, key, strlen(key), "value", 5, 1);
+	}
+	sleep(3);
+	fail |= dump_and_reload(table, "expired table");
+
+	destroy_kvtable(&table);
+	unlink(DUMP_FILE);
+	printf("%s\n", fail ? "FAIL" : "OK");
+	return fail;
+}
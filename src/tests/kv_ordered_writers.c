@@ -0,0 +1,100 @@
+/*
+ * kv_ordered_writers.c - Concurrent writers on an ordered table
+ *
+ * Several threads write and delete disjoint keys while others scan with
+ * cursors. Every scan must come back in strictly increasing key order,
+ * and a final scan must see exactly the keys left by the writers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "victorkv.h"
+#include "vtime.h"
+
+#define WRITERS 4
+#define READERS 2
+#define KEYS    20000
+
+static KVTable *table;
+static int stop;
+static int disorder;
+
+static int scan(const char *prefix, uint64_t *count) {
+	char last[32] = "";
+	KVResult res[64];
+	KVCursor *c;
+	int found, bad = 0;
+
+	*count = 0;
+	if (kv_scan_prefix(table, prefix, strlen(prefix), &c) != KV_SUCCESS)
+		return 1;
+	do {
+		if (kv_cursor_next(c, res, 64, &found) != KV_SUCCESS)
+			bad = 1;
+		for (int i = 0; i < found; i++) {
+			char key[32];
+			memcpy(key, res[i].key, res[i].klen);
+			key[res[i].klen] = 0;
+			if (*count > 0 && strcmp(last, key) >= 0)
+				bad = 1;
+			strcpy(last, key);
+			(*count)++;
+		}
+	} while (found > 0);
+	kv_cursor_close(&c);
+	return bad;
+}
+
+static void *writer(void *arg) {
+	long id = (long) arg;
+	char key[32];
+
+	for (int i = 0; i < KEYS; i++) {
+		snprintf(key, sizeof(key), "w%ld-%06d", id, i);
+		kv_put(table, key, strlen(key), key, strlen(key));
+	}
+	/* Leave every other key */
+	for (int i = 0; i < KEYS; i += 2) {
+		snprintf(key, sizeof(key), "w%ld-%06d", id, i);
+		kv_del(table, key, strlen(key));
+	}
+	return NULL;
+}
+
+static void *reader(void *arg) {
+	uint64_t count;
+
+	(void) arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+		if (scan("w", &count))
+			__atomic_store_n(&disorder, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+int main(void) {
+	pthread_t w[WRITERS], r[READERS];
+	uint64_t count;
+	double start;
+	int fail;
+
+	table = alloc_kvtable("ordered");
+	kv_enable_ordered(table);
+
+	start = get_time_ms_monotonic();
+	for (long i = 0; i < READERS; i++)
+		pthread_create(&r[i], NULL, reader, NULL);
+	for (long i = 0; i < WRITERS; i++)
+		pthread_create(&w[i], NULL, writer, (void *) i);
+	for (int i = 0; i < WRITERS; i++)
+		pthread_join(w[i], NULL);
+	printf("%d writers, %d scanning readers: %.1f ms\n", WRITERS, READERS, get_time_ms_monotonic() - start);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	for (int i = 0; i < READERS; i++)
+		pthread_join(r[i], NULL);
+
+	fail = disorder || scan("w", &count) || count != (uint64_t) WRITERS * KEYS / 2;
+	destroy_kvtable(&table);
+	printf("%s\n", fail ? "FAIL" : "OK");
+	return fail;
+}
@@ -0,0 +1,67 @@
+/*
+ * trace.h - Per-search work counters
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Helpers used by the search backends to fill a SearchTrace. Every macro
+ * takes the trace pointer first and does nothing when it is NULL, which
+ * is the case for searches that did not ask for one.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H 1
+
+#include "victor.h"
+#include "vtime.h"
+
+#define TRACE_LEVEL(l) ((l) < TRACE_LEVELS ? (l) : TRACE_LEVELS - 1)
+
+/* A distance was computed for a node first reached on level `l` */
+#define TRACE_VISIT(t, l)                                   \
+    do {                                                    \
+        if (t) {                                            \
+            (t)->distances++;                               \
+            (t)->visited[TRACE_LEVEL(l)]++;                 \
+        }                                                   \
+    } while (0)
+
+#define TRACE_ADD(t, field, n)                              \
+    do {                                                    \
+        if (t)                                              \
+            (t)->field += (n);                              \
+    } while (0)
+
+#define TRACE_PEAK(t, size)                                 \
+    do {                                                    \
+        if ((t) && (uint64_t) (size) > (t)->queue_peak)     \
+            (t)->queue_peak = (uint64_t) (size);            \
+    } while (0)
+
+#define TRACE_SET(t, field, v)                              \
+    do {                                                    \
+        if (t)                                              \
+            (t)->field = (v);                               \
+    } while (0)
+
+/* Current time for a phase timer, 0 without a trace */
+#define TRACE_CLOCK(t) ((t) ? get_time_ms_monotonic() : 0.0)
+
+#endif
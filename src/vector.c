@@ -33,6 +33,76 @@
 #include "mem.h"
 
 
+/*
+ * Vector blocks are owned by the MemAccount of the index that adopted
+ * them. Only frees through that account look at the blocks, so vectors
+ * allocated one by one never take a lock.
+ */
+static inline void block_lock(MemAccount *acct) {
+    while (__atomic_test_and_set(&acct->block_lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static inline void block_unlock(MemAccount *acct) {
+    __atomic_clear(&acct->block_lock, __ATOMIC_RELEASE);
+}
+
+int vector_block_release(MemAccount *acct, Vector *vector) {
+    VectorBlock **pb, *dead = NULL;
+    int found = 0;
+
+    if (acct == NULL || __atomic_load_n(&acct->blocks, __ATOMIC_ACQUIRE) == NULL)
+        return 0;
+
+    block_lock(acct);
+    for (pb = &acct->blocks; *pb; pb = &(*pb)->next) {
+        VectorBlock *b = *pb;
+        if ((char *) vector >= b->base && (char *) vector < b->base + b->size) {
+            found = 1;
+            if (--b->live == 0) {
+                *pb = b->next;
+                dead = b;
+            }
+            break;
+        }
+    }
+    block_unlock(acct);
+
+    if (dead)
+        free_vector_block(dead);
+    return found;
+}
+
+VectorBlock *alloc_vector_block(uint16_t dims_aligned, uint64_t count) {
+    VectorBlock *block;
+
+    if (count == 0)
+        return NULL;
+    if ((block = calloc_mem(1, sizeof(VectorBlock))) == NULL)
+        return NULL;
+    block->size = VECTORSZ(dims_aligned) * count;
+    block->live = count;
+    if ((block->base = aligned_calloc_mem(64, block->size)) == NULL) {
+        free_mem(block);
+        return NULL;
+    }
+    return block;
+}
+
+void free_vector_block(VectorBlock *block) {
+    if (block) {
+        free_aligned_mem(block->base);
+        free_mem(block);
+    }
+}
+
+void vector_block_adopt(MemAccount *acct, VectorBlock *block) {
+    block_lock(acct);
+    block->next = acct->blocks;
+    __atomic_store_n(&acct->blocks, block, __ATOMIC_RELEASE);
+    block_unlock(acct);
+}
+
 Vector *alloc_vector(uint16_t dims_aligned) {
     return (Vector *) aligned_calloc_mem(16, VECTORSZ(dims_aligned));
 }
@@ -74,3 +144,32 @@ void free_vector(Vector **vector) {
         *vector = NULL;
     }
 }
+
+Vector *make_vector_acct(MemAccount *acct, uint64_t id, uint64_t tag, float32_t *src, uint16_t dims) {
+    Vector *vector = alloc_object(acct, MEM_VECTORS, VECTORSZ(ALIGN_DIMS(dims)), 16);
+
+    if (vector) {
+        vector->id  = id;
+        vector->tag = tag;
+        if (src)
+            memcpy(vector->vector, src, dims * sizeof(float32_t));
+    }
+    return vector;
+}
+
+void free_vector_acct(MemAccount *acct, Vector **vector, uint16_t dims_aligned) {
+    if (vector && *vector) {
+        if (vector_block_release(acct, *vector))
+            mem_track(acct, MEM_VECTORS, NULL, -(int64_t) VECTORSZ(dims_aligned));
+        else
+            free_object(acct, MEM_VECTORS, *vector, VECTORSZ(dims_aligned), 16);
+        *vector = NULL;
+    }
+}
+
+void free_payload_acct(MemAccount *acct, Payload **payload) {
+    if (payload && *payload) {
+        free_mem_acct(acct, MEM_PAYLOADS, *payload, sizeof(Payload) + (*payload)->length);
+        *payload = NULL;
+    }
+}
@@ -30,6 +30,7 @@
 #define __VECTOR_H 1
 
 #include "victor.h"
+#include "mem.h"
 
 #define ALIGN_DIMS(d) (((d) + 3) & ~3)
 
@@ -45,6 +46,15 @@ typedef struct __attribute__((aligned(16))) {
     float32_t vector[];
 } Vector;
 
+/**
+ * Payload of a vector, owned by the node that holds the vector. Replaced
+ * as a whole by set_payload(), never modified in place.
+ */
+typedef struct {
+    uint32_t length;
+    unsigned char data[];
+} Payload;
+
 
 extern Vector *alloc_vector(uint16_t dims_aligned);
  
@@ -58,12 +68,70 @@ extern Vector *alloc_vector(uint16_t dims_aligned);
  */
 extern Vector *make_vector(uint64_t id, uint64_t tag, float32_t *src, uint16_t dims);
 
+/**
+ * Block of vectors allocated in one piece by alloc_vector_block().
+ */
+typedef struct VectorBlock {
+    struct VectorBlock *next;   // Next block of the owning MemAccount
+    char     *base;             // First vector
+    size_t    size;             // Size of the block in bytes
+    uint64_t  live;             // Vectors of the owner not yet freed
+} VectorBlock;
+
+/**
+ * Allocates `count` zeroed vectors in one contiguous block.
+ *
+ * Vector `i` starts at `block->base + i * VECTORSZ(dims_aligned)`. The
+ * vectors must not be freed one by one until the block has been handed
+ * to an index with vector_block_adopt(); until then free_vector_block()
+ * releases them all.
+ *
+ * @param dims_aligned Aligned dimensions of every vector.
+ * @param count        Number of vectors.
+ * @return The block, or NULL on failure.
+ */
+extern VectorBlock *alloc_vector_block(uint16_t dims_aligned, uint64_t count);
+
+/**
+ * Releases a block and all the vectors in it.
+ */
+extern void free_vector_block(VectorBlock *block);
+
+/**
+ * Hands `block` to `acct`. Its vectors are then released one by one, with
+ * free_vector_acct() on the same account or vector_block_release(), and
+ * the block goes back to the system with the last one.
+ */
+extern void vector_block_adopt(MemAccount *acct, VectorBlock *block);
+
+/**
+ * Releases a vector of a block adopted by `acct` without accounting it.
+ *
+ * @return 1 if the vector belonged to one of its blocks, 0 otherwise.
+ */
+extern int vector_block_release(MemAccount *acct, Vector *vector);
+
 /**
  * Frees the memory allocated for a `Vector` structure.
  *
  * @param vector Pointer to the `Vector` structure to be freed.
  */
 extern void free_vector(Vector **vector);
+
+/**
+ * make_vector() and free_vector() for the vectors of an index: the vector
+ * comes from the allocator of `acct` and is accounted to MEM_VECTORS.
+ * Vectors of a block adopted by `acct` are accounted against it.
+ */
+extern Vector *make_vector_acct(MemAccount *acct, uint64_t id, uint64_t tag, float32_t *src, uint16_t dims);
+
+extern void free_vector_acct(MemAccount *acct, Vector **vector, uint16_t dims_aligned);
+
+/**
+ * Releases a payload accounted to MEM_PAYLOADS of `acct` and clears the
+ * pointer. Does nothing if there is none.
+ */
+extern void free_payload_acct(MemAccount *acct, Payload **payload);
  
 #endif // __VECTOR_H
  
\ No newline at end of file
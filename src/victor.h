@@ -43,6 +43,96 @@ typedef struct {
     float32_t distance;      // Distance or similarity score
 } MatchResult;
 
+/* Largest payload that can be attached to a vector, in bytes */
+#define MAX_PAYLOAD_SIZE (64 * 1024)
+
+typedef struct {
+    uint64_t    id;          // ID of the matched vector
+    float32_t   distance;    // Distance or similarity score
+    uint32_t    plen;        // Length of the vector payload, 0 if none
+    const void *payload;     // Payload copied to the caller buffer, NULL if none or if it did not fit
+} MatchPayload;
+
+/* Graph levels with their own SearchTrace.visited counter; deeper levels
+   are added to the last one */
+#define TRACE_LEVELS 16
+
+/**
+ * Why a search stopped looking at candidates (SearchTrace.stop).
+ */
+#define TRACE_STOP_SCAN      0  // Linear scan: every vector was considered
+#define TRACE_STOP_EXHAUSTED 1  // Graph search ran out of candidates
+#define TRACE_STOP_BOUND     2  // Best candidate left was worse than every result kept
+
+/**
+ * Work done by one search (see search_trace()). The graph counters cover
+ * every level searched.
+ */
+typedef struct {
+    uint64_t distances;              // Distance computations
+    uint64_t visited[TRACE_LEVELS];  // Nodes reached on each graph level
+    uint64_t heap_ops;               // Insertions, replacements and removals in the queues
+    uint64_t queue_peak;             // Largest size of the candidate queue
+    uint64_t tombstones;             // Deleted vectors reached and left out of the results
+    int      levels;                 // Graph levels searched, 0 for a linear scan
+    int      stop;                   // TRACE_STOP_* of the last level searched
+    double   descent_ms;             // Greedy search of the upper levels
+    double   base_ms;                // Search of level 0, or the linear scan
+    double   total_ms;               // Whole call, including locking and copying the results
+} SearchTrace;
+
+/* Graph levels with their own MemStats.adjacency counter; deeper levels
+   are added to the last one */
+#define MEM_LEVELS 16
+
+/**
+ * Memory held by an index, in bytes (see memory_usage()).
+ */
+typedef struct {
+    uint64_t vectors;                // Vector values, IDs and tags
+    uint64_t nodes;                  // Index nodes, without their neighbor lists
+    uint64_t adjacency[MEM_LEVELS];  // HNSW neighbor lists of each level
+    uint64_t map_buckets;            // Bucket arrays of the ID map
+    uint64_t map_nodes;              // Entries of the ID map
+    uint64_t payloads;               // Vector payloads
+    uint64_t tombstones;             // Part of the above still held by deleted vectors
+    uint64_t overhead;               // Allocator headers and rounding (estimated)
+    uint64_t mapped;                 // Shared image mapped by attach_index()
+    uint64_t total;                  // Everything above except `tombstones`
+} MemStats;
+
+/**
+ * Replacement for the heap functions used by the whole library (see
+ * set_mem_hooks()). The aligned pair is optional; when missing, aligned
+ * blocks still come from the system allocator.
+ */
+typedef struct {
+    void *(*calloc)(size_t count, size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void  (*free)(void *ptr);
+    void *(*aligned_calloc)(size_t alignment, size_t size);  // Zeroed, or NULL
+    void  (*aligned_free)(void *ptr);                        // Or NULL
+} MemHooks;
+
+/**
+ * Allocator of the nodes and vectors of one index (see index_allocator()).
+ */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size, size_t alignment); // Zeroed memory, or NULL
+    void  (*free)(void *ctx, void *ptr, size_t size);         // `size` as given to alloc
+    void  (*release)(void *ctx);                              // Called by destroy_index(), or NULL
+    void  *ctx;
+} IndexAllocator;
+
+/* index_arena() flags */
+#define ARENA_HUGEPAGES 0x01               // Back the arena with huge pages
+#define ARENA_NODE(n)   (((n) + 1) << 8)   // Place the arena on NUMA node `n` (0 to node count - 1)
+
+/**
+ * Copies of one index, one per NUMA node (see alloc_replicas()).
+ */
+typedef struct IndexReplicas IndexReplicas;
+
 /**
  * Enumeration of available comparison methods.
  */
@@ -57,6 +147,13 @@ typedef struct {
 #define IMPORT_IGNORE_VERBOSE 0x01
 #define IMPORT_IGNORE         0x02
 
+/**
+ * Vector encodings for dump_quantized().
+ */
+#define DUMP_FP32  0x00  // Exact 32-bit floats (dump() default)
+#define DUMP_FP16  0x01  // IEEE half floats, 2 bytes per dimension
+#define DUMP_SQ8   0x02  // 8-bit scalar quantization with per-vector scale
+
 
 #define PRINT_VECTOR(where,vec, dims)                              \
     do {                                                     \
@@ -91,6 +188,8 @@ typedef enum {
     FILEIO_ERROR,
     NOT_IMPLEMENTED,
     INVALID_FILE,
+    READ_ONLY_INDEX,
+    INDEX_NOT_EMPTY,
 } IndexErrorCode;
 
 
@@ -138,6 +237,17 @@ typedef struct {
     TimeStat search;     // Single search timing
 } IndexStats;
 
+/**
+ * Operations with a latency histogram (see stats_percentiles()).
+ */
+#define STAT_INSERT  0   // insert(), insert_with_payload()
+#define STAT_DELETE  1   // delete()
+#define STAT_SEARCH  2   // search(), search_with_payload() and asynchronous searches
+#define STAT_DUMP    3   // dump(), dump_quantized(), dump_async()
+#define STAT_FILTER  4   // filter_subset()
+#define STAT_UPDATE  5   // set_tag(), set_payload()
+#define STAT_OPS     6
+
 
 #define HNSW_CONTEXT 0x01
 #define HNSW_CONTEXT_SET_EF_CONSTRUCT 1 << 2
@@ -149,6 +259,49 @@ typedef struct {
     int M0;
 } HNSWContext;
 
+/**
+ * Write-ahead log settings for enable_wal(). Zero fields take defaults.
+ */
+typedef struct {
+    int group_ms;        // Max delay before staged records are synced (default 10)
+    int group_records;   // Sync as soon as this many records are staged (default 256)
+    int sync;            // Non-zero: mutations return once their record is durable
+} WALContext;
+
+/**
+ * Completion callback for search_async().
+ *
+ * Invoked from a library worker thread once the search finishes.
+ * `results` is the buffer passed at submission, filled with `n` entries
+ * when `status` is SUCCESS.
+ */
+typedef void (*SearchCallback)(int status, MatchResult *results, int n, void *userdata);
+
+/**
+ * Completion callback for dump_async(), invoked from a library worker.
+ */
+typedef void (*DumpCallback)(int status, void *userdata);
+
+/**
+ * Submission/completion queue for event-loop integration.
+ */
+typedef struct SearchQueue SearchQueue;
+
+/**
+ * Cursor over the vectors of an index, see export_begin().
+ */
+typedef struct ExportCursor ExportCursor;
+
+/**
+ * A finished search returned by squeue_poll().
+ */
+typedef struct {
+    void *userdata;          // Value given at submission
+    MatchResult *results;    // Results buffer given at submission
+    int n;                   // Number of results requested
+    int status;              // SUCCESS or error code of the search
+} SearchCompletion;
+
 #ifndef _LIB_CODE
 
 typedef struct Index Index;
@@ -169,6 +322,130 @@ extern const char *__LIB_SHORT_VERSION();
  */
 extern int search(Index *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n);
 
+/**
+ * Same as search(), also reporting the work it took in `trace`. Searches
+ * without a trace pay one pointer test per counter.
+ *
+ * @param trace - Output, zeroed first (may be NULL).
+ *
+ * @return SUCCESS or an error code; `trace` is filled in either case.
+ */
+extern int search_trace(Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
+                        MatchResult *results, int n, SearchTrace *trace);
+
+/**
+ * Same as search(), also returning the payload of each match.
+ *
+ * Payloads are copied into `buf`, one after another at 8-byte aligned
+ * offsets, under the same read lock as the search, so they match the
+ * returned IDs. A match whose payload does not fit in the remaining space
+ * gets `payload` NULL and its real `plen`.
+ *
+ * @param index   - Pointer to the index.
+ * @param tag     - Tag filter (0 for none).
+ * @param vector  - Query vector.
+ * @param dims    - Number of dimensions of the query vector.
+ * @param results - Output array of `n` matches.
+ * @param n       - Number of matches to retrieve.
+ * @param buf     - Buffer receiving the payloads (may be NULL if `buflen` is 0).
+ * @param buflen  - Size of `buf` in bytes.
+ *
+ * @return SUCCESS or an error code.
+ */
+extern int search_with_payload(Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
+                               MatchPayload *results, int n, void *buf, size_t buflen);
+
+
+/**
+ * Sets the number of worker threads used for asynchronous operations.
+ *
+ * By default the pool is started on first use with one worker per online
+ * CPU. Pending work on the previous pool is completed before it is replaced.
+ * Passing 0 stops the pool until the next asynchronous submission.
+ * Returns THREAD_ERROR when called from a callback run by a worker.
+ *
+ * @param nthreads - Number of workers.
+ *
+ * @return SUCCESS, INVALID_ARGUMENT, SYSTEM_ERROR or THREAD_ERROR.
+ */
+extern int set_worker_threads(int nthreads);
+
+/**
+ * Binds each worker thread to one CPU, spreading them evenly over the
+ * NUMA nodes, or lets them run anywhere again. Workers then steal work
+ * from their own node first, and replicas_search_async() runs every
+ * search on a worker of the node holding the replica it searches.
+ * Replaces the running pool like set_worker_threads().
+ *
+ * @param enable - Non-zero to pin, 0 to unpin.
+ *
+ * @return SUCCESS, SYSTEM_ERROR or THREAD_ERROR.
+ */
+extern int set_worker_pinning(int enable);
+
+/**
+ * Asynchronous version of search().
+ *
+ * The query vector is copied, so the caller may reuse it right away. The
+ * `results` buffer must remain valid until the callback runs. The index must
+ * not be destroyed from the callback; destroy_index() waits for pending
+ * asynchronous searches on that index.
+ *
+ * @param index    - Pointer to the index.
+ * @param tag      - Tag filter (0 for none).
+ * @param vector   - Query vector.
+ * @param dims     - Number of dimensions of the query vector.
+ * @param results  - Output buffer for up to `n` matches.
+ * @param n        - Number of matches to retrieve.
+ * @param cb       - Completion callback, called from a worker thread.
+ * @param userdata - Opaque pointer handed to the callback.
+ *
+ * @return SUCCESS if the search was queued, or an error code.
+ */
+extern int search_async(Index *index, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n,
+                        SearchCallback cb, void *userdata);
+
+/**
+ * Allocates a search submission/completion queue.
+ *
+ * @return Pointer to the queue, or NULL on failure.
+ */
+extern SearchQueue *alloc_search_queue(void);
+
+/**
+ * Queues a search whose completion is delivered through `sq`.
+ *
+ * Same argument rules as search_async(). Completions are collected with
+ * squeue_poll().
+ *
+ * @return SUCCESS if the search was queued, or an error code.
+ */
+extern int squeue_submit(SearchQueue *sq, Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
+                         MatchResult *results, int n, void *userdata);
+
+/**
+ * Collects up to `max` finished searches without blocking.
+ *
+ * @return Number of completions stored in `out` (0 if none), or -1 on invalid arguments.
+ */
+extern int squeue_poll(SearchQueue *sq, SearchCompletion *out, int max);
+
+/**
+ * Returns a file descriptor that is readable while completions are pending.
+ *
+ * It is an eventfd on Linux and the read end of a pipe on other POSIX
+ * systems; it may be registered with epoll/poll/kqueue but must only be
+ * drained through squeue_poll(). Returns -1 where unsupported (Windows).
+ */
+extern int squeue_fd(SearchQueue *sq);
+
+/**
+ * Waits for every in-flight search of the queue, discards uncollected
+ * completions and releases the queue.
+ *
+ * @return SUCCESS or INVALID_ARGUMENT.
+ */
+extern int destroy_search_queue(SearchQueue **sq);
 
 /**
  * Inserts a vector with its ID into the index.
@@ -176,6 +453,19 @@ extern int search(Index *index, uint64_t tag, float32_t *vector, uint16_t dims,
  */
 extern int insert(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims);
 
+/**
+ * Inserts a vector together with its payload.
+ *
+ * The payload (up to MAX_PAYLOAD_SIZE bytes) is copied and kept by the
+ * index until the vector is deleted; it is returned by
+ * search_with_payload() and saved by dump(). A `plen` of 0 is the same as
+ * insert().
+ *
+ * @return SUCCESS, DUPLICATED_ENTRY, INVALID_ARGUMENT or an error code.
+ */
+extern int insert_with_payload(Index *index, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims,
+                               const void *payload, uint32_t plen);
+
 
 /**
  * @brief Filters and ranks a subset of elements from an index based on similarity
@@ -234,6 +524,80 @@ extern int delete(Index *index, uint64_t id);
 #endif
 
 
+/**
+ * Changes the tag of a vector already in the index.
+ *
+ * @param index - Pointer to the index.
+ * @param id    - ID of the vector.
+ * @param tag   - New tag.
+ *
+ * @return SUCCESS, NOT_FOUND_ID or an error code.
+ */
+extern int set_tag(Index *index, uint64_t id, uint64_t tag);
+
+/**
+ * Replaces the payload of a vector already in the index.
+ *
+ * @param index   - Pointer to the index.
+ * @param id      - ID of the vector.
+ * @param payload - New payload, copied by the index.
+ * @param plen    - Its length, at most MAX_PAYLOAD_SIZE; 0 removes the payload.
+ *
+ * @return SUCCESS, NOT_FOUND_ID, INVALID_ARGUMENT or an error code.
+ */
+extern int set_payload(Index *index, uint64_t id, const void *payload, uint32_t plen);
+
+/**
+ * Copies the payload of a vector.
+ *
+ * `*plen` receives the payload length (0 if the vector has none). The
+ * payload is only copied if it fits in `buflen` bytes.
+ *
+ * @return SUCCESS, NOT_FOUND_ID or an error code.
+ */
+extern int get_payload(Index *index, uint64_t id, void *buf, uint32_t buflen, uint32_t *plen);
+
+/**
+ * Starts logging insert/delete/set_tag/set_payload operations to a write-ahead log.
+ *
+ * Records are synced in groups by a background thread (see WALContext).
+ * An existing log is appended to, so the usual recovery sequence is:
+ * load_index(snapshot), replay_wal(index, log), enable_wal(index, log, ctx).
+ * A successful dump() truncates the log, since the snapshot contains it.
+ * import() is not logged; dump() the index after importing into it.
+ *
+ * @param index    - Pointer to the index.
+ * @param filename - Path of the log file.
+ * @param ctx      - Group commit settings, or NULL for defaults.
+ *
+ * @return SUCCESS, INVALID_ARGUMENT if a log is already enabled,
+ *         INVALID_FILE, FILEIO_ERROR, SYSTEM_ERROR or THREAD_ERROR.
+ */
+extern int enable_wal(Index *index, const char *filename, WALContext *ctx);
+
+/**
+ * Flushes and closes the write-ahead log of the index, if any.
+ *
+ * @return SUCCESS or INVALID_INDEX.
+ */
+extern int disable_wal(Index *index);
+
+/**
+ * Applies the operations recorded in a write-ahead log to the index.
+ *
+ * Replay is idempotent with respect to a snapshot taken while the log was
+ * active: inserts of IDs already present and deletes/set_tag of missing
+ * IDs are skipped. A torn record at the end of the log ends the replay.
+ * Must be called while no log is enabled on the index.
+ *
+ * @param index    - Pointer to the index.
+ * @param filename - Path of the log file.
+ *
+ * @return SUCCESS, INVALID_ARGUMENT, INVALID_FILE, FILEIO_ERROR or the
+ *         error of the first operation that could not be applied.
+ */
+extern int replay_wal(Index *index, const char *filename);
+
 /**
  * Update Index Context 
  */
@@ -252,6 +616,173 @@ extern int update_icontext(Index *index, void *icontext, int mode);
  */
 extern int stats(Index *index, IndexStats *stats);
 
+/**
+ * Computes latency percentiles of an operation since the index was
+ * created or last reset.
+ *
+ * Every timed operation is recorded in a log-linear histogram of the
+ * calling thread's shard; each reported value is exact to about 6%.
+ *
+ * @param index - Pointer to the index instance.
+ * @param op    - STAT_INSERT, STAT_DELETE, STAT_SEARCH, STAT_DUMP,
+ *                STAT_FILTER or STAT_UPDATE.
+ * @param q     - `n` percentiles to compute, from 0 to 100 (e.g. 50, 99, 99.9).
+ * @param ms    - Output: `n` latencies in milliseconds (0 if there were no operations).
+ * @param n     - Number of percentiles.
+ * @param count - Optional output: number of operations recorded.
+ *
+ * @return SUCCESS, INVALID_INDEX or INVALID_ARGUMENT.
+ */
+extern int stats_percentiles(Index *index, int op, const double *q, double *ms, int n, uint64_t *count);
+
+/**
+ * Same as stats_percentiles(), for the operations recorded since the
+ * previous stats_interval() call on the same operation (or since the
+ * index was created or reset). Each call starts a new interval.
+ */
+extern int stats_interval(Index *index, int op, const double *q, double *ms, int n, uint64_t *count);
+
+/**
+ * Clears the timing statistics and latency histograms of the index.
+ *
+ * @return SUCCESS or INVALID_INDEX.
+ */
+extern int stats_reset(Index *index);
+
+/**
+ * Turns timing statistics and latency histograms on or off. They are on
+ * when an index is created or loaded; turning them off saves two clock
+ * reads per operation. Already collected values are kept.
+ *
+ * @param index  - Pointer to the index instance.
+ * @param enable - 0 to stop collecting, anything else to resume.
+ *
+ * @return SUCCESS or INVALID_INDEX.
+ */
+extern int stats_enable(Index *index, int enable);
+
+/**
+ * Reports the memory held by an index, by component.
+ *
+ * The counters are kept up to date by every allocation and release the
+ * index makes, so the call only copies them. Temporary buffers of running
+ * operations and the delta tracking map are not included.
+ *
+ * @param index - Pointer to the index instance.
+ * @param mem   - Output.
+ *
+ * @return SUCCESS, INVALID_INDEX or INVALID_ARGUMENT.
+ */
+extern int memory_usage(Index *index, MemStats *mem);
+
+/**
+ * Routes every heap allocation of the library through `hooks`, or back
+ * to the system allocator if `hooks` is NULL. Blocks are freed by the
+ * hooks in place when they are freed, so this must be called before any
+ * other function of the library, and not again while any object of the
+ * library exists. Allocator overhead is not estimated by memory_usage()
+ * while hooks are installed.
+ *
+ * @return SUCCESS, or INVALID_ARGUMENT if a required function is missing
+ *         or only one of the aligned pair is given.
+ */
+extern int set_mem_hooks(const MemHooks *hooks);
+
+/**
+ * Allocates the nodes and vectors of an index with `alloc` instead of the
+ * library heap. Vectors read from a file by load_index() or import()
+ * keep their shared block. `alloc` is copied; its context must live until
+ * destroy_index(), which calls `release` once the index is freed.
+ *
+ * @param index - An index that has never held a vector.
+ * @param alloc - Allocator; `alloc` and `free` are required.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT, READ_ONLY_INDEX or
+ *         INDEX_NOT_EMPTY.
+ */
+extern int index_allocator(Index *index, const IndexAllocator *alloc);
+
+/**
+ * Allocates the nodes and vectors of an index from a built-in arena: they
+ * are carved one after the other out of `chunk`-byte chunks (0 for 2 MB),
+ * so the graph neighborhood of a query shares few pages. With
+ * ARENA_HUGEPAGES, chunks are mapped with huge pages when the system has
+ * them reserved and advised for transparent huge pages otherwise, which
+ * cuts the TLB misses of random graph hops. Freed nodes are reused by
+ * later inserts; the chunks are returned by destroy_index().
+ *
+ * @param index - An index that has never held a vector.
+ * @param chunk - Chunk size in bytes, 0 for the default.
+ * @param flags - ARENA_* flags.
+ *
+ * @return SUCCESS, INVALID_INDEX, SYSTEM_ERROR, READ_ONLY_INDEX or
+ *         INDEX_NOT_EMPTY.
+ */
+extern int index_arena(Index *index, size_t chunk, int flags);
+
+/**
+ * Creates an index replicated on every NUMA node of the host.
+ *
+ * Each replica allocates its nodes and vectors from an arena bound to its
+ * node (see index_arena()), and searches are served by the replica of the
+ * node the calling thread runs on, so graph hops read local memory. On a
+ * host with a single node there is one replica. Memory use is multiplied
+ * by the number of nodes, and every insert is applied to each replica.
+ * HNSW replicas draw their levels independently, so approximate results
+ * may differ slightly between nodes.
+ *
+ * @param type      - FLAT_INDEX or HNSW_INDEX.
+ * @param method    - Distance method.
+ * @param dims      - Vector dimensions.
+ * @param icontext  - Index context, as for alloc_index().
+ * @param flags     - ARENA_HUGEPAGES or 0.
+ *
+ * @return The replicas, or NULL on failure.
+ */
+extern IndexReplicas *alloc_replicas(int type, int method, uint16_t dims, void *icontext, int flags);
+
+/**
+ * Inserts a vector into every replica. Mutations are serialized; if one
+ * replica fails, the others drop the vector again.
+ *
+ * @return SUCCESS or the error of the failing replica, as for insert().
+ */
+extern int replicas_insert(IndexReplicas *r, uint64_t id, uint64_t tag, float32_t *vector, uint16_t dims);
+
+/**
+ * Deletes a vector from every replica.
+ *
+ * @return SUCCESS or the first error, as for delete().
+ */
+extern int replicas_delete(IndexReplicas *r, uint64_t id);
+
+/**
+ * search() on the replica local to the calling thread.
+ */
+extern int replicas_search(IndexReplicas *r, uint64_t tag, float32_t *vector, uint16_t dims, MatchResult *results, int n);
+
+/**
+ * search_async() spread round-robin over the nodes: each search is queued
+ * on a worker of a node and runs on that node's replica. Without
+ * set_worker_pinning() the worker may run on any CPU.
+ */
+extern int replicas_search_async(IndexReplicas *r, uint64_t tag, float32_t *vector, uint16_t dims,
+                                 MatchResult *results, int n, SearchCallback cb, void *userdata);
+
+/**
+ * Returns the replica local to the calling thread, for read-only calls
+ * (stats(), memory_usage(), contains(), ...). Mutate the replicas only
+ * through the replicas_* functions.
+ */
+extern Index *replicas_local(IndexReplicas *r);
+
+/**
+ * Destroys every replica.
+ *
+ * @return SUCCESS or INVALID_INDEX.
+ */
+extern int destroy_replicas(IndexReplicas **r);
+
 /**
  * Retrieves the current number of elements in the index.
  *
@@ -271,6 +802,7 @@ extern int size(Index *index, uint64_t *sz);
  * This function serializes the internal structure and data of the index,
  * including vectors, metadata, and any algorithm-specific state (e.g., graph links).
  * The resulting file can later be used to restore the index via a corresponding load operation.
+ * The index lock is held only while a snapshot is captured, not while writing.
  *
  * @param index - Pointer to the index instance.
  * @param filename - Path to the output file where the index will be saved.
@@ -282,6 +814,59 @@ extern int size(Index *index, uint64_t *sz);
  */
 extern int dump(Index *index, const char *filename);
 
+/**
+ * Dumps the index to a file in the background.
+ *
+ * A consistent snapshot is captured before the call returns (holding the
+ * index lock only for the capture); the file is then written by a library
+ * worker while the index keeps accepting inserts, deletes and searches.
+ * As with dump(), a write-ahead log is checkpointed once the file is
+ * complete. destroy_index() waits for pending background dumps.
+ *
+ * @param index    - Pointer to the index instance.
+ * @param filename - Path to the output file.
+ * @param cb       - Optional completion callback.
+ * @param userdata - Opaque pointer handed to the callback.
+ *
+ * @return SUCCESS if the dump was scheduled, or an error code.
+ */
+extern int dump_async(Index *index, const char *filename, DumpCallback cb, void *userdata);
+
+/**
+ * Dumps the index with its vectors stored in a compact encoding.
+ *
+ * DUMP_FP16 halves and DUMP_SQ8 roughly quarters the size of the vectors
+ * section; load_index() and import() convert them back to fp32, so the
+ * loaded vectors are approximations of the originals. Meant for backups
+ * and transfers: since the file is lossy, a write-ahead log is not
+ * checkpointed against it.
+ *
+ * @param index    - Pointer to the index instance.
+ * @param filename - Path to the output file.
+ * @param encoding - DUMP_FP32, DUMP_FP16 or DUMP_SQ8.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT, NOT_IMPLEMENTED,
+ *         SYSTEM_ERROR or FILEIO_ERROR.
+ */
+extern int dump_quantized(Index *index, const char *filename, int encoding);
+
+/**
+ * Writes the changes made since the last snapshot to a delta file.
+ *
+ * Every dump(), dump_delta() and load_index() starts a new snapshot; the
+ * index tracks the IDs inserted, deleted or re-tagged since then, and the
+ * delta holds their current state (vector and tag, or a deletion). The
+ * file is linked to the snapshot it applies to and is restored with
+ * load_index_chain(). Its size depends on the changes, not the index.
+ *
+ * @param index    - Pointer to the index instance.
+ * @param filename - Path to the delta file.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT if there is no snapshot
+ *         to link to, NOT_IMPLEMENTED, SYSTEM_ERROR or FILEIO_ERROR.
+ */
+extern int dump_delta(Index *index, const char *filename);
+
 /**
  * Import vectors from a file and populate the index.
  *
@@ -305,6 +890,8 @@ extern int import(Index *index, const char *filename, int mode);
  *
  * This function serializes vectors.
  * The resulting file can later be used to import vector in the index via a corresponding import operation.
+ * Vectors are streamed to the file through an export cursor, with the
+ * same consistency guarantees as export_begin().
  *
  * @param index - Pointer to the index instance.
  * @param filename - Path to the output file where the index will be saved.
@@ -316,6 +903,50 @@ extern int import(Index *index, const char *filename, int mode);
  */
 extern int export(Index *index, const char *filename);
 
+/**
+ * Opens a cursor to read the vectors of an index in batches.
+ *
+ * Memory use is bounded by the batch size, not by the index size. The
+ * index lock is only taken while each batch is copied, so inserts, deletes
+ * and searches proceed between batches.
+ *
+ * The cursor is weakly consistent: every vector present when it is opened
+ * and still present when the cursor reaches it is returned exactly once,
+ * and vectors inserted afterwards are never returned. A vector deleted
+ * while the cursor is open may or may not be returned; a flat index still
+ * returns it with the value it had when deleted.
+ *
+ * @param index  - Pointer to the index instance.
+ * @param cursor - Output: the new cursor.
+ * @param dims   - Optional output: number of dimensions of each vector.
+ *
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT, NOT_IMPLEMENTED or SYSTEM_ERROR.
+ */
+extern int export_begin(Index *index, ExportCursor **cursor, uint16_t *dims);
+
+/**
+ * Copies the next batch of vectors out of the cursor.
+ *
+ * @param cursor  - Cursor returned by export_begin().
+ * @param ids     - Output array of `max` IDs.
+ * @param tags    - Output array of `max` tags, or NULL.
+ * @param vectors - Output array of `max * dims` floats, or NULL.
+ * @param max     - Maximum number of vectors to return.
+ *
+ * @return Number of vectors copied (0 when the cursor is exhausted), -1 on
+ *         invalid arguments, or -SYSTEM_ERROR if the batch buffer could not
+ *         be allocated (the cursor is left where it was).
+ */
+extern int export_next_batch(ExportCursor *cursor, uint64_t *ids, uint64_t *tags, float32_t *vectors, int max);
+
+/**
+ * Closes a cursor and releases its resources.
+ *
+ * @param cursor - Pointer to the cursor; set to NULL on return.
+ * @return SUCCESS or INVALID_ARGUMENT.
+ */
+extern int export_end(ExportCursor **cursor);
+
 /**
  * Checks whether a given vector ID exists in the index.
  *
@@ -354,6 +985,60 @@ extern const char* index_name(Index *index);
  */
 extern Index *load_index(const char *filename);
 
+/**
+ * Loads a dumped index and applies a chain of deltas to it.
+ *
+ * Each delta must have been written by dump_delta() right after the
+ * previous file of the chain (the first one after `filename`); a broken
+ * link fails the load.
+ *
+ * @param filename - Path to the full dump.
+ * @param deltas   - Paths of the delta files, oldest first.
+ * @param ndeltas  - Number of deltas.
+ * @return A pointer to the restored index, or NULL on failure.
+ */
+extern Index *load_index_chain(const char *filename, const char **deltas, int ndeltas);
+
+/**
+ * Publishes a read-only image of the index for other processes.
+ *
+ * The image holds the vectors, an ID table and, for HNSW, the graph with
+ * element numbers instead of pointers, so it can be mapped at any address.
+ * It is written to a POSIX shared memory object when `name` is "/name"
+ * (no other '/'), or to a file mapped shared otherwise (e.g. on tmpfs or
+ * hugetlbfs). Publishing again replaces the image; processes attached to
+ * the previous one keep using it until they destroy their index.
+ *
+ * @param index - Pointer to the index.
+ * @param name  - Shared memory object name or file path.
+ * @return SUCCESS, INVALID_INDEX, INVALID_ARGUMENT, NOT_IMPLEMENTED,
+ *         SYSTEM_ERROR or FILEIO_ERROR.
+ */
+extern int publish_index(Index *index, const char *name);
+
+/**
+ * Attaches to an image published with publish_index().
+ *
+ * The image is mapped read-only and searched in place, so nothing is
+ * copied and every attached process shares the same pages. The graph of
+ * an HNSW image is checked once at attach (one pass over its nodes). The
+ * index supports search, filter_subset, contains, size and export;
+ * insert, delete, set_tag and import return READ_ONLY_INDEX.
+ *
+ * @param name - Name the image was published under.
+ * @return A pointer to the attached index (release it with destroy_index()),
+ *         or NULL if the image does not exist or is invalid.
+ */
+extern Index *attach_index(const char *name);
+
+/**
+ * Removes a published image. Attached indexes are not affected.
+ *
+ * @param name - Name the image was published under.
+ * @return SUCCESS, INVALID_ARGUMENT or FILEIO_ERROR.
+ */
+extern int unpublish_index(const char *name);
+
 /**
  * Releases all resources associated with the index.
  * @param index Double pointer to the index to be destroyed.
@@ -13,11 +13,26 @@ typedef enum {
 	KV_ERROR_INVALID_VALUE,
 	KV_ERROR_FILEIO,
 	KV_ERROR_FILE_INVALID,
-	KV_ERROR_MISMATCH_ELEMENT_COUNT
+	KV_ERROR_MISMATCH_ELEMENT_COUNT,
+	KV_ERROR_NOT_ORDERED,
+	KV_ERROR_NOT_PERSISTENT,
+	KV_ERROR_PERSISTENT,
+	KV_ERROR_NOT_IMPLEMENTED
 } TableErrorCode;
 
 typedef struct KVTable KVTable;
 
+typedef struct KVCursor KVCursor;
+
+/**
+ * Settings of a persistent table (open_kvtable()). Zero fields take defaults.
+ */
+typedef struct {
+    int      sync;           // Non-zero: every put and delete is synced before returning
+    double   compact_ratio;  // Compact once garbage exceeds this fraction of the file (default 0.5, > 1 never)
+    uint64_t compact_min;    // ... and the file is at least this large (default 64 MiB)
+} KVLogContext;
+
 typedef struct {
     void *key;
 	void *value;
@@ -25,6 +40,17 @@ typedef struct {
 	int vlen;
 } KVResult;
 
+/**
+ * A value pinned by kv_get_handle(): `value` stays valid and unchanged until
+ * kv_release_handle(), whatever writers do to the key meanwhile.
+ */
+typedef struct {
+    const void *value;
+    int         vlen;
+    KVTable    *table;       // Private
+    void       *entry;       // Private
+} KVHandle;
+
 /**
  * @brief Returns a human-readable error message for a TableErrorCode.
  *
@@ -40,7 +66,7 @@ extern const char *table_strerror(TableErrorCode code);
 /**
  * @brief Acquires a write lock on the table without any safety checks.
  *
- * This function directly acquires the internal write lock of the table
+ * This function directly acquires the locks of all the shards of the table
  * without performing any validation. It should only be used in scenarios
  * where you need manual lock control and are certain the table is valid.
  *
@@ -55,7 +81,7 @@ extern void kv_unsafe_lock(KVTable *table);
 /**
  * @brief Releases a write lock on the table without any safety checks.
  *
- * This function directly releases the internal write lock of the table
+ * This function directly releases the locks of all the shards of the table
  * without performing any validation. It should only be used to unlock
  * a table that was previously locked with kv_unsafe_lock().
  *
@@ -115,11 +141,11 @@ extern void destroy_kvtable(KVTable **KVTable);
  *
  * This function inserts a new entry or updates an existing one in the hash map represented
  * by `KVTable`. If the key already exists, the value is updated in-place (reallocating memory
- * if necessary). If the key does not exist, a new node is created and inserted into the corresponding
- * bucket based on the key's hash.
+ * if necessary). If the key does not exist, a new entry is stored in the first free slot of
+ * the key's probe sequence.
  *
- * The function also performs rehashing if the load factor exceeds the configured threshold,
- * and ensures thread-safety using a write lock.
+ * The function also rehashes the table when it runs out of free slots, and ensures
+ * thread-safety using a write lock.
  *
  * @param table Pointer to the hash map (KVTable).
  * @param key Pointer to the key to insert.
@@ -143,6 +169,52 @@ extern void destroy_kvtable(KVTable **KVTable);
  */
 extern int kv_put(KVTable *c, void *key, int klen, void *value, int vlen);
 
+/**
+ * @brief Inserts or updates a key-value pair that expires after `ttl` seconds.
+ *
+ * Works as kv_put(), but lookups and scans stop returning the entry once `ttl` seconds
+ * have passed (and less than `ttl` + 1). Expired entries are reclaimed lazily by later
+ * writes to the table. A later kv_put() of the key clears the TTL.
+ *
+ * @param table Pointer to the KVTable.
+ * @param key Pointer to the key to insert.
+ * @param klen Length of the key in bytes.
+ * @param value Pointer to the value to insert.
+ * @param vlen Length of the value in bytes.
+ * @param ttl Lifetime of the entry in seconds; 0 for no expiry.
+ *
+ * @return KV_SUCCESS (0) on success.
+ *         KV_ERROR_INVALID_TABLE if the table is NULL.
+ *         KV_ERROR_INVALID_KEY if the key is NULL or key length is invalid.
+ *         KV_ERROR_INVALID_VALUE if the value is NULL or value length is invalid.
+ *         KV_ERROR_PERSISTENT if the table was opened with open_kvtable().
+ *         KV_ERROR_SYSTEM if memory allocation fails.
+ *
+ * @note TTLs are not saved by kv_dump(), which leaves expired entries out.
+ */
+extern int kv_put_ttl(KVTable *table, void *key, int klen, void *value, int vlen, uint32_t ttl);
+
+/**
+ * @brief Caps the memory used by the entries of a table, turning it into a cache.
+ *
+ * The budget is split evenly between the shards of the table. A write that leaves its
+ * shard above its share evicts other entries of that shard with the CLOCK algorithm,
+ * an approximation of least recently used: lookups mark the entries they return, and
+ * eviction skips (and unmarks) marked entries once. Marking does not take a write lock.
+ * Entries above a new budget are evicted by this call.
+ *
+ * @param table Pointer to the KVTable.
+ * @param bytes Budget in bytes for the entries (keys, values and per-entry overhead;
+ *              the slot arrays are not counted); 0 removes the budget.
+ *
+ * @return KV_SUCCESS (0) on success.
+ *         KV_ERROR_INVALID_TABLE if the table is NULL.
+ *         KV_ERROR_PERSISTENT if the table was opened with open_kvtable().
+ *
+ * @note Scans do not mark entries, so a full scan does not flush the recently used ones.
+ */
+extern int kv_set_budget(KVTable *table, uint64_t bytes);
+
 /**
  * @brief Retrieves the value associated with a given key from the hash map.
  *
@@ -166,9 +238,53 @@ extern int kv_put(KVTable *c, void *key, int klen, void *value, int vlen);
  *
  * @note The value returned via `*value` is a pointer to internal memory; the caller must not free it.
  * @note The function does not copy the value; it only provides direct access to the internal storage.
+ * @note On a persistent table the value is read in place from the mapped data file; the
+ *       pointer stays valid until the second compaction that follows the call.
  */
 extern int kv_get(KVTable *c, void *key, int klen, void **value, int *vlen);
 
+/**
+ * @brief Retrieves the values of a batch of keys.
+ *
+ * Equivalent to calling kv_get() for every key, but the keys are grouped by
+ * shard so each shard is locked once per group of keys rather than once per key.
+ *
+ * @param table Pointer to the KVTable.
+ * @param items Keys to look up in `key` and `klen`; `value` and `vlen` receive the
+ *              value of each key, or NULL and 0 if the key does not exist.
+ * @param n Number of items.
+ * @param found If not NULL, receives the number of keys found.
+ *
+ * @return KV_SUCCESS if every key was looked up.
+ *         KV_ERROR_INVALID_TABLE if the table is NULL.
+ *         KV_ERROR_INVALID_KEY if a key is NULL or has invalid length.
+ *         KV_ERROR_INVALID_VALUE if items is NULL or n is negative.
+ *
+ * @note The values point to internal memory, with the same lifetime as those of kv_get().
+ */
+extern int kv_mget(KVTable *table, KVResult *items, int n, int *found);
+
+/**
+ * @brief Inserts or updates a batch of key-value pairs.
+ *
+ * Equivalent to calling kv_put() for every pair in order, but the pairs are grouped by
+ * shard so each shard is locked once per group of pairs rather than once per pair.
+ *
+ * @param table Pointer to the KVTable.
+ * @param items Pairs to store in `key`, `klen`, `value` and `vlen`.
+ * @param n Number of items.
+ *
+ * @return KV_SUCCESS if every pair was stored.
+ *         KV_ERROR_INVALID_TABLE if the table is NULL.
+ *         KV_ERROR_INVALID_KEY if a key is NULL or has invalid length.
+ *         KV_ERROR_INVALID_VALUE if items is NULL, n is negative, or a value is NULL or empty.
+ *         KV_ERROR_SYSTEM or KV_ERROR_FILEIO if storing a pair fails.
+ *
+ * @note Invalid pairs are reported before anything is stored. After KV_ERROR_SYSTEM or
+ *       KV_ERROR_FILEIO some of the pairs may have been stored.
+ */
+extern int kv_mput(KVTable *table, KVResult *items, int n);
+
 /**
  * @brief Scans the table for keys that match a given prefix pattern or wildcard.
  *
@@ -228,12 +344,45 @@ extern int kv_unsafe_prefix_scan(KVTable *table, void *ilike, int ilen, KVResult
  */
 extern int kv_get_copy(KVTable *table, void *key, int klen,void **value, int *vlen);
 
+/**
+ * @brief Retrieves a value without copying it, pinned until the handle is released.
+ *
+ * Unlike kv_get(), the value stays valid and unchanged outside any lock: a kv_put() or
+ * kv_del() of the key while the handle is held replaces or removes the entry in the table
+ * but leaves the pinned one alone, and the last release frees it. Unlike kv_get_copy(),
+ * nothing is allocated or copied.
+ *
+ * @param table Pointer to the KVTable.
+ * @param key Pointer to the key to look up.
+ * @param klen Length of the key in bytes.
+ * @param handle Caller-owned handle that receives the value.
+ *
+ * @return KV_SUCCESS (0) if the key was found; release the handle with kv_release_handle().
+ *         KV_ERROR_INVALID_TABLE if the table is NULL.
+ *         KV_ERROR_INVALID_KEY if the key is NULL or has invalid length.
+ *         KV_ERROR_INVALID_VALUE if handle is NULL.
+ *         KV_ERROR_PERSISTENT if the table was opened with open_kvtable().
+ *         KV_ERROR_SYSTEM if the entry already has too many handles.
+ *         KV_KEY_NOT_FOUND if the key does not exist in the map.
+ *
+ * @note Every handle must be released before the table is destroyed.
+ */
+extern int kv_get_handle(KVTable *table, void *key, int klen, KVHandle *handle);
+
+/**
+ * @brief Releases a handle obtained with kv_get_handle().
+ *
+ * @param handle Handle to release; cleared.
+ *
+ * @return KV_SUCCESS, or KV_ERROR_INVALID_VALUE if the handle holds no value.
+ */
+extern int kv_release_handle(KVHandle *handle);
+
 /**
  * @brief Deletes a key-value pair from the hash map.
  *
  * This function searches for a key in the hash map and removes the corresponding entry
- * if found. It safely unlinks the node from its bucket's linked list and releases the
- * memory associated with the key-value entry.
+ * if found, freeing its slot and releasing the memory associated with the key-value entry.
  *
  * Thread-safety is ensured by acquiring a write lock during the deletion process.
  *
@@ -287,4 +436,132 @@ extern int kv_dump(KVTable *table, const char *filename);
  * @note Returns NULL if the file doesn't exist, is corrupted, or incompatible.
  */
 extern KVTable *load_kvtable(const char *filename);
+
+/**
+ * @brief Keeps the entries of the table in key order.
+ *
+ * Builds an ordered index of the current keys and maintains it on every
+ * kv_put() and kv_del() from then on. Prefix and range scans of an ordered
+ * table cost O(log N + results), and kv_unsafe_prefix_scan() uses the index
+ * too. The index adds a node per entry. Each shard keeps the keys it
+ * holds in its own list under its own lock, so writers to different
+ * shards do not wait for each other; scans merge the shard lists.
+ *
+ * @param table Pointer to the KVTable.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE or KV_ERROR_SYSTEM.
+ */
+extern int kv_enable_ordered(KVTable *table);
+
+/**
+ * @brief Opens a cursor over the keys that start with `prefix`, in key order.
+ *
+ * The cursor holds no lock between calls: each kv_cursor_next() read-locks
+ * the shards only while it copies its batch, and resumes after the
+ * last key it visited. Writers proceed between batches, and the thread
+ * holding a cursor may write to the table. Keys inserted ahead of the
+ * cursor are returned, keys deleted before it reaches them are not.
+ *
+ * @param table Pointer to a table with kv_enable_ordered().
+ * @param prefix Pointer to the prefix.
+ * @param plen Length of the prefix in bytes; 0 scans every key.
+ * @param cursor Receives the cursor.
+ *
+ * @return KV_SUCCESS on success.
+ *         KV_ERROR_INVALID_TABLE if table is NULL.
+ *         KV_ERROR_INVALID_KEY if the prefix or cursor is invalid.
+ *         KV_ERROR_NOT_ORDERED if the table is not ordered.
+ *         KV_ERROR_SYSTEM if memory allocation fails.
+ */
+extern int kv_scan_prefix(KVTable *table, const void *prefix, int plen, KVCursor **cursor);
+
+/**
+ * @brief Opens a cursor over the keys in [from, to), in key order.
+ *
+ * Keys compare byte by byte, a key sorting before any longer key it is a
+ * prefix of. Locking is as for kv_scan_prefix().
+ *
+ * @param table Pointer to a table with kv_enable_ordered().
+ * @param from First key of the range; flen 0 starts at the first key.
+ * @param to End of the range (excluded); tlen 0 scans to the last key.
+ * @param cursor Receives the cursor.
+ *
+ * @return As for kv_scan_prefix().
+ */
+extern int kv_scan_range(KVTable *table, const void *from, int flen, const void *to, int tlen, KVCursor **cursor);
+
+/**
+ * @brief Returns up to `max` more entries of a scan.
+ *
+ * @param cursor Open cursor.
+ * @param results Array to fill; keys and values point to copies owned by
+ *        the cursor, valid until the next kv_cursor_next() or
+ *        kv_cursor_close() on it.
+ * @param max Size of `results`.
+ * @param found Receives the number of entries returned, 0 at the end.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_VALUE, or KV_ERROR_SYSTEM if the
+ *         copies could not be allocated (the cursor does not move).
+ */
+extern int kv_cursor_next(KVCursor *cursor, KVResult *results, int max, int *found);
+
+/**
+ * @brief Closes a cursor and releases its buffers.
+ *
+ * @param cursor Pointer to the cursor; set to NULL.
+ *
+ * @return KV_SUCCESS or KV_ERROR_INVALID_VALUE.
+ */
+extern int kv_cursor_close(KVCursor **cursor);
+/**
+ * @brief Opens a persistent table backed by an append-only data file.
+ *
+ * Every put and delete is appended to the file and the table only keeps the
+ * keys in memory, next to the location of their latest value; values are
+ * read from a shared mapping of the file. Reopening the file replays its
+ * records, so a restart does not need a dump, and a torn tail left by a
+ * crash is discarded.
+ *
+ * Records replaced or deleted by later writes are garbage. Once it exceeds
+ * `compact_ratio` of a file of at least `compact_min` bytes, a background
+ * compaction rewrites the live records into `<filename>.next` and renames it
+ * over the data file (see kv_compact()).
+ *
+ * Close the table with destroy_kvtable(), which syncs the file. kv_dump()
+ * and load_kvtable() still work and produce or load in-memory tables.
+ *
+ * @param filename Path of the data file.
+ * @param ctx Durability and compaction settings, or NULL for defaults.
+ *
+ * @return Pointer to the table, or NULL if the file cannot be opened or is not a data file.
+ *
+ * @note Not available on Windows (the data file is read through mmap): NULL is returned.
+ */
+extern KVTable *open_kvtable(const char *filename, KVLogContext *ctx);
+
+/**
+ * @brief Flushes the data file of a persistent table to stable storage.
+ *
+ * Without `sync` in the KVLogContext, writes survive a crash of the process
+ * but not of the system until this is called.
+ *
+ * @param table Pointer to a persistent table.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_NOT_PERSISTENT or KV_ERROR_FILEIO.
+ */
+extern int kv_sync(KVTable *table);
+
+/**
+ * @brief Compacts the data file of a persistent table now.
+ *
+ * Writes go on during the compaction; each shard is only locked while its
+ * live records are copied. A thread holding a cursor must not call it.
+ *
+ * @param table Pointer to a persistent table.
+ *
+ * @return KV_SUCCESS, KV_ERROR_INVALID_TABLE, KV_ERROR_NOT_PERSISTENT,
+ *         KV_ERROR_FILEIO or KV_ERROR_SYSTEM.
+ */
+extern int kv_compact(KVTable *table);
+
 #endif
@@ -0,0 +1,577 @@
+/*
+ * wal.c - Write-ahead log for index mutations
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Group commit write-ahead log. Appenders copy records into an in-memory
+ * buffer; a single flusher thread swaps it with a spare buffer, writes it
+ * with one write call and syncs the file, then advances the durable LSN.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+#include "wal.h"
+#include "file.h"
+#include "mem.h"
+
+#define WAL_BUFFER_INIT (64 * 1024)
+
+struct Wal {
+    IOFile *file;
+    char *filename;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  wakeup;     // Flusher: records pending or stop requested
+    pthread_cond_t  flushed;    // Waiters: durable LSN advanced
+    pthread_t flusher;
+
+    char  *buff;                // Records staged for the next group
+    size_t blen;
+    size_t bcap;
+    char  *spare;               // Buffer being written by the flusher
+    size_t scap;
+
+    uint64_t lsn;               // Last appended LSN
+    uint64_t durable;           // Last LSN known to be on stable storage
+    int pending;                // Records in buff
+    struct timespec first;      // Time the oldest pending record was staged
+
+    int group_ms;
+    int group_records;
+    int sync;
+
+    int flushing;
+    int users;                  // Appenders still to call wal_wait()
+    int stop;
+    int error;                  // Sticky flush error
+};
+
+/*-------------------------------------------------------------------------------------*
+ *                                PRIVATE FUNCTIONS                                    *
+ *-------------------------------------------------------------------------------------*/
+
+static int valid_record(const WalRecordHDR *hdr) {
+    switch (hdr->type) {
+    case WAL_INSERT:
+        return hdr->dims > 0 && hdr->length >= hdr->dims * sizeof(float32_t);
+    case WAL_SET_PAYLOAD:
+        return hdr->dims == 0;
+    case WAL_DELETE:
+    case WAL_SET_TAG:
+        return hdr->length == 0;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Reads records from `f` (positioned after the file header) until the end
+ * or the first invalid record. `end` receives the offset just past the
+ * last valid record and `last` its LSN.
+ */
+static int wal_scan(IOFile *f, WalApply apply, void *arg, uint64_t *count, uint64_t *last, off_t *end) {
+    WalRecordHDR hdr;
+    char *rec = NULL;
+    size_t cap = 0, sz;
+    uint64_t n = 0;
+    int ret = SUCCESS;
+
+    *end = sizeof(WalHDR);
+    for (;;) {
+        if (file_read(&hdr, 1, sizeof(hdr), f) != sizeof(hdr) || !valid_record(&hdr))
+            break;
+        sz = sizeof(hdr) + hdr.length;
+        if (sz > cap) {
+            char *tmp = realloc_mem(rec, sz);
+            if (!tmp) {
+                ret = SYSTEM_ERROR;
+                break;
+            }
+            rec = tmp;
+            cap = sz;
+        }
+        memcpy(rec, &hdr, sizeof(hdr));
+        if (hdr.length > 0 && file_read(rec + sizeof(hdr), 1, hdr.length, f) != hdr.length)
+            break;
+        if (XXH64(rec + sizeof(uint64_t), sz - sizeof(uint64_t), 0) != hdr.checksum)
+            break;
+
+        if (apply && (ret = apply(arg, &hdr, hdr.length ? (float32_t *) (rec + sizeof(hdr)) : NULL)) != SUCCESS)
+            break;
+        *end += sz;
+        *last = hdr.lsn;
+        n++;
+    }
+    if (rec)
+        free_mem(rec);
+    if (count)
+        *count = n;
+    return ret;
+}
+
+/*
+ * Reads and checks the file header. Returns SUCCESS, INVALID_FILE, or
+ * NOT_FOUND_ID when the file is empty.
+ */
+static int wal_read_header(IOFile *f) {
+    WalHDR hdr;
+    size_t n = file_read(&hdr, 1, sizeof(hdr), f);
+
+    if (n == 0)
+        return NOT_FOUND_ID;
+    if (n != sizeof(hdr) || hdr.magic != WAL_MAGIC || hdr.hsize != sizeof(WalHDR))
+        return INVALID_FILE;
+    return SUCCESS;
+}
+
+/*
+ * Writes the staged group and syncs it. Called with the lock held; the lock
+ * is released while the I/O is in progress so appenders are not blocked.
+ */
+static void wal_flush_locked(Wal *wal) {
+    char  *buff = wal->buff;
+    size_t bcap = wal->bcap;
+    size_t len  = wal->blen;
+    uint64_t target = wal->lsn;
+    int ok;
+
+    wal->buff = wal->spare;
+    wal->bcap = wal->scap;
+    wal->spare = buff;
+    wal->scap = bcap;
+    wal->blen = 0;
+    wal->pending = 0;
+    wal->flushing = 1;
+    pthread_mutex_unlock(&wal->lock);
+
+    ok = file_write(buff, 1, len, wal->file) == len && file_sync(wal->file) == 0;
+
+    pthread_mutex_lock(&wal->lock);
+    wal->flushing = 0;
+    if (ok)
+        wal->durable = target;
+    else
+        wal->error = FILEIO_ERROR;
+    pthread_cond_broadcast(&wal->flushed);
+}
+
+static void *wal_flusher(void *arg) {
+    Wal *wal = (Wal *) arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        while (!wal->stop && wal->pending < wal->group_records) {
+            if (wal->pending == 0) {
+                pthread_cond_wait(&wal->wakeup, &wal->lock);
+                continue;
+            }
+            deadline = wal->first;
+            deadline.tv_sec  += wal->group_ms / 1000;
+            deadline.tv_nsec += (long) (wal->group_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            if (pthread_cond_timedwait(&wal->wakeup, &wal->lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+        if (wal->pending > 0) {
+            if (wal->error) {
+                /* Appends already fail; drop what cannot be written */
+                wal->blen = 0;
+                wal->pending = 0;
+            } else {
+                wal_flush_locked(wal);
+            }
+        }
+        if (wal->stop && wal->pending == 0)
+            break;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+/*
+ * Removes staged records with LSN <= `upto`. Called with the lock held.
+ */
+static void wal_drop_staged(Wal *wal, uint64_t upto) {
+    WalRecordHDR hdr;
+    size_t off = 0;
+    int dropped = 0;
+
+    while (off < wal->blen) {
+        memcpy(&hdr, wal->buff + off, sizeof(hdr));
+        if (hdr.lsn > upto)
+            break;
+        off += sizeof(hdr) + hdr.length;
+        dropped++;
+    }
+    if (off == 0)
+        return;
+    memmove(wal->buff, wal->buff + off, wal->blen - off);
+    wal->blen -= off;
+    wal->pending -= dropped;
+}
+
+typedef struct {
+    IOFile *out;
+    uint64_t upto;
+} WalCopy;
+
+static int wal_copy_record(void *arg, const WalRecordHDR *rec, float32_t *vector) {
+    WalCopy *c = (WalCopy *) arg;
+
+    if (rec->lsn <= c->upto)
+        return SUCCESS;
+    if (file_write(rec, sizeof(*rec), 1, c->out) != 1)
+        return FILEIO_ERROR;
+    if (rec->length > 0 && file_write(vector, rec->length, 1, c->out) != 1)
+        return FILEIO_ERROR;
+    return SUCCESS;
+}
+
+/*
+ * Replaces the log with a copy holding only the records newer than `upto`.
+ * Called with the lock held and no flush in progress.
+ */
+static int wal_rewrite(Wal *wal, uint64_t upto) {
+    WalHDR hdr = { .magic = WAL_MAGIC, .major = 1, .minor = 0, .patch = 0, .hsize = sizeof(WalHDR) };
+    WalCopy copy = { .out = NULL, .upto = upto };
+    IOFile *in, *f;
+    uint64_t last;
+    off_t end;
+    char *tmp;
+    int ret;
+
+    if ((tmp = calloc_mem(1, strlen(wal->filename) + 6)) == NULL)
+        return SYSTEM_ERROR;
+    sprintf(tmp, "%s.ckpt", wal->filename);
+
+    if ((in = file_open(wal->filename, "rb")) == NULL) {
+        ret = FILEIO_ERROR;
+        goto end;
+    }
+    if ((copy.out = file_open(tmp, "wb")) == NULL) {
+        file_close(in);
+        ret = FILEIO_ERROR;
+        goto end;
+    }
+
+    ret = file_write(&hdr, sizeof(hdr), 1, copy.out) == 1 ? wal_read_header(in) : FILEIO_ERROR;
+    if (ret == SUCCESS)
+        ret = wal_scan(in, wal_copy_record, &copy, NULL, &last, &end);
+    if (ret == SUCCESS && file_sync(copy.out) != 0)
+        ret = FILEIO_ERROR;
+    file_close(copy.out);
+    file_close(in);
+
+    if (ret != SUCCESS) {
+        remove(tmp);
+        goto end;
+    }
+#ifdef _WIN32
+    remove(wal->filename);
+#endif
+    if (rename(tmp, wal->filename) != 0 || (f = file_open(wal->filename, "ab")) == NULL) {
+        ret = FILEIO_ERROR;
+        goto end;
+    }
+    file_close(wal->file);
+    wal->file = f;
+
+end:
+    free_mem(tmp);
+    return ret;
+}
+
+/*-------------------------------------------------------------------------------------*
+ *                                PUBLIC FUNCTIONS                                     *
+ *-------------------------------------------------------------------------------------*/
+
+int wal_open(Wal **wal, const char *filename, WALContext *ctx) {
+    WalHDR hdr = { .magic = WAL_MAGIC, .major = 1, .minor = 0, .patch = 0, .hsize = sizeof(WalHDR) };
+    IOFile *f;
+    Wal *w;
+    off_t end = 0, size;
+    uint64_t last = 0;
+    int ret;
+
+    if (!wal || !filename)
+        return INVALID_ARGUMENT;
+
+    /* Find the end of the valid prefix of an existing log */
+    if ((f = file_open(filename, "rb")) != NULL) {
+        ret = wal_read_header(f);
+        if (ret == SUCCESS)
+            ret = wal_scan(f, NULL, NULL, NULL, &last, &end);
+        file_close(f);
+        if (ret != SUCCESS && ret != NOT_FOUND_ID)
+            return ret;
+    }
+
+    if ((w = calloc_mem(1, sizeof(Wal))) == NULL)
+        return SYSTEM_ERROR;
+
+    w->group_ms      = ctx && ctx->group_ms > 0      ? ctx->group_ms      : WAL_DEFAULT_GROUP_MS;
+    w->group_records = ctx && ctx->group_records > 0 ? ctx->group_records : WAL_DEFAULT_GROUP_RECORDS;
+    w->sync          = ctx ? ctx->sync : 0;
+    w->lsn = w->durable = last;
+
+    w->buff  = calloc_mem(1, WAL_BUFFER_INIT);
+    w->spare = calloc_mem(1, WAL_BUFFER_INIT);
+    if (!w->buff || !w->spare) {
+        ret = SYSTEM_ERROR;
+        goto error_return;
+    }
+    w->bcap = w->scap = WAL_BUFFER_INIT;
+
+    if ((w->filename = calloc_mem(1, strlen(filename) + 1)) == NULL) {
+        ret = SYSTEM_ERROR;
+        goto error_return;
+    }
+    strcpy(w->filename, filename);
+
+    if ((w->file = file_open(filename, "ab")) == NULL) {
+        ret = FILEIO_ERROR;
+        goto error_return;
+    }
+
+    /* Cut a torn tail, or write the header on a new log */
+    file_seek(w->file, 0, SEEK_END);
+    size = file_tello(w->file);
+    if (end == 0) {
+        if (file_resize(w->file, 0) != 0 || file_write(&hdr, sizeof(hdr), 1, w->file) != 1) {
+            ret = FILEIO_ERROR;
+            goto error_return;
+        }
+    } else if (size != end && file_resize(w->file, end) != 0) {
+        ret = FILEIO_ERROR;
+        goto error_return;
+    }
+    if (file_sync(w->file) != 0) {
+        ret = FILEIO_ERROR;
+        goto error_return;
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wakeup, NULL);
+    pthread_cond_init(&w->flushed, NULL);
+    if (pthread_create(&w->flusher, NULL, wal_flusher, w) != 0) {
+        pthread_cond_destroy(&w->flushed);
+        pthread_cond_destroy(&w->wakeup);
+        pthread_mutex_destroy(&w->lock);
+        ret = THREAD_ERROR;
+        goto error_return;
+    }
+
+    *wal = w;
+    return SUCCESS;
+
+error_return:
+    if (w->file)  file_close(w->file);
+    if (w->buff)  free_mem(w->buff);
+    if (w->spare) free_mem(w->spare);
+    if (w->filename) free_mem(w->filename);
+    free_mem(w);
+    return ret;
+}
+
+int wal_append(Wal *wal, int type, uint64_t id, uint64_t tag, const float32_t *vector, uint16_t dims,
+               const void *payload, uint32_t plen, uint64_t *lsn) {
+    WalRecordHDR hdr = {0};
+    size_t vlen = type == WAL_INSERT ? dims * sizeof(float32_t) : 0;
+    size_t length = vlen + (payload ? plen : 0);
+    size_t need = sizeof(hdr) + length;
+    char *rec;
+    int ret = SUCCESS;
+
+    *lsn = 0;
+    pthread_mutex_lock(&wal->lock);
+    if (wal->error) {
+        ret = wal->error;
+        goto unlock;
+    }
+
+    if (wal->blen + need > wal->bcap) {
+        size_t cap = wal->bcap * 2;
+        while (cap < wal->blen + need)
+            cap *= 2;
+        if ((rec = realloc_mem(wal->buff, cap)) == NULL) {
+            ret = SYSTEM_ERROR;
+            goto unlock;
+        }
+        wal->buff = rec;
+        wal->bcap = cap;
+    }
+
+    hdr.length = (uint32_t) length;
+    hdr.type = (uint8_t) type;
+    hdr.dims = type == WAL_INSERT ? dims : 0;
+    hdr.lsn  = ++wal->lsn;
+    hdr.id   = id;
+    hdr.tag  = tag;
+
+    rec = wal->buff + wal->blen;
+    memcpy(rec, &hdr, sizeof(hdr));
+    if (vlen > 0)
+        memcpy(rec + sizeof(hdr), vector, vlen);
+    if (length > vlen)
+        memcpy(rec + sizeof(hdr) + vlen, payload, length - vlen);
+    hdr.checksum = XXH64(rec + sizeof(uint64_t), need - sizeof(uint64_t), 0);
+    memcpy(rec, &hdr.checksum, sizeof(uint64_t));
+    wal->blen += need;
+
+    if (wal->pending++ == 0) {
+        clock_gettime(CLOCK_REALTIME, &wal->first);
+        pthread_cond_signal(&wal->wakeup);
+    } else if (wal->pending >= wal->group_records) {
+        pthread_cond_signal(&wal->wakeup);
+    }
+
+    if (wal->sync) {
+        *lsn = hdr.lsn;
+        wal->users++;
+    }
+
+unlock:
+    pthread_mutex_unlock(&wal->lock);
+    return ret;
+}
+
+int wal_wait(Wal *wal, uint64_t lsn) {
+    int ret;
+
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable < lsn && !wal->error)
+        pthread_cond_wait(&wal->flushed, &wal->lock);
+    ret = wal->durable >= lsn ? SUCCESS : wal->error;
+    if (--wal->users == 0)
+        pthread_cond_broadcast(&wal->flushed);
+    pthread_mutex_unlock(&wal->lock);
+    return ret;
+}
+
+uint64_t wal_lsn(Wal *wal) {
+    uint64_t lsn;
+    pthread_mutex_lock(&wal->lock);
+    lsn = wal->lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+int wal_checkpoint(Wal *wal, const char *snapshot, uint64_t upto) {
+    IOFile *f;
+    int ret = SUCCESS;
+
+    if ((f = file_open(snapshot, "rb")) == NULL)
+        return FILEIO_ERROR;
+    ret = file_sync(f) == 0 ? SUCCESS : FILEIO_ERROR;
+    file_close(f);
+    if (ret != SUCCESS)
+        return ret;
+
+    pthread_mutex_lock(&wal->lock);
+    while (wal->flushing)
+        pthread_cond_wait(&wal->flushed, &wal->lock);
+
+    wal_drop_staged(wal, upto);
+    if (upto >= wal->durable) {
+        /* Every record on disk is covered by the snapshot */
+        if (file_resize(wal->file, sizeof(WalHDR)) != 0 || file_sync(wal->file) != 0)
+            ret = FILEIO_ERROR;
+        else
+            wal->durable = upto;
+    } else {
+        ret = wal_rewrite(wal, upto);
+    }
+
+    if (ret != SUCCESS)
+        wal->error = ret;
+    else if (upto >= wal->lsn)
+        wal->error = 0;
+    pthread_cond_broadcast(&wal->flushed);
+    pthread_mutex_unlock(&wal->lock);
+    return ret;
+}
+
+void wal_close(Wal **wal) {
+    Wal *w;
+
+    if (!wal || !*wal)
+        return;
+    w = *wal;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->wakeup);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->flusher, NULL);
+
+    /* Synchronous writers may still be reading the durable LSN */
+    pthread_mutex_lock(&w->lock);
+    if (w->durable < w->lsn && !w->error)
+        w->error = FILEIO_ERROR;
+    pthread_cond_broadcast(&w->flushed);
+    while (w->users > 0)
+        pthread_cond_wait(&w->flushed, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+
+    file_close(w->file);
+    pthread_cond_destroy(&w->flushed);
+    pthread_cond_destroy(&w->wakeup);
+    pthread_mutex_destroy(&w->lock);
+    free_mem(w->buff);
+    free_mem(w->spare);
+    free_mem(w->filename);
+    free_mem(w);
+    *wal = NULL;
+}
+
+int wal_replay(const char *filename, WalApply apply, void *arg, uint64_t *count) {
+    IOFile *f;
+    uint64_t last = 0;
+    off_t end;
+    int ret;
+
+    if (count)
+        *count = 0;
+    if (!filename || !apply)
+        return INVALID_ARGUMENT;
+    if ((f = file_open(filename, "rb")) == NULL)
+        return FILEIO_ERROR;
+
+    ret = wal_read_header(f);
+    if (ret == SUCCESS)
+        ret = wal_scan(f, apply, arg, count, &last, &end);
+    else if (ret == NOT_FOUND_ID)
+        ret = SUCCESS;
+    file_close(f);
+    return ret;
+}
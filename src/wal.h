@@ -0,0 +1,167 @@
+/*
+ * wal.h - Write-ahead log for index mutations
+ *
+ * Copyright (C) 2025 Emiliano A. Billi
+ *
+ * This file is part of libvictor.
+ *
+ * libvictor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * libvictor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libvictor. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Contact: emiliano.billi@gmail.com
+ *
+ * Purpose:
+ * Append-only log of insert/delete/set_tag/set_payload operations. Records are staged
+ * in memory and a background flusher writes and syncs them in groups
+ * (every `group_ms` milliseconds or `group_records` records), so the cost
+ * of durability is proportional to the changes, not to the index size.
+ *
+ * File layout: an 8-byte WalHDR followed by records. Each record is a
+ * WalRecordHDR plus `dims` floats for inserts, followed by the payload of
+ * the vector if it has one; set_payload records carry only the payload. The checksum covers the
+ * record from `length` to the end of its payload; replay stops at the first
+ * short or corrupt record (torn tail after a crash).
+ */
+
+#ifndef _WAL_H
+#define _WAL_H 1
+
+#include <stdint.h>
+#include "victor.h"
+
+#define WAL_MAGIC       0x57414C47  /**< 'WALG' */
+
+#define WAL_INSERT      0x01
+#define WAL_DELETE      0x02
+#define WAL_SET_TAG     0x03
+#define WAL_SET_PAYLOAD 0x04
+
+#define WAL_DEFAULT_GROUP_MS      10
+#define WAL_DEFAULT_GROUP_RECORDS 256
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;         /**< WAL_MAGIC. */
+    uint8_t  major;         /**< Major version. */
+    uint8_t  minor;         /**< Minor version. */
+    uint8_t  patch;         /**< Patch version. */
+    uint8_t  hsize;         /**< Size of this header in bytes. */
+} WalHDR;
+
+typedef struct {
+    uint64_t checksum;      /**< XXH64 of the record after this field. */
+    uint32_t length;        /**< Payload size in bytes. */
+    uint8_t  type;          /**< WAL_INSERT, WAL_DELETE, WAL_SET_TAG or WAL_SET_PAYLOAD. */
+    uint8_t  reserved;
+    uint16_t dims;          /**< Vector dimensions (inserts only). */
+    uint64_t lsn;           /**< Log sequence number. */
+    uint64_t id;            /**< Vector ID. */
+    uint64_t tag;           /**< Tag (insert and set_tag). */
+} WalRecordHDR;
+#pragma pack(pop)
+
+_Static_assert(sizeof(WalHDR) == 8, "WalHDR must be exactly 8 bytes");
+_Static_assert(sizeof(WalRecordHDR) == 40, "WalRecordHDR must be exactly 40 bytes");
+
+typedef struct Wal Wal;
+
+/**
+ * Called by wal_replay() for every valid record. `vector` points to the
+ * `length` bytes that follow the header: the vector and payload of a
+ * WAL_INSERT, or the payload of a WAL_SET_PAYLOAD (NULL when empty).
+ * A non-SUCCESS return aborts the replay.
+ */
+typedef int (*WalApply)(void *arg, const WalRecordHDR *rec, float32_t *vector);
+
+/**
+ * @brief Opens (or creates) a log for appending.
+ *
+ * An existing log is scanned and any torn tail is cut off, so new records
+ * follow the last valid one.
+ *
+ * @param wal      Output pointer to the new log.
+ * @param filename Path of the log file; `<filename>.ckpt` is used as a
+ *                 scratch file by wal_checkpoint().
+ * @param ctx      Group commit settings, or NULL for defaults.
+ * @return SUCCESS, INVALID_FILE, FILEIO_ERROR, SYSTEM_ERROR or THREAD_ERROR.
+ */
+extern int wal_open(Wal **wal, const char *filename, WALContext *ctx);
+
+/**
+ * @brief Stages a record for the next group commit.
+ *
+ * Must be called with the index write lock held so the log order matches
+ * the order in which the mutations were applied.
+ *
+ * @param vector  Vector of a WAL_INSERT, NULL otherwise.
+ * @param dims    Dimensions of `vector`.
+ * @param payload Payload of a WAL_INSERT or WAL_SET_PAYLOAD, or NULL.
+ * @param plen    Length of `payload` in bytes.
+ * @param lsn     Output: the record LSN if the caller must wait for it with
+ *                wal_wait() (synchronous mode), 0 otherwise.
+ * @return SUCCESS, SYSTEM_ERROR or FILEIO_ERROR (sticky flush failure).
+ */
+extern int wal_append(Wal *wal, int type, uint64_t id, uint64_t tag,
+                      const float32_t *vector, uint16_t dims,
+                      const void *payload, uint32_t plen, uint64_t *lsn);
+
+/**
+ * @brief Blocks until the record `lsn` is durable.
+ *
+ * Every non-zero LSN returned by wal_append() must be passed here exactly
+ * once, after the index lock has been released.
+ *
+ * @return SUCCESS or FILEIO_ERROR.
+ */
+extern int wal_wait(Wal *wal, uint64_t lsn);
+
+/**
+ * @brief Returns the LSN of the last appended record.
+ *
+ * Taken together with a snapshot (under the same index lock) it identifies
+ * the records the snapshot contains.
+ */
+extern uint64_t wal_lsn(Wal *wal);
+
+/**
+ * @brief Discards the records contained in a snapshot.
+ *
+ * The snapshot file is synced first. If every record written to the log
+ * is covered (`upto` >= durable LSN) the log is truncated; otherwise the
+ * records newer than `upto` are copied to a new log that atomically
+ * replaces the current one. Staged records up to `upto` are dropped.
+ *
+ * @param snapshot Path of the snapshot just written.
+ * @param upto     wal_lsn() at the time the snapshot was captured.
+ * @return SUCCESS, FILEIO_ERROR or SYSTEM_ERROR.
+ */
+extern int wal_checkpoint(Wal *wal, const char *snapshot, uint64_t upto);
+
+/**
+ * @brief Flushes pending records, stops the flusher and releases the log.
+ */
+extern void wal_close(Wal **wal);
+
+/**
+ * @brief Reads a log and calls `apply` for each valid record, in order.
+ *
+ * @param filename Path of the log file.
+ * @param apply    Callback applying one record.
+ * @param arg      Opaque pointer for the callback.
+ * @param count    Optional output: number of records applied.
+ * @return SUCCESS (a torn tail is not an error), INVALID_FILE,
+ *         FILEIO_ERROR, SYSTEM_ERROR or the first error from `apply`.
+ */
+extern int wal_replay(const char *filename, WalApply apply, void *arg, uint64_t *count);
+
+#endif